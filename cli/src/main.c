@@ -47,90 +47,503 @@
  *
  */
 
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <vibrant/vibrant.h>
 
+#include "watch.c"
+
 /**
- * Find the output on the RandR screen resource by name.
+ * Create a vibrant instance on the default X server, printing why if that
+ * fails.
  *
- * @param dpy The X Display
- * @param res The RandR screen resource
- * @param name The output name to search for
- * @return The RandR-Output X-ID if found, 0 (None) otherwise
+ * @return The instance or NULL on failure
  */
-static vibrant_controller *find_output_by_name(vibrant_controller *controllers,
-                                               size_t controllers_size,
-                                               const char *name) {
-  for (size_t i = 0; i < controllers_size; i++) {
-    if (strcmp(name, controllers[i].info->name) == 0) {
-      return controllers + i;
+static vibrant_instance *open_instance(void) {
+  vibrant_instance *instance;
+  vibrant_errors err;
+  if ((err = vibrant_instance_new(&instance, NULL)) != vibrant_NoError) {
+    switch (err) {
+    case vibrant_ConnectToX:
+      puts("Failed to connect to default x server.");
+      break;
+    case vibrant_NoMem:
+      puts("Failed to allocate memory for vibrant controller.");
+      break;
+    default: // satisfy Clang-tidy
+      break;
     }
+
+    return NULL;
+  }
+
+  return instance;
+}
+
+/**
+ * Save or restore the color state of all outputs.
+ *
+ * @param restore 0 to save the snapshot, 1 to restore it
+ * @param path Path of the snapshot file
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int run_snapshot(int restore, const char *path) {
+  vibrant_instance *instance = open_instance();
+  if (instance == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  vibrant_transaction_result result;
+  vibrant_errors err =
+      restore ? vibrant_instance_restore_snapshot(instance, path, &result)
+              : vibrant_instance_save_snapshot(instance, path);
+  vibrant_instance_free(&instance);
+
+  switch (err) {
+  case vibrant_NoError:
+    if (restore) {
+      printf("Restored snapshot %s in %.3f ms, %zu outputs already matched\n",
+             path, result.apply_time_ns / 1e6, result.unchanged);
+    } else {
+      printf("Saved snapshot %s\n", path);
+    }
+    return EXIT_SUCCESS;
+  case vibrant_IOError:
+    printf("Failed to access snapshot %s\n", path);
+    break;
+  case vibrant_BadFile:
+    printf("%s is not a valid snapshot\n", path);
+    break;
+  case vibrant_NoMem:
+    puts("Failed to allocate memory for snapshot.");
+    break;
+  case vibrant_BackendError:
+    if (restore) {
+      printf("%zu outputs failed, the previous state was restored\n",
+             result.failed);
+    } else {
+      puts("Failed to read the state of an output.");
+    }
+    break;
+  default: // satisfy Clang-tidy
+    break;
+  }
+
+  return EXIT_FAILURE;
+}
+
+/**
+ * Bake the color transform of an output into a 3D LUT file, .cube or, for
+ * any other extension, raw floats.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int run_lut(const char *output_name, const char *path,
+                   const char *size_text) {
+  char *end;
+  unsigned long size = size_text != NULL ? strtoul(size_text, &end, 10) : 33;
+  if (size_text != NULL && (end == size_text || *end != '\0')) {
+    size = 0;
+  }
+
+  vibrant_instance *instance = open_instance();
+  if (instance == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  vibrant_controller *output =
+      vibrant_instance_find_controller(instance, output_name);
+  if (output == NULL) {
+    printf("Cannot find output %s in the list of supported outputs, "
+           "it either does not exist or is not supported\n",
+           output_name);
+    vibrant_instance_free(&instance);
+    return EXIT_FAILURE;
+  }
+
+  double matrix[9];
+  vibrant_errors err = vibrant_controller_get_matrix(output, matrix);
+  vibrant_instance_free(&instance);
+  if (err != vibrant_NoError) {
+    puts("Failed to read the state of the output.");
+    return EXIT_FAILURE;
+  }
+
+  const char *extension = strrchr(path, '.');
+  vibrant_lut_format format = extension != NULL &&
+                                      strcmp(extension, ".cube") == 0
+                                  ? vibrant_LutCube
+                                  : vibrant_LutFloat32;
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  switch (vibrant_lut_export(matrix, 1.0, size, format, path,
+                             threads > 0 ? threads : 1)) {
+  case vibrant_NoError:
+    printf("Wrote %lu^3 LUT of %s to %s\n", size, output_name, path);
+    return EXIT_SUCCESS;
+  case vibrant_InvalidArgument:
+    printf("SIZE must be between %d and %d.\n", VIBRANT_LUT_SIZE_MIN,
+           VIBRANT_LUT_SIZE_MAX);
+    break;
+  case vibrant_NoMem:
+    puts("Failed to allocate memory for LUT.");
+    break;
+  default:
+    printf("Failed to write %s\n", path);
+    break;
+  }
+
+  return EXIT_FAILURE;
+}
+
+/**
+ * Parse a saturation value, printing an error if it is invalid.
+ *
+ * @param text Text to parse
+ * @param saturation Parsed saturation will be placed here
+ * @return 1 on success, 0 otherwise
+ */
+static int parse_saturation(const char *text, double *saturation) {
+  char *saturation_text;
+  *saturation = strtod(text, &saturation_text);
+
+  // text will be set to saturation_text if strtod fails to convert
+  if (saturation_text == text || *saturation_text != '\0' ||
+      *saturation < 0.0 || *saturation > 4.0) {
+    puts("SATURATION value must be between 0.0 and 4.0.");
+
+    return 0;
   }
 
-  return NULL;
+  return 1;
+}
+
+/**
+ * Queue a single OUTPUT=SATURATION or "OUTPUT SATURATION" command.
+ *
+ * @param instance The vibrant instance
+ * @param transaction Transaction collecting the batch
+ * @param command The command, modified in place
+ * @return 1 on success, 0 otherwise
+ */
+static int queue_command(vibrant_instance *instance,
+                         vibrant_transaction *transaction, char *command) {
+  char *separator = strpbrk(command, "= \t");
+  if (separator == NULL) {
+    printf("Expected OUTPUT=SATURATION, got %s\n", command);
+
+    return 0;
+  }
+  *separator = '\0';
+
+  char *saturation_opt = separator + 1;
+  saturation_opt += strspn(saturation_opt, "= \t");
+
+  double saturation;
+  if (!parse_saturation(saturation_opt, &saturation)) {
+    return 0;
+  }
+
+  vibrant_controller *output = vibrant_instance_find_controller(instance,
+                                                                command);
+  if (output == NULL) {
+    printf("Cannot find output %s in the list of supported outputs, "
+           "it either does not exist or is not supported\n",
+           command);
+
+    return 0;
+  }
+
+  if (vibrant_transaction_set_saturation(transaction, output, saturation) !=
+      vibrant_NoError) {
+    puts("Failed to allocate memory for batch.");
+
+    return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Apply all commands queued in transaction in one go.
+ *
+ * @return 1 on success, 0 otherwise
+ */
+static int commit_batch(vibrant_transaction *transaction) {
+  vibrant_transaction_result result;
+
+  if (vibrant_transaction_commit(transaction, &result) != vibrant_NoError) {
+    printf("%zu outputs failed, the previous state was restored\n",
+           result.failed);
+
+    return 0;
+  }
+
+  printf("Applied batch in %.3f ms, %zu outputs already matched\n",
+         result.apply_time_ns / 1e6, result.unchanged);
+
+  return 1;
+}
+
+/**
+ * Set several outputs at once, either from OUTPUT=SATURATION arguments or,
+ * if commands is NULL, from lines read from stdin. On stdin a line reading
+ * "commit" applies everything queued so far, the rest is applied at the end
+ * of input.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int run_batch(int commands_size, char *const *commands) {
+  vibrant_instance *instance = open_instance();
+  if (instance == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  vibrant_transaction *transaction;
+  if (vibrant_transaction_new(instance, &transaction) != vibrant_NoError) {
+    puts("Failed to allocate memory for batch.");
+    vibrant_instance_free(&instance);
+
+    return EXIT_FAILURE;
+  }
+
+  int ok = 1;
+  if (commands != NULL) {
+    for (int i = 0; i < commands_size && ok; i++) {
+      char *command = strdup(commands[i]);
+      ok = command != NULL && queue_command(instance, transaction, command);
+      free(command);
+    }
+  } else {
+    char *line = NULL;
+    size_t line_size = 0;
+    while (ok && getline(&line, &line_size, stdin) != -1) {
+      line[strcspn(line, "\r\n")] = '\0';
+
+      char *command = line + strspn(line, " \t");
+      if (*command == '\0' || *command == '#') {
+        continue;
+      }
+
+      if (strcmp(command, "commit") == 0) {
+        ok = commit_batch(transaction);
+      } else {
+        ok = queue_command(instance, transaction, command);
+      }
+    }
+    free(line);
+  }
+
+  if (ok) {
+    ok = commit_batch(transaction);
+  }
+
+  vibrant_transaction_free(&transaction);
+  vibrant_instance_free(&instance);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * List all supported outputs as JSON array.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int run_json(void) {
+  vibrant_instance *instance = open_instance();
+  if (instance == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  vibrant_controller *controllers;
+  size_t controllers_size;
+  vibrant_instance_get_controllers(instance, &controllers, &controllers_size);
+
+  putchar('[');
+  for (size_t i = 0; i < controllers_size; i++) {
+    vibrant_controller *controller = controllers + i;
+
+    printf(i == 0 ? "\n  {\"name\": " : ",\n  {\"name\": ");
+    print_json_string(stdout, controller->info->name);
+    printf(", \"id\": \"%016llx\", \"backend\": ",
+           vibrant_controller_get_id(controller));
+    print_json_string(stdout,
+                      vibrant_controller_get_backend_name(controller));
+    printf(", \"saturation\": %f}",
+           vibrant_controller_get_saturation(controller));
+  }
+  puts(controllers_size > 0 ? "\n]" : "]");
+
+  vibrant_instance_free(&instance);
+
+  return EXIT_SUCCESS;
+}
+
+typedef struct watch_state {
+  int json;
+  // set once outputs were connected or disconnected
+  int outputs_changed;
+} watch_state;
+
+/**
+ * Print a change reported by the instance as a single line and flush it, so
+ * readers of a pipe see it right away.
+ */
+static void print_change(const vibrant_change *change, void *user_data) {
+  watch_state *state = user_data;
+  vibrant_controller *controller = change->controller;
+
+  if (controller == NULL) {
+    state->outputs_changed = 1;
+    puts(state->json ? "{\"event\": \"outputs\"}" : "outputs changed");
+  } else {
+    print_watch_line(stdout, state->json, controller->info->name,
+                     vibrant_controller_get_id(controller), change->saturation);
+  }
+
+  fflush(stdout);
+}
+
+/**
+ * Print the saturation of every output, then a line for every change until
+ * killed. The process sleeps in poll between changes. When outputs are
+ * connected or disconnected, the instance is opened again and every output
+ * is printed anew.
+ *
+ * @return EXIT_FAILURE, on success this never returns
+ */
+static int run_watch(int json) {
+  watch_state state = {json, 0};
+
+  for (;;) {
+    vibrant_instance *instance = open_instance();
+    if (instance == NULL) {
+      return EXIT_FAILURE;
+    }
+
+    vibrant_controller *controllers;
+    size_t controllers_size;
+    vibrant_instance_get_controllers(instance, &controllers, &controllers_size);
+
+    for (size_t i = 0; i < controllers_size; i++) {
+      vibrant_change change = {
+          controllers + i, vibrant_controller_get_saturation(controllers + i)};
+      print_change(&change, &state);
+    }
+
+    state.outputs_changed = 0;
+    if (vibrant_instance_set_change_listener(instance, print_change, &state) !=
+        vibrant_NoError) {
+      puts("Failed to listen for changes of the outputs.");
+      vibrant_instance_free(&instance);
+      return EXIT_FAILURE;
+    }
+
+    struct pollfd pfd = {vibrant_instance_get_fd(instance), POLLIN, 0};
+    while (!state.outputs_changed) {
+      if (vibrant_instance_dispatch(instance, NULL) != vibrant_NoError) {
+        puts("Failed to handle events of the X server.");
+        vibrant_instance_free(&instance);
+        return EXIT_FAILURE;
+      }
+
+      if (!state.outputs_changed && poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+        vibrant_instance_free(&instance);
+        return EXIT_FAILURE;
+      }
+    }
+
+    vibrant_instance_free(&instance);
+  }
 }
 
 int main(int argc, char *const argv[]) {
-  // The following values will hold the parsed double from saturation_opt
+  // machine readable output must not be preceded by anything
+  if (argc == 2 && strcmp(argv[1], "--json") == 0) {
+    return run_json();
+  }
+  int watch_json;
+  int watch = parse_watch_arguments(argc, argv, &watch_json);
+  if (watch && watch_json) {
+    return run_watch(1);
+  }
 
   printf("libvibrant version %s\n", VIBRANT_VERSION);
 
   // Parse arguments
   if (argc < 2) {
-    printf("Usage: %s OUTPUT [SATURATION]\n", argv[0]);
+    printf("Usage: %s OUTPUT|ID [SATURATION]\n"
+           "       %s OUTPUT=SATURATION [OUTPUT=SATURATION...]\n"
+           "       %s -\n"
+           "       %s --json\n"
+           "       %s --watch [--json]\n"
+           "       %s --save FILE\n"
+           "       %s --restore FILE\n"
+           "       %s --lut OUTPUT|ID FILE [SIZE]\n",
+           argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+           argv[0]);
 
     return EXIT_FAILURE;
   }
 
-  char *saturation_text;
-  double saturation = -1.0;
+  if (strcmp(argv[1], "--save") == 0 || strcmp(argv[1], "--restore") == 0) {
+    if (argc != 3) {
+      printf("%s requires exactly one FILE argument\n", argv[1]);
 
-  char *output_name = argv[1];
+      return EXIT_FAILURE;
+    }
+
+    return run_snapshot(strcmp(argv[1], "--restore") == 0, argv[2]);
+  }
 
-  if (argc > 2) {
-    char *saturation_opt = argv[2];
-    saturation = strtod(saturation_opt, &saturation_text);
+  if (watch) {
+    return run_watch(0);
+  }
 
-    // text will be set to saturation_opt if strtod fails to convert
-    if (saturation_text == saturation_opt || saturation < 0.0 ||
-        saturation > 4.0) {
-      puts("SATURATION value must be between 0.0 and 4.0.");
+  if (strcmp(argv[1], "--lut") == 0) {
+    if (argc != 4 && argc != 5) {
+      puts("--lut requires OUTPUT, FILE and optionally SIZE");
 
       return EXIT_FAILURE;
     }
+
+    return run_lut(argv[2], argv[3], argc == 5 ? argv[4] : NULL);
   }
 
-  vibrant_instance *instance;
-  vibrant_errors err;
-  if ((err = vibrant_instance_new(&instance, NULL)) != vibrant_NoError) {
-    switch (err) {
-    case vibrant_ConnectToX:
-      puts("Failed to connect to default x server.");
-      break;
-    case vibrant_NoMem:
-      puts("Failed to allocate memory for vibrant controller.");
-      break;
-    default: // satisfy Clang-tidy
-      break;
-    }
+  if (argc == 2 && strcmp(argv[1], "-") == 0) {
+    return run_batch(0, NULL);
+  }
+
+  // output names never contain '=', so this can't be the single output form
+  if (strchr(argv[1], '=') != NULL) {
+    return run_batch(argc - 1, argv + 1);
+  }
+
+  double saturation = -1.0;
+
+  char *output_name = argv[1];
 
+  if (argc > 2 && !parse_saturation(argv[2], &saturation)) {
     return EXIT_FAILURE;
   }
 
-  vibrant_controller *controllers;
-  size_t controllers_size;
-  vibrant_instance_get_controllers(instance, &controllers, &controllers_size);
+  vibrant_instance *instance = open_instance();
+  if (instance == NULL) {
+    return EXIT_FAILURE;
+  }
 
   /**
    * We need to know which output we're setting the property on.
-   * Since we only have a name to work with, find the vibrant_controller
-   * using the name.
+   * We only have a name or the stable id of the output to work with, find
+   * the vibrant_controller using that.
    */
   vibrant_controller *output =
-      find_output_by_name(controllers, controllers_size, output_name);
+      vibrant_instance_find_controller(instance, output_name);
   if (output == NULL) {
     printf("Cannot find output %s in the list of supported outputs, "
            "it either does not exist or is not supported\n",
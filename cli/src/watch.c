@@ -0,0 +1,86 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// output of --json and --watch, included by main.c and the tests
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Print a string as JSON string literal to file.
+ */
+static void print_json_string(FILE *file, const char *text) {
+  fputc('"', file);
+  for (; *text != '\0'; text++) {
+    unsigned char c = (unsigned char)*text;
+
+    if (c == '"' || c == '\\') {
+      fprintf(file, "\\%c", c);
+    } else if (c == '\n') {
+      fputs("\\n", file);
+    } else if (c == '\r') {
+      fputs("\\r", file);
+    } else if (c == '\t') {
+      fputs("\\t", file);
+    } else if (c < 0x20) {
+      fprintf(file, "\\u%04x", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+/**
+ * Print the saturation of an output as a single line of --watch.
+ */
+static void print_watch_line(FILE *file, int json, const char *name,
+                             unsigned long long id, double saturation) {
+  if (json) {
+    fputs("{\"event\": \"saturation\", \"name\": ", file);
+    print_json_string(file, name);
+    fprintf(file, ", \"id\": \"%016llx\", \"saturation\": %f}\n", id,
+            saturation);
+  } else {
+    fprintf(file, "%s %f\n", name, saturation);
+  }
+}
+
+/**
+ * Check whether the arguments ask for --watch, which may be combined with
+ * --json in any order.
+ *
+ * @return 1 and json set if they do, 0 otherwise
+ */
+static int parse_watch_arguments(int argc, char *const argv[], int *json) {
+  int watch = 0;
+  *json = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--watch") == 0 && !watch) {
+      watch = 1;
+    } else if (strcmp(argv[i], "--json") == 0 && !*json) {
+      *json = 1;
+    } else {
+      return 0;
+    }
+  }
+
+  return watch;
+}
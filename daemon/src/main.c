@@ -0,0 +1,513 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * vibrantd owns one vibrant instance and exposes its outputs on the session
+ * bus, so desktop components share one X connection and learn about changes
+ * through signals instead of polling.
+ *
+ *   /io/github/libvibrant/Vibrant1               io.github.libvibrant.Vibrant1
+ *     SetMany(a{sd} saturations) -> (u failed, u unchanged)
+ *   /io/github/libvibrant/Vibrant1/outputs/NAME  ...Vibrant1.Output
+ *     Name s, Id t, Backend s, Saturation d (writable, emits change)
+ *
+ * Outputs are listed through org.freedesktop.DBus.ObjectManager on the root
+ * path. When outputs are connected or disconnected, the instance is opened
+ * again and the output objects are replaced.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+
+#include <systemd/sd-bus.h>
+#include <systemd/sd-event.h>
+
+#include <vibrant/vibrant.h>
+
+#define DAEMON_BUS_NAME "io.github.libvibrant.Vibrant1"
+#define DAEMON_PATH "/io/github/libvibrant/Vibrant1"
+#define DAEMON_OUTPUTS_PATH DAEMON_PATH "/outputs"
+#define DAEMON_INTERFACE DAEMON_BUS_NAME
+#define DAEMON_OUTPUT_INTERFACE DAEMON_BUS_NAME ".Output"
+#define DAEMON_ERROR_BACKEND DAEMON_BUS_NAME ".Error.Backend"
+
+struct daemon_state;
+
+typedef struct daemon_output {
+  struct daemon_state *daemon;
+  vibrant_controller *controller;
+  char *path;
+  sd_bus_slot *slot;
+  // value of the Saturation property, announced on every change
+  double saturation;
+} daemon_output;
+
+typedef struct daemon_state {
+  sd_bus *bus;
+  sd_event *event;
+  // watches the X connection, NULL for backends without one
+  sd_event_source *io;
+
+  const char *display_name;
+  // NULL for the X backend
+  const vibrant_instance_options *options;
+  vibrant_instance *instance;
+
+  // one per controller of instance, in the same order
+  daemon_output *outputs;
+  size_t outputs_size;
+  // set by the change listener once outputs were connected or disconnected
+  int outputs_changed;
+} daemon_state;
+
+/**
+ * Update the Saturation property of output, emitting PropertiesChanged only
+ * if the value actually changed.
+ */
+static void daemon_announce(daemon_output *output, double saturation) {
+  if (saturation == output->saturation) {
+    return;
+  }
+  output->saturation = saturation;
+
+  sd_bus_emit_properties_changed(output->daemon->bus, output->path,
+                                 DAEMON_OUTPUT_INTERFACE, "Saturation", NULL);
+}
+
+static void daemon_change(const vibrant_change *change, void *user_data) {
+  daemon_state *daemon = user_data;
+
+  if (change->controller == NULL) {
+    daemon->outputs_changed = 1;
+    return;
+  }
+
+  for (size_t i = 0; i < daemon->outputs_size; i++) {
+    if (daemon->outputs[i].controller == change->controller) {
+      daemon_announce(daemon->outputs + i, change->saturation);
+      return;
+    }
+  }
+}
+
+/**
+ * Apply all saturations in one transaction and announce the outputs that
+ * changed. The change listener would notice them too, but only for
+ * backends whose changes raise events, and only once the next event
+ * arrives.
+ *
+ * @return 0 or a negative errno, with error set
+ */
+static int daemon_apply(daemon_state *daemon, daemon_output *const *outputs,
+                        const double *saturations, size_t n,
+                        vibrant_transaction_result *result,
+                        sd_bus_error *error) {
+  vibrant_transaction *transaction;
+  if (vibrant_transaction_new(daemon->instance, &transaction) !=
+      vibrant_NoError) {
+    return -ENOMEM;
+  }
+
+  vibrant_errors err = vibrant_NoError;
+  for (size_t i = 0; i < n && err == vibrant_NoError; i++) {
+    err = vibrant_transaction_set_saturation(
+        transaction, outputs[i]->controller, saturations[i]);
+  }
+  if (err == vibrant_NoError) {
+    err = vibrant_transaction_commit(transaction, result);
+  }
+  vibrant_transaction_free(&transaction);
+
+  for (size_t i = 0; i < n; i++) {
+    daemon_announce(outputs[i],
+                    vibrant_controller_get_saturation(outputs[i]->controller));
+  }
+
+  if (err == vibrant_NoMem) {
+    return -ENOMEM;
+  }
+  if (err != vibrant_NoError && result->rolled_back) {
+    return sd_bus_error_setf(error, DAEMON_ERROR_BACKEND,
+                             "%zu outputs failed, changes were rolled back",
+                             result->failed);
+  }
+  if (err != vibrant_NoError && result->failed > 0) {
+    // the snapshot taken before writing was incomplete
+    return sd_bus_error_setf(error, DAEMON_ERROR_BACKEND,
+                             "%zu outputs could not be read, nothing was "
+                             "changed",
+                             result->failed);
+  }
+  if (err != vibrant_NoError) {
+    return sd_bus_error_set(error, DAEMON_ERROR_BACKEND,
+                            "the outputs could not be changed");
+  }
+
+  return 0;
+}
+
+static daemon_output *daemon_find_output(daemon_state *daemon,
+                                         const char *name) {
+  vibrant_controller *controller =
+      vibrant_instance_find_controller(daemon->instance, name);
+
+  for (size_t i = 0; controller != NULL && i < daemon->outputs_size; i++) {
+    if (daemon->outputs[i].controller == controller) {
+      return daemon->outputs + i;
+    }
+  }
+
+  return NULL;
+}
+
+static int daemon_set_many(sd_bus_message *message, void *user_data,
+                           sd_bus_error *error) {
+  daemon_state *daemon = user_data;
+  daemon_output **outputs = NULL;
+  double *saturations = NULL;
+  size_t n = 0;
+
+  int r = sd_bus_message_enter_container(message, 'a', "{sd}");
+  while (r >= 0 &&
+         (r = sd_bus_message_enter_container(message, 'e', "sd")) > 0) {
+    const char *name;
+    double saturation;
+    if ((r = sd_bus_message_read(message, "sd", &name, &saturation)) < 0 ||
+        (r = sd_bus_message_exit_container(message)) < 0) {
+      break;
+    }
+
+    daemon_output *output = daemon_find_output(daemon, name);
+    if (output == NULL) {
+      r = sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS,
+                            "No output called %s", name);
+      break;
+    }
+
+    daemon_output **new_outputs = realloc(outputs, (n + 1) * sizeof(*outputs));
+    double *new_saturations =
+        realloc(saturations, (n + 1) * sizeof(*saturations));
+    if (new_outputs != NULL) {
+      outputs = new_outputs;
+    }
+    if (new_saturations != NULL) {
+      saturations = new_saturations;
+    }
+    if (new_outputs == NULL || new_saturations == NULL) {
+      r = -ENOMEM;
+      break;
+    }
+
+    outputs[n] = output;
+    saturations[n] = saturation;
+    n++;
+  }
+  if (r >= 0) {
+    r = sd_bus_message_exit_container(message);
+  }
+
+  vibrant_transaction_result result = {0};
+  if (r >= 0) {
+    r = daemon_apply(daemon, outputs, saturations, n, &result, error);
+  }
+
+  free(outputs);
+  free(saturations);
+
+  if (r < 0) {
+    return r;
+  }
+
+  return sd_bus_reply_method_return(message, "uu", (uint32_t)result.failed,
+                                    (uint32_t)result.unchanged);
+}
+
+static int daemon_get_name(sd_bus *bus, const char *path,
+                           const char *interface, const char *property,
+                           sd_bus_message *reply, void *user_data,
+                           sd_bus_error *error) {
+  daemon_output *output = user_data;
+  return sd_bus_message_append(reply, "s", output->controller->info->name);
+}
+
+static int daemon_get_id(sd_bus *bus, const char *path, const char *interface,
+                         const char *property, sd_bus_message *reply,
+                         void *user_data, sd_bus_error *error) {
+  daemon_output *output = user_data;
+  return sd_bus_message_append(
+      reply, "t", (uint64_t)vibrant_controller_get_id(output->controller));
+}
+
+static int daemon_get_backend(sd_bus *bus, const char *path,
+                              const char *interface, const char *property,
+                              sd_bus_message *reply, void *user_data,
+                              sd_bus_error *error) {
+  daemon_output *output = user_data;
+  return sd_bus_message_append(
+      reply, "s", vibrant_controller_get_backend_name(output->controller));
+}
+
+static int daemon_get_saturation(sd_bus *bus, const char *path,
+                                 const char *interface, const char *property,
+                                 sd_bus_message *reply, void *user_data,
+                                 sd_bus_error *error) {
+  daemon_output *output = user_data;
+  return sd_bus_message_append(reply, "d", output->saturation);
+}
+
+static int daemon_set_saturation(sd_bus *bus, const char *path,
+                                 const char *interface, const char *property,
+                                 sd_bus_message *value, void *user_data,
+                                 sd_bus_error *error) {
+  daemon_output *output = user_data;
+
+  double saturation;
+  int r = sd_bus_message_read(value, "d", &saturation);
+  if (r < 0) {
+    return r;
+  }
+
+  vibrant_transaction_result result = {0};
+  return daemon_apply(output->daemon, &output, &saturation, 1, &result,
+                      error);
+}
+
+static const sd_bus_vtable daemon_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD_WITH_NAMES("SetMany", "a{sd}", SD_BUS_PARAM(saturations),
+                             "uu", SD_BUS_PARAM(failed) SD_BUS_PARAM(unchanged),
+                             daemon_set_many, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_VTABLE_END};
+
+static const sd_bus_vtable daemon_output_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_PROPERTY("Name", "s", daemon_get_name, 0,
+                    SD_BUS_VTABLE_PROPERTY_CONST),
+    SD_BUS_PROPERTY("Id", "t", daemon_get_id, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+    SD_BUS_PROPERTY("Backend", "s", daemon_get_backend, 0,
+                    SD_BUS_VTABLE_PROPERTY_CONST),
+    SD_BUS_WRITABLE_PROPERTY("Saturation", "d", daemon_get_saturation,
+                             daemon_set_saturation, 0,
+                             SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE |
+                                 SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_VTABLE_END};
+
+static int daemon_io(sd_event_source *source, int fd, uint32_t revents,
+                     void *user_data) {
+  // waking the loop is enough, daemon_post() handles the events
+  return 0;
+}
+
+static void daemon_close(daemon_state *daemon) {
+  for (size_t i = 0; i < daemon->outputs_size; i++) {
+    daemon_output *output = daemon->outputs + i;
+
+    sd_bus_emit_object_removed(daemon->bus, output->path);
+    sd_bus_slot_unref(output->slot);
+    free(output->path);
+  }
+  free(daemon->outputs);
+  daemon->outputs = NULL;
+  daemon->outputs_size = 0;
+
+  daemon->io = sd_event_source_disable_unref(daemon->io);
+
+  if (daemon->instance != NULL) {
+    vibrant_instance_free(&daemon->instance);
+    daemon->instance = NULL;
+  }
+}
+
+/**
+ * Open the instance and publish an object for each of its outputs.
+ *
+ * @return 0 or a negative errno
+ */
+static int daemon_open(daemon_state *daemon) {
+  vibrant_errors err = vibrant_instance_new_with_options(
+      &daemon->instance, daemon->display_name, daemon->options);
+  if (err != vibrant_NoError) {
+    daemon->instance = NULL;
+    fprintf(stderr, "Failed to open the display: error %d\n", err);
+    return err == vibrant_NoMem ? -ENOMEM : -EIO;
+  }
+
+  daemon->outputs_changed = 0;
+  if (vibrant_instance_set_change_listener(daemon->instance, daemon_change,
+                                           daemon) != vibrant_NoError) {
+    fputs("Failed to listen for changes of the outputs.\n", stderr);
+    return -EIO;
+  }
+
+  int fd = vibrant_instance_get_fd(daemon->instance);
+  if (fd >= 0) {
+    int r = sd_event_add_io(daemon->event, &daemon->io, fd, EPOLLIN,
+                            daemon_io, daemon);
+    if (r < 0) {
+      return r;
+    }
+  }
+
+  vibrant_controller *controllers;
+  size_t controllers_size;
+  vibrant_instance_get_controllers(daemon->instance, &controllers,
+                                   &controllers_size);
+
+  daemon->outputs = calloc(controllers_size + 1, sizeof(daemon_output));
+  if (daemon->outputs == NULL) {
+    return -ENOMEM;
+  }
+
+  for (size_t i = 0; i < controllers_size; i++) {
+    daemon_output *output = daemon->outputs + i;
+    output->daemon = daemon;
+    output->controller = controllers + i;
+    output->saturation = vibrant_controller_get_saturation(controllers + i);
+
+    // output names may contain anything, the path escapes them
+    int r = sd_bus_path_encode(DAEMON_OUTPUTS_PATH, controllers[i].info->name,
+                               &output->path);
+    if (r >= 0) {
+      r = sd_bus_add_object_vtable(daemon->bus, &output->slot, output->path,
+                                   DAEMON_OUTPUT_INTERFACE,
+                                   daemon_output_vtable, output);
+    }
+    if (r < 0) {
+      free(output->path);
+      return r;
+    }
+
+    daemon->outputs_size++;
+    sd_bus_emit_object_added(daemon->bus, output->path);
+  }
+
+  return 0;
+}
+
+/**
+ * Runs after every other event source. Requests sent while handling bus
+ * calls may have read events into the queue of the X connection without
+ * its fd becoming readable again, so events are processed here rather than
+ * on readability alone. Outputs are replaced here too, where no bus call
+ * still refers to them.
+ */
+static int daemon_post(sd_event_source *source, void *user_data) {
+  daemon_state *daemon = user_data;
+
+  if (daemon->instance == NULL) {
+    return 0;
+  }
+
+  if (vibrant_instance_dispatch(daemon->instance, NULL) != vibrant_NoError) {
+    fputs("Failed to handle events of the X server.\n", stderr);
+    return sd_event_exit(daemon->event, EXIT_FAILURE);
+  }
+
+  if (daemon->outputs_changed) {
+    daemon_close(daemon);
+    if (daemon_open(daemon) < 0) {
+      return sd_event_exit(daemon->event, EXIT_FAILURE);
+    }
+  }
+
+  return 0;
+}
+
+static int daemon_signal(sd_event_source *source,
+                         const struct signalfd_siginfo *info,
+                         void *user_data) {
+  daemon_state *daemon = user_data;
+  return sd_event_exit(daemon->event, EXIT_SUCCESS);
+}
+
+int main(int argc, char *const argv[]) {
+  daemon_state daemon = {0};
+  vibrant_instance_options options = {vibrant_BackendMock, {0, 0, 0}};
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--display") == 0 && i + 1 < argc) {
+      daemon.display_name = argv[++i];
+    } else if (strcmp(argv[i], "--mock") == 0 && i + 1 < argc) {
+      // simulated outputs, for trying out clients without touching displays
+      options.mock.outputs = strtoul(argv[++i], NULL, 10);
+      daemon.options = &options;
+    } else {
+      printf("Usage: %s [--display DISPLAY] [--mock OUTPUTS]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGINT);
+  sigprocmask(SIG_BLOCK, &signals, NULL);
+
+  int r = sd_event_default(&daemon.event);
+  if (r >= 0) {
+    r = sd_event_add_signal(daemon.event, NULL, SIGTERM, daemon_signal,
+                            &daemon);
+  }
+  if (r >= 0) {
+    r = sd_event_add_signal(daemon.event, NULL, SIGINT, daemon_signal,
+                            &daemon);
+  }
+  if (r >= 0) {
+    r = sd_event_add_post(daemon.event, NULL, daemon_post, &daemon);
+  }
+  if (r >= 0) {
+    r = sd_bus_open_user(&daemon.bus);
+  }
+  if (r >= 0) {
+    r = sd_bus_attach_event(daemon.bus, daemon.event, SD_EVENT_PRIORITY_NORMAL);
+  }
+  if (r >= 0) {
+    r = sd_bus_add_object_manager(daemon.bus, NULL, DAEMON_PATH);
+  }
+  if (r >= 0) {
+    r = sd_bus_add_object_vtable(daemon.bus, NULL, DAEMON_PATH,
+                                 DAEMON_INTERFACE, daemon_vtable, &daemon);
+  }
+  if (r >= 0) {
+    r = daemon_open(&daemon);
+  }
+  // last, so clients that see the name can use every object right away
+  if (r >= 0) {
+    r = sd_bus_request_name(daemon.bus, DAEMON_BUS_NAME, 0);
+    if (r == -EEXIST) {
+      fprintf(stderr, "%s is already running.\n", DAEMON_BUS_NAME);
+    }
+  }
+  if (r >= 0) {
+    r = sd_event_loop(daemon.event);
+  } else {
+    fprintf(stderr, "Failed to start: %s\n", strerror(-r));
+    r = EXIT_FAILURE;
+  }
+
+  daemon_close(&daemon);
+  sd_bus_flush_close_unref(daemon.bus);
+  sd_event_unref(daemon.event);
+
+  return r;
+}
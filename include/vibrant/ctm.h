@@ -60,8 +60,10 @@ extern "C" {
 #endif // __cplusplus
 
 /*
- * From drm/drm_mode.h
+ * From drm/drm_mode.h, which defines it itself if it was included first, see
+ * drm.c
  */
+#ifndef _DRM_MODE_H
 struct drm_color_ctm {
   /*
    * Conversion matrix in S31.32 sign-magnitude
@@ -69,6 +71,7 @@ struct drm_color_ctm {
    */
   u_int64_t matrix[9];
 };
+#endif // _DRM_MODE_H
 
 /**
  * Get saturation of output in human readable format.
@@ -93,6 +96,44 @@ double ctm_get_saturation(Display *dpy, RROutput output, int *x_status);
 void ctm_set_saturation(Display *dpy, RROutput output, double saturation,
                         int *x_status);
 
+/**
+ * Get the raw CTM property of output, padded as described in ctm_set_ctm().
+ *
+ * @param dpy The X Display
+ * @param output RandR output to get the CTM from
+ * @param padded_ctm long array of size 18. Will hold the padded CTM.
+ * @return X-defined return code (See get_output_blob())
+ */
+int ctm_get_padded_ctm(Display *dpy, RROutput output, long *padded_ctm);
+
+/**
+ * Queue a request replacing the CTM property of output with padded_ctm.
+ * Unlike ctm_set_saturation() this neither verifies that the property exists
+ * nor flushes or syncs, errors are delivered through the X error handler.
+ *
+ * @param dpy The X Display
+ * @param output RandR output to set the CTM on
+ * @param padded_ctm long array of size 18, holding the padded CTM
+ */
+void ctm_queue_padded_ctm(Display *dpy, RROutput output,
+                          const long *padded_ctm);
+
+/**
+ * Convert a saturation into the padded CTM ctm_set_saturation() would send.
+ *
+ * @param saturation Saturation, clamped to the supported range
+ * @param padded_ctm long array of size 18. Will hold the padded CTM.
+ */
+void ctm_saturation_to_padded_ctm(double saturation, long *padded_ctm);
+
+/**
+ * Get the atom of the CTM property without creating it.
+ *
+ * @param dpy The X Display
+ * @return the atom or None if no output ever had a CTM property
+ */
+Atom ctm_get_atom(Display *dpy);
+
 /**
  * Check if output has the CTM property.
  *
@@ -0,0 +1,59 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_DRM_H
+#define LIBVIBRANT_DRM_H
+
+#include "vibrant/vibrant.h"
+
+/**
+ * Populate instance with the outputs of a DRM device. instance must already
+ * be allocated, it is left untouched on failure.
+ *
+ * @param instance The instance to populate
+ * @param options DRM configuration
+ * @return vibrant_NoError, vibrant_NoMem, vibrant_IOError or
+ * vibrant_BackendError, see vibrant_instance_new_with_options()
+ */
+vibrant_errors drm_instance_new(vibrant_instance *instance,
+                                const vibrant_drm_options *options);
+
+/**
+ * Free everything drm_instance_new allocated and close the device. Does not
+ * free instance itself.
+ *
+ * @param instance The instance to clean up
+ */
+void drm_instance_free(vibrant_instance *instance);
+
+/**
+ * Apply the states queued by the set_state of DRM controllers since the last
+ * commit, in one atomic commit across all CRTCs. Either all of them apply or
+ * none does.
+ *
+ * @param instance The instance whose queue to commit
+ * @return Success or the X-defined error code closest to the errno of the
+ * commit
+ */
+int drm_commit(vibrant_instance *instance);
+
+#endif // LIBVIBRANT_DRM_H
@@ -0,0 +1,75 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_EXPORT_H
+#define LIBVIBRANT_EXPORT_H
+
+#include "vibrant/internal.h"
+#include "vibrant/vibrant.h"
+
+/**
+ * Turn controller into an Export controller, whose matrix is published on
+ * the export page of its instance instead of being sent to its output.
+ *
+ * @param priv The controller to set up
+ */
+void export_controller_init(vibrant_controller_internal *priv);
+
+/**
+ * Populate instance with an Export controller for every output named in
+ * options. instance must already be allocated, it is left untouched on
+ * failure.
+ *
+ * @param instance The instance to populate
+ * @param options Export configuration, outputs must not be NULL
+ * @return vibrant_NoError or vibrant_NoMem
+ */
+vibrant_errors export_instance_new(vibrant_instance *instance,
+                                   const vibrant_export_options *options);
+
+/**
+ * Free everything export_instance_new allocated. Does not free instance
+ * itself.
+ *
+ * @param instance The instance to clean up
+ */
+void export_instance_free(vibrant_instance *instance);
+
+/**
+ * Create the export page of instance holding every Export controller, all
+ * set to the identity matrix. Must be called once the controllers are final
+ * and before any of them is used.
+ *
+ * @param instance
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_IOError
+ */
+vibrant_errors export_publish(vibrant_instance *instance);
+
+/**
+ * Close the export page of instance, if there is one. Compositors that
+ * mapped it keep their mapping.
+ *
+ * @param instance
+ */
+void export_unpublish(vibrant_instance *instance);
+
+#endif // LIBVIBRANT_EXPORT_H
@@ -0,0 +1,76 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_FRAME_H
+#define LIBVIBRANT_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// pixels are sampled in contiguous spans of this many pixels
+#define FRAME_SPAN 8
+// number of chroma thresholds, 32, 64, ..., 224
+#define FRAME_CHROMA_THRESHOLDS 7
+
+/**
+ * Running sums over sampled pixels, see vibrant_frame_analyze.
+ */
+typedef struct frame_sums {
+  // rg = R - G
+  int64_t rg;
+  int64_t rg2;
+  // yb = R + G - 2B, twice the usual yellow-blue opponent
+  int64_t yb;
+  int64_t yb2;
+  uint64_t count;
+  // number of pixels with max(R, G, B) - min(R, G, B) >= 32 * (i + 1)
+  uint64_t chroma_above[FRAME_CHROMA_THRESHOLDS];
+} frame_sums;
+
+/**
+ * Add the pixels of one row of 32-bit XRGB little-endian pixels to sums.
+ * Spans of FRAME_SPAN pixels are sampled, starting every FRAME_SPAN * step
+ * pixels. All implementations sample the same pixels and produce identical
+ * sums. width must be below 32768, the largest width X can represent.
+ */
+typedef void (*frame_accumulate_fn)(const unsigned char *row, size_t width,
+                                    unsigned step, frame_sums *sums);
+
+void frame_accumulate_scalar(const unsigned char *row, size_t width,
+                             unsigned step, frame_sums *sums);
+
+#if defined(__x86_64__) || defined(__i386__)
+void frame_accumulate_avx2(const unsigned char *row, size_t width,
+                           unsigned step, frame_sums *sums);
+#endif
+
+#if defined(__aarch64__)
+void frame_accumulate_neon(const unsigned char *row, size_t width,
+                           unsigned step, frame_sums *sums);
+#endif
+
+/**
+ * Pick the fastest implementation the CPU supports.
+ */
+frame_accumulate_fn frame_accumulate_best(void);
+
+#endif // LIBVIBRANT_FRAME_H
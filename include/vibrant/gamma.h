@@ -0,0 +1,121 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_GAMMA_H
+#define LIBVIBRANT_GAMMA_H
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+
+/*
+ * Gamma ramps are applied to every channel on its own, so they can't mix
+ * channels the way a CTM does. Saturation is approximated by a contrast
+ * S-curve instead: steeper around mid-gray to boost colors, flatter to mute
+ * them. A ramp is identified by its level, the saturation in thousandths.
+ */
+
+// saturation * GAMMA_LEVEL_SCALE is the level of a ramp
+#define GAMMA_LEVEL_SCALE 1000
+
+// number of distinct ramps kept by a gamma_cache
+#define GAMMA_CACHE_SIZE 8
+
+typedef struct gamma_cache gamma_cache;
+
+typedef struct gamma_table_cache gamma_table_cache;
+
+/**
+ * Convert a ramp level into a saturation.
+ */
+double gamma_level_to_saturation(int level);
+
+/**
+ * Convert a saturation into a ramp level. saturation is clamped to the
+ * supported range.
+ */
+int gamma_saturation_to_level(double saturation);
+
+/**
+ * Fill a single channel ramp of size entries for level.
+ */
+void gamma_fill_ramp(int level, int size, unsigned short *ramp);
+
+/**
+ * Recover the level of a ramp by fitting it against the S-curve. Ramps that
+ * were not written by gamma_fill_ramp, e.g. calibration curves, yield the
+ * closest level.
+ */
+int gamma_ramp_to_level(const unsigned short *ramp, int size);
+
+/**
+ * Query the gamma ramp size of crtc.
+ *
+ * @return the number of ramp entries, 0 if the CRTC has no gamma ramp
+ */
+int gamma_crtc_size(Display *dpy, RRCrtc crtc);
+
+/**
+ * Query the level of the red ramp of crtc.
+ *
+ * @return Success, or BadMatch if the query failed
+ */
+int gamma_get_level(Display *dpy, RRCrtc crtc, int *level);
+
+/**
+ * Queue a request setting all ramps of crtc to level without flushing.
+ * Ramps are generated once per level and size and kept in *cache, which is
+ * allocated on first use. Errors are delivered through the X error handler.
+ *
+ * @return Success, or BadAlloc if no ramp could be allocated
+ */
+int gamma_queue_level(gamma_cache **cache, Display *dpy, RRCrtc crtc,
+                      int size, int level);
+
+/**
+ * Free all ramps of *cache and set it to NULL.
+ */
+void gamma_cache_free(gamma_cache **cache);
+
+/**
+ * Create a sealed memfd holding the red, green and blue ramps of size entries
+ * for level one after another, the table layout of wlr-gamma-control.
+ *
+ * @return the fd, or -1 on failure
+ */
+int gamma_table_fd(int level, int size);
+
+/**
+ * Find the table of level and size in *cache, creating it with
+ * gamma_table_fd() and *cache on first use. Tables that are handed out again
+ * are not computed again, but every call opens a new file description of the
+ * table, positioned at its start, which the caller has to close.
+ *
+ * @return the fd, or -1 on failure
+ */
+int gamma_table_lookup(gamma_table_cache **cache, int size, int level);
+
+/**
+ * Close all tables of *cache and set it to NULL.
+ */
+void gamma_table_cache_free(gamma_table_cache **cache);
+
+#endif // LIBVIBRANT_GAMMA_H
@@ -0,0 +1,335 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_INTERNAL_H
+#define LIBVIBRANT_INTERNAL_H
+
+#include "vibrant/ctm.h"
+#include "vibrant/vibrant.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef double (*vibrant_get_saturation_fn)(vibrant_controller *);
+
+/**
+ * Backend setter. Returns Success (0) or an X-defined error code.
+ */
+typedef int (*vibrant_set_saturation_fn)(vibrant_controller *, double);
+
+typedef enum vibrant_controller_backend {
+  CTM,
+  XNVCtrl,
+  Mock,
+  Gamma,
+  DRM,
+  Wayland,
+  Export,
+  Unknown
+} vibrant_controller_backend;
+
+/**
+ * Raw color state of a controller, exactly as the backend stores it.
+ */
+typedef struct vibrant_controller_state {
+  union {
+    // CTM, Mock and Export: CTM property as returned by RandR, see
+    // ctm_set_ctm()
+    long padded_ctm[18];
+    // XNVCtrl: NV_CTRL_DIGITAL_VIBRANCE value
+    int nv_vibrance;
+    // Gamma and Wayland: level of the gamma ramps, see gamma.h
+    int gamma_level;
+    // DRM: contents of the CTM blob of the CRTC, unpadded
+    struct drm_color_ctm drm_ctm;
+  };
+} vibrant_controller_state;
+
+typedef int (*vibrant_get_state_fn)(vibrant_controller *,
+                                    vibrant_controller_state *);
+
+/**
+ * Backend state setter. X backends only queue their requests without
+ * flushing or syncing, errors are reported through the X error handler.
+ * Returns Success (0) or an X-defined error code for errors that are known
+ * immediately.
+ */
+typedef int (*vibrant_set_state_fn)(vibrant_controller *,
+                                    const vibrant_controller_state *);
+
+typedef void (*vibrant_saturation_to_state_fn)(double,
+                                               vibrant_controller_state *);
+
+/**
+ * Named adjustment of a controller, see vibrant_controller_set_layer.
+ */
+typedef struct vibrant_layer {
+  char *name;
+  int priority;
+  double matrix[9];
+} vibrant_layer;
+
+typedef struct vibrant_controller_internal {
+  vibrant_controller_backend backend;
+
+  // only applied if this display is an nvidia display,
+  // otherwise this is set to -1
+  int nvId;
+
+  // only applied if this display is driven through its gamma ramps,
+  // otherwise this is set to 0. Number of entries of the CRTC ramps.
+  int gamma_size;
+
+  vibrant_get_saturation_fn get_saturation;
+  vibrant_set_saturation_fn set_saturation;
+  vibrant_get_state_fn get_state;
+  vibrant_set_state_fn set_state;
+  vibrant_saturation_to_state_fn saturation_to_state;
+
+  // owning instance and position inside its controller array
+  vibrant_instance *instance;
+  size_t index;
+
+  // identity of the output that stays the same across restarts and
+  // connector renames, derived from its EDID. See assign_output_ids().
+  uint64_t id;
+
+  // luminance weights of the panel, valid if panel_valid. See panel.h
+  double panel_weights[3];
+  int panel_valid;
+  // see vibrant_controller_set_saturation_model
+  vibrant_saturation_model saturation_model;
+
+  // adjustment layers sorted by ascending priority, see layer.c
+  vibrant_layer *layers;
+  size_t layers_size;
+  // state the layers were last composed into, valid if composed_written
+  vibrant_controller_state composed;
+  int composed_written;
+
+  // state the watchdog keeps the output at, see watch.c
+  vibrant_controller_state intended;
+  // set when an event hinted that the output may have lost its state
+  int watch_pending;
+  // state last reported to the change listener
+  vibrant_controller_state reported;
+
+  // selection standing for the lease of the output, None until first used.
+  // See lease.c
+  Atom lease_atom;
+  int leased;
+  // request received for the output, applied by the next lease_apply()
+  int lease_pending;
+  double lease_saturation;
+} vibrant_controller_internal;
+
+struct vibrant_instance {
+  Display *dpy;
+
+  vibrant_controller *controllers;
+  int controllers_size;
+
+  vibrant_backend backend;
+  // backend specific state, e.g. struct vibrant_mock for vibrant_BackendMock
+  void *backend_data;
+
+  // open addressing hash tables over controllers by name and by id, see
+  // index.c. Slots hold the controller index + 1, 0 marks an empty slot.
+  size_t *index_by_name;
+  size_t *index_by_id;
+  size_t index_mask;
+
+  // see vibrant_instance_set_watchdog
+  int watching;
+  int randr_event_base;
+  // NV-CONTROL event base, -1 if the extension is missing. Only valid while
+  // events are selected, see watch_select()
+  int nv_event_base;
+
+  // see vibrant_instance_set_change_listener
+  vibrant_change_fn change_fn;
+  void *change_data;
+  int outputs_changed;
+
+  // see vibrant_instance_publish_status, NULL if not published
+  struct vibrant_status_publisher *status;
+
+  // ramps generated for Gamma controllers, see gamma.h
+  struct gamma_cache *gamma_cache;
+
+  // unmapped window whose PropertyNotify events mark processed requests,
+  // None until the first fence, see fence.c
+  Window fence_window;
+  Atom fence_atom;
+  // pending fences, linked through vibrant_fence.next
+  vibrant_fence *fences;
+
+  // unmapped window owning the lease selections and receiving requests,
+  // None until the first lease, see lease.c
+  Window lease_window;
+  Atom lease_request_atom;
+  // see vibrant_instance_set_lease_listener
+  vibrant_lease_fn lease_fn;
+  void *lease_data;
+
+  // set while VIBRANT_RECORD records the instance, see trace.h
+  struct vibrant_trace *trace;
+
+  // page the matrices of Export controllers are published in, NULL unless
+  // created with vibrant_BackendExport. See export.h
+  struct vibrant_export_publisher *exporter;
+
+  // applies everything set_state queued, for backends without an X
+  // connection that batch their requests. NULL if set_state applies directly.
+  // Returns Success or an X-defined error code that applies to all of them
+  int (*commit)(vibrant_instance *instance);
+};
+
+// size of an EDID base block, the part that identifies the panel
+#define EDID_BLOCK_SIZE 128
+
+#define VIBRANT_HASH_SEED 0xcbf29ce484222325ull
+
+/**
+ * 64-bit FNV-1a hash of data, used to derive stable output identities.
+ * Pass VIBRANT_HASH_SEED as seed, or a previous hash to continue it.
+ */
+uint64_t vibrant_hash(uint64_t seed, const void *data, size_t length);
+
+/**
+ * Build the lookup tables of instance once its controllers are final.
+ *
+ * @return vibrant_NoError or vibrant_NoMem
+ */
+vibrant_errors index_build(vibrant_instance *instance);
+
+/**
+ * Free the lookup tables built by index_build.
+ */
+void index_free(vibrant_instance *instance);
+
+/**
+ * Find a controller of instance by output name in constant time.
+ *
+ * @return the controller or NULL
+ */
+vibrant_controller *index_find_name(vibrant_instance *instance,
+                                    const char *name);
+
+/**
+ * Find a controller of instance by id in constant time.
+ *
+ * @return the controller or NULL
+ */
+vibrant_controller *index_find_id(vibrant_instance *instance, uint64_t id);
+
+/**
+ * Compare two states of controller's backend.
+ *
+ * @return 1 if both states are identical, 0 otherwise
+ */
+int vibrant_controller_state_equal(vibrant_controller *controller,
+                                   const vibrant_controller_state *a,
+                                   const vibrant_controller_state *b);
+
+/**
+ * Convert saturation into coefficients using the saturation model of
+ * controller. saturation is clamped to the supported range.
+ */
+void controller_saturation_to_coeffs(vibrant_controller *controller,
+                                     double saturation, double *coeffs);
+
+/**
+ * Convert saturation into a state of controller using its saturation model.
+ * Use this instead of the saturation_to_state of the backend.
+ */
+void controller_saturation_to_state(vibrant_controller *controller,
+                                    double saturation,
+                                    vibrant_controller_state *state);
+
+/**
+ * Add a raw state change of controller to transaction, see
+ * vibrant_transaction_set_saturation.
+ */
+vibrant_errors transaction_set_state(vibrant_transaction *transaction,
+                                     vibrant_controller *controller,
+                                     const vibrant_controller_state *state);
+
+/**
+ * Notify the parts of the library tracking the state of controller that it
+ * was successfully set to state.
+ */
+void controller_state_changed(vibrant_controller *controller,
+                              const vibrant_controller_state *state);
+
+/**
+ * Remember state as what the watchdog should keep controller at. Does nothing
+ * unless the watchdog of its instance is enabled.
+ */
+void watch_set_intended(vibrant_controller *controller,
+                        const vibrant_controller_state *state);
+
+/**
+ * Publish state as the new state of controller on the status page of its
+ * instance, if there is one.
+ */
+void status_update(vibrant_controller *controller,
+                   const vibrant_controller_state *state);
+
+/**
+ * Remove the status page of instance, if there is one.
+ */
+void status_unpublish(vibrant_instance *instance);
+
+/**
+ * Free the adjustment layers of controller.
+ */
+void layers_free(vibrant_controller *controller);
+
+/**
+ * Complete the pending fences of instance whose requests were processed.
+ */
+void fences_check(vibrant_instance *instance);
+
+/**
+ * Fail all pending fences of instance, which is about to be freed.
+ */
+void fences_abandon(vibrant_instance *instance);
+
+/**
+ * Handle event if it concerns the leases of instance.
+ *
+ * @return 1 if event was a lease event, 0 otherwise
+ */
+int lease_handle_event(vibrant_instance *instance, const XEvent *event);
+
+/**
+ * Apply the requests received for the outputs instance holds the lease of,
+ * in one transaction.
+ *
+ * @param result receives the outcome, see vibrant_transaction_commit
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BackendError
+ */
+vibrant_errors lease_apply(vibrant_instance *instance,
+                           vibrant_transaction_result *result);
+
+#endif // LIBVIBRANT_INTERNAL_H
@@ -0,0 +1,46 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_MOCK_H
+#define LIBVIBRANT_MOCK_H
+
+#include "vibrant/vibrant.h"
+
+/**
+ * Populate instance with simulated controllers. instance must already be
+ * allocated, it is left untouched on failure.
+ *
+ * @param instance The instance to populate
+ * @param options Mock configuration
+ * @return vibrant_NoError or vibrant_NoMem
+ */
+vibrant_errors mock_instance_new(vibrant_instance *instance,
+                                 const vibrant_mock_options *options);
+
+/**
+ * Free everything mock_instance_new allocated. Does not free instance itself.
+ *
+ * @param instance The instance to clean up
+ */
+void mock_instance_free(vibrant_instance *instance);
+
+#endif // LIBVIBRANT_MOCK_H
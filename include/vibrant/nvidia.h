@@ -28,4 +28,28 @@ double nvidia_get_saturation(Display *dpy, int id);
 
 void nvidia_set_saturation(Display *dpy, int id, double saturation);
 
+/**
+ * Convert a NV_CTRL_DIGITAL_VIBRANCE value into a saturation.
+ */
+double nvidia_vibrance_to_saturation(int nv_saturation);
+
+/**
+ * Convert a saturation into a NV_CTRL_DIGITAL_VIBRANCE value. saturation is
+ * clamped to the supported range.
+ */
+int nvidia_saturation_to_vibrance(double saturation);
+
+/**
+ * Query the raw NV_CTRL_DIGITAL_VIBRANCE value of display id.
+ *
+ * @return Success, or BadMatch if the query failed
+ */
+int nvidia_get_vibrance(Display *dpy, int id, int *nv_saturation);
+
+/**
+ * Queue a request setting NV_CTRL_DIGITAL_VIBRANCE of display id without
+ * flushing. Errors are delivered through the X error handler.
+ */
+void nvidia_queue_vibrance(Display *dpy, int id, int nv_saturation);
+
 #endif // LIBVIBRANT_NVIDIA_H
@@ -0,0 +1,82 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_PANEL_H
+#define LIBVIBRANT_PANEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The uniform saturation matrix mixes every channel with the average of all
+ * three. Panel profiles mix with the luminance of the color instead, weighted
+ * by how bright the primaries of the panel are relative to its white point:
+ *
+ *   M(s) = s * I + (1 - s) * W,   every row of W = (w_r, w_g, w_b)
+ *
+ * Grays and the luminance of every color stay put, so a saturation looks the
+ * same on sRGB and wide-gamut panels. The weights are the Y row of the RGB to
+ * XYZ matrix of the panel, derived once per EDID and cached for the lifetime
+ * of the process.
+ */
+
+/**
+ * Read the chromaticity coordinates of the primaries and the white point from
+ * an EDID base block.
+ *
+ * @param edid EDID_BLOCK_SIZE bytes
+ * @param chromaticity receives red x, y, green x, y, blue x, y and white x, y
+ */
+void panel_edid_chromaticity(const unsigned char *edid, double *chromaticity);
+
+/**
+ * Derive the luminance weights of a panel from its chromaticity coordinates.
+ *
+ * @param chromaticity see panel_edid_chromaticity
+ * @param weights receives the weights of red, green and blue, summing to 1
+ * @return 1 on success, 0 if the coordinates don't describe a usable gamut
+ */
+int panel_chromaticity_to_weights(const double *chromaticity, double *weights);
+
+/**
+ * Look up the luminance weights of the panel with the EDID base block edid,
+ * deriving and caching them on first use.
+ *
+ * @param edid_hash vibrant_hash of the EDID base block
+ * @param edid EDID_BLOCK_SIZE bytes, only read if the panel is not cached yet
+ * @param weights receives the weights, see panel_chromaticity_to_weights
+ * @return 1 if the panel has a usable profile, 0 otherwise
+ */
+int panel_profile_lookup(uint64_t edid_hash, const unsigned char *edid,
+                         double *weights);
+
+/**
+ * Generate the saturation matrix of a panel profile.
+ *
+ * @param weights see panel_chromaticity_to_weights
+ * @param saturation see vibrant_saturation_to_coeffs
+ * @param coeffs receives the 9 coefficients
+ */
+void panel_saturation_to_coeffs(const double *weights, double saturation,
+                                double *coeffs);
+
+#endif // LIBVIBRANT_PANEL_H
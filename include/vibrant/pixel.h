@@ -0,0 +1,65 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_PIXEL_H
+#define LIBVIBRANT_PIXEL_H
+
+#include "vibrant/vibrant.h"
+
+#include <stddef.h>
+
+/**
+ * Quantize a color matrix to the S31.32 sign-magnitude CTM that is sent to
+ * the driver, and decode it again. Every quantized coefficient is exactly
+ * representable as a double.
+ *
+ * @param matrix row-major 3x3 matrix
+ * @param coeffs receives the 9 quantized coefficients
+ */
+void pixel_quantize_matrix(const double *matrix, double *coeffs);
+
+/**
+ * Apply quantized coefficients to a row of width pixels in place. All
+ * implementations produce bit-identical results, the exact product rounded
+ * half up.
+ */
+typedef void (*pixel_apply_fn)(const double *coeffs,
+                               vibrant_pixel_format format, unsigned char *row,
+                               size_t width);
+
+void pixel_apply_scalar(const double *coeffs, vibrant_pixel_format format,
+                        unsigned char *row, size_t width);
+
+#if defined(__x86_64__) || defined(__i386__)
+void pixel_apply_sse2(const double *coeffs, vibrant_pixel_format format,
+                      unsigned char *row, size_t width);
+
+void pixel_apply_avx2(const double *coeffs, vibrant_pixel_format format,
+                      unsigned char *row, size_t width);
+#endif
+
+/**
+ * Pick the fastest implementation the CPU supports.
+ */
+pixel_apply_fn pixel_apply_best(void);
+
+#endif // LIBVIBRANT_PIXEL_H
@@ -0,0 +1,111 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_SCHEDULE_H
+#define LIBVIBRANT_SCHEDULE_H
+
+#include "vibrant/vibrant.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define SCHEDULE_DAY 86400u
+
+// where the kernel lists power supplies
+#define SCHEDULE_POWER_DIR "/sys/class/power_supply"
+
+// interval between two writes of a transition
+#define SCHEDULE_STEP_MS 50u
+
+// netlink groups of the kernel's uevents and of those udev forwards
+#define SCHEDULE_UEVENT_KERNEL 1u
+#define SCHEDULE_UEVENT_UDEV 2u
+
+// exists while udev runs and forwards uevents
+#define SCHEDULE_UDEV_CONTROL "/run/udev/control"
+
+/**
+ * vibrant_schedule_rule with the output resolved.
+ */
+typedef struct schedule_rule {
+  // index of the controller, or -1 for every controller
+  long controller;
+  unsigned start;
+  vibrant_power_state power;
+  double saturation;
+} schedule_rule;
+
+/**
+ * Find the saturation controller should have at seconds after midnight: that
+ * of the matching rule that started last. See vibrant_schedule_rule for ties.
+ *
+ * @return 1 if a rule matched and saturation was set, 0 otherwise
+ */
+int schedule_pick(const schedule_rule *rules, size_t rules_size,
+                  long controller, unsigned seconds, vibrant_power_state power,
+                  double *saturation);
+
+/**
+ * Find the start of the next rule relevant to power after seconds.
+ *
+ * @return seconds after midnight, SCHEDULE_DAY or more if the next start is
+ * on the following day, or 0 if there is no relevant rule
+ */
+unsigned schedule_next_start(const schedule_rule *rules, size_t rules_size,
+                             unsigned seconds, vibrant_power_state power);
+
+/**
+ * Determine the power state from the power supplies listed in dir, see
+ * SCHEDULE_POWER_DIR. Machines without a system battery count as on AC.
+ */
+vibrant_power_state schedule_read_power(const char *dir);
+
+/**
+ * Bring every output to the profile of wall clock time now, continuing a
+ * running transition at monotonic time now_ms, and arm the timer for the
+ * next change. vibrant_schedule_dispatch calls this with the current time.
+ */
+vibrant_errors schedule_update(vibrant_schedule *schedule, time_t now,
+                               uint64_t now_ms,
+                               vibrant_transaction_result *result);
+
+/**
+ * Hash udev puts into the header of its messages to let listeners filter
+ * them by subsystem, MurmurHash2 of the name with seed 0.
+ */
+uint32_t schedule_udev_hash(const char *subsystem);
+
+/**
+ * Attach a socket filter to fd that only passes udev messages of the
+ * power_supply subsystem, see SCHEDULE_UEVENT_UDEV.
+ *
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int schedule_attach_uevent_filter(int fd);
+
+/**
+ * Set the power state the next schedule_update assumes.
+ */
+void schedule_set_power(vibrant_schedule *schedule, vibrant_power_state power);
+
+#endif // LIBVIBRANT_SCHEDULE_H
@@ -0,0 +1,73 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_SEQLOCK_H
+#define LIBVIBRANT_SEQLOCK_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Sequence lock for pages shared with other processes, see status.c and
+ * export.c. The writer makes the sequence odd before it changes anything and
+ * even again afterwards. Readers retry their copy if the sequence was odd or
+ * changed while they copied, so they never block the writer. Writers must be
+ * serialized by the caller.
+ */
+
+static inline void seqlock_write_begin(_Atomic uint64_t *sequence) {
+  atomic_store_explicit(
+      sequence, atomic_load_explicit(sequence, memory_order_relaxed) + 1,
+      memory_order_relaxed);
+  // the odd sequence must be visible before any of the changes
+  atomic_thread_fence(memory_order_release);
+}
+
+static inline void seqlock_write_end(_Atomic uint64_t *sequence) {
+  atomic_fetch_add_explicit(sequence, 1, memory_order_release);
+}
+
+/**
+ * Wait until no write is in progress.
+ *
+ * @return the sequence to pass to seqlock_read_retry once the copy is done
+ */
+static inline uint64_t seqlock_read_begin(_Atomic uint64_t *sequence) {
+  uint64_t begin;
+  while ((begin = atomic_load_explicit(sequence, memory_order_acquire)) & 1u) {
+    // a write is in progress
+  }
+  return begin;
+}
+
+/**
+ * @return 1 if the data was changed since seqlock_read_begin returned begin
+ * and has to be copied again, 0 otherwise
+ */
+static inline int seqlock_read_retry(_Atomic uint64_t *sequence,
+                                     uint64_t begin) {
+  // none of the copies may move past the second sequence load
+  atomic_thread_fence(memory_order_acquire);
+  return atomic_load_explicit(sequence, memory_order_relaxed) != begin;
+}
+
+#endif // LIBVIBRANT_SEQLOCK_H
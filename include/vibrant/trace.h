@@ -0,0 +1,141 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_TRACE_H
+#define LIBVIBRANT_TRACE_H
+
+#include "vibrant/vibrant.h"
+
+/**
+ * Current time on the monotonic clock, used to time instance creation before
+ * the trace can be opened.
+ *
+ * @return nanoseconds since an arbitrary point
+ */
+unsigned long long trace_now_ns(void);
+
+/**
+ * Steps of opening an X11 instance that wait for the server.
+ */
+typedef enum trace_probe_step {
+  // XOpenDisplay and the NV-CONTROL extension query
+  ProbeConnect,
+  // XRRGetScreenResources
+  ProbeResources,
+  // XRRGetOutputInfo of one output
+  ProbeOutput,
+  // NV-CONTROL queries of one screen
+  ProbeNvidia,
+  // CTM property query of one output
+  ProbeCTM,
+  // gamma ramp size of one CRTC
+  ProbeGamma,
+  // EDID of one output
+  ProbeEDID
+} trace_probe_step;
+
+typedef struct trace_probe {
+  trace_probe_step step;
+  unsigned long long latency_ns;
+} trace_probe;
+
+/**
+ * Probing steps of an instance that is being opened, in the order they ran.
+ */
+typedef struct trace_probes {
+  trace_probe *probes;
+  size_t size;
+  size_t capacity;
+  // set if a step could not be stored
+  int failed;
+  // trace_now_ns() when the current step began
+  unsigned long long start_ns;
+} trace_probes;
+
+/**
+ * Start timing a probing step. Does nothing if probes is NULL, so callers
+ * don't have to know whether they are recorded.
+ *
+ * @param probes The steps recorded so far, or NULL
+ */
+void trace_probe_begin(trace_probes *probes);
+
+/**
+ * Store the latency of the step started by the last trace_probe_begin.
+ *
+ * @param probes The steps recorded so far, or NULL
+ * @param step The step that just finished
+ */
+void trace_probe_end(trace_probes *probes, trace_probe_step step);
+
+/**
+ * Free the steps of probes and reset it.
+ *
+ * @param probes The recorded steps
+ */
+void trace_probes_free(trace_probes *probes);
+
+/**
+ * Record the outputs of instance and every request sent to them from now on
+ * into the file at path, see vibrant_replay_options. Wraps the backend
+ * functions of every controller.
+ *
+ * @param instance The instance to record, with its controllers final
+ * @param path File to write the trace to, replaced if it exists
+ * @param start_ns trace_now_ns() from before the instance was created
+ * @param probes Probing steps of the instance, counted out of the rest of
+ * its opening time
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_IOError
+ */
+vibrant_errors trace_record_start(vibrant_instance *instance, const char *path,
+                                  unsigned long long start_ns,
+                                  const trace_probes *probes);
+
+/**
+ * Finish the trace of instance, if it is recorded, and restore its backend
+ * functions.
+ *
+ * @param instance The instance to stop recording
+ */
+void trace_record_stop(vibrant_instance *instance);
+
+/**
+ * Populate instance with the outputs recorded in a trace. instance must
+ * already be allocated, it is left untouched on failure.
+ *
+ * @param instance The instance to populate
+ * @param options Replay configuration
+ * @return vibrant_NoError, vibrant_NoMem, vibrant_IOError if the trace can't
+ * be read or vibrant_BadFile if it is not a trace
+ */
+vibrant_errors replay_instance_new(vibrant_instance *instance,
+                                   const vibrant_replay_options *options);
+
+/**
+ * Free everything replay_instance_new allocated. Does not free instance
+ * itself.
+ *
+ * @param instance The instance to clean up
+ */
+void replay_instance_free(vibrant_instance *instance);
+
+#endif // LIBVIBRANT_TRACE_H
@@ -66,12 +66,24 @@ extern "C" {
 
 // private structs, users don't need and shouldn't be accessing their data
 typedef struct vibrant_instance vibrant_instance;
+typedef struct vibrant_transaction vibrant_transaction;
 struct vibrant_controller_internal;
 
 typedef enum vibrant_errors {
   vibrant_NoError,
   vibrant_ConnectToX,
-  vibrant_NoMem
+  vibrant_NoMem,
+  // an output rejected a request, see vibrant_transaction_commit
+  vibrant_BackendError,
+  // a file could not be opened, read or written
+  vibrant_IOError,
+  // a file was read but its contents are invalid or unsupported
+  vibrant_BadFile,
+  // a parameter is out of its documented range
+  vibrant_InvalidArgument,
+  // another client holds the lease of the output, see
+  // vibrant_controller_acquire_lease
+  vibrant_LeaseHeld
 } vibrant_errors;
 
 typedef struct vibrant_controller {
@@ -83,6 +95,388 @@ typedef struct vibrant_controller {
   struct vibrant_controller_internal *priv;
 } vibrant_controller;
 
+typedef enum vibrant_backend {
+  // real outputs of an X server, driven through CTM or NV-CONTROL
+  vibrant_BackendX11,
+  // simulated outputs without any X connection, see vibrant_mock_options
+  vibrant_BackendMock,
+  // outputs of a DRM device driven through atomic KMS, without an X server.
+  // See vibrant_drm_options
+  vibrant_BackendDRM,
+  // outputs of a wlroots based Wayland compositor, driven through the
+  // wlr-gamma-control protocol. display_name names the Wayland display, NULL
+  // for $WAYLAND_DISPLAY. The compositor resets the gamma of every output
+  // once the instance is freed
+  vibrant_BackendWayland,
+  // outputs read from a trace recorded with VIBRANT_RECORD, answering with
+  // the recorded latencies. See vibrant_replay_options
+  vibrant_BackendReplay,
+  // outputs whose color transform is applied by a compositor in its
+  // shaders. The matrix of every output is published in shared memory
+  // instead of being sent to hardware, see vibrant_export_options
+  vibrant_BackendExport
+} vibrant_backend;
+
+/**
+ * Configuration of the mock backend. Every simulated output behaves like a
+ * CTM-capable output, so values read back carry the same fixed-point
+ * quantization as real hardware.
+ *
+ * Failed requests leave the simulated state untouched, failed reads return
+ * -1.0.
+ *
+ * The simulated outputs and the request log are locked, so the getters and
+ * setters of the controllers of a mock instance may be called from several
+ * threads at once. Nothing else is: transactions, layers, the watchdog and
+ * every instance with an X connection share unlocked state, including the
+ * process-wide X error recorder, and must stay on one thread at a time.
+ */
+typedef struct vibrant_mock_options {
+  // number of simulated outputs, named MOCK-0, MOCK-1, ...
+  size_t outputs;
+  // time every get or set request takes to complete, in microseconds
+  unsigned int latency_us;
+  // if non-zero, every fail_every-th request fails with BadMatch
+  unsigned int fail_every;
+} vibrant_mock_options;
+
+/**
+ * Replacement for ioctl(2) on the DRM device, e.g. to run the DRM backend
+ * against a fake device. Returns 0, or -1 with errno set.
+ */
+typedef int (*vibrant_drm_ioctl_fn)(int fd, unsigned long request, void *arg,
+                                    void *user_data);
+
+/**
+ * Configuration of the DRM backend. Connected connectors whose CRTC has a
+ * CTM property become controllers, named like the kernel names them, e.g.
+ * DP-1 or HDMI-A-1. Changing the CTM requires DRM master, so no compositor
+ * or X server may be running on the device.
+ */
+typedef struct vibrant_drm_options {
+  // device node, e.g. /dev/dri/card0. NULL picks the first card with an
+  // output that has a CTM
+  const char *device;
+  // NULL for ioctl(2). If set, device is not opened and ioctl receives -1
+  // as fd
+  vibrant_drm_ioctl_fn ioctl;
+  void *ioctl_data;
+} vibrant_drm_options;
+
+/**
+ * Configuration of the replay backend. While the environment variable
+ * VIBRANT_RECORD is set to a path, new instances write a trace to that file,
+ * replacing it: how long every step of opening the instance took, e.g. the
+ * query of each output of an X server and the fetch of its EDID, and every
+ * request it sends to its outputs, with its latency and result. Replaying
+ * such a trace takes as long as each recorded step to open, recreates the
+ * outputs with their names, ids, backends and initial state, and delays
+ * every request like the recorded requests of the same kind to the same
+ * output, in order, starting over once they are used up. Failed requests
+ * fail again.
+ */
+typedef struct vibrant_replay_options {
+  // trace written through VIBRANT_RECORD
+  const char *path;
+  // factor applied to every recorded latency, 1.0 to replay in real time,
+  // 0.0 to measure the overhead of the library alone
+  double latency_scale;
+} vibrant_replay_options;
+
+/**
+ * Configuration of the export backend. Exported outputs behave like
+ * CTM-capable outputs, but their matrix is written to a sealed memfd page
+ * (see vibrant_instance_get_export_fd) that a compositor maps and applies in
+ * its shaders, e.g. on outputs whose hardware has no CTM. Every change
+ * signals an eventfd, see vibrant_instance_get_export_event_fd. Exported
+ * outputs start out with the identity matrix.
+ */
+typedef struct vibrant_export_options {
+  // names of the outputs to export, e.g. as the compositor calls them. No X
+  // server is involved then. If NULL, the outputs of the X server on
+  // display_name are used instead: outputs with NV-CONTROL or a CTM are
+  // driven as usual, all others are exported rather than approximated
+  // through their gamma ramps
+  const char *const *outputs;
+  size_t outputs_size;
+} vibrant_export_options;
+
+typedef struct vibrant_instance_options {
+  vibrant_backend backend;
+  // only used if backend is vibrant_BackendMock
+  vibrant_mock_options mock;
+  // only used if backend is vibrant_BackendDRM
+  vibrant_drm_options drm;
+  // only used if backend is vibrant_BackendReplay
+  vibrant_replay_options replay;
+  // only used if backend is vibrant_BackendExport
+  vibrant_export_options exported;
+} vibrant_instance_options;
+
+/**
+ * Outcome of vibrant_transaction_commit.
+ */
+typedef struct vibrant_transaction_result {
+  // number of controllers that reported an error while applying
+  size_t failed;
+  // number of controllers that already had the requested state
+  size_t unchanged;
+  // 1 if the previous state was restored because of a failure, 0 otherwise
+  int rolled_back;
+  // time spent between grabbing and releasing the server, in nanoseconds
+  unsigned long long apply_time_ns;
+} vibrant_transaction_result;
+
+typedef enum vibrant_mock_request_type {
+  vibrant_MockGetSaturation,
+  vibrant_MockSetSaturation
+} vibrant_mock_request_type;
+
+/**
+ * A request received by the mock backend.
+ */
+typedef struct vibrant_mock_request {
+  vibrant_mock_request_type type;
+  // index of the controller in the array of vibrant_instance_get_controllers
+  size_t controller;
+  // saturation requested by a set or returned by a get
+  double saturation;
+  // Success or the injected X error code
+  int status;
+  // CLOCK_MONOTONIC time the request was received at, in nanoseconds
+  unsigned long long timestamp_ns;
+} vibrant_mock_request;
+
+/**
+ * Read-only handle on a status page published by another instance, see
+ * vibrant_status_open.
+ */
+typedef struct vibrant_status vibrant_status;
+
+#define VIBRANT_STATUS_NAME_SIZE 32
+#define VIBRANT_STATUS_BACKEND_SIZE 16
+
+/**
+ * Published state of one output.
+ */
+typedef struct vibrant_status_entry {
+  // see vibrant_controller_get_id
+  unsigned long long id;
+  // output name, may be truncated
+  char name[VIBRANT_STATUS_NAME_SIZE];
+  // see vibrant_controller_get_backend_name
+  char backend[VIBRANT_STATUS_BACKEND_SIZE];
+  double saturation;
+  // incremented every time the state of the output changes
+  unsigned long long generation;
+} vibrant_status_entry;
+
+/**
+ * Read-only handle on an export page, see vibrant_export_open.
+ */
+typedef struct vibrant_export vibrant_export;
+
+#define VIBRANT_EXPORT_NAME_SIZE 32
+
+/**
+ * Exported matrix of one output.
+ */
+typedef struct vibrant_export_entry {
+  // see vibrant_controller_get_id
+  unsigned long long id;
+  // output name, may be truncated
+  char name[VIBRANT_EXPORT_NAME_SIZE];
+  // row-major 3x3 matrix to multiply RGB column vectors with, quantized
+  // exactly like a hardware CTM
+  double matrix[9];
+  // incremented every time the matrix of the output changes
+  unsigned long long generation;
+} vibrant_export_entry;
+
+#define VIBRANT_FRAME_HISTOGRAM_SIZE 8
+
+/**
+ * Content metrics of a frame, see vibrant_frame_analyze.
+ */
+typedef struct vibrant_frame_metrics {
+  // colorfulness after Hasler and Suesstrunk. 0 for gray content, around 33
+  // for moderately and above 100 for extremely colorful content.
+  double colorfulness;
+  // share of sampled pixels per chroma (max(R, G, B) - min(R, G, B)) range
+  // of width 32, starting at 0
+  double chroma_histogram[VIBRANT_FRAME_HISTOGRAM_SIZE];
+  // number of pixels sampled
+  size_t samples;
+} vibrant_frame_metrics;
+
+/**
+ * How a saturation is turned into a color matrix, see
+ * vibrant_controller_set_saturation_model.
+ */
+typedef enum vibrant_saturation_model {
+  // mix every channel with the average of all three, the same on every panel
+  vibrant_SaturationUniform,
+  // mix every channel with the luminance of the color, derived from the
+  // primaries and white point in the EDID of the panel
+  vibrant_SaturationPanel
+} vibrant_saturation_model;
+
+/**
+ * Layout of 32-bit pixels in memory, see vibrant_apply_matrix_rgba.
+ */
+typedef enum vibrant_pixel_format {
+  // bytes R, G, B, A
+  vibrant_PixelRGBA8888,
+  // little-endian words with R in bits 0-9, G in 10-19, B in 20-29 and A in
+  // 30-31, DRM_FORMAT_ABGR2101010
+  vibrant_PixelRGBA1010102
+} vibrant_pixel_format;
+
+/**
+ * File formats of vibrant_lut_export.
+ */
+typedef enum vibrant_lut_format {
+  // Adobe/Resolve .cube text format, understood by mpv and most video tools
+  vibrant_LutCube,
+  // size^3 RGB triplets of 32-bit floats in host byte order, red changing
+  // fastest, without header
+  vibrant_LutFloat32
+} vibrant_lut_format;
+
+#define VIBRANT_LUT_SIZE_MIN 2
+#define VIBRANT_LUT_SIZE_MAX 256
+
+/**
+ * Adaptive vibrance, see vibrant_adaptive_new.
+ */
+typedef struct vibrant_adaptive vibrant_adaptive;
+
+typedef struct vibrant_adaptive_options {
+  // range the saturation is kept in
+  double min_saturation;
+  double max_saturation;
+  // colorfulness that is left at saturation 1.0, duller content is boosted
+  double target_colorfulness;
+  // share of the distance to the new goal covered per step, in (0, 1]
+  double smoothing;
+  // initial sampling density, every step-th row and span is analyzed
+  unsigned sample_step;
+  // CPU time one analysis may take, sampling gets sparser if exceeded
+  unsigned budget_us;
+} vibrant_adaptive_options;
+
+/**
+ * Completion of an asynchronous request, see
+ * vibrant_controller_set_saturation_async.
+ */
+typedef struct vibrant_fence vibrant_fence;
+
+typedef enum vibrant_fence_status {
+  vibrant_FencePending,
+  vibrant_FenceDone,
+  // the X server rejected the request
+  vibrant_FenceFailed
+} vibrant_fence_status;
+
+typedef void (*vibrant_fence_fn)(vibrant_fence *fence,
+                                 vibrant_fence_status status, void *user_data);
+
+/**
+ * Change reported to a vibrant_change_fn.
+ */
+typedef struct vibrant_change {
+  // controller whose saturation changed, or NULL if outputs were connected
+  // or disconnected. The controllers of the instance stay the same, a new
+  // instance is needed to see the new set of outputs.
+  vibrant_controller *controller;
+  double saturation;
+} vibrant_change;
+
+typedef void (*vibrant_change_fn)(const vibrant_change *change,
+                                  void *user_data);
+
+/**
+ * Scheduled profiles, see vibrant_schedule_new.
+ */
+typedef struct vibrant_schedule vibrant_schedule;
+
+/**
+ * Rules loaded from a configuration file, see vibrant_config_new.
+ */
+typedef struct vibrant_config vibrant_config;
+
+/**
+ * Instances on several X servers driven together, see vibrant_pool_new.
+ */
+typedef struct vibrant_pool vibrant_pool;
+
+typedef enum vibrant_lease_event_type {
+  // another client took the lease of the output
+  vibrant_LeaseLost,
+  // another client asked for a saturation through
+  // vibrant_controller_request_saturation
+  vibrant_LeaseRequest
+} vibrant_lease_event_type;
+
+/**
+ * Lease event reported to a vibrant_lease_fn.
+ */
+typedef struct vibrant_lease_event {
+  vibrant_lease_event_type type;
+  vibrant_controller *controller;
+  // requested saturation, only set for vibrant_LeaseRequest
+  double saturation;
+} vibrant_lease_event;
+
+typedef void (*vibrant_lease_fn)(const vibrant_lease_event *event,
+                                 void *user_data);
+
+typedef struct vibrant_pool_command {
+  // index of the display in the list the pool was created with
+  size_t display;
+  // output name or id, see vibrant_instance_find_controller
+  const char *output;
+  double saturation;
+} vibrant_pool_command;
+
+/**
+ * Latency of the batches applied to one display of a pool, from sending the
+ * first write until the server processed the last one.
+ */
+typedef struct vibrant_pool_stats {
+  // batches that touched the display and completed in time
+  size_t batches;
+  // writes that failed or did not complete in time
+  size_t failed;
+  // in nanoseconds, all 0 until the first batch completed
+  unsigned long long last_ns;
+  unsigned long long min_ns;
+  unsigned long long max_ns;
+  unsigned long long total_ns;
+} vibrant_pool_stats;
+
+typedef enum vibrant_power_state {
+  vibrant_PowerAny,
+  vibrant_PowerAC,
+  vibrant_PowerBattery
+} vibrant_power_state;
+
+/**
+ * The rule that took effect last applies. If several rules start at the same
+ * time, rules for a single output take precedence over rules for every
+ * output, and among those the one listed last wins.
+ */
+typedef struct vibrant_schedule_rule {
+  // output name or id, see vibrant_instance_find_controller. NULL matches
+  // every output
+  const char *output;
+  // local time the rule takes effect at, in seconds after midnight
+  unsigned start;
+  // vibrant_PowerAny, or the power state the rule is limited to
+  vibrant_power_state power;
+  double saturation;
+} vibrant_schedule_rule;
+
 /**
  * initializes a vibrant_instance struct using the X server specified by
  * display_name.
@@ -95,6 +489,29 @@ typedef struct vibrant_controller {
 vibrant_errors vibrant_instance_new(vibrant_instance **instance,
                                     const char *display_name);
 
+/**
+ * Same as vibrant_instance_new, but lets the caller select the backend.
+ * Passing NULL as options is equivalent to vibrant_instance_new.
+ * @param instance
+ * @param display_name X or Wayland display, ignored by the mock and DRM
+ * backends
+ * @param options
+ * @return vibrant_NoError if no issues occurred, vibrant_connectToX if
+ * connecting to display_name failed, or vibrant_NoMem if memory allocation
+ * failed. The DRM backend returns vibrant_IOError if no device could be
+ * opened and vibrant_BackendError if it lacks atomic modesetting or, when
+ * picking a device, no device has an output with a CTM. The Wayland backend
+ * returns vibrant_ConnectToX if the compositor can't be reached and
+ * vibrant_BackendError if it lacks wlr-gamma-control or was built without it.
+ * The replay backend returns vibrant_IOError if the trace can't be read and
+ * vibrant_BadFile if it is not a trace. If VIBRANT_RECORD is set but can't
+ * be written, vibrant_IOError is returned
+ */
+vibrant_errors
+vibrant_instance_new_with_options(vibrant_instance **instance,
+                                  const char *display_name,
+                                  const vibrant_instance_options *options);
+
 /**
  * Deinits instance by closing its X connection and freeing its allocated
  * memory.
@@ -112,6 +529,32 @@ void vibrant_instance_get_controllers(vibrant_instance *instance,
                                       vibrant_controller **controllers,
                                       size_t *length);
 
+/**
+ * Finds a controller of instance in constant time.
+ * @param instance
+ * @param key either the output name (e.g. DisplayPort-0) or the id returned
+ * by vibrant_controller_get_id, printed as 16 hexadecimal digits
+ * @return the controller or NULL if no controller matches
+ */
+vibrant_controller *vibrant_instance_find_controller(vibrant_instance *instance,
+                                                     const char *key);
+
+/**
+ * Returns an identifier of the output controlled by controller that stays the
+ * same across restarts, connector renames and re-enumeration. It is derived
+ * from the EDID of the connected panel, or from the output name if the panel
+ * has no EDID.
+ * @param controller
+ */
+unsigned long long vibrant_controller_get_id(vibrant_controller *controller);
+
+/**
+ * Returns a short human readable name of the mechanism used to adjust the
+ * output controlled by controller, e.g. "CTM" or "NV-CONTROL".
+ * @param controller
+ */
+const char *vibrant_controller_get_backend_name(vibrant_controller *controller);
+
 /**
  * Returns a double in the range of [0.0, 4.0] representing the current
  * saturation. 0.0 being no saturation, 1.0 being the default,
@@ -130,6 +573,804 @@ double vibrant_controller_get_saturation(vibrant_controller *controller);
 void vibrant_controller_set_saturation(vibrant_controller *controller,
                                        double saturation);
 
+/**
+ * Selects how saturations of controller are turned into color matrices from
+ * now on, by every function taking a saturation. vibrant_SaturationUniform
+ * is the default. vibrant_SaturationPanel keeps the luminance of every color,
+ * so the same saturation looks alike on sRGB and wide-gamut panels. Its
+ * profile is derived from the EDID once per panel and cached for the
+ * lifetime of the process. Saturations read back are exact in both models.
+ * @param controller
+ * @param model
+ * @return vibrant_NoError, vibrant_InvalidArgument or vibrant_BackendError if
+ * the EDID of the panel has no usable primaries or the backend can't apply
+ * matrices (NV-CONTROL and gamma ramps)
+ */
+vibrant_errors
+vibrant_controller_set_saturation_model(vibrant_controller *controller,
+                                        vibrant_saturation_model model);
+
+/**
+ * Returns the model selected by vibrant_controller_set_saturation_model.
+ * @param controller
+ */
+vibrant_saturation_model
+vibrant_controller_get_saturation_model(vibrant_controller *controller);
+
+/**
+ * Starts a new, empty transaction on instance. Changes added to it are only
+ * applied by vibrant_transaction_commit.
+ * @param instance
+ * @param transaction
+ * @return vibrant_NoError or vibrant_NoMem
+ */
+vibrant_errors vibrant_transaction_new(vibrant_instance *instance,
+                                       vibrant_transaction **transaction);
+
+/**
+ * Frees transaction, discarding changes that were not committed.
+ * @param transaction
+ */
+void vibrant_transaction_free(vibrant_transaction **transaction);
+
+/**
+ * Adds a saturation change of controller to transaction. Setting the same
+ * controller again replaces the previous value.
+ * @param transaction
+ * @param controller must belong to the instance of transaction
+ * @param saturation see vibrant_controller_set_saturation
+ * @return vibrant_NoError or vibrant_NoMem
+ */
+vibrant_errors vibrant_transaction_set_saturation(
+    vibrant_transaction *transaction, vibrant_controller *controller,
+    double saturation);
+
+/**
+ * Applies all changes of transaction at once. The current state of every
+ * affected output is saved, then all changes are sent while the X server is
+ * grabbed and confirmed with a single round trip. Outputs that already have
+ * the requested state are not written to. If any output reports an
+ * error, every affected output is restored to its saved state.
+ * The transaction is emptied afterwards and can be reused.
+ * @param transaction
+ * @param result may be NULL. Receives failure count and apply time.
+ * @return vibrant_NoError if every change was applied, vibrant_BackendError
+ * if changes were rolled back
+ */
+vibrant_errors vibrant_transaction_commit(vibrant_transaction *transaction,
+                                          vibrant_transaction_result *result);
+
+/**
+ * Saves the raw color state of every controller of instance to a binary
+ * snapshot file at path. Entries are keyed by stable output identity, so the
+ * file stays usable when outputs are enumerated in a different order.
+ * The file is replaced atomically.
+ * @param instance
+ * @param path
+ * @return vibrant_NoError, vibrant_BackendError if a state could not be
+ * read, vibrant_IOError or vibrant_NoMem
+ */
+vibrant_errors vibrant_instance_save_snapshot(vibrant_instance *instance,
+                                              const char *path);
+
+/**
+ * Restores a snapshot written by vibrant_instance_save_snapshot. All outputs
+ * found in the snapshot are restored in a single transaction, outputs that
+ * already match it are skipped. Outputs missing from the snapshot are left
+ * alone.
+ * @param instance
+ * @param path
+ * @param result may be NULL, see vibrant_transaction_commit
+ * @return vibrant_NoError, vibrant_IOError, vibrant_BadFile, vibrant_NoMem or
+ * vibrant_BackendError (see vibrant_transaction_commit)
+ */
+vibrant_errors
+vibrant_instance_restore_snapshot(vibrant_instance *instance, const char *path,
+                                  vibrant_transaction_result *result);
+
+/**
+ * Adds or replaces the adjustment layer called name on controller. All layers
+ * of a controller are composed into one color matrix, lower priorities are
+ * applied to the pixels first. This lets independent users of one instance,
+ * e.g. a night light and a vibrance profile, adjust the same output without
+ * overwriting each other.
+ *
+ * The composed result is only written if it differs from what was written
+ * to the controller, by the layers or anything else. Once a controller has
+ * layers, they own its color state, later calls of
+ * vibrant_controller_set_saturation are overridden by the next layer change.
+ * If the result can't be written, the layer is left as it was before the
+ * call, a new layer is not added.
+ * @param controller
+ * @param name identifies the layer, copied
+ * @param priority
+ * @param matrix row-major 3x3 color matrix, the identity leaves colors alone
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BackendError
+ */
+vibrant_errors vibrant_controller_set_layer(vibrant_controller *controller,
+                                            const char *name, int priority,
+                                            const double matrix[9]);
+
+/**
+ * Adds or replaces a layer that only adjusts saturation, see
+ * vibrant_controller_set_layer and vibrant_controller_set_saturation.
+ * @param controller
+ * @param name
+ * @param priority
+ * @param saturation
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BackendError
+ */
+vibrant_errors
+vibrant_controller_set_layer_saturation(vibrant_controller *controller,
+                                        const char *name, int priority,
+                                        double saturation);
+
+/**
+ * Removes the layer called name from controller and applies the remaining
+ * layers. Removing a layer that does not exist does nothing.
+ * @param controller
+ * @param name
+ * @return vibrant_NoError or vibrant_BackendError
+ */
+vibrant_errors vibrant_controller_remove_layer(vibrant_controller *controller,
+                                               const char *name);
+
+/**
+ * Returns the file descriptor of the X connection of instance, to be polled
+ * for readability by event loops, or -1 if instance has no connection (mock
+ * instances). Call vibrant_instance_dispatch whenever it becomes readable.
+ * Other calls on instance talk to the X server and may move events into the
+ * queue of Xlib, where polling can't see them, so dispatch again before
+ * polling after them. vibrant_instance_dispatch only returns once that queue
+ * is empty.
+ * @param instance
+ */
+int vibrant_instance_get_fd(vibrant_instance *instance);
+
+/**
+ * Enables (enabled != 0) or disables the watchdog of instance. While enabled,
+ * the state every controller was last set to through instance is tracked.
+ * Outputs that lose it, e.g. because the driver reset the CTM on a modeset,
+ * VT switch or DPMS wake, are put back by vibrant_instance_dispatch.
+ * Enabling takes the current state of every output as intended state.
+ * @param instance
+ * @param enabled
+ * @return vibrant_NoError or vibrant_BackendError if the current state of an
+ * output could not be read
+ */
+vibrant_errors vibrant_instance_set_watchdog(vibrant_instance *instance,
+                                             int enabled);
+
+/**
+ * Same as vibrant_controller_set_saturation, but only sends the request
+ * without waiting for the X server to process it. Completion is tracked by
+ * fence, which can be polled, waited on or given a callback. Errors are
+ * recorded by an X error handler the library installs while requests are
+ * in flight, they reach neither stdout nor the default handler.
+ * @param controller
+ * @param saturation
+ * @param fence receives the fence, free it with vibrant_fence_free
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BackendError if the
+ * request could not be sent at all
+ */
+vibrant_errors
+vibrant_controller_set_saturation_async(vibrant_controller *controller,
+                                        double saturation,
+                                        vibrant_fence **fence);
+
+/**
+ * Checks whether the request of fence was processed, without blocking.
+ * @param fence
+ * @return the status of fence
+ */
+vibrant_fence_status vibrant_fence_poll(vibrant_fence *fence);
+
+/**
+ * Waits for the request of fence to be processed.
+ * @param fence
+ * @param timeout_ms maximum time to wait, negative to wait indefinitely
+ * @return the status of fence, vibrant_FencePending if the time ran out
+ */
+vibrant_fence_status vibrant_fence_wait(vibrant_fence *fence, int timeout_ms);
+
+/**
+ * Sets the function called once fence completes. Completion is noticed by
+ * vibrant_fence_poll, vibrant_fence_wait and vibrant_instance_dispatch. If
+ * fence already completed, fn is called right away.
+ * @param fence
+ * @param fn
+ * @param user_data passed to fn
+ */
+void vibrant_fence_set_callback(vibrant_fence *fence, vibrant_fence_fn fn,
+                                void *user_data);
+
+/**
+ * Frees fence. Its request is still applied if it was not processed yet.
+ * Fences may outlive their instance, they fail once it is freed.
+ * @param fence
+ */
+void vibrant_fence_free(vibrant_fence **fence);
+
+/**
+ * Sets the function called by vibrant_instance_dispatch for every change of
+ * the saturation of an output, no matter who made it, and for outputs being
+ * connected or disconnected. Changes are detected through RandR and
+ * NV-CONTROL events, nothing is polled. Changes of gamma ramps are not
+ * announced by the X server and go unnoticed. Pass NULL as fn to stop
+ * listening.
+ * @param instance
+ * @param fn
+ * @param user_data passed to fn
+ * @return vibrant_NoError or vibrant_BackendError
+ */
+vibrant_errors vibrant_instance_set_change_listener(vibrant_instance *instance,
+                                                    vibrant_change_fn fn,
+                                                    void *user_data);
+
+/**
+ * Processes all pending events of instance without blocking. Changes are
+ * reported to the change listener first. Requests other clients sent for
+ * leased outputs are applied next, see vibrant_instance_set_lease_listener.
+ * If the watchdog is enabled, outputs affected by CRTC, output or CTM
+ * property changes are checked and those that drifted are re-applied in a
+ * single transaction.
+ * @param instance
+ * @param result may be NULL, see vibrant_transaction_commit. Outputs that
+ * were checked but still had their intended state count as unchanged.
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BackendError
+ */
+vibrant_errors vibrant_instance_dispatch(vibrant_instance *instance,
+                                         vibrant_transaction_result *result);
+
+/**
+ * Publishes the state of every controller of instance in a shared memory
+ * page called name (see shm_open(3)), e.g. "/vibrant-status". Every change
+ * made through instance updates the page, so other processes can read the
+ * current state with vibrant_status_open and vibrant_status_read without
+ * talking to the X server. The page is removed when instance is freed.
+ * Publishing again under the same name replaces the page of instance.
+ * A page left behind by a publisher that died is replaced, its pid is
+ * stored in the page, so publishers have to share a pid namespace.
+ * @param instance
+ * @param name
+ * @return vibrant_NoError, vibrant_IOError, also if the publisher of another
+ * page called name is still running, vibrant_NoMem or vibrant_BackendError
+ * if the current state of an output could not be read
+ */
+vibrant_errors vibrant_instance_publish_status(vibrant_instance *instance,
+                                               const char *name);
+
+/**
+ * Opens the status page called name for reading.
+ * @param name see vibrant_instance_publish_status
+ * @param status
+ * @return vibrant_NoError, vibrant_NoMem, vibrant_IOError if there is no
+ * such page or vibrant_BadFile if it is not a status page
+ */
+vibrant_errors vibrant_status_open(const char *name, vibrant_status **status);
+
+/**
+ * Closes a status page opened by vibrant_status_open.
+ * @param status
+ */
+void vibrant_status_close(vibrant_status **status);
+
+/**
+ * Copies a consistent snapshot of the published state. Never blocks the
+ * publisher, only retries while an update is in progress.
+ * @param status
+ * @param entries receives up to capacity entries
+ * @param capacity
+ * @param length total number of published outputs, may exceed capacity
+ * @param generation may be NULL, receives a counter that is incremented on
+ * every change of the page
+ */
+void vibrant_status_read(vibrant_status *status, vibrant_status_entry *entries,
+                         size_t capacity, size_t *length,
+                         unsigned long long *generation);
+
+/**
+ * Returns the memfd holding the export page of instance, or -1 if it was not
+ * created with vibrant_BackendExport. Hand it to the compositor, e.g. over a
+ * UNIX socket, and let it open the page with vibrant_export_open. The
+ * descriptor stays owned by instance.
+ * @param instance
+ */
+int vibrant_instance_get_export_fd(vibrant_instance *instance);
+
+/**
+ * Returns the eventfd (see eventfd(2)) instance signals after every change
+ * of its export page, or -1 if it was not created with
+ * vibrant_BackendExport. It becomes readable once a matrix changed, reading
+ * it resets it. The descriptor stays owned by instance.
+ * @param instance
+ */
+int vibrant_instance_get_export_event_fd(vibrant_instance *instance);
+
+/**
+ * Maps the export page in fd for reading. fd is not consumed and may be
+ * closed afterwards.
+ * @param fd see vibrant_instance_get_export_fd
+ * @param exported
+ * @return vibrant_NoError, vibrant_NoMem, vibrant_IOError if fd can't be
+ * mapped or vibrant_BadFile if it holds no export page
+ */
+vibrant_errors vibrant_export_open(int fd, vibrant_export **exported);
+
+/**
+ * Unmaps an export page opened by vibrant_export_open.
+ * @param exported
+ */
+void vibrant_export_close(vibrant_export **exported);
+
+/**
+ * Copies a consistent snapshot of the exported matrices. Never blocks the
+ * publisher, only retries while an update is in progress.
+ * @param exported
+ * @param entries receives up to capacity entries
+ * @param capacity
+ * @param length total number of exported outputs, may exceed capacity
+ * @param generation may be NULL, receives a counter that is incremented on
+ * every change of the page
+ */
+void vibrant_export_read(vibrant_export *exported,
+                         vibrant_export_entry *entries, size_t capacity,
+                         size_t *length, unsigned long long *generation);
+
+/**
+ * Converts a saturation into the color matrix vibrant_controller_set_saturation
+ * programs, for vibrant_apply_matrix_rgba and vibrant_controller_set_layer.
+ * @param saturation clamped to [0.0, 4.0]
+ * @param matrix receives the row-major 3x3 matrix
+ */
+void vibrant_saturation_to_matrix(double saturation, double matrix[9]);
+
+/**
+ * Applies a color matrix to pixels in place, in software, e.g. to preview
+ * profiles or verify them where no display hardware applies the CTM. The
+ * matrix is quantized to the S31.32 CTM sent to the driver and applied
+ * exactly, rounding every channel half up. Display engines may apply the CTM
+ * at a lower precision of their own, so the result can differ from the
+ * panel by one step. Alpha is left alone.
+ * @param matrix row-major 3x3 matrix
+ * @param format
+ * @param pixels
+ * @param width
+ * @param height
+ * @param stride distance between rows in bytes
+ * @param threads number of threads to split the rows across, 0 or 1 to only
+ * use the calling thread
+ * @return vibrant_NoError
+ */
+vibrant_errors vibrant_apply_matrix_rgba(const double matrix[9],
+                                         vibrant_pixel_format format,
+                                         unsigned char *pixels, size_t width,
+                                         size_t height, size_t stride,
+                                         unsigned threads);
+
+/**
+ * Reads the color matrix controller currently applies. NV-CONTROL outputs
+ * report the saturation matrix matching their digital vibrance.
+ * @param controller
+ * @param matrix receives the row-major 3x3 matrix
+ * @return vibrant_NoError or vibrant_BackendError
+ */
+vibrant_errors vibrant_controller_get_matrix(vibrant_controller *controller,
+                                             double matrix[9]);
+
+/**
+ * Bakes matrix, followed by a power curve, into a 3D LUT. Entries are RGB
+ * triplets with red changing fastest, then green, then blue. The matrix is
+ * quantized to the S31.32 CTM sent to the driver, like
+ * vibrant_apply_matrix_rgba does.
+ * @param matrix row-major 3x3 matrix
+ * @param gamma every channel v becomes v^(1/gamma) after the matrix, 1.0
+ * leaves them alone
+ * @param size points per axis, typically 17, 33 or 65
+ * @param lut receives size^3 * 3 floats
+ * @param threads number of threads to generate with, 0 or 1 to only use the
+ * calling thread
+ * @return vibrant_NoError or vibrant_InvalidArgument if size is not within
+ * [VIBRANT_LUT_SIZE_MIN, VIBRANT_LUT_SIZE_MAX] or gamma is not positive
+ */
+vibrant_errors vibrant_lut_generate(const double matrix[9], double gamma,
+                                    size_t size, float *lut, unsigned threads);
+
+/**
+ * Generates a 3D LUT like vibrant_lut_generate and writes it to path. The
+ * file is replaced atomically.
+ * @param matrix
+ * @param gamma
+ * @param size
+ * @param format
+ * @param path
+ * @param threads
+ * @return vibrant_NoError, vibrant_InvalidArgument, vibrant_NoMem or
+ * vibrant_IOError
+ */
+vibrant_errors vibrant_lut_export(const double matrix[9], double gamma,
+                                  size_t size, vibrant_lut_format format,
+                                  const char *path, unsigned threads);
+
+/**
+ * Computes content metrics of a frame of 32-bit XRGB little-endian pixels,
+ * the format of 24 and 32 bit deep X images on little-endian machines. Only
+ * every step-th row and every step-th span of 8 pixels is sampled.
+ * @param pixels
+ * @param width must be below 32768
+ * @param height
+ * @param stride distance between rows in bytes
+ * @param step 1 samples every pixel
+ * @param metrics
+ */
+void vibrant_frame_analyze(const unsigned char *pixels, size_t width,
+                           size_t height, size_t stride, unsigned step,
+                           vibrant_frame_metrics *metrics);
+
+/**
+ * Creates an adaptive vibrance controller for controller. Each step analyzes
+ * the content shown on the output and moves its saturation smoothly towards
+ * a goal: dull content is boosted, content that already has many strongly
+ * saturated pixels is left at 1.0 at most.
+ * @param controller
+ * @param options may be NULL for defaults
+ * @param adaptive
+ * @return vibrant_NoError or vibrant_NoMem
+ */
+vibrant_errors vibrant_adaptive_new(vibrant_controller *controller,
+                                    const vibrant_adaptive_options *options,
+                                    vibrant_adaptive **adaptive);
+
+/**
+ * Frees adaptive and its capture resources. The saturation is left as is.
+ * @param adaptive
+ */
+void vibrant_adaptive_free(vibrant_adaptive **adaptive);
+
+/**
+ * Captures the CRTC region of the output through MIT-SHM and feeds it to
+ * vibrant_adaptive_feed. Call this periodically, e.g. a few times a second.
+ * @param adaptive
+ * @param saturation may be NULL, receives the saturation after the step
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BackendError if the
+ * output is off, can't be captured, e.g. on remote displays or with more than
+ * 8 bits per channel, or the new saturation could not be written
+ */
+vibrant_errors vibrant_adaptive_step(vibrant_adaptive *adaptive,
+                                     double *saturation);
+
+/**
+ * Runs one step of adaptive on a frame provided by the caller instead of a
+ * capture, for synthetic frames and other capture mechanisms. See
+ * vibrant_frame_analyze for the pixel format.
+ * @param adaptive
+ * @param pixels
+ * @param width
+ * @param height
+ * @param stride
+ * @param saturation may be NULL, receives the saturation after the step
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BackendError if the new
+ * saturation could not be written, the next step tries again
+ */
+vibrant_errors vibrant_adaptive_feed(vibrant_adaptive *adaptive,
+                                     const unsigned char *pixels, size_t width,
+                                     size_t height, size_t stride,
+                                     double *saturation);
+
+/**
+ * Creates a schedule switching the outputs of instance between profiles by
+ * time of day and power state. Each output follows the matching rule that
+ * took effect last, wrapping around midnight; among rules with the same
+ * start the later one in rules wins. Outputs without a matching rule are
+ * left alone.
+ *
+ * The schedule sleeps on a single timer until the next transition and is
+ * woken by power supply changes and clock jumps, it never wakes up
+ * periodically while idle. Nothing is applied before the first call of
+ * vibrant_schedule_dispatch, the fd is readable right away for that.
+ * @param instance must outlive the schedule
+ * @param rules copied, including the output names
+ * @param rules_size
+ * @param transition_ms duration of the fade between two profiles, 0 to
+ * switch at once
+ * @param schedule
+ * @return vibrant_NoError, vibrant_NoMem, vibrant_IOError if the timer could
+ * not be created or vibrant_InvalidArgument if a rule is out of range or
+ * names an output instance doesn't have
+ */
+vibrant_errors vibrant_schedule_new(vibrant_instance *instance,
+                                    const vibrant_schedule_rule *rules,
+                                    size_t rules_size, unsigned transition_ms,
+                                    vibrant_schedule **schedule);
+
+/**
+ * Frees schedule. The saturation of every output is left as is.
+ * @param schedule
+ */
+void vibrant_schedule_free(vibrant_schedule **schedule);
+
+/**
+ * Returns a file descriptor to be polled for readability by event loops.
+ * Call vibrant_schedule_dispatch whenever it becomes readable.
+ * @param schedule
+ */
+int vibrant_schedule_get_fd(vibrant_schedule *schedule);
+
+/**
+ * Handles pending timer and power supply events without blocking. Outputs
+ * whose profile changed are written in a single transaction, or one per
+ * step while a transition is running.
+ * @param schedule
+ * @param result may be NULL, see vibrant_transaction_commit
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BackendError
+ */
+vibrant_errors vibrant_schedule_dispatch(vibrant_schedule *schedule,
+                                         vibrant_transaction_result *result);
+
+/**
+ * Loads the rules in the configuration file at path and watches it for
+ * changes. The file consists of lines of the form OUTPUT = SATURATION, where
+ * OUTPUT is a name or id (see vibrant_instance_find_controller) or * for
+ * every output. Named outputs take precedence over *. Lines following a
+ * [CLASS] header only apply while an application with the WM_CLASS class
+ * CLASS (compared case-insensitively) is focused and fall back to the
+ * lines before the first header. Everything after # is a comment, outputs
+ * that are not connected are ignored.
+ *
+ * Nothing is applied before vibrant_config_set_application is called.
+ * @param instance must outlive the config
+ * @param path
+ * @param config
+ * @param error_line may be NULL, receives the line of the first invalid
+ * line if vibrant_BadFile is returned
+ * @return vibrant_NoError, vibrant_NoMem, vibrant_IOError if the file could
+ * not be read or watched, or vibrant_BadFile
+ */
+vibrant_errors vibrant_config_new(vibrant_instance *instance, const char *path,
+                                  vibrant_config **config, size_t *error_line);
+
+/**
+ * Frees config and stops watching its file. The saturation of every output
+ * is left as is.
+ * @param config
+ */
+void vibrant_config_free(vibrant_config **config);
+
+/**
+ * Returns a file descriptor to be polled for readability by event loops.
+ * Call vibrant_config_dispatch whenever it becomes readable.
+ * @param config
+ */
+int vibrant_config_get_fd(vibrant_config *config);
+
+/**
+ * Handles pending changes of the configuration file without blocking. If it
+ * was written or replaced, it is loaded again and the outputs whose
+ * effective saturation changed are written in a single transaction. If the
+ * new file is invalid the previous rules stay in effect.
+ * @param config
+ * @param result may be NULL, see vibrant_transaction_commit
+ * @return vibrant_NoError, vibrant_NoMem, vibrant_BackendError,
+ * vibrant_IOError or vibrant_BadFile, see vibrant_config_get_error_line
+ */
+vibrant_errors vibrant_config_dispatch(vibrant_config *config,
+                                       vibrant_transaction_result *result);
+
+/**
+ * Switches to the rules of the focused application and writes the outputs
+ * whose effective saturation changed in a single transaction. Outputs
+ * without a matching rule are left alone.
+ * @param config
+ * @param application WM_CLASS class of the focused window, NULL if none
+ * @param result may be NULL, see vibrant_transaction_commit
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BackendError
+ */
+vibrant_errors
+vibrant_config_set_application(vibrant_config *config, const char *application,
+                               vibrant_transaction_result *result);
+
+/**
+ * Returns the line of the first invalid line found by the last failed
+ * reload, 0 if the last load succeeded.
+ * @param config
+ */
+size_t vibrant_config_get_error_line(vibrant_config *config);
+
+/**
+ * Opens an instance for every display in display_names and multiplexes their
+ * connections in one epoll set, so a single thread can drive all of them.
+ * @param pool
+ * @param display_names
+ * @param display_names_size
+ * @return vibrant_NoError, vibrant_NoMem, vibrant_IOError if the epoll set
+ * could not be created or the error of the first instance that could not be
+ * created
+ */
+vibrant_errors vibrant_pool_new(vibrant_pool **pool,
+                                const char *const *display_names,
+                                size_t display_names_size);
+
+/**
+ * Same as vibrant_pool_new, with options applying to every instance.
+ * @param pool
+ * @param display_names
+ * @param display_names_size
+ * @param options may be NULL
+ */
+vibrant_errors
+vibrant_pool_new_with_options(vibrant_pool **pool,
+                              const char *const *display_names,
+                              size_t display_names_size,
+                              const vibrant_instance_options *options);
+
+/**
+ * Frees pool and all its instances.
+ * @param pool
+ */
+void vibrant_pool_free(vibrant_pool **pool);
+
+/**
+ * Returns the number of displays of pool.
+ * @param pool
+ */
+size_t vibrant_pool_get_size(vibrant_pool *pool);
+
+/**
+ * Returns the instance of the display at index, or NULL if index is out of
+ * range. The instance is owned by pool.
+ * @param pool
+ * @param index
+ */
+vibrant_instance *vibrant_pool_get_instance(vibrant_pool *pool, size_t index);
+
+/**
+ * Returns the epoll file descriptor of pool, to be polled for readability by
+ * event loops. Call vibrant_pool_dispatch whenever it becomes readable.
+ * @param pool
+ */
+int vibrant_pool_get_fd(vibrant_pool *pool);
+
+/**
+ * Calls vibrant_instance_dispatch for every display with pending events,
+ * without blocking.
+ * @param pool
+ * @param result may be NULL, receives the sum of the results of every
+ * display, see vibrant_instance_dispatch
+ * @return vibrant_NoError or the first error of a display
+ */
+vibrant_errors vibrant_pool_dispatch(vibrant_pool *pool,
+                                     vibrant_transaction_result *result);
+
+/**
+ * Applies commands across the displays of pool concurrently. The writes of
+ * every display are sent without waiting for a reply, then the pool waits
+ * on all connections at once until every display processed its writes, so
+ * a batch takes about as long as its slowest display rather than the sum of
+ * all of them. Writes are independent of each other, a failed write is not
+ * rolled back. Events of other displays arriving meanwhile are dispatched.
+ * @param pool
+ * @param commands
+ * @param commands_size
+ * @param timeout_ms maximum time to wait, negative to wait indefinitely.
+ * Writes that did not complete in time count as failed but are still
+ * applied by the server.
+ * @param result may be NULL. failed counts the writes that failed or timed
+ * out, apply_time_ns is the duration of the whole batch
+ * @return vibrant_NoError, vibrant_NoMem, vibrant_InvalidArgument if a
+ * display or output does not exist, nothing is sent in that case, or
+ * vibrant_BackendError if a write could not be sent
+ */
+vibrant_errors vibrant_pool_apply(vibrant_pool *pool,
+                                  const vibrant_pool_command *commands,
+                                  size_t commands_size, int timeout_ms,
+                                  vibrant_transaction_result *result);
+
+/**
+ * Sets stats to the latency statistics of the display at index.
+ * @param pool
+ * @param index
+ * @param stats
+ * @return vibrant_NoError or vibrant_InvalidArgument if index is out of range
+ */
+vibrant_errors vibrant_pool_get_stats(vibrant_pool *pool, size_t index,
+                                      vibrant_pool_stats *stats);
+
+/**
+ * Takes the lease of the output of controller, announcing to other clients
+ * of the X server that this instance writes its color state. Leases are
+ * cooperative: other clients that go through
+ * vibrant_controller_request_saturation hand their changes to the holder
+ * instead of writing themselves, so two tools don't keep overwriting each
+ * other. Leases are X selections, they end when the holder releases them,
+ * another client takes them over or the connection closes. Instances
+ * without an X connection always get the lease.
+ * @param controller
+ * @param force non-zero to take the lease even if another client holds it.
+ * The holder is notified with vibrant_LeaseLost
+ * @return vibrant_NoError, vibrant_LeaseHeld if another client holds the
+ * lease and force is 0, or vibrant_BackendError
+ */
+vibrant_errors vibrant_controller_acquire_lease(vibrant_controller *controller,
+                                                int force);
+
+/**
+ * Gives up the lease of the output of controller, if this instance holds it.
+ * @param controller
+ */
+void vibrant_controller_release_lease(vibrant_controller *controller);
+
+/**
+ * Returns 1 if this instance holds the lease of the output of controller,
+ * 0 otherwise. Losing the lease is noticed by vibrant_instance_dispatch.
+ * @param controller
+ */
+int vibrant_controller_has_lease(vibrant_controller *controller);
+
+/**
+ * Cooperative variant of vibrant_controller_set_saturation. If another
+ * client holds the lease of the output, the change is sent to it and it
+ * decides whether to apply it, nothing is written here. Otherwise the
+ * saturation is applied directly, skipping the write if the output already
+ * has it.
+ * @param controller
+ * @param saturation see vibrant_controller_set_saturation
+ * @return vibrant_NoError if the saturation was applied or handed to the
+ * holder, vibrant_NoMem or vibrant_BackendError
+ */
+vibrant_errors
+vibrant_controller_request_saturation(vibrant_controller *controller,
+                                      double saturation);
+
+/**
+ * Sets the function called by vibrant_instance_dispatch when this instance
+ * loses a lease or receives a request for an output it holds. Without a
+ * listener, requests are applied as they arrive. With one, they are only
+ * reported and the listener decides. Pass NULL as fn to go back to applying
+ * requests.
+ * @param instance
+ * @param fn
+ * @param user_data passed to fn
+ */
+void vibrant_instance_set_lease_listener(vibrant_instance *instance,
+                                         vibrant_lease_fn fn,
+                                         void *user_data);
+
+/**
+ * Copies the log of every request a mock instance received, in the order
+ * they were received. Instances using other backends always report an empty
+ * log.
+ * @param instance
+ * @param requests receives the copy, to be released with free(3), or NULL if
+ * the log is empty
+ * @param length
+ * @return vibrant_NoError or vibrant_NoMem
+ */
+vibrant_errors vibrant_mock_get_requests(vibrant_instance *instance,
+                                         vibrant_mock_request **requests,
+                                         size_t *length);
+
+/**
+ * Empties the request log of a mock instance.
+ * @param instance
+ */
+void vibrant_mock_clear_requests(vibrant_instance *instance);
+
+/**
+ * Makes every following request to controller fail (fail != 0) or succeed
+ * again (fail == 0). Only has an effect on controllers of mock instances.
+ * @param controller
+ * @param fail
+ */
+void vibrant_mock_set_failing(vibrant_controller *controller, int fail);
+
+/**
+ * Simulates a driver that drops the color state of controller, e.g. on a
+ * modeset, and notifies the instance like the X server would. Only has an
+ * effect on controllers of mock instances.
+ * @param controller
+ */
+void vibrant_mock_reset_output(vibrant_controller *controller);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -0,0 +1,476 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// C++20 interface to libvibrant. Everything here is inline, link against
+// libvibrant as usual.
+
+#ifndef LIBVIBRANT_VIBRANT_HPP
+#define LIBVIBRANT_VIBRANT_HPP
+
+#include "vibrant/vibrant.h"
+
+#include <algorithm>
+#include <array>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+namespace vibrant {
+
+// row-major 3x3 color matrix
+using matrix = std::array<double, 9>;
+
+// contents of struct drm_color_ctm: S31.32 sign-magnitude coefficients, ready
+// to be sent as the blob of a DRM CTM property
+using drm_ctm = std::array<std::uint64_t, 9>;
+
+// drm_ctm as the RandR CTM property stores it, every coefficient split into
+// its low and high 32 bits. See ctm_set_ctm()
+using padded_ctm = std::array<long, 18>;
+
+/*
+ * Compile-time versions of the conversions in src/util.c, yielding the same
+ * bits, so presets can be baked into constants:
+ *
+ *   constexpr auto vivid = vibrant::saturation_to_ctm(1.5);
+ */
+
+/**
+ * Clamp saturation to the range the library accepts.
+ */
+constexpr double clamp_saturation(double saturation) {
+  return std::clamp(saturation, VIBRANT_SATURATION_MIN,
+                    VIBRANT_SATURATION_MAX);
+}
+
+/**
+ * Uniform saturation matrix, see vibrant_SaturationUniform. saturation is
+ * not clamped.
+ */
+constexpr matrix saturation_to_coeffs(double saturation) {
+  matrix coeffs{};
+  double coeff = (1.0 - saturation) / 3.0;
+  for (std::size_t i = 0; i < 9; i++) {
+    coeffs[i] = coeff + (i % 4 == 0 ? saturation : 0);
+  }
+  return coeffs;
+}
+
+/**
+ * Saturation of a matrix built by saturation_to_coeffs or a panel profile.
+ */
+constexpr double coeffs_to_saturation(const matrix &coeffs) {
+  return coeffs[0] - coeffs[3];
+}
+
+constexpr drm_ctm coeffs_to_ctm(const matrix &coeffs) {
+  constexpr double one = 4294967296.0; // 1 << 32
+  constexpr std::uint64_t sign = 1ull << 63u;
+
+  drm_ctm ctm{};
+  for (std::size_t i = 0; i < 9; i++) {
+    if (coeffs[i] < 0) {
+      ctm[i] = static_cast<std::uint64_t>(
+                   static_cast<std::int64_t>(-coeffs[i] * one)) |
+               sign;
+    } else {
+      ctm[i] = static_cast<std::uint64_t>(
+          static_cast<std::int64_t>(coeffs[i] * one));
+    }
+  }
+  return ctm;
+}
+
+constexpr matrix ctm_to_coeffs(const drm_ctm &ctm) {
+  constexpr std::uint64_t sign = 1ull << 63u;
+
+  matrix coeffs{};
+  for (std::size_t i = 0; i < 9; i++) {
+    coeffs[i] = (ctm[i] & ~sign) / 4294967296.0;
+    if (ctm[i] & sign) {
+      coeffs[i] *= -1;
+    }
+  }
+  return coeffs;
+}
+
+constexpr padded_ctm ctm_to_padded_ctm(const drm_ctm &ctm) {
+  padded_ctm padded{};
+  for (std::size_t i = 0; i < 9; i++) {
+    padded[2 * i] = static_cast<long>(ctm[i] & 0xffffffffu);
+    padded[2 * i + 1] = static_cast<long>(ctm[i] >> 32u);
+  }
+  return padded;
+}
+
+constexpr drm_ctm padded_ctm_to_ctm(const padded_ctm &padded) {
+  drm_ctm ctm{};
+  for (std::size_t i = 0; i < 9; i++) {
+    ctm[i] = static_cast<std::uint32_t>(padded[2 * i + 1]);
+    ctm[i] = ctm[i] << 32u | static_cast<std::uint32_t>(padded[2 * i]);
+  }
+  return ctm;
+}
+
+/**
+ * DRM CTM blob for saturation, like the DRM backend writes it. saturation is
+ * clamped.
+ */
+constexpr drm_ctm saturation_to_ctm(double saturation) {
+  return coeffs_to_ctm(saturation_to_coeffs(clamp_saturation(saturation)));
+}
+
+/**
+ * RandR CTM property for saturation, like the CTM backend writes it.
+ * saturation is clamped.
+ */
+constexpr padded_ctm saturation_to_padded_ctm(double saturation) {
+  return ctm_to_padded_ctm(saturation_to_ctm(saturation));
+}
+
+/**
+ * Thrown for every vibrant_errors other than vibrant_NoError.
+ */
+class error : public std::runtime_error {
+public:
+  explicit error(vibrant_errors code)
+      : std::runtime_error(describe(code)), code_(code) {}
+
+  vibrant_errors code() const noexcept { return code_; }
+
+  static const char *describe(vibrant_errors code) noexcept {
+    switch (code) {
+    case vibrant_NoError:
+      return "no error";
+    case vibrant_ConnectToX:
+      return "could not connect to the display server";
+    case vibrant_NoMem:
+      return "out of memory";
+    case vibrant_BackendError:
+      return "an output rejected a request";
+    case vibrant_IOError:
+      return "file could not be accessed";
+    case vibrant_BadFile:
+      return "file is invalid or unsupported";
+    case vibrant_InvalidArgument:
+      return "invalid argument";
+    case vibrant_LeaseHeld:
+      return "another client holds the lease of the output";
+    }
+    return "unknown error";
+  }
+
+private:
+  vibrant_errors code_;
+};
+
+inline void check(vibrant_errors code) {
+  if (code != vibrant_NoError) {
+    throw error(code);
+  }
+}
+
+/**
+ * Non-owning handle of a controller. Controllers belong to their instance,
+ * handles are as cheap as the pointer they hold and stay valid until the
+ * instance is freed.
+ */
+class controller {
+public:
+  explicit controller(vibrant_controller *native) noexcept : native_(native) {}
+
+  vibrant_controller *native() const noexcept { return native_; }
+
+  std::string_view name() const noexcept {
+    return {native_->info->name,
+            static_cast<std::size_t>(native_->info->nameLen)};
+  }
+
+  unsigned long long id() const noexcept {
+    return vibrant_controller_get_id(native_);
+  }
+
+  std::string_view backend_name() const noexcept {
+    return vibrant_controller_get_backend_name(native_);
+  }
+
+  double saturation() const noexcept {
+    return vibrant_controller_get_saturation(native_);
+  }
+
+  void set_saturation(double saturation) const noexcept {
+    vibrant_controller_set_saturation(native_, saturation);
+  }
+
+  void set_saturation_model(vibrant_saturation_model model) const {
+    check(vibrant_controller_set_saturation_model(native_, model));
+  }
+
+  matrix get_matrix() const {
+    matrix coeffs;
+    check(vibrant_controller_get_matrix(native_, coeffs.data()));
+    return coeffs;
+  }
+
+  void set_layer(const char *name, int priority, const matrix &coeffs) const {
+    check(vibrant_controller_set_layer(native_, name, priority, coeffs.data()));
+  }
+
+  void set_layer_saturation(const char *name, int priority,
+                            double saturation) const {
+    check(vibrant_controller_set_layer_saturation(native_, name, priority,
+                                                  saturation));
+  }
+
+  void remove_layer(const char *name) const {
+    check(vibrant_controller_remove_layer(native_, name));
+  }
+
+  friend bool operator==(controller a, controller b) noexcept {
+    return a.native_ == b.native_;
+  }
+
+private:
+  vibrant_controller *native_;
+};
+
+/**
+ * Zero-copy view over the controller array of an instance, yielding
+ * controller handles.
+ */
+class controller_view {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = controller;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = controller;
+
+    iterator() noexcept = default;
+    explicit iterator(vibrant_controller *position) noexcept
+        : position_(position) {}
+
+    controller operator*() const noexcept { return controller(position_); }
+    controller operator[](difference_type n) const noexcept {
+      return controller(position_ + n);
+    }
+
+    iterator &operator++() noexcept {
+      ++position_;
+      return *this;
+    }
+    iterator operator++(int) noexcept { return iterator(position_++); }
+    iterator &operator--() noexcept {
+      --position_;
+      return *this;
+    }
+    iterator operator--(int) noexcept { return iterator(position_--); }
+    iterator &operator+=(difference_type n) noexcept {
+      position_ += n;
+      return *this;
+    }
+    iterator &operator-=(difference_type n) noexcept {
+      position_ -= n;
+      return *this;
+    }
+
+    friend iterator operator+(iterator it, difference_type n) noexcept {
+      return it += n;
+    }
+    friend iterator operator+(difference_type n, iterator it) noexcept {
+      return it += n;
+    }
+    friend iterator operator-(iterator it, difference_type n) noexcept {
+      return it -= n;
+    }
+    friend difference_type operator-(iterator a, iterator b) noexcept {
+      return a.position_ - b.position_;
+    }
+    friend auto operator<=>(iterator a, iterator b) noexcept = default;
+
+  private:
+    vibrant_controller *position_ = nullptr;
+  };
+
+  explicit controller_view(std::span<vibrant_controller> native) noexcept
+      : native_(native) {}
+
+  std::span<vibrant_controller> native() const noexcept { return native_; }
+
+  iterator begin() const noexcept { return iterator(native_.data()); }
+  iterator end() const noexcept {
+    return iterator(native_.data() + native_.size());
+  }
+  std::size_t size() const noexcept { return native_.size(); }
+  bool empty() const noexcept { return native_.empty(); }
+  controller operator[](std::size_t index) const noexcept {
+    return controller(native_.data() + index);
+  }
+
+private:
+  std::span<vibrant_controller> native_;
+};
+
+/**
+ * Owning handle of a vibrant_instance, freed on destruction. Move-only.
+ */
+class instance {
+public:
+  /**
+   * Connect to the X server display_name, see vibrant_instance_new.
+   */
+  explicit instance(const char *display_name = nullptr) {
+    check(vibrant_instance_new(&native_, display_name));
+  }
+
+  /**
+   * See vibrant_instance_new_with_options.
+   */
+  instance(const char *display_name, const vibrant_instance_options &options) {
+    check(vibrant_instance_new_with_options(&native_, display_name, &options));
+  }
+
+  instance(const instance &) = delete;
+  instance &operator=(const instance &) = delete;
+
+  instance(instance &&other) noexcept
+      : native_(std::exchange(other.native_, nullptr)) {}
+
+  instance &operator=(instance &&other) noexcept {
+    if (this != &other) {
+      reset();
+      native_ = std::exchange(other.native_, nullptr);
+    }
+    return *this;
+  }
+
+  ~instance() { reset(); }
+
+  // NULL once moved from
+  vibrant_instance *native() const noexcept { return native_; }
+
+  std::span<vibrant_controller> native_controllers() const noexcept {
+    vibrant_controller *controllers;
+    std::size_t length;
+    vibrant_instance_get_controllers(native_, &controllers, &length);
+    return {controllers, length};
+  }
+
+  controller_view controllers() const noexcept {
+    return controller_view(native_controllers());
+  }
+
+  /**
+   * Find a controller by output name or id, see
+   * vibrant_instance_find_controller.
+   */
+  std::optional<controller> find(const char *name_or_id) const noexcept {
+    vibrant_controller *found =
+        vibrant_instance_find_controller(native_, name_or_id);
+    if (found == nullptr) {
+      return std::nullopt;
+    }
+    return controller(found);
+  }
+
+  int fd() const noexcept { return vibrant_instance_get_fd(native_); }
+
+  vibrant_transaction_result dispatch() const {
+    vibrant_transaction_result result{};
+    check(vibrant_instance_dispatch(native_, &result));
+    return result;
+  }
+
+private:
+  void reset() noexcept {
+    if (native_ != nullptr) {
+      vibrant_instance_free(&native_);
+      native_ = nullptr;
+    }
+  }
+
+  vibrant_instance *native_ = nullptr;
+};
+
+/**
+ * Owning handle of a vibrant_transaction, freed on destruction. Move-only.
+ */
+class transaction {
+public:
+  explicit transaction(const instance &owner) {
+    check(vibrant_transaction_new(owner.native(), &native_));
+  }
+
+  transaction(const transaction &) = delete;
+  transaction &operator=(const transaction &) = delete;
+
+  transaction(transaction &&other) noexcept
+      : native_(std::exchange(other.native_, nullptr)) {}
+
+  transaction &operator=(transaction &&other) noexcept {
+    if (this != &other) {
+      reset();
+      native_ = std::exchange(other.native_, nullptr);
+    }
+    return *this;
+  }
+
+  ~transaction() { reset(); }
+
+  // NULL once moved from
+  vibrant_transaction *native() const noexcept { return native_; }
+
+  transaction &set_saturation(controller target, double saturation) {
+    check(vibrant_transaction_set_saturation(native_, target.native(),
+                                             saturation));
+    return *this;
+  }
+
+  /**
+   * Apply all changes, see vibrant_transaction_commit. A rolled back
+   * transaction is not an error, check result.rolled_back instead.
+   */
+  vibrant_transaction_result commit() {
+    vibrant_transaction_result result{};
+    vibrant_transaction_commit(native_, &result);
+    return result;
+  }
+
+private:
+  void reset() noexcept {
+    if (native_ != nullptr) {
+      vibrant_transaction_free(&native_);
+      native_ = nullptr;
+    }
+  }
+
+  vibrant_transaction *native_ = nullptr;
+};
+
+} // namespace vibrant
+
+#endif // LIBVIBRANT_VIBRANT_HPP
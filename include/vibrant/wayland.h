@@ -0,0 +1,50 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_WAYLAND_H
+#define LIBVIBRANT_WAYLAND_H
+
+#include "vibrant/vibrant.h"
+
+/**
+ * Populate instance with the outputs of a Wayland compositor that implements
+ * wlr-gamma-control. instance must already be allocated, it is left untouched
+ * on failure.
+ *
+ * @param instance The instance to populate
+ * @param display_name Wayland display to connect to, NULL for the default
+ * @return vibrant_NoError, vibrant_NoMem, vibrant_ConnectToX or
+ * vibrant_BackendError, see vibrant_instance_new_with_options()
+ */
+vibrant_errors wayland_instance_new(vibrant_instance *instance,
+                                    const char *display_name);
+
+/**
+ * Free everything wayland_instance_new allocated and disconnect, which makes
+ * the compositor restore the gamma of every output. Does not free instance
+ * itself.
+ *
+ * @param instance The instance to clean up
+ */
+void wayland_instance_free(vibrant_instance *instance);
+
+#endif // LIBVIBRANT_WAYLAND_H
@@ -0,0 +1,89 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// user code should NOT include this header directly, just use the interfaces
+// provided through vibrant.h
+
+#ifndef LIBVIBRANT_XERROR_H
+#define LIBVIBRANT_XERROR_H
+
+#include <X11/Xlib.h>
+
+/*
+ * The library installs a single X error handler while it has requests in
+ * flight. It records the errors of the displays it was asked to watch by
+ * serial, and passes errors of other displays on to the handler that was
+ * installed before. Like Xlib error handlers this is process-wide, and it is
+ * not locked: only one thread at a time may send requests through it.
+ */
+
+/**
+ * Start recording X errors on dpy. Calls nest, every call must be matched
+ * by xerror_release.
+ *
+ * @param dpy The X Display
+ */
+void xerror_acquire(Display *dpy);
+
+/**
+ * Stop recording X errors on dpy once all users released it, and restore
+ * the previous error handler when no display is recorded anymore.
+ *
+ * @param dpy The X Display
+ */
+void xerror_release(Display *dpy);
+
+/**
+ * Find a recorded error of dpy for requests with serials in
+ * [first_serial, last_serial). Only the most recent errors are kept, make
+ * sure they have arrived, e.g. by XSync, and look them up soon after.
+ *
+ * @param dpy The X Display
+ * @param first_serial NextRequest() before the first request of interest
+ * @param last_serial NextRequest() after the last request of interest
+ * @return the X error code of the first error found, Success if none
+ */
+int xerror_find(Display *dpy, unsigned long first_serial,
+                unsigned long last_serial);
+
+/**
+ * Start recording X errors on dpy for a single synchronous operation.
+ * Traps don't nest.
+ *
+ * @param dpy The X Display
+ */
+void xerror_trap_push(Display *dpy);
+
+/**
+ * Stop recording for the current trap. Call XSync before this to make sure
+ * all errors have arrived.
+ */
+void xerror_trap_pop(void);
+
+/**
+ * Find an error recorded on the display of the current trap, see
+ * xerror_find.
+ *
+ * @param first_serial NextRequest() before the first request of interest
+ * @param last_serial NextRequest() after the last request of interest
+ * @return the X error code of the first error found, Success if none
+ */
+int xerror_trap_find(unsigned long first_serial, unsigned long last_serial);
+
+#endif // LIBVIBRANT_XERROR_H
@@ -3,8 +3,13 @@
   stdenv,
   cmake,
   libX11,
+  libXext,
   libXrandr,
   linuxPackages,
+  pkg-config,
+  systemd,
+  wayland,
+  wayland-scanner,
 }:
 
 stdenv.mkDerivation {
@@ -17,7 +22,9 @@ stdenv.mkDerivation {
       map (fileName: ../${fileName}) [
         "cli"
         "cmake"
+        "daemon"
         "include"
+        "protocol"
         "src"
         "CMakeLists.txt"
       ]
@@ -26,10 +33,22 @@ stdenv.mkDerivation {
 
   buildInputs = [
     libX11
+    libXext
     libXrandr
     linuxPackages.nvidia_x11.settings.libXNVCtrl
+    systemd
+    wayland
+  ];
+  nativeBuildInputs = [
+    cmake
+    pkg-config
+    wayland-scanner
+  ];
+
+  cmakeFlags = [
+    "-DVIBRANT_ENABLE_DBUS=ON"
+    "-DVIBRANT_ENABLE_WAYLAND=ON"
   ];
-  nativeBuildInputs = [ cmake ];
 
   meta = with lib; {
     description = "A simple library to adjust color saturation of X11 outputs";
@@ -0,0 +1,328 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/frame.h"
+#include "vibrant/internal.h"
+#include "vibrant/vibrant.h"
+#include "vibrant/xerror.h"
+
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <time.h>
+
+// sparsest sampling the CPU budget may push an analysis to
+#define ADAPTIVE_MAX_STEP 64u
+// saturation changes smaller than this are not written
+#define ADAPTIVE_MIN_CHANGE 0.01
+// share of pixels with chroma >= 192 above which content counts as vivid
+#define ADAPTIVE_VIVID_SHARE 0.05
+
+static const vibrant_adaptive_options adaptive_default_options = {
+    .min_saturation = 1.0,
+    .max_saturation = 2.0,
+    .target_colorfulness = 40.0,
+    .smoothing = 0.2,
+    .sample_step = 4,
+    .budget_us = 2000,
+};
+
+struct vibrant_adaptive {
+  vibrant_controller *controller;
+  vibrant_adaptive_options options;
+
+  // smoothed saturation and the value last written to the output
+  double saturation;
+  double written;
+  unsigned step;
+
+  // MIT-SHM capture buffer, reused while the CRTC size stays the same
+  XImage *image;
+  XShmSegmentInfo shm;
+};
+
+void vibrant_frame_analyze(const unsigned char *pixels, size_t width,
+                           size_t height, size_t stride, unsigned step,
+                           vibrant_frame_metrics *metrics) {
+  frame_accumulate_fn accumulate = frame_accumulate_best();
+  frame_sums sums;
+
+  memset(&sums, 0, sizeof(sums));
+  memset(metrics, 0, sizeof(vibrant_frame_metrics));
+  step = step > 0 ? step : 1;
+
+  for (size_t y = 0; y < height; y += step) {
+    accumulate(pixels + y * stride, width, step, &sums);
+  }
+
+  if (sums.count == 0) {
+    return;
+  }
+
+  double n = (double)sums.count;
+  double rg_mean = sums.rg / n;
+  // yb was summed doubled, see frame_sums
+  double yb_mean = sums.yb / n / 2.0;
+  double rg_var = fmax(sums.rg2 / n - rg_mean * rg_mean, 0.0);
+  double yb_var = fmax(sums.yb2 / n / 4.0 - yb_mean * yb_mean, 0.0);
+
+  metrics->colorfulness = sqrt(rg_var + yb_var) +
+                          0.3 * sqrt(rg_mean * rg_mean + yb_mean * yb_mean);
+  metrics->samples = sums.count;
+
+  uint64_t above = sums.count;
+  for (int i = 0; i < VIBRANT_FRAME_HISTOGRAM_SIZE; i++) {
+    uint64_t next = i < FRAME_CHROMA_THRESHOLDS ? sums.chroma_above[i] : 0;
+    metrics->chroma_histogram[i] = (above - next) / n;
+    above = next;
+  }
+}
+
+vibrant_errors vibrant_adaptive_new(vibrant_controller *controller,
+                                    const vibrant_adaptive_options *options,
+                                    vibrant_adaptive **adaptive) {
+  *adaptive = calloc(1, sizeof(vibrant_adaptive));
+  if (*adaptive == NULL) {
+    return vibrant_NoMem;
+  }
+
+  (*adaptive)->controller = controller;
+  (*adaptive)->options = options != NULL ? *options : adaptive_default_options;
+  if ((*adaptive)->options.sample_step == 0) {
+    (*adaptive)->options.sample_step = 1;
+  }
+  (*adaptive)->step = (*adaptive)->options.sample_step;
+
+  // start from what the output shows, so the first steps don't jump
+  (*adaptive)->saturation = vibrant_controller_get_saturation(controller);
+  (*adaptive)->written = (*adaptive)->saturation;
+
+  return vibrant_NoError;
+}
+
+static void adaptive_free_image(vibrant_adaptive *adaptive) {
+  if (adaptive->image == NULL) {
+    return;
+  }
+
+  XShmDetach(adaptive->controller->display, &adaptive->shm);
+  // the segment was marked for removal on creation, detaching frees it
+  shmdt(adaptive->shm.shmaddr);
+  // XDestroyImage would free the shared memory data
+  adaptive->image->data = NULL;
+  XDestroyImage(adaptive->image);
+  adaptive->image = NULL;
+}
+
+void vibrant_adaptive_free(vibrant_adaptive **adaptive) {
+  adaptive_free_image(*adaptive);
+  free(*adaptive);
+  *adaptive = NULL;
+}
+
+/**
+ * Make sure adaptive has a shared image of width x height.
+ */
+static vibrant_errors adaptive_create_image(vibrant_adaptive *adaptive,
+                                            unsigned width, unsigned height) {
+  Display *dpy = adaptive->controller->display;
+  int screen = DefaultScreen(dpy);
+
+  if (adaptive->image != NULL && adaptive->image->width == (int)width &&
+      adaptive->image->height == (int)height) {
+    return vibrant_NoError;
+  }
+  adaptive_free_image(adaptive);
+
+  XImage *image = XShmCreateImage(dpy, DefaultVisual(dpy, screen),
+                                  DefaultDepth(dpy, screen), ZPixmap, NULL,
+                                  &adaptive->shm, width, height);
+  if (image == NULL) {
+    return vibrant_NoMem;
+  }
+  // the analysis only knows 8 bits per channel XRGB, not e.g. depth 30
+  if (image->bits_per_pixel != 32 || image->byte_order != LSBFirst ||
+      image->red_mask != 0xff0000 || image->green_mask != 0xff00 ||
+      image->blue_mask != 0xff) {
+    XDestroyImage(image);
+    return vibrant_BackendError;
+  }
+
+  adaptive->shm.shmid = shmget(IPC_PRIVATE, image->bytes_per_line * height,
+                               IPC_CREAT | 0600);
+  if (adaptive->shm.shmid < 0) {
+    XDestroyImage(image);
+    return vibrant_NoMem;
+  }
+  adaptive->shm.shmaddr = shmat(adaptive->shm.shmid, NULL, 0);
+  // freed as soon as both we and the server have detached
+  shmctl(adaptive->shm.shmid, IPC_RMID, NULL);
+  if (adaptive->shm.shmaddr == (char *)-1) {
+    XDestroyImage(image);
+    return vibrant_NoMem;
+  }
+  image->data = adaptive->shm.shmaddr;
+  adaptive->shm.readOnly = False;
+
+  // servers on other machines can't attach, which is reported as X error
+  xerror_trap_push(dpy);
+  unsigned long first_serial = NextRequest(dpy);
+  XShmAttach(dpy, &adaptive->shm);
+  unsigned long last_serial = NextRequest(dpy);
+  XSync(dpy, False);
+  int status = xerror_trap_find(first_serial, last_serial);
+  xerror_trap_pop();
+
+  if (status != Success) {
+    shmdt(adaptive->shm.shmaddr);
+    image->data = NULL;
+    XDestroyImage(image);
+    return vibrant_BackendError;
+  }
+  adaptive->image = image;
+
+  return vibrant_NoError;
+}
+
+vibrant_errors vibrant_adaptive_step(vibrant_adaptive *adaptive,
+                                     double *saturation) {
+  vibrant_controller *controller = adaptive->controller;
+  Display *dpy = controller->display;
+
+  if (dpy == NULL || !XShmQueryExtension(dpy) ||
+      controller->info->crtc == None) {
+    return vibrant_BackendError;
+  }
+
+  Window root = DefaultRootWindow(dpy);
+  XRRScreenResources *resources = XRRGetScreenResourcesCurrent(dpy, root);
+  if (resources == NULL) {
+    return vibrant_BackendError;
+  }
+  XRRCrtcInfo *crtc = XRRGetCrtcInfo(dpy, resources, controller->info->crtc);
+  XRRFreeScreenResources(resources);
+  if (crtc == NULL) {
+    return vibrant_BackendError;
+  }
+
+  int x = crtc->x;
+  int y = crtc->y;
+  unsigned width = crtc->width;
+  unsigned height = crtc->height;
+  XRRFreeCrtcInfo(crtc);
+  if (width == 0 || height == 0) {
+    return vibrant_BackendError;
+  }
+
+  vibrant_errors err = adaptive_create_image(adaptive, width, height);
+  if (err != vibrant_NoError) {
+    return err;
+  }
+
+  // the root window holds the content before the CTM is applied, so our own
+  // adjustments never feed back into the analysis
+  if (!XShmGetImage(dpy, root, adaptive->image, x, y, AllPlanes)) {
+    return vibrant_BackendError;
+  }
+
+  return vibrant_adaptive_feed(
+      adaptive, (const unsigned char *)adaptive->image->data, width, height,
+      adaptive->image->bytes_per_line, saturation);
+}
+
+static unsigned long long adaptive_cpu_time_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+/**
+ * Write saturation to the output of adaptive in a transaction of its own,
+ * which reports whether the backend took it.
+ */
+static vibrant_errors adaptive_write(vibrant_adaptive *adaptive,
+                                     double saturation) {
+  vibrant_controller *controller = adaptive->controller;
+  vibrant_transaction *transaction;
+  vibrant_errors err =
+      vibrant_transaction_new(controller->priv->instance, &transaction);
+  if (err != vibrant_NoError) {
+    return err;
+  }
+
+  err = vibrant_transaction_set_saturation(transaction, controller,
+                                           saturation);
+  if (err == vibrant_NoError) {
+    err = vibrant_transaction_commit(transaction, NULL);
+  }
+  vibrant_transaction_free(&transaction);
+
+  return err;
+}
+
+vibrant_errors vibrant_adaptive_feed(vibrant_adaptive *adaptive,
+                                     const unsigned char *pixels, size_t width,
+                                     size_t height, size_t stride,
+                                     double *saturation) {
+  const vibrant_adaptive_options *options = &adaptive->options;
+  vibrant_frame_metrics metrics;
+
+  unsigned long long start = adaptive_cpu_time_us();
+  vibrant_frame_analyze(pixels, width, height, stride, adaptive->step,
+                        &metrics);
+  unsigned long long elapsed = adaptive_cpu_time_us() - start;
+
+  // trade accuracy for CPU time, and take it back once there is headroom
+  if (elapsed > options->budget_us && adaptive->step < ADAPTIVE_MAX_STEP) {
+    adaptive->step *= 2;
+  } else if (elapsed * 4 < options->budget_us &&
+             adaptive->step > options->sample_step) {
+    adaptive->step /= 2;
+  }
+
+  double goal = options->target_colorfulness / fmax(metrics.colorfulness, 1.0);
+  double vivid = metrics.chroma_histogram[6] + metrics.chroma_histogram[7];
+  if (vivid > ADAPTIVE_VIVID_SHARE) {
+    // boosting would only clip what is already strongly saturated
+    goal = fmin(goal, 1.0);
+  }
+  goal = fmax(goal, options->min_saturation);
+  goal = fmin(goal, options->max_saturation);
+
+  adaptive->saturation += options->smoothing * (goal - adaptive->saturation);
+
+  vibrant_errors err = vibrant_NoError;
+  if (fabs(adaptive->saturation - adaptive->written) >= ADAPTIVE_MIN_CHANGE) {
+    // on failure the next step tries again
+    err = adaptive_write(adaptive, adaptive->saturation);
+    if (err == vibrant_NoError) {
+      adaptive->written = adaptive->saturation;
+    }
+  }
+
+  if (saturation != NULL) {
+    *saturation = adaptive->saturation;
+  }
+
+  return err;
+}
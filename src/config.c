@@ -0,0 +1,461 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/internal.h"
+#include "vibrant/vibrant.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/**
+ * Rules of one [CLASS] section, or of the lines before the first header.
+ */
+typedef struct config_section {
+  // NULL for the default section
+  char *application;
+  // value of *, NAN if unset
+  double wildcard;
+  // per controller, NAN if unset
+  double *values;
+} config_section;
+
+/**
+ * Compiled configuration file. sections[0] is the default section, the
+ * others are sorted by application for lookups by bsearch.
+ */
+typedef struct config_rules {
+  config_section *sections;
+  size_t sections_size;
+} config_rules;
+
+struct vibrant_config {
+  vibrant_instance *instance;
+  char *path;
+  config_rules rules;
+
+  // watches the directory, editors usually replace files by renaming
+  int inotify_fd;
+  // name of the file inside the watched directory
+  const char *file_name;
+
+  // section of the focused application, NULL if it has none
+  const config_section *application;
+  char *application_name;
+  // set once vibrant_config_set_application was called, reloads only apply
+  // the rules from then on
+  int active;
+  // per controller, value last written by the config, NAN if unknown
+  double *applied;
+  size_t error_line;
+};
+
+static void config_rules_free(config_rules *rules) {
+  for (size_t i = 0; i < rules->sections_size; i++) {
+    free(rules->sections[i].application);
+    free(rules->sections[i].values);
+  }
+  free(rules->sections);
+  rules->sections = NULL;
+  rules->sections_size = 0;
+}
+
+/**
+ * Find the section for application, appending it if create is set.
+ */
+static config_section *config_rules_section(config_rules *rules,
+                                            size_t controllers_size,
+                                            const char *application) {
+  for (size_t i = 0; i < rules->sections_size; i++) {
+    const char *name = rules->sections[i].application;
+    if ((name == NULL && application == NULL) ||
+        (name != NULL && application != NULL &&
+         strcasecmp(name, application) == 0)) {
+      return rules->sections + i;
+    }
+  }
+
+  config_section *tmp = realloc(rules->sections, sizeof(config_section) *
+                                                     (rules->sections_size + 1));
+  if (tmp == NULL) {
+    return NULL;
+  }
+  rules->sections = tmp;
+
+  config_section *section = rules->sections + rules->sections_size;
+  section->application = application != NULL ? strdup(application) : NULL;
+  section->wildcard = NAN;
+  section->values =
+      malloc(sizeof(double) * (controllers_size > 0 ? controllers_size : 1));
+  if ((application != NULL && section->application == NULL) ||
+      section->values == NULL) {
+    free(section->application);
+    free(section->values);
+    return NULL;
+  }
+  for (size_t i = 0; i < controllers_size; i++) {
+    section->values[i] = NAN;
+  }
+
+  rules->sections_size++;
+  return section;
+}
+
+static char *config_trim(char *text) {
+  while (isspace((unsigned char)*text)) {
+    text++;
+  }
+
+  char *end = text + strlen(text);
+  while (end > text && isspace((unsigned char)end[-1])) {
+    end--;
+  }
+  *end = '\0';
+
+  return text;
+}
+
+static int config_section_compare(const void *a, const void *b) {
+  return strcasecmp(((const config_section *)a)->application,
+                    ((const config_section *)b)->application);
+}
+
+/**
+ * Parse the file at path into rules.
+ */
+static vibrant_errors config_load(vibrant_instance *instance, const char *path,
+                                  config_rules *rules, size_t *error_line) {
+  *error_line = 0;
+
+  FILE *file = fopen(path, "re");
+  if (file == NULL) {
+    return vibrant_IOError;
+  }
+
+  size_t n = instance->controllers_size;
+  memset(rules, 0, sizeof(config_rules));
+
+  // the default section always exists, even if it stays empty
+  config_section *section = config_rules_section(rules, n, NULL);
+  vibrant_errors err = section != NULL ? vibrant_NoError : vibrant_NoMem;
+
+  char *line = NULL;
+  size_t line_size = 0;
+  size_t line_number = 0;
+  while (err == vibrant_NoError && getline(&line, &line_size, file) != -1) {
+    line_number++;
+    line[strcspn(line, "#")] = '\0';
+    char *text = config_trim(line);
+    size_t length = strlen(text);
+
+    if (length == 0) {
+      continue;
+    }
+
+    if (text[0] == '[') {
+      if (text[length - 1] != ']') {
+        err = vibrant_BadFile;
+        break;
+      }
+      text[length - 1] = '\0';
+      char *application = config_trim(text + 1);
+      if (*application == '\0') {
+        err = vibrant_BadFile;
+        break;
+      }
+
+      section = config_rules_section(rules, n, application);
+      if (section == NULL) {
+        err = vibrant_NoMem;
+      }
+      continue;
+    }
+
+    char *separator = strchr(text, '=');
+    if (separator == NULL) {
+      err = vibrant_BadFile;
+      break;
+    }
+    *separator = '\0';
+    char *output = config_trim(text);
+    char *value_text = config_trim(separator + 1);
+
+    char *end;
+    double value = strtod(value_text, &end);
+    if (*output == '\0' || end == value_text || *end != '\0' ||
+        !(value >= VIBRANT_SATURATION_MIN && value <= VIBRANT_SATURATION_MAX)) {
+      err = vibrant_BadFile;
+      break;
+    }
+
+    if (strcmp(output, "*") == 0) {
+      section->wildcard = value;
+      continue;
+    }
+
+    vibrant_controller *controller =
+        vibrant_instance_find_controller(instance, output);
+    if (controller != NULL) {
+      section->values[controller->priv->index] = value;
+    }
+  }
+
+  if (err == vibrant_NoError && ferror(file)) {
+    err = vibrant_IOError;
+  }
+  if (err == vibrant_BadFile) {
+    *error_line = line_number;
+  }
+
+  free(line);
+  fclose(file);
+
+  if (err != vibrant_NoError) {
+    config_rules_free(rules);
+    return err;
+  }
+
+  qsort(rules->sections + 1, rules->sections_size - 1, sizeof(config_section),
+        config_section_compare);
+
+  return vibrant_NoError;
+}
+
+static const config_section *config_rules_find(const config_rules *rules,
+                                               const char *application) {
+  if (application == NULL) {
+    return NULL;
+  }
+
+  config_section key = {.application = (char *)application};
+  return bsearch(&key, rules->sections + 1, rules->sections_size - 1,
+                 sizeof(config_section), config_section_compare);
+}
+
+static double config_section_value(const config_section *section,
+                                   size_t controller) {
+  if (section == NULL) {
+    return NAN;
+  }
+
+  return isnan(section->values[controller]) ? section->wildcard
+                                            : section->values[controller];
+}
+
+/**
+ * Write the effective value of every controller that differs from what was
+ * written last.
+ */
+static vibrant_errors config_apply(vibrant_config *config,
+                                   vibrant_transaction_result *result) {
+  vibrant_instance *instance = config->instance;
+  vibrant_transaction *transaction = NULL;
+  vibrant_errors err = vibrant_NoError;
+
+  for (int i = 0; i < instance->controllers_size; i++) {
+    double value = config_section_value(config->application, i);
+    if (isnan(value)) {
+      value = config_section_value(config->rules.sections, i);
+    }
+    if (isnan(value) || value == config->applied[i]) {
+      continue;
+    }
+
+    if (transaction == NULL) {
+      err = vibrant_transaction_new(instance, &transaction);
+      if (err != vibrant_NoError) {
+        return err;
+      }
+    }
+
+    vibrant_controller *controller = instance->controllers + i;
+    vibrant_controller_state state;
+    controller_saturation_to_state(controller, value, &state);
+    err = transaction_set_state(transaction, controller, &state);
+    if (err != vibrant_NoError) {
+      break;
+    }
+    config->applied[i] = value;
+  }
+
+  if (transaction == NULL) {
+    if (result != NULL) {
+      memset(result, 0, sizeof(vibrant_transaction_result));
+    }
+    return vibrant_NoError;
+  }
+
+  if (err == vibrant_NoError) {
+    err = vibrant_transaction_commit(transaction, result);
+  }
+  vibrant_transaction_free(&transaction);
+
+  if (err != vibrant_NoError) {
+    // nothing was written, try every output again next time
+    for (int i = 0; i < instance->controllers_size; i++) {
+      config->applied[i] = NAN;
+    }
+  }
+
+  return err;
+}
+
+vibrant_errors vibrant_config_new(vibrant_instance *instance, const char *path,
+                                  vibrant_config **config, size_t *error_line) {
+  vibrant_config *c = calloc(1, sizeof(vibrant_config));
+  if (c == NULL) {
+    return vibrant_NoMem;
+  }
+
+  size_t n = instance->controllers_size;
+  c->instance = instance;
+  c->inotify_fd = -1;
+  c->path = strdup(path);
+  c->applied = malloc(sizeof(double) * (n > 0 ? n : 1));
+  if (c->path == NULL || c->applied == NULL) {
+    vibrant_config_free(&c);
+    return vibrant_NoMem;
+  }
+  for (size_t i = 0; i < n; i++) {
+    c->applied[i] = NAN;
+  }
+
+  vibrant_errors err = config_load(instance, path, &c->rules, &c->error_line);
+  if (error_line != NULL) {
+    *error_line = c->error_line;
+  }
+  if (err != vibrant_NoError) {
+    vibrant_config_free(&c);
+    return err;
+  }
+
+  // watch the directory, the file itself is gone after an atomic replace
+  char *slash = strrchr(c->path, '/');
+  c->file_name = slash != NULL ? slash + 1 : c->path;
+  char *directory = slash == c->path ? strdup("/")
+                    : slash != NULL  ? strndup(c->path, slash - c->path)
+                                     : strdup(".");
+  c->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (directory == NULL || c->inotify_fd < 0 ||
+      inotify_add_watch(c->inotify_fd, directory,
+                        IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    free(directory);
+    vibrant_config_free(&c);
+    return directory == NULL ? vibrant_NoMem : vibrant_IOError;
+  }
+  free(directory);
+
+  *config = c;
+  return vibrant_NoError;
+}
+
+void vibrant_config_free(vibrant_config **config) {
+  vibrant_config *c = *config;
+
+  if (c->inotify_fd >= 0) {
+    close(c->inotify_fd);
+  }
+  config_rules_free(&c->rules);
+  free(c->path);
+  free(c->application_name);
+  free(c->applied);
+  free(c);
+  *config = NULL;
+}
+
+int vibrant_config_get_fd(vibrant_config *config) { return config->inotify_fd; }
+
+size_t vibrant_config_get_error_line(vibrant_config *config) {
+  return config->error_line;
+}
+
+vibrant_errors
+vibrant_config_set_application(vibrant_config *config, const char *application,
+                               vibrant_transaction_result *result) {
+  char *name = NULL;
+  if (application != NULL) {
+    name = strdup(application);
+    if (name == NULL) {
+      return vibrant_NoMem;
+    }
+  }
+
+  free(config->application_name);
+  config->application_name = name;
+  config->application = config_rules_find(&config->rules, name);
+  config->active = 1;
+
+  return config_apply(config, result);
+}
+
+vibrant_errors vibrant_config_dispatch(vibrant_config *config,
+                                       vibrant_transaction_result *result) {
+  char buffer[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  int changed = 0;
+  ssize_t length;
+
+  while ((length = read(config->inotify_fd, buffer, sizeof(buffer))) > 0) {
+    for (ssize_t i = 0; i < length;) {
+      const struct inotify_event *event =
+          (const struct inotify_event *)(buffer + i);
+      if (event->len > 0 && strcmp(event->name, config->file_name) == 0) {
+        changed = 1;
+      }
+      i += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  if (!changed) {
+    if (result != NULL) {
+      memset(result, 0, sizeof(vibrant_transaction_result));
+    }
+    return vibrant_NoError;
+  }
+
+  config_rules rules;
+  vibrant_errors err =
+      config_load(config->instance, config->path, &rules, &config->error_line);
+  if (err != vibrant_NoError) {
+    return err;
+  }
+
+  config_rules_free(&config->rules);
+  config->rules = rules;
+  config->application =
+      config_rules_find(&config->rules, config->application_name);
+
+  if (!config->active) {
+    if (result != NULL) {
+      memset(result, 0, sizeof(vibrant_transaction_result));
+    }
+    return vibrant_NoError;
+  }
+
+  // the compiled values are compared against what was written, so only
+  // outputs whose effective value changed are touched
+  return config_apply(config, result);
+}
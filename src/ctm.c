@@ -50,11 +50,11 @@
 #include <X11/Xatom.h>
 #include <math.h>
 #include <stdint.h>
-#include <stdio.h>
 
 #include "util.c"
 #include "vibrant/ctm.h"
 #include "vibrant/vibrant.h"
+#include "vibrant/xerror.h"
 
 #define RANDR_FORMAT 32u
 #define PROP_CTM "CTM"
@@ -62,11 +62,13 @@
 // *_blob and *_ctm functions are private
 /**
  * Set a DRM blob property on the given output. It calls XSync at the end to
- * flush the change request so that it applies.
+ * flush the change request so that it applies. X errors caused by the change
+ * are caught by the library error handler and returned.
  *
  * Return values:
  *   - BadAtom if the given name string doesn't exist
  *   - BadName if the property referenced by the name string does not exist
+ *   - the X error code if the server rejected the change
  *   - Success if everything went well
  *
  * @param dpy The X Display
@@ -84,14 +86,12 @@ int ctm_set_output_blob(Display *dpy, RROutput output, const char *prop_name,
   // Find the X Atom associated with the property name
   prop_atom = XInternAtom(dpy, prop_name, 1);
   if (!prop_atom) {
-    printf("Property key '%s' not found.\n", prop_name);
     return BadAtom;
   }
 
   // Make sure the property exists
   prop_info = XRRQueryOutputProperty(dpy, output, prop_atom);
   if (!prop_info) {
-    printf("Property key '%s' not found on output\n", prop_name);
     return BadName; /* Property not found */
   }
 
@@ -107,13 +107,19 @@ int ctm_set_output_blob(Display *dpy, RROutput output, const char *prop_name,
    *             = blob_bytes / (format / 8)
    *             = blob_bytes / (format >> 3)
    */
+  xerror_acquire(dpy);
+  unsigned long first_serial = NextRequest(dpy);
   XRRChangeOutputProperty(dpy, output, prop_atom, XA_INTEGER, RANDR_FORMAT,
                           PropModeReplace, blob_data,
                           blob_bytes / (RANDR_FORMAT >> 3u));
+  unsigned long last_serial = NextRequest(dpy);
   // Call XSync to apply it.
   XSync(dpy, 0);
 
-  return Success;
+  int status = xerror_find(dpy, first_serial, last_serial);
+  xerror_release(dpy);
+
+  return status;
 }
 
 /**
@@ -145,14 +151,12 @@ int ctm_get_output_blob(Display *dpy, RROutput output, const char *prop_name,
   // Find the X Atom associated with the property name
   prop_atom = XInternAtom(dpy, prop_name, 1);
   if (!prop_atom) {
-    printf("Property key '%s' not found.\n", prop_name);
     return BadAtom;
   }
 
   // Make sure the property exists
   prop_info = XRRQueryOutputProperty(dpy, output, prop_atom);
   if (!prop_info) {
-    printf("Property key '%s' not found on output\n", prop_name);
     return BadName; /* Property not found */
   }
 
@@ -189,7 +193,7 @@ int ctm_set_ctm(Display *dpy, RROutput output, double *coeffs) {
   struct drm_color_ctm ctm;
   long padded_ctm[18];
 
-  int i, ret;
+  int ret;
 
   vibrant_translate_coeffs_to_ctm(coeffs, &ctm);
 
@@ -216,15 +220,10 @@ int ctm_set_ctm(Display *dpy, RROutput output, double *coeffs) {
    *
    * We just assume little-endian, which is why we don't even bother.
    */
-  for (i = 0; i < 18; i++)
-    // Think of this as a padded 'memcpy()'.
-    // long* padded_ctm <- (uint32_t *) ctm.matrix
-    padded_ctm[i] = ((uint32_t *)ctm.matrix)[i];
+  vibrant_translate_ctm_to_padded_ctm(&ctm, padded_ctm);
 
   ret = ctm_set_output_blob(dpy, output, PROP_CTM, &padded_ctm, blob_size);
 
-  if (ret)
-    printf("Failed to set CTM. %d\n", ret);
   return ret;
 }
 
@@ -284,6 +283,35 @@ void ctm_set_saturation(Display *dpy, RROutput output, double saturation,
   }
 }
 
+int ctm_get_padded_ctm(Display *dpy, RROutput output, long *padded_ctm) {
+  return ctm_get_output_blob(dpy, output, PROP_CTM, padded_ctm);
+}
+
+void ctm_queue_padded_ctm(Display *dpy, RROutput output,
+                          const long *padded_ctm) {
+  // outputs only become CTM controllers if the atom exists, see
+  // ctm_output_has_ctm(). Xlib caches it, so this doesn't round trip.
+  Atom prop_atom = XInternAtom(dpy, PROP_CTM, 1);
+
+  XRRChangeOutputProperty(dpy, output, prop_atom, XA_INTEGER, RANDR_FORMAT,
+                          PropModeReplace, (const unsigned char *)padded_ctm,
+                          sizeof(struct drm_color_ctm) / (RANDR_FORMAT >> 3u));
+}
+
+void ctm_saturation_to_padded_ctm(double saturation, long *padded_ctm) {
+  double ctm_coeffs[9];
+  struct drm_color_ctm ctm;
+
+  saturation = fmax(saturation, VIBRANT_SATURATION_MIN);
+  saturation = fmin(saturation, VIBRANT_SATURATION_MAX);
+
+  vibrant_saturation_to_coeffs(saturation, ctm_coeffs);
+  vibrant_translate_coeffs_to_ctm(ctm_coeffs, &ctm);
+  vibrant_translate_ctm_to_padded_ctm(&ctm, padded_ctm);
+}
+
+Atom ctm_get_atom(Display *dpy) { return XInternAtom(dpy, PROP_CTM, 1); }
+
 int ctm_output_has_ctm(Display *dpy, RROutput output) {
   Atom prop_atom;
 
@@ -0,0 +1,680 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// before the vibrant headers: ctm.h only defines struct drm_color_ctm if
+// drm_mode.h didn't, and the CTM blobs are exactly that struct
+#include <drm/drm.h>
+#include <drm/drm_mode.h>
+
+#include "vibrant/drm.h"
+#include "vibrant/internal.h"
+#include "vibrant/panel.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "util.c"
+
+#define DRM_CARD_FORMAT "/dev/dri/card%d"
+#define DRM_CARD_MAX 16
+
+// drm_connector_status, not part of the uapi headers
+#define DRM_CONNECTED 1
+
+typedef struct drm_output {
+  uint32_t crtc;
+  // id of the CTM property of crtc
+  uint32_t ctm_property;
+  // state set_state queued for the next drm_commit()
+  bool queued;
+  struct drm_color_ctm ctm;
+} drm_output;
+
+struct vibrant_drm {
+  // -1 if a replacement ioctl runs without a device
+  int fd;
+  vibrant_drm_ioctl_fn ioctl;
+  void *ioctl_data;
+
+  // one per controller, in the same order
+  drm_output *outputs;
+};
+
+// names the kernel gives connector types, indexed by DRM_MODE_CONNECTOR_*
+static const char *const drm_connector_names[] = {
+    "Unknown", "VGA", "DVI-I", "DVI-D", "DVI-A", "Composite", "SVIDEO",
+    "LVDS", "Component", "DIN", "DP", "HDMI-A", "HDMI-B", "TV", "eDP",
+    "Virtual", "DSI", "DPI", "Writeback", "SPI", "USB"};
+
+static int drm_ioctl(struct vibrant_drm *drm, unsigned long request,
+                     void *arg) {
+  if (drm->ioctl != NULL) {
+    return drm->ioctl(drm->fd, request, arg, drm->ioctl_data);
+  }
+
+  int ret;
+  do {
+    ret = ioctl(drm->fd, request, arg);
+  } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+
+  return ret;
+}
+
+/**
+ * Map the errno of a failed ioctl to the X-defined error code controllers
+ * report.
+ */
+static int drm_errno_status(int err) {
+  switch (err) {
+  case EACCES:
+  case EPERM:
+    // someone else is DRM master
+    return BadAccess;
+  case ENOMEM:
+    return BadAlloc;
+  case EINVAL:
+  case ERANGE:
+    return BadValue;
+  default:
+    return BadMatch;
+  }
+}
+
+/**
+ * Read the property ids and values of object. On success ids and values must
+ * be freed by the caller.
+ *
+ * @return number of properties or -1 on failure
+ */
+static long drm_object_properties(struct vibrant_drm *drm, uint32_t object,
+                                  uint32_t type, uint32_t **ids,
+                                  uint64_t **values) {
+  struct drm_mode_obj_get_properties props = {.obj_id = object,
+                                              .obj_type = type};
+  if (drm_ioctl(drm, DRM_IOCTL_MODE_OBJ_GETPROPERTIES, &props) != 0) {
+    return -1;
+  }
+
+  uint32_t count = props.count_props;
+  *ids = calloc(count + 1, sizeof(uint32_t));
+  *values = calloc(count + 1, sizeof(uint64_t));
+  if (*ids == NULL || *values == NULL) {
+    free(*ids);
+    free(*values);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  props.props_ptr = (uintptr_t)*ids;
+  props.prop_values_ptr = (uintptr_t)*values;
+  if (count > 0 &&
+      drm_ioctl(drm, DRM_IOCTL_MODE_OBJ_GETPROPERTIES, &props) != 0) {
+    free(*ids);
+    free(*values);
+    return -1;
+  }
+
+  // properties are fixed once the driver registered the object
+  return props.count_props < count ? props.count_props : count;
+}
+
+/**
+ * Find the property called name of object.
+ *
+ * @return 1 and the id and value of the property, or 0 if object has none
+ */
+static int drm_find_property(struct vibrant_drm *drm, uint32_t object,
+                             uint32_t type, const char *name,
+                             uint32_t *property, uint64_t *value) {
+  uint32_t *ids;
+  uint64_t *values;
+  long count = drm_object_properties(drm, object, type, &ids, &values);
+  int found = 0;
+
+  for (long i = 0; i < count && !found; i++) {
+    struct drm_mode_get_property prop = {.prop_id = ids[i]};
+
+    if (drm_ioctl(drm, DRM_IOCTL_MODE_GETPROPERTY, &prop) == 0 &&
+        strncmp(prop.name, name, DRM_PROP_NAME_LEN) == 0) {
+      *property = ids[i];
+      *value = values[i];
+      found = 1;
+    }
+  }
+
+  if (count >= 0) {
+    free(ids);
+    free(values);
+  }
+
+  return found;
+}
+
+/**
+ * Read the value of property of object.
+ *
+ * @return Success or an X-defined error code
+ */
+static int drm_property_value(struct vibrant_drm *drm, uint32_t object,
+                              uint32_t type, uint32_t property,
+                              uint64_t *value) {
+  uint32_t *ids;
+  uint64_t *values;
+  long count = drm_object_properties(drm, object, type, &ids, &values);
+  if (count < 0) {
+    return drm_errno_status(errno);
+  }
+
+  int status = BadMatch;
+  for (long i = 0; i < count; i++) {
+    if (ids[i] == property) {
+      *value = values[i];
+      status = Success;
+      break;
+    }
+  }
+
+  free(ids);
+  free(values);
+
+  return status;
+}
+
+/**
+ * Hash the EDID base block of connector and look up the panel profile of
+ * priv, see assign_output_ids().
+ *
+ * @return the hash or 0 if connector has no EDID
+ */
+static uint64_t drm_edid_id(struct vibrant_drm *drm, uint32_t connector,
+                            vibrant_controller_internal *priv) {
+  uint32_t property;
+  uint64_t blob_id;
+  if (!drm_find_property(drm, connector, DRM_MODE_OBJECT_CONNECTOR, "EDID",
+                         &property, &blob_id) ||
+      blob_id == 0) {
+    return 0;
+  }
+
+  // the kernel only copies blobs if the length matches, ask for it first
+  struct drm_mode_get_blob blob = {.blob_id = (uint32_t)blob_id};
+  if (drm_ioctl(drm, DRM_IOCTL_MODE_GETPROPBLOB, &blob) != 0 ||
+      blob.length < EDID_BLOCK_SIZE) {
+    return 0;
+  }
+
+  unsigned char *edid = malloc(blob.length);
+  if (edid == NULL) {
+    return 0;
+  }
+
+  uint64_t id = 0;
+  blob.data = (uintptr_t)edid;
+  if (drm_ioctl(drm, DRM_IOCTL_MODE_GETPROPBLOB, &blob) == 0 &&
+      blob.length >= EDID_BLOCK_SIZE) {
+    id = vibrant_hash(VIBRANT_HASH_SEED, edid, EDID_BLOCK_SIZE);
+    priv->panel_valid = panel_profile_lookup(id, edid, priv->panel_weights);
+  }
+  free(edid);
+
+  return id;
+}
+
+static void drm_identity_ctm(struct drm_color_ctm *ctm) {
+  double coeffs[9];
+  vibrant_saturation_to_coeffs(1.0, coeffs);
+  vibrant_translate_coeffs_to_ctm(coeffs, ctm);
+}
+
+static void drmctrl_saturation_to_state(double saturation,
+                                        vibrant_controller_state *state) {
+  saturation = fmax(saturation, VIBRANT_SATURATION_MIN);
+  saturation = fmin(saturation, VIBRANT_SATURATION_MAX);
+
+  double coeffs[9];
+  vibrant_saturation_to_coeffs(saturation, coeffs);
+  vibrant_translate_coeffs_to_ctm(coeffs, &state->drm_ctm);
+}
+
+static int drmctrl_get_state(vibrant_controller *controller,
+                             vibrant_controller_state *state) {
+  struct vibrant_drm *drm = controller->priv->instance->backend_data;
+  drm_output *output = drm->outputs + controller->priv->index;
+
+  uint64_t blob_id = 0;
+  int status = drm_property_value(drm, output->crtc, DRM_MODE_OBJECT_CRTC,
+                                  output->ctm_property, &blob_id);
+  if (status != Success) {
+    return status;
+  }
+
+  // CRTCs without a CTM blob pass colors through unchanged
+  if (blob_id == 0) {
+    drm_identity_ctm(&state->drm_ctm);
+    return Success;
+  }
+
+  struct drm_mode_get_blob blob = {.blob_id = (uint32_t)blob_id,
+                                   .length = sizeof(struct drm_color_ctm),
+                                   .data = (uintptr_t)&state->drm_ctm};
+  if (drm_ioctl(drm, DRM_IOCTL_MODE_GETPROPBLOB, &blob) != 0) {
+    return drm_errno_status(errno);
+  }
+
+  return blob.length == sizeof(struct drm_color_ctm) ? Success : BadMatch;
+}
+
+static int drmctrl_set_state(vibrant_controller *controller,
+                             const vibrant_controller_state *state) {
+  struct vibrant_drm *drm = controller->priv->instance->backend_data;
+  drm_output *output = drm->outputs + controller->priv->index;
+
+  output->ctm = state->drm_ctm;
+  output->queued = true;
+
+  return Success;
+}
+
+static double drmctrl_get_saturation(vibrant_controller *controller) {
+  vibrant_controller_state state;
+  if (drmctrl_get_state(controller, &state) != Success) {
+    return -1.0;
+  }
+
+  double coeffs[9];
+  vibrant_translate_ctm_to_coeffs(&state.drm_ctm, coeffs);
+  return vibrant_coeffs_to_saturation(coeffs);
+}
+
+static int drmctrl_set_saturation(vibrant_controller *controller,
+                                  double saturation) {
+  vibrant_controller_state state;
+  drmctrl_saturation_to_state(saturation, &state);
+  drmctrl_set_state(controller, &state);
+
+  return drm_commit(controller->priv->instance);
+}
+
+int drm_commit(vibrant_instance *instance) {
+  struct vibrant_drm *drm = instance->backend_data;
+  size_t n = instance->controllers_size;
+
+  // per CRTC: object, property count, property, value and the blob created
+  uint32_t *objs = calloc(n + 1, 4 * sizeof(uint32_t));
+  uint64_t *values = calloc(n + 1, sizeof(uint64_t));
+  if (objs == NULL || values == NULL) {
+    free(objs);
+    free(values);
+    for (size_t i = 0; i < n; i++) {
+      drm->outputs[i].queued = false;
+    }
+    return BadAlloc;
+  }
+  uint32_t *count_props = objs + n;
+  uint32_t *props = count_props + n;
+  uint32_t *blobs = props + n;
+
+  size_t objs_size = 0;
+  int status = Success;
+
+  for (size_t i = 0; i < n && status == Success; i++) {
+    drm_output *output = drm->outputs + i;
+    if (!output->queued) {
+      continue;
+    }
+
+    // clones share their CRTC, the state queued last for it wins
+    bool superseded = false;
+    for (size_t j = i + 1; j < n && !superseded; j++) {
+      superseded = drm->outputs[j].queued &&
+                   drm->outputs[j].crtc == output->crtc;
+    }
+    if (superseded) {
+      output->queued = false;
+      continue;
+    }
+
+    struct drm_mode_create_blob create = {
+        .data = (uintptr_t)&output->ctm,
+        .length = sizeof(struct drm_color_ctm)};
+    if (drm_ioctl(drm, DRM_IOCTL_MODE_CREATEPROPBLOB, &create) != 0) {
+      status = drm_errno_status(errno);
+      break;
+    }
+    output->queued = false;
+
+    objs[objs_size] = output->crtc;
+    count_props[objs_size] = 1;
+    props[objs_size] = output->ctm_property;
+    values[objs_size] = create.blob_id;
+    blobs[objs_size] = create.blob_id;
+    objs_size++;
+  }
+
+  if (status == Success && objs_size > 0) {
+    struct drm_mode_atomic atomic = {.count_objs = objs_size,
+                                     .objs_ptr = (uintptr_t)objs,
+                                     .count_props_ptr = (uintptr_t)count_props,
+                                     .props_ptr = (uintptr_t)props,
+                                     .prop_values_ptr = (uintptr_t)values};
+    if (drm_ioctl(drm, DRM_IOCTL_MODE_ATOMIC, &atomic) != 0) {
+      status = drm_errno_status(errno);
+    }
+  }
+
+  // the CRTC states hold their own references, ours are no longer needed
+  for (size_t i = 0; i < objs_size; i++) {
+    struct drm_mode_destroy_blob destroy = {.blob_id = blobs[i]};
+    drm_ioctl(drm, DRM_IOCTL_MODE_DESTROYPROPBLOB, &destroy);
+  }
+
+  // a failed commit applies nothing, the queue starts over either way
+  for (size_t i = 0; i < n; i++) {
+    drm->outputs[i].queued = false;
+  }
+
+  free(objs);
+  free(values);
+
+  return status;
+}
+
+static void drm_free_controllers(vibrant_controller *controllers,
+                                 size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    free(controllers[i].info->name);
+    free(controllers[i].info);
+    layers_free(controllers + i);
+    free(controllers[i].priv);
+  }
+}
+
+/**
+ * Give every controller its id, like assign_output_ids() does for X.
+ */
+static void drm_assign_ids(vibrant_controller *controllers, size_t length,
+                           const uint64_t *edid_ids) {
+  for (size_t i = 0; i < length; i++) {
+    vibrant_controller *controller = controllers + i;
+
+    if (edid_ids[i] == 0) {
+      controller->priv->id = vibrant_hash(
+          VIBRANT_HASH_SEED, controller->info->name, controller->info->nameLen);
+      continue;
+    }
+
+    controller->priv->id = edid_ids[i];
+    for (size_t j = 0; j < length; j++) {
+      if (i != j && edid_ids[i] == edid_ids[j]) {
+        // identical panels, tell them apart by connector
+        controller->priv->id = vibrant_hash(
+            edid_ids[i], controller->info->name, controller->info->nameLen);
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * Read the connector ids of the device.
+ *
+ * @return number of connectors or -1 on failure
+ */
+static long drm_connectors(struct vibrant_drm *drm, uint32_t **connectors) {
+  struct drm_mode_card_res res = {0};
+  if (drm_ioctl(drm, DRM_IOCTL_MODE_GETRESOURCES, &res) != 0) {
+    return -1;
+  }
+
+  uint32_t count = res.count_connectors;
+  *connectors = calloc(count + 1, sizeof(uint32_t));
+  if (*connectors == NULL) {
+    return -1;
+  }
+
+  // only ask for connectors, every count left at 0 skips its array
+  res = (struct drm_mode_card_res){.connector_id_ptr = (uintptr_t)*connectors,
+                                   .count_connectors = count};
+  if (count > 0 && drm_ioctl(drm, DRM_IOCTL_MODE_GETRESOURCES, &res) != 0) {
+    free(*connectors);
+    return -1;
+  }
+
+  // connectors plugged in meanwhile are picked up by the next instance
+  return res.count_connectors < count ? res.count_connectors : count;
+}
+
+/**
+ * Find the CRTC driving connector, if it is connected and active.
+ *
+ * @return the CRTC id or 0
+ */
+static uint32_t drm_connector_crtc(struct vibrant_drm *drm, uint32_t connector,
+                                   uint32_t *type, uint32_t *type_id) {
+  // one mode slot keeps the kernel from probing the connector, which can
+  // take a while and isn't needed to read the current state
+  struct drm_mode_modeinfo mode;
+  struct drm_mode_get_connector conn = {.modes_ptr = (uintptr_t)&mode,
+                                        .count_modes = 1,
+                                        .connector_id = connector};
+  if (drm_ioctl(drm, DRM_IOCTL_MODE_GETCONNECTOR, &conn) != 0 ||
+      conn.connection != DRM_CONNECTED || conn.encoder_id == 0) {
+    return 0;
+  }
+
+  struct drm_mode_get_encoder encoder = {.encoder_id = conn.encoder_id};
+  if (drm_ioctl(drm, DRM_IOCTL_MODE_GETENCODER, &encoder) != 0) {
+    return 0;
+  }
+
+  *type = conn.connector_type;
+  *type_id = conn.connector_type_id;
+  return encoder.crtc_id;
+}
+
+/**
+ * Create a controller for every connected connector whose CRTC has a CTM.
+ *
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BackendError if the
+ * device doesn't support atomic modesetting
+ */
+static vibrant_errors drm_probe(vibrant_instance *instance,
+                                struct vibrant_drm *drm,
+                                vibrant_controller **controllers,
+                                size_t *controllers_size) {
+  struct drm_set_client_cap cap = {DRM_CLIENT_CAP_ATOMIC, 1};
+  if (drm_ioctl(drm, DRM_IOCTL_SET_CLIENT_CAP, &cap) != 0) {
+    return vibrant_BackendError;
+  }
+
+  uint32_t *connectors;
+  long count = drm_connectors(drm, &connectors);
+  if (count < 0) {
+    return errno == ENOMEM ? vibrant_NoMem : vibrant_BackendError;
+  }
+
+  vibrant_controller *c = calloc(count + 1, sizeof(vibrant_controller));
+  drm_output *outputs = calloc(count + 1, sizeof(drm_output));
+  uint64_t *edid_ids = calloc(count + 1, sizeof(uint64_t));
+  if (c == NULL || outputs == NULL || edid_ids == NULL) {
+    free(c);
+    free(outputs);
+    free(edid_ids);
+    free(connectors);
+    return vibrant_NoMem;
+  }
+
+  size_t n = 0;
+  for (long i = 0; i < count; i++) {
+    uint32_t type, type_id;
+    uint32_t crtc = drm_connector_crtc(drm, connectors[i], &type, &type_id);
+
+    uint32_t ctm_property;
+    uint64_t ctm_blob;
+    if (crtc == 0 || !drm_find_property(drm, crtc, DRM_MODE_OBJECT_CRTC, "CTM",
+                                        &ctm_property, &ctm_blob)) {
+      continue;
+    }
+
+    const char *type_name =
+        type < sizeof(drm_connector_names) / sizeof(drm_connector_names[0])
+            ? drm_connector_names[type]
+            : drm_connector_names[0];
+    int name_len = snprintf(NULL, 0, "%s-%u", type_name, type_id);
+    XRROutputInfo *info = calloc(1, sizeof(XRROutputInfo));
+    char *name = malloc(name_len + 1);
+    vibrant_controller_internal *priv =
+        malloc(sizeof(vibrant_controller_internal));
+    if (info == NULL || name == NULL || priv == NULL) {
+      free(info);
+      free(name);
+      free(priv);
+      drm_free_controllers(c, n);
+      free(c);
+      free(outputs);
+      free(edid_ids);
+      free(connectors);
+      return vibrant_NoMem;
+    }
+
+    snprintf(name, name_len + 1, "%s-%u", type_name, type_id);
+    info->name = name;
+    info->nameLen = name_len;
+    info->connection = RR_Connected;
+    info->crtc = crtc;
+
+    *priv = (vibrant_controller_internal){
+        .backend = DRM,
+        .nvId = -1,
+        .get_saturation = drmctrl_get_saturation,
+        .set_saturation = drmctrl_set_saturation,
+        .get_state = drmctrl_get_state,
+        .set_state = drmctrl_set_state,
+        .saturation_to_state = drmctrl_saturation_to_state,
+        .instance = instance,
+        .index = n};
+    c[n] = (vibrant_controller){connectors[i], info, NULL, priv};
+    outputs[n] = (drm_output){.crtc = crtc, .ctm_property = ctm_property};
+    edid_ids[n] = drm_edid_id(drm, connectors[i], priv);
+    n++;
+  }
+
+  drm_assign_ids(c, n, edid_ids);
+
+  free(edid_ids);
+  free(connectors);
+
+  drm->outputs = outputs;
+  *controllers = c;
+  *controllers_size = n;
+
+  return vibrant_NoError;
+}
+
+vibrant_errors drm_instance_new(vibrant_instance *instance,
+                                const vibrant_drm_options *options) {
+  struct vibrant_drm *drm = calloc(1, sizeof(struct vibrant_drm));
+  if (drm == NULL) {
+    return vibrant_NoMem;
+  }
+  drm->fd = -1;
+  drm->ioctl = options->ioctl;
+  drm->ioctl_data = options->ioctl_data;
+
+  vibrant_controller *controllers = NULL;
+  size_t n = 0;
+  vibrant_errors err;
+
+  if (options->ioctl != NULL || options->device != NULL) {
+    if (options->ioctl == NULL) {
+      drm->fd = open(options->device, O_RDWR | O_CLOEXEC);
+    }
+
+    err = options->ioctl == NULL && drm->fd < 0
+              ? vibrant_IOError
+              : drm_probe(instance, drm, &controllers, &n);
+  } else {
+    // take the first card that has something to drive
+    err = vibrant_IOError;
+    for (int i = 0; i < DRM_CARD_MAX; i++) {
+      char path[sizeof(DRM_CARD_FORMAT) + 8];
+      snprintf(path, sizeof(path), DRM_CARD_FORMAT, i);
+
+      drm->fd = open(path, O_RDWR | O_CLOEXEC);
+      if (drm->fd < 0) {
+        continue;
+      }
+
+      err = drm_probe(instance, drm, &controllers, &n);
+      if (err == vibrant_NoError && n > 0) {
+        break;
+      }
+
+      if (err == vibrant_NoError) {
+        free(controllers);
+        free(drm->outputs);
+        drm->outputs = NULL;
+        err = vibrant_BackendError;
+      }
+      close(drm->fd);
+      drm->fd = -1;
+
+      if (err == vibrant_NoMem) {
+        break;
+      }
+    }
+  }
+
+  if (err != vibrant_NoError) {
+    if (drm->fd >= 0) {
+      close(drm->fd);
+    }
+    free(drm);
+    return err;
+  }
+
+  *instance = (vibrant_instance){.controllers = controllers,
+                                 .controllers_size = n,
+                                 .backend = vibrant_BackendDRM,
+                                 .backend_data = drm};
+  instance->commit = drm_commit;
+
+  return vibrant_NoError;
+}
+
+void drm_instance_free(vibrant_instance *instance) {
+  struct vibrant_drm *drm = instance->backend_data;
+
+  drm_free_controllers(instance->controllers, instance->controllers_size);
+  free(instance->controllers);
+
+  free(drm->outputs);
+  if (drm->fd >= 0) {
+    close(drm->fd);
+  }
+  free(drm);
+}
@@ -0,0 +1,435 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// memfd_create
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "vibrant/export.h"
+#include "vibrant/ctm.h"
+#include "vibrant/internal.h"
+#include "vibrant/seqlock.h"
+#include "vibrant/vibrant.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util.c"
+
+#define EXPORT_MAGIC "VIBEXPT"
+#define EXPORT_VERSION 1u
+
+/*
+ * Export page layout, in host byte order:
+ *
+ *   export_page_header
+ *   export_page_entry[header.entries]
+ *
+ * Everything after the magic is protected by the seqlock in sequence, see
+ * seqlock.h. The memfd is sealed against resizing, so a compositor can map
+ * it without risking SIGBUS.
+ */
+typedef struct export_page_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t entries;
+  _Atomic uint64_t sequence;
+  uint64_t generation;
+} export_page_header;
+
+typedef struct export_page_entry {
+  uint64_t id;
+  char name[VIBRANT_EXPORT_NAME_SIZE];
+  // S31.32 sign-magnitude, exactly what a CTM blob of the output would hold
+  struct drm_color_ctm ctm;
+  uint64_t generation;
+} export_page_entry;
+
+_Static_assert(sizeof(export_page_header) == 32, "export header is packed");
+_Static_assert(sizeof(export_page_entry) == 120, "export entry is packed");
+
+struct vibrant_export_publisher {
+  export_page_header *page;
+  size_t size;
+  int fd;
+  int event_fd;
+  // slot on the page of every controller, -1 for controllers that are not
+  // exported. Indexed by vibrant_controller_internal.index
+  int *slots;
+  // serializes writers, readers never take it
+  pthread_mutex_t lock;
+};
+
+struct vibrant_export {
+  // mapped read-only
+  export_page_header *page;
+  size_t size;
+};
+
+static export_page_entry *export_entries(export_page_header *page) {
+  return (export_page_entry *)(page + 1);
+}
+
+/**
+ * Inverse of vibrant_translate_ctm_to_padded_ctm.
+ */
+static void export_padded_ctm_to_ctm(const long *padded_ctm,
+                                     struct drm_color_ctm *ctm) {
+  uint32_t words[18];
+
+  for (int i = 0; i < 18; i++) {
+    words[i] = (uint32_t)padded_ctm[i];
+  }
+  memcpy(ctm->matrix, words, sizeof(words));
+}
+
+static int exportctrl_get_state(vibrant_controller *controller,
+                                vibrant_controller_state *state) {
+  struct vibrant_export_publisher *exporter =
+      controller->priv->instance->exporter;
+  if (exporter == NULL) {
+    return BadMatch;
+  }
+
+  export_page_entry *entry =
+      export_entries(exporter->page) + exporter->slots[controller->priv->index];
+
+  pthread_mutex_lock(&exporter->lock);
+  struct drm_color_ctm ctm = entry->ctm;
+  pthread_mutex_unlock(&exporter->lock);
+
+  vibrant_translate_ctm_to_padded_ctm(&ctm, state->padded_ctm);
+
+  return Success;
+}
+
+static int exportctrl_set_state(vibrant_controller *controller,
+                                const vibrant_controller_state *state) {
+  struct vibrant_export_publisher *exporter =
+      controller->priv->instance->exporter;
+  if (exporter == NULL) {
+    return BadMatch;
+  }
+
+  export_page_header *page = exporter->page;
+  export_page_entry *entry =
+      export_entries(page) + exporter->slots[controller->priv->index];
+  struct drm_color_ctm ctm;
+  export_padded_ctm_to_ctm(state->padded_ctm, &ctm);
+
+  pthread_mutex_lock(&exporter->lock);
+  seqlock_write_begin(&page->sequence);
+  entry->ctm = ctm;
+  entry->generation++;
+  page->generation++;
+  seqlock_write_end(&page->sequence);
+  pthread_mutex_unlock(&exporter->lock);
+
+  // only fails once the counter is saturated, which keeps the eventfd
+  // readable anyway
+  eventfd_write(exporter->event_fd, 1);
+
+  return Success;
+}
+
+static void exportctrl_saturation_to_state(double saturation,
+                                           vibrant_controller_state *state) {
+  ctm_saturation_to_padded_ctm(saturation, state->padded_ctm);
+}
+
+static double exportctrl_get_saturation(vibrant_controller *controller) {
+  vibrant_controller_state state;
+  if (exportctrl_get_state(controller, &state) != Success) {
+    return -1.0;
+  }
+
+  double coeffs[9];
+  vibrant_translate_padded_ctm_to_coeffs(state.padded_ctm, coeffs);
+  return vibrant_coeffs_to_saturation(coeffs);
+}
+
+static int exportctrl_set_saturation(vibrant_controller *controller,
+                                     double saturation) {
+  vibrant_controller_state state;
+  exportctrl_saturation_to_state(saturation, &state);
+  return exportctrl_set_state(controller, &state);
+}
+
+void export_controller_init(vibrant_controller_internal *priv) {
+  priv->backend = Export;
+  priv->get_saturation = exportctrl_get_saturation;
+  priv->set_saturation = exportctrl_set_saturation;
+  priv->get_state = exportctrl_get_state;
+  priv->set_state = exportctrl_set_state;
+  priv->saturation_to_state = exportctrl_saturation_to_state;
+}
+
+static void export_free_controllers(vibrant_controller *controllers,
+                                    size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    free(controllers[i].info->name);
+    free(controllers[i].info);
+    layers_free(controllers + i);
+    free(controllers[i].priv);
+  }
+}
+
+vibrant_errors export_instance_new(vibrant_instance *instance,
+                                   const vibrant_export_options *options) {
+  size_t n = options->outputs_size;
+
+  for (size_t i = 0; i < n; i++) {
+    if (options->outputs[i] == NULL || options->outputs[i][0] == '\0') {
+      return vibrant_InvalidArgument;
+    }
+    for (size_t j = 0; j < i; j++) {
+      if (strcmp(options->outputs[i], options->outputs[j]) == 0) {
+        return vibrant_InvalidArgument;
+      }
+    }
+  }
+
+  vibrant_controller *controllers = calloc(n, sizeof(vibrant_controller));
+  if (n > 0 && controllers == NULL) {
+    return vibrant_NoMem;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    size_t name_len = strlen(options->outputs[i]);
+    XRROutputInfo *info = calloc(1, sizeof(XRROutputInfo));
+    char *name = strdup(options->outputs[i]);
+    vibrant_controller_internal *priv =
+        malloc(sizeof(vibrant_controller_internal));
+    if (info == NULL || name == NULL || priv == NULL) {
+      free(info);
+      free(name);
+      free(priv);
+      export_free_controllers(controllers, i);
+      free(controllers);
+      return vibrant_NoMem;
+    }
+
+    info->name = name;
+    info->nameLen = (int)name_len;
+    info->connection = RR_Connected;
+    // every output gets a CRTC of its own, like the index of the controller
+    info->crtc = i + 1;
+
+    *priv = (vibrant_controller_internal){
+        .nvId = -1,
+        .instance = instance,
+        .index = i,
+        .id = vibrant_hash(VIBRANT_HASH_SEED, name, name_len)};
+    export_controller_init(priv);
+    // XIDs are never 0, mimic that for the exported outputs
+    controllers[i] = (vibrant_controller){i + 1, info, NULL, priv};
+  }
+
+  *instance = (vibrant_instance){.controllers = controllers,
+                                 .controllers_size = n,
+                                 .backend = vibrant_BackendExport};
+
+  return vibrant_NoError;
+}
+
+void export_instance_free(vibrant_instance *instance) {
+  export_free_controllers(instance->controllers, instance->controllers_size);
+  free(instance->controllers);
+}
+
+vibrant_errors export_publish(vibrant_instance *instance) {
+  size_t n = instance->controllers_size;
+
+  struct vibrant_export_publisher *exporter =
+      calloc(1, sizeof(struct vibrant_export_publisher));
+  int *slots = malloc(n * sizeof(int));
+  if (exporter == NULL || (n > 0 && slots == NULL)) {
+    free(exporter);
+    free(slots);
+    return vibrant_NoMem;
+  }
+
+  uint32_t entries = 0;
+  for (size_t i = 0; i < n; i++) {
+    slots[i] =
+        instance->controllers[i].priv->backend == Export ? (int)entries++ : -1;
+  }
+
+  // a whole number of pages, the memfd is mapped in full anyway
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t size = sizeof(export_page_header) + entries * sizeof(export_page_entry);
+  size = (size + page_size - 1) / page_size * page_size;
+
+  int fd = memfd_create("vibrant-export", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  int event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  void *map = MAP_FAILED;
+  if (fd >= 0 && event_fd >= 0 && ftruncate(fd, size) == 0 &&
+      fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (map == MAP_FAILED) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (event_fd >= 0) {
+      close(event_fd);
+    }
+    free(exporter);
+    free(slots);
+    return vibrant_IOError;
+  }
+
+  export_page_header *page = map;
+  export_page_entry *page_entries = export_entries(page);
+  page->version = EXPORT_VERSION;
+  page->entries = entries;
+
+  // every exported output starts out with the identity matrix, like a
+  // fresh CRTC
+  double coeffs[9];
+  struct drm_color_ctm identity;
+  vibrant_saturation_to_coeffs(1.0, coeffs);
+  vibrant_translate_coeffs_to_ctm(coeffs, &identity);
+
+  for (size_t i = 0; i < n; i++) {
+    if (slots[i] < 0) {
+      continue;
+    }
+
+    vibrant_controller *controller = instance->controllers + i;
+    export_page_entry *entry = page_entries + slots[i];
+    entry->id = controller->priv->id;
+    strncpy(entry->name, controller->info->name, VIBRANT_EXPORT_NAME_SIZE - 1);
+    entry->ctm = identity;
+  }
+
+  // readers reject the page until the magic shows up
+  atomic_thread_fence(memory_order_release);
+  memcpy(page->magic, EXPORT_MAGIC, sizeof(page->magic));
+
+  exporter->page = page;
+  exporter->size = size;
+  exporter->fd = fd;
+  exporter->event_fd = event_fd;
+  exporter->slots = slots;
+  pthread_mutex_init(&exporter->lock, NULL);
+  instance->exporter = exporter;
+
+  return vibrant_NoError;
+}
+
+void export_unpublish(vibrant_instance *instance) {
+  struct vibrant_export_publisher *exporter = instance->exporter;
+  if (exporter == NULL) {
+    return;
+  }
+
+  munmap(exporter->page, exporter->size);
+  close(exporter->fd);
+  close(exporter->event_fd);
+  pthread_mutex_destroy(&exporter->lock);
+  free(exporter->slots);
+  free(exporter);
+  instance->exporter = NULL;
+}
+
+int vibrant_instance_get_export_fd(vibrant_instance *instance) {
+  return instance->exporter != NULL ? instance->exporter->fd : -1;
+}
+
+int vibrant_instance_get_export_event_fd(vibrant_instance *instance) {
+  return instance->exporter != NULL ? instance->exporter->event_fd : -1;
+}
+
+vibrant_errors vibrant_export_open(int fd, vibrant_export **exported) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return vibrant_IOError;
+  }
+  if ((size_t)st.st_size < sizeof(export_page_header)) {
+    return vibrant_BadFile;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    return vibrant_IOError;
+  }
+
+  // the page is sealed, its size is fixed by the publisher up front
+  export_page_header *page = map;
+  if (memcmp(page->magic, EXPORT_MAGIC, sizeof(page->magic)) != 0 ||
+      page->version != EXPORT_VERSION ||
+      (size_t)st.st_size < sizeof(export_page_header) +
+                               page->entries * sizeof(export_page_entry)) {
+    munmap(map, st.st_size);
+    return vibrant_BadFile;
+  }
+
+  *exported = malloc(sizeof(vibrant_export));
+  if (*exported == NULL) {
+    munmap(map, st.st_size);
+    return vibrant_NoMem;
+  }
+  (*exported)->page = page;
+  (*exported)->size = st.st_size;
+
+  return vibrant_NoError;
+}
+
+void vibrant_export_close(vibrant_export **exported) {
+  munmap((*exported)->page, (*exported)->size);
+  free(*exported);
+  *exported = NULL;
+}
+
+void vibrant_export_read(vibrant_export *exported,
+                         vibrant_export_entry *entries, size_t capacity,
+                         size_t *length, unsigned long long *generation) {
+  export_page_header *page = exported->page;
+  const export_page_entry *page_entries = export_entries(page);
+  size_t n = page->entries;
+  size_t copy = n < capacity ? n : capacity;
+  uint64_t begin, page_generation;
+
+  do {
+    begin = seqlock_read_begin(&page->sequence);
+
+    page_generation = page->generation;
+    for (size_t i = 0; i < copy; i++) {
+      entries[i].id = page_entries[i].id;
+      memcpy(entries[i].name, page_entries[i].name, VIBRANT_EXPORT_NAME_SIZE);
+      vibrant_translate_ctm_to_coeffs(&page_entries[i].ctm, entries[i].matrix);
+      entries[i].generation = page_entries[i].generation;
+    }
+  } while (seqlock_read_retry(&page->sequence, begin));
+
+  *length = n;
+  if (generation != NULL) {
+    *generation = page_generation;
+  }
+}
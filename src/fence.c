@@ -0,0 +1,266 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/internal.h"
+#include "vibrant/vibrant.h"
+#include "vibrant/xerror.h"
+
+#include <X11/Xatom.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FENCE_ATOM "_VIBRANT_FENCE"
+
+struct vibrant_fence {
+  // NULL once the instance was freed
+  vibrant_instance *instance;
+  vibrant_controller *controller;
+  vibrant_controller_state state;
+
+  // serial range of the requests that apply state, the marker request that
+  // completes the fence is last_serial - 1
+  unsigned long first_serial;
+  unsigned long last_serial;
+
+  vibrant_fence_status status;
+  vibrant_fence_fn fn;
+  void *user_data;
+  // set by vibrant_fence_free while pending, the errors of the request must
+  // still be caught, so the fence is only released once it completes
+  int freed;
+
+  // next pending fence of the instance
+  vibrant_fence *next;
+};
+
+/**
+ * Create the window whose PropertyNotify events mark processed requests.
+ */
+static int fence_window_create(vibrant_instance *instance) {
+  if (instance->fence_window != None) {
+    return 1;
+  }
+
+  Display *dpy = instance->dpy;
+  XSetWindowAttributes attributes = {.event_mask = PropertyChangeMask};
+
+  instance->fence_atom = XInternAtom(dpy, FENCE_ATOM, False);
+  instance->fence_window =
+      XCreateWindow(dpy, DefaultRootWindow(dpy), -1, -1, 1, 1, 0, 0,
+                    InputOnly, CopyFromParent, CWEventMask, &attributes);
+
+  return instance->fence_window != None;
+}
+
+static void fence_complete(vibrant_fence *fence, vibrant_fence_status status) {
+  fence->status = status;
+
+  // the output has the state whether or not anyone still waits for it
+  if (status == vibrant_FenceDone) {
+    controller_state_changed(fence->controller, &fence->state);
+  }
+
+  if (fence->freed) {
+    free(fence);
+    return;
+  }
+
+  if (fence->fn != NULL) {
+    fence->fn(fence, status, fence->user_data);
+  }
+}
+
+vibrant_errors
+vibrant_controller_set_saturation_async(vibrant_controller *controller,
+                                        double saturation,
+                                        vibrant_fence **fence) {
+  vibrant_instance *instance = controller->priv->instance;
+  Display *dpy = instance->dpy;
+
+  vibrant_fence *f = calloc(1, sizeof(vibrant_fence));
+  if (f == NULL) {
+    return vibrant_NoMem;
+  }
+  f->instance = instance;
+  f->controller = controller;
+  f->status = vibrant_FencePending;
+  controller_saturation_to_state(controller, saturation, &f->state);
+
+  // backends without a connection apply right away
+  if (dpy == NULL) {
+    int status = controller->priv->set_state(controller, &f->state);
+    if (status == Success && instance->commit != NULL) {
+      status = instance->commit(instance);
+    }
+    fence_complete(f, status == Success ? vibrant_FenceDone
+                                        : vibrant_FenceFailed);
+    *fence = f;
+    return vibrant_NoError;
+  }
+
+  if (!fence_window_create(instance)) {
+    free(f);
+    return vibrant_BackendError;
+  }
+
+  xerror_acquire(dpy);
+
+  f->first_serial = NextRequest(dpy);
+  if (controller->priv->set_state(controller, &f->state) != Success) {
+    xerror_release(dpy);
+    free(f);
+    return vibrant_BackendError;
+  }
+
+  // the server answers with a PropertyNotify once it processed everything
+  // up to here, appending nothing leaves the property as it is
+  XChangeProperty(dpy, instance->fence_window, instance->fence_atom,
+                  XA_INTEGER, 32, PropModeAppend, NULL, 0);
+  f->last_serial = NextRequest(dpy);
+  XFlush(dpy);
+
+  f->next = instance->fences;
+  instance->fences = f;
+
+  *fence = f;
+  return vibrant_NoError;
+}
+
+void fences_check(vibrant_instance *instance) {
+  Display *dpy = instance->dpy;
+  if (dpy == NULL) {
+    return;
+  }
+
+  unsigned long processed = LastKnownRequestProcessed(dpy);
+  vibrant_fence **link = &instance->fences;
+
+  while (*link != NULL) {
+    vibrant_fence *fence = *link;
+
+    if (fence->last_serial - 1 > processed) {
+      link = &fence->next;
+      continue;
+    }
+
+    *link = fence->next;
+    fence->next = NULL;
+
+    int error = xerror_find(dpy, fence->first_serial, fence->last_serial);
+    xerror_release(dpy);
+    fence_complete(fence, error == Success ? vibrant_FenceDone
+                                           : vibrant_FenceFailed);
+  }
+}
+
+void fences_abandon(vibrant_instance *instance) {
+  while (instance->fences != NULL) {
+    vibrant_fence *fence = instance->fences;
+    instance->fences = fence->next;
+    fence->next = NULL;
+
+    xerror_release(instance->dpy);
+    if (fence->freed) {
+      free(fence);
+      continue;
+    }
+
+    fence->instance = NULL;
+    fence->status = vibrant_FenceFailed;
+    if (fence->fn != NULL) {
+      fence->fn(fence, vibrant_FenceFailed, fence->user_data);
+    }
+  }
+}
+
+/**
+ * Read whatever the server sent so far without blocking and complete the
+ * fences it covers.
+ */
+static void fence_read(vibrant_instance *instance) {
+  Display *dpy = instance->dpy;
+  XEvent event;
+
+  // errors are handled and the last processed serial updated while reading
+  XEventsQueued(dpy, QueuedAfterReading);
+  while (XCheckTypedWindowEvent(dpy, instance->fence_window, PropertyNotify,
+                                &event)) {
+  }
+
+  fences_check(instance);
+}
+
+vibrant_fence_status vibrant_fence_poll(vibrant_fence *fence) {
+  if (fence->status == vibrant_FencePending) {
+    fence_read(fence->instance);
+  }
+
+  return fence->status;
+}
+
+static long long fence_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+vibrant_fence_status vibrant_fence_wait(vibrant_fence *fence, int timeout_ms) {
+  long long deadline = fence_now_ms() + timeout_ms;
+
+  while (vibrant_fence_poll(fence) == vibrant_FencePending) {
+    int remaining = -1;
+    if (timeout_ms >= 0) {
+      long long left = deadline - fence_now_ms();
+      if (left <= 0) {
+        break;
+      }
+      remaining = (int)left;
+    }
+
+    struct pollfd pfd = {ConnectionNumber(fence->instance->dpy), POLLIN, 0};
+    poll(&pfd, 1, remaining);
+  }
+
+  return fence->status;
+}
+
+void vibrant_fence_set_callback(vibrant_fence *fence, vibrant_fence_fn fn,
+                                void *user_data) {
+  fence->fn = fn;
+  fence->user_data = user_data;
+
+  if (fn != NULL && fence->status != vibrant_FencePending) {
+    fn(fence, fence->status, user_data);
+  }
+}
+
+void vibrant_fence_free(vibrant_fence **fence) {
+  vibrant_fence *f = *fence;
+  *fence = NULL;
+
+  if (f->status == vibrant_FencePending) {
+    // released by fences_check or fences_abandon
+    f->freed = 1;
+    f->fn = NULL;
+    return;
+  }
+
+  free(f);
+}
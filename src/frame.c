@@ -0,0 +1,204 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/frame.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+static inline void frame_accumulate_pixel(const unsigned char *pixel,
+                                          frame_sums *sums) {
+  int b = pixel[0];
+  int g = pixel[1];
+  int r = pixel[2];
+
+  int rg = r - g;
+  int yb = r + g - 2 * b;
+  sums->rg += rg;
+  sums->rg2 += rg * rg;
+  sums->yb += yb;
+  sums->yb2 += yb * yb;
+  sums->count++;
+
+  int max = r > g ? r : g;
+  max = max > b ? max : b;
+  int min = r < g ? r : g;
+  min = min < b ? min : b;
+  int chroma = max - min;
+  for (int i = 0; i < FRAME_CHROMA_THRESHOLDS; i++) {
+    sums->chroma_above[i] += chroma >= 32 * (i + 1);
+  }
+}
+
+void frame_accumulate_scalar(const unsigned char *row, size_t width,
+                             unsigned step, frame_sums *sums) {
+  for (size_t x = 0; x < width; x += (size_t)FRAME_SPAN * step) {
+    size_t end = x + FRAME_SPAN < width ? x + FRAME_SPAN : width;
+
+    for (size_t i = x; i < end; i++) {
+      frame_accumulate_pixel(row + 4 * i, sums);
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static int64_t frame_sum_epi32(__m256i v) __attribute__((target("avx2")));
+
+static int64_t frame_sum_epi32(__m256i v) {
+  int32_t lanes[8];
+  _mm256_storeu_si256((__m256i *)lanes, v);
+
+  int64_t sum = 0;
+  for (int i = 0; i < 8; i++) {
+    sum += lanes[i];
+  }
+  return sum;
+}
+
+__attribute__((target("avx2"))) void
+frame_accumulate_avx2(const unsigned char *row, size_t width, unsigned step,
+                      frame_sums *sums) {
+  const __m256i byte_mask = _mm256_set1_epi32(0xff);
+  __m256i rg_sum = _mm256_setzero_si256();
+  __m256i rg2_sum = _mm256_setzero_si256();
+  __m256i yb_sum = _mm256_setzero_si256();
+  __m256i yb2_sum = _mm256_setzero_si256();
+  __m256i above[FRAME_CHROMA_THRESHOLDS];
+  for (int i = 0; i < FRAME_CHROMA_THRESHOLDS; i++) {
+    above[i] = _mm256_setzero_si256();
+  }
+
+  // one span per iteration, one pixel per 32-bit lane. The lane sums can't
+  // overflow as long as width stays below 32768.
+  size_t x = 0;
+  size_t spans = 0;
+  for (; x + FRAME_SPAN <= width; x += (size_t)FRAME_SPAN * step, spans++) {
+    __m256i pixels = _mm256_loadu_si256((const __m256i *)(row + 4 * x));
+    __m256i b = _mm256_and_si256(pixels, byte_mask);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), byte_mask);
+    __m256i r = _mm256_and_si256(_mm256_srli_epi32(pixels, 16), byte_mask);
+
+    __m256i rg = _mm256_sub_epi32(r, g);
+    __m256i yb = _mm256_sub_epi32(_mm256_add_epi32(r, g),
+                                  _mm256_slli_epi32(b, 1));
+    rg_sum = _mm256_add_epi32(rg_sum, rg);
+    rg2_sum = _mm256_add_epi32(rg2_sum, _mm256_mullo_epi32(rg, rg));
+    yb_sum = _mm256_add_epi32(yb_sum, yb);
+    yb2_sum = _mm256_add_epi32(yb2_sum, _mm256_mullo_epi32(yb, yb));
+
+    __m256i max = _mm256_max_epi32(_mm256_max_epi32(r, g), b);
+    __m256i min = _mm256_min_epi32(_mm256_min_epi32(r, g), b);
+    __m256i chroma = _mm256_sub_epi32(max, min);
+    for (int i = 0; i < FRAME_CHROMA_THRESHOLDS; i++) {
+      // matching lanes are -1, subtracting counts them
+      __m256i match =
+          _mm256_cmpgt_epi32(chroma, _mm256_set1_epi32(32 * (i + 1) - 1));
+      above[i] = _mm256_sub_epi32(above[i], match);
+    }
+  }
+
+  sums->rg += frame_sum_epi32(rg_sum);
+  sums->rg2 += frame_sum_epi32(rg2_sum);
+  sums->yb += frame_sum_epi32(yb_sum);
+  sums->yb2 += frame_sum_epi32(yb2_sum);
+  sums->count += spans * FRAME_SPAN;
+  for (int i = 0; i < FRAME_CHROMA_THRESHOLDS; i++) {
+    sums->chroma_above[i] += frame_sum_epi32(above[i]);
+  }
+
+  // a last span cut short by the end of the row
+  if (x < width) {
+    frame_accumulate_scalar(row + 4 * x, width - x, step, sums);
+  }
+}
+#endif
+
+#if defined(__aarch64__)
+void frame_accumulate_neon(const unsigned char *row, size_t width,
+                           unsigned step, frame_sums *sums) {
+  int32x4_t rg_sum = vdupq_n_s32(0);
+  int32x4_t rg2_sum = vdupq_n_s32(0);
+  int32x4_t yb_sum = vdupq_n_s32(0);
+  int32x4_t yb2_sum = vdupq_n_s32(0);
+  uint16x8_t above[FRAME_CHROMA_THRESHOLDS];
+  for (int i = 0; i < FRAME_CHROMA_THRESHOLDS; i++) {
+    above[i] = vdupq_n_u16(0);
+  }
+
+  // one span per iteration, deinterleaved into B, G, R and X vectors
+  size_t x = 0;
+  size_t spans = 0;
+  for (; x + FRAME_SPAN <= width; x += (size_t)FRAME_SPAN * step, spans++) {
+    uint8x8x4_t pixels = vld4_u8(row + 4 * x);
+    int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(pixels.val[0]));
+    int16x8_t g = vreinterpretq_s16_u16(vmovl_u8(pixels.val[1]));
+    int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(pixels.val[2]));
+
+    int16x8_t rg = vsubq_s16(r, g);
+    int16x8_t yb = vsubq_s16(vaddq_s16(r, g), vshlq_n_s16(b, 1));
+    rg_sum = vpadalq_s16(rg_sum, rg);
+    yb_sum = vpadalq_s16(yb_sum, yb);
+    rg2_sum = vmlal_s16(rg2_sum, vget_low_s16(rg), vget_low_s16(rg));
+    rg2_sum = vmlal_s16(rg2_sum, vget_high_s16(rg), vget_high_s16(rg));
+    yb2_sum = vmlal_s16(yb2_sum, vget_low_s16(yb), vget_low_s16(yb));
+    yb2_sum = vmlal_s16(yb2_sum, vget_high_s16(yb), vget_high_s16(yb));
+
+    uint8x8_t max = vmax_u8(vmax_u8(pixels.val[0], pixels.val[1]),
+                            pixels.val[2]);
+    uint8x8_t min = vmin_u8(vmin_u8(pixels.val[0], pixels.val[1]),
+                            pixels.val[2]);
+    uint8x8_t chroma = vsub_u8(max, min);
+    for (int i = 0; i < FRAME_CHROMA_THRESHOLDS; i++) {
+      uint8x8_t match = vcge_u8(chroma, vdup_n_u8(32 * (i + 1)));
+      above[i] = vaddw_u8(above[i], vshr_n_u8(match, 7));
+    }
+  }
+
+  // lanes get close to INT32_MAX on saturated rows, widen before adding them
+  sums->rg += vaddlvq_s32(rg_sum);
+  sums->rg2 += vaddlvq_s32(rg2_sum);
+  sums->yb += vaddlvq_s32(yb_sum);
+  sums->yb2 += vaddlvq_s32(yb2_sum);
+  sums->count += spans * FRAME_SPAN;
+  for (int i = 0; i < FRAME_CHROMA_THRESHOLDS; i++) {
+    sums->chroma_above[i] += vaddlvq_u16(above[i]);
+  }
+
+  if (x < width) {
+    frame_accumulate_scalar(row + 4 * x, width - x, step, sums);
+  }
+}
+#endif
+
+frame_accumulate_fn frame_accumulate_best(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return frame_accumulate_avx2;
+  }
+#elif defined(__aarch64__)
+  return frame_accumulate_neon;
+#endif
+
+  return frame_accumulate_scalar;
+}
@@ -0,0 +1,322 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// memfd_create
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "vibrant/gamma.h"
+#include "vibrant/vibrant.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// how far the S-curve bends per unit of saturation, chosen so that the
+// supported range stays monotonic: the slope never drops below 0.25
+#define GAMMA_CURVE_STRENGTH 0.25
+
+typedef struct gamma_cache_entry {
+  int size;
+  int level;
+  XRRCrtcGamma *gamma;
+} gamma_cache_entry;
+
+struct gamma_cache {
+  gamma_cache_entry entries[GAMMA_CACHE_SIZE];
+  // entry replaced next, once all are taken
+  unsigned int next;
+};
+
+typedef struct gamma_table_entry {
+  int size;
+  int level;
+  // -1 if unused
+  int fd;
+} gamma_table_entry;
+
+struct gamma_table_cache {
+  gamma_table_entry entries[GAMMA_CACHE_SIZE];
+  // entry replaced next, once all are taken
+  unsigned int next;
+};
+
+static double gamma_smoothstep(double v) { return v * v * (3 - 2 * v); }
+
+double gamma_level_to_saturation(int level) {
+  return (double)level / GAMMA_LEVEL_SCALE;
+}
+
+int gamma_saturation_to_level(double saturation) {
+  saturation = fmax(saturation, VIBRANT_SATURATION_MIN);
+  saturation = fmin(saturation, VIBRANT_SATURATION_MAX);
+
+  return (int)lround(saturation * GAMMA_LEVEL_SCALE);
+}
+
+void gamma_fill_ramp(int level, int size, unsigned short *ramp) {
+  double k = (gamma_level_to_saturation(level) - 1) * GAMMA_CURVE_STRENGTH;
+
+  for (int i = 0; i < size; i++) {
+    double v = size > 1 ? (double)i / (size - 1) : 0;
+    double f = v + k * (gamma_smoothstep(v) - v);
+
+    ramp[i] = (unsigned short)lround(fmin(fmax(f, 0), 1) * 65535);
+  }
+}
+
+int gamma_ramp_to_level(const unsigned short *ramp, int size) {
+  // least squares fit of k in f(v) - v = k * (smoothstep(v) - v), using
+  // every entry keeps the 16 bit rounding of single entries out of the level
+  double num = 0, den = 0;
+
+  for (int i = 0; i < size; i++) {
+    double v = size > 1 ? (double)i / (size - 1) : 0;
+    double d = gamma_smoothstep(v) - v;
+
+    num += ((double)ramp[i] / 65535 - v) * d;
+    den += d * d;
+  }
+
+  if (den == 0) {
+    return GAMMA_LEVEL_SCALE;
+  }
+
+  return gamma_saturation_to_level(num / den / GAMMA_CURVE_STRENGTH + 1);
+}
+
+int gamma_crtc_size(Display *dpy, RRCrtc crtc) {
+  if (crtc == None) {
+    return 0;
+  }
+
+  return XRRGetCrtcGammaSize(dpy, crtc);
+}
+
+int gamma_get_level(Display *dpy, RRCrtc crtc, int *level) {
+  if (crtc == None) {
+    return BadMatch;
+  }
+
+  XRRCrtcGamma *gamma = XRRGetCrtcGamma(dpy, crtc);
+  if (gamma == NULL || gamma->size <= 0) {
+    if (gamma != NULL) {
+      XRRFreeGamma(gamma);
+    }
+    return BadMatch;
+  }
+
+  *level = gamma_ramp_to_level(gamma->red, gamma->size);
+  XRRFreeGamma(gamma);
+
+  return Success;
+}
+
+/**
+ * Find the ramp of level and size in cache, generating it if necessary.
+ */
+static XRRCrtcGamma *gamma_cache_lookup(gamma_cache *cache, int size,
+                                        int level) {
+  gamma_cache_entry *free_entry = NULL;
+
+  for (int i = 0; i < GAMMA_CACHE_SIZE; i++) {
+    gamma_cache_entry *entry = cache->entries + i;
+
+    if (entry->gamma == NULL) {
+      if (free_entry == NULL) {
+        free_entry = entry;
+      }
+    } else if (entry->size == size && entry->level == level) {
+      return entry->gamma;
+    }
+  }
+
+  XRRCrtcGamma *gamma = XRRAllocGamma(size);
+  if (gamma == NULL) {
+    return NULL;
+  }
+
+  gamma_fill_ramp(level, size, gamma->red);
+  for (int i = 0; i < size; i++) {
+    gamma->green[i] = gamma->red[i];
+    gamma->blue[i] = gamma->red[i];
+  }
+
+  if (free_entry == NULL) {
+    free_entry = cache->entries + cache->next;
+    cache->next = (cache->next + 1) % GAMMA_CACHE_SIZE;
+    XRRFreeGamma(free_entry->gamma);
+  }
+
+  free_entry->size = size;
+  free_entry->level = level;
+  free_entry->gamma = gamma;
+
+  return gamma;
+}
+
+int gamma_queue_level(gamma_cache **cache, Display *dpy, RRCrtc crtc,
+                      int size, int level) {
+  if (crtc == None || size <= 0) {
+    return BadMatch;
+  }
+
+  if (*cache == NULL) {
+    *cache = calloc(1, sizeof(gamma_cache));
+    if (*cache == NULL) {
+      return BadAlloc;
+    }
+  }
+
+  XRRCrtcGamma *gamma = gamma_cache_lookup(*cache, size, level);
+  if (gamma == NULL) {
+    return BadAlloc;
+  }
+
+  XRRSetCrtcGamma(dpy, crtc, gamma);
+
+  return Success;
+}
+
+void gamma_cache_free(gamma_cache **cache) {
+  if (*cache == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < GAMMA_CACHE_SIZE; i++) {
+    if ((*cache)->entries[i].gamma != NULL) {
+      XRRFreeGamma((*cache)->entries[i].gamma);
+    }
+  }
+
+  free(*cache);
+  *cache = NULL;
+}
+
+int gamma_table_fd(int level, int size) {
+  if (size <= 0) {
+    return -1;
+  }
+
+  size_t ramp_bytes = (size_t)size * sizeof(unsigned short);
+  int fd = memfd_create("vibrant-gamma", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    return -1;
+  }
+
+  unsigned short *table = MAP_FAILED;
+  if (ftruncate(fd, 3 * ramp_bytes) == 0) {
+    table = mmap(NULL, 3 * ramp_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                 0);
+  }
+  if (table == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+
+  gamma_fill_ramp(level, size, table);
+  memcpy(table + size, table, ramp_bytes);
+  memcpy(table + 2 * size, table, ramp_bytes);
+  munmap(table, 3 * ramp_bytes);
+
+  // receivers read the table while it is in use, it must neither change nor
+  // shrink underneath
+  if (fcntl(fd, F_ADD_SEALS,
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/**
+ * Open a new file description of the table behind fd. Compositors read() the
+ * table from the current offset, and duplicates of an fd share it, so every
+ * table that is sent needs one of its own.
+ */
+static int gamma_table_reopen(int fd) {
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+  return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+int gamma_table_lookup(gamma_table_cache **cache, int size, int level) {
+  if (*cache == NULL) {
+    *cache = malloc(sizeof(gamma_table_cache));
+    if (*cache == NULL) {
+      return -1;
+    }
+    for (int i = 0; i < GAMMA_CACHE_SIZE; i++) {
+      (*cache)->entries[i].fd = -1;
+    }
+    (*cache)->next = 0;
+  }
+
+  gamma_table_entry *free_entry = NULL;
+
+  for (int i = 0; i < GAMMA_CACHE_SIZE; i++) {
+    gamma_table_entry *entry = (*cache)->entries + i;
+
+    if (entry->fd < 0) {
+      if (free_entry == NULL) {
+        free_entry = entry;
+      }
+    } else if (entry->size == size && entry->level == level) {
+      return gamma_table_reopen(entry->fd);
+    }
+  }
+
+  int fd = gamma_table_fd(level, size);
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (free_entry == NULL) {
+    free_entry = (*cache)->entries + (*cache)->next;
+    (*cache)->next = ((*cache)->next + 1) % GAMMA_CACHE_SIZE;
+    close(free_entry->fd);
+  }
+
+  free_entry->size = size;
+  free_entry->level = level;
+  free_entry->fd = fd;
+
+  return gamma_table_reopen(fd);
+}
+
+void gamma_table_cache_free(gamma_table_cache **cache) {
+  if (*cache == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < GAMMA_CACHE_SIZE; i++) {
+    if ((*cache)->entries[i].fd >= 0) {
+      close((*cache)->entries[i].fd);
+    }
+  }
+
+  free(*cache);
+  *cache = NULL;
+}
@@ -0,0 +1,138 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/internal.h"
+#include "vibrant/vibrant.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// number of hex digits of a printed controller id
+#define ID_HEX_DIGITS 16
+
+static uint64_t index_name_hash(const char *name) {
+  return vibrant_hash(VIBRANT_HASH_SEED, name, strlen(name));
+}
+
+static void index_insert(size_t *table, size_t mask, uint64_t hash,
+                         size_t controller) {
+  size_t slot = hash & mask;
+  // linear probing, the table is kept at most half full
+  while (table[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+  table[slot] = controller + 1;
+}
+
+vibrant_errors index_build(vibrant_instance *instance) {
+  size_t n = instance->controllers_size;
+  size_t capacity = 4;
+  while (capacity < n * 2) {
+    capacity *= 2;
+  }
+
+  instance->index_by_name = calloc(capacity, sizeof(size_t));
+  instance->index_by_id = calloc(capacity, sizeof(size_t));
+  if (instance->index_by_name == NULL || instance->index_by_id == NULL) {
+    index_free(instance);
+    return vibrant_NoMem;
+  }
+  instance->index_mask = capacity - 1;
+
+  for (size_t i = 0; i < n; i++) {
+    vibrant_controller *controller = instance->controllers + i;
+    index_insert(instance->index_by_name, instance->index_mask,
+                 index_name_hash(controller->info->name), i);
+    index_insert(instance->index_by_id, instance->index_mask,
+                 controller->priv->id, i);
+  }
+
+  return vibrant_NoError;
+}
+
+void index_free(vibrant_instance *instance) {
+  free(instance->index_by_name);
+  free(instance->index_by_id);
+  instance->index_by_name = NULL;
+  instance->index_by_id = NULL;
+  instance->index_mask = 0;
+}
+
+vibrant_controller *index_find_name(vibrant_instance *instance,
+                                    const char *name) {
+  if (instance->index_by_name == NULL) {
+    return NULL;
+  }
+
+  size_t mask = instance->index_mask;
+  for (size_t slot = index_name_hash(name) & mask;
+       instance->index_by_name[slot] != 0; slot = (slot + 1) & mask) {
+    vibrant_controller *controller =
+        instance->controllers + instance->index_by_name[slot] - 1;
+    if (strcmp(controller->info->name, name) == 0) {
+      return controller;
+    }
+  }
+
+  return NULL;
+}
+
+vibrant_controller *index_find_id(vibrant_instance *instance, uint64_t id) {
+  if (instance->index_by_id == NULL) {
+    return NULL;
+  }
+
+  size_t mask = instance->index_mask;
+  for (size_t slot = id & mask; instance->index_by_id[slot] != 0;
+       slot = (slot + 1) & mask) {
+    vibrant_controller *controller =
+        instance->controllers + instance->index_by_id[slot] - 1;
+    if (controller->priv->id == id) {
+      return controller;
+    }
+  }
+
+  return NULL;
+}
+
+vibrant_controller *vibrant_instance_find_controller(vibrant_instance *instance,
+                                                     const char *key) {
+  vibrant_controller *controller = index_find_name(instance, key);
+  if (controller != NULL || strlen(key) != ID_HEX_DIGITS) {
+    return controller;
+  }
+
+  uint64_t id = 0;
+  for (size_t i = 0; i < ID_HEX_DIGITS; i++) {
+    char c = key[i];
+    int digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return NULL;
+    }
+    id = id << 4u | digit;
+  }
+
+  return index_find_id(instance, id);
+}
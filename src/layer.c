@@ -0,0 +1,220 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/internal.h"
+#include "vibrant/vibrant.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.c"
+
+static vibrant_layer *layers_find(vibrant_controller_internal *priv,
+                                  const char *name) {
+  for (size_t i = 0; i < priv->layers_size; i++) {
+    if (strcmp(priv->layers[i].name, name) == 0) {
+      return priv->layers + i;
+    }
+  }
+
+  return NULL;
+}
+
+static void layers_remove(vibrant_controller_internal *priv,
+                          vibrant_layer *layer) {
+  free(layer->name);
+  size_t index = layer - priv->layers;
+  memmove(layer, layer + 1,
+          sizeof(vibrant_layer) * (priv->layers_size - index - 1));
+  priv->layers_size--;
+}
+
+/**
+ * Keep layers ordered by priority. Layers of equal priority stay in the order
+ * they were added, so re-setting a layer doesn't reshuffle the composition.
+ */
+static void layers_sort(vibrant_controller_internal *priv) {
+  for (size_t i = 1; i < priv->layers_size; i++) {
+    vibrant_layer layer = priv->layers[i];
+    size_t j = i;
+
+    for (; j > 0 && priv->layers[j - 1].priority > layer.priority; j--) {
+      priv->layers[j] = priv->layers[j - 1];
+    }
+    priv->layers[j] = layer;
+  }
+}
+
+/**
+ * Multiply all layers of priv into coeffs, lowest priority first.
+ */
+static void layers_compose(const vibrant_controller_internal *priv,
+                           double *coeffs) {
+  vibrant_saturation_to_coeffs(1.0, coeffs);
+
+  for (size_t n = 0; n < priv->layers_size; n++) {
+    const double *matrix = priv->layers[n].matrix;
+    double product[9];
+
+    for (int row = 0; row < 3; row++) {
+      for (int col = 0; col < 3; col++) {
+        product[row * 3 + col] = matrix[row * 3] * coeffs[col] +
+                                 matrix[row * 3 + 1] * coeffs[3 + col] +
+                                 matrix[row * 3 + 2] * coeffs[6 + col];
+      }
+    }
+    memcpy(coeffs, product, sizeof(product));
+  }
+}
+
+/**
+ * Compose the layers of controller and write the result, unless it is what
+ * was written last time.
+ */
+static vibrant_errors layers_apply(vibrant_controller *controller) {
+  vibrant_controller_internal *priv = controller->priv;
+  vibrant_controller_state state;
+  double coeffs[9];
+
+  memset(&state, 0, sizeof(state));
+  layers_compose(priv, coeffs);
+
+  if (priv->backend == XNVCtrl || priv->backend == Gamma ||
+      priv->backend == Wayland) {
+    // digital vibrance and gamma ramps can only express the saturation part
+    // of the matrix
+    priv->saturation_to_state(vibrant_coeffs_to_saturation(coeffs), &state);
+  } else if (priv->backend == DRM) {
+    vibrant_translate_coeffs_to_ctm(coeffs, &state.drm_ctm);
+  } else {
+    struct drm_color_ctm ctm;
+    vibrant_translate_coeffs_to_ctm(coeffs, &ctm);
+    vibrant_translate_ctm_to_padded_ctm(&ctm, state.padded_ctm);
+  }
+
+  if (priv->composed_written &&
+      vibrant_controller_state_equal(controller, &priv->composed, &state)) {
+    return vibrant_NoError;
+  }
+
+  vibrant_transaction *transaction;
+  vibrant_errors err = vibrant_transaction_new(priv->instance, &transaction);
+  if (err != vibrant_NoError) {
+    return err;
+  }
+
+  err = transaction_set_state(transaction, controller, &state);
+  if (err == vibrant_NoError) {
+    err = vibrant_transaction_commit(transaction, NULL);
+  }
+  vibrant_transaction_free(&transaction);
+
+  // on failure the next layer change tries again
+  if (err == vibrant_NoError) {
+    priv->composed = state;
+    priv->composed_written = 1;
+  }
+
+  return err;
+}
+
+vibrant_errors vibrant_controller_set_layer(vibrant_controller *controller,
+                                            const char *name, int priority,
+                                            const double matrix[9]) {
+  vibrant_controller_internal *priv = controller->priv;
+  vibrant_layer *layer = layers_find(priv, name);
+  vibrant_layer previous;
+  int added = layer == NULL;
+
+  if (layer != NULL) {
+    previous = *layer;
+  } else {
+    char *layer_name = strdup(name);
+    if (layer_name == NULL) {
+      return vibrant_NoMem;
+    }
+
+    vibrant_layer *tmp = realloc(priv->layers, sizeof(vibrant_layer) *
+                                                   (priv->layers_size + 1));
+    if (tmp == NULL) {
+      free(layer_name);
+      return vibrant_NoMem;
+    }
+    priv->layers = tmp;
+
+    layer = priv->layers + priv->layers_size++;
+    layer->name = layer_name;
+  }
+
+  layer->priority = priority;
+  memcpy(layer->matrix, matrix, sizeof(layer->matrix));
+  layers_sort(priv);
+
+  vibrant_errors err = layers_apply(controller);
+  if (err != vibrant_NoError) {
+    // the layers have to describe what is on the output, drop what couldn't
+    // be written
+    layer = layers_find(priv, name);
+    if (added) {
+      layers_remove(priv, layer);
+    } else {
+      *layer = previous;
+      layers_sort(priv);
+    }
+  }
+
+  return err;
+}
+
+vibrant_errors
+vibrant_controller_set_layer_saturation(vibrant_controller *controller,
+                                        const char *name, int priority,
+                                        double saturation) {
+  double coeffs[9];
+
+  controller_saturation_to_coeffs(controller, saturation, coeffs);
+
+  return vibrant_controller_set_layer(controller, name, priority, coeffs);
+}
+
+vibrant_errors vibrant_controller_remove_layer(vibrant_controller *controller,
+                                               const char *name) {
+  vibrant_controller_internal *priv = controller->priv;
+  vibrant_layer *layer = layers_find(priv, name);
+
+  if (layer == NULL) {
+    return vibrant_NoError;
+  }
+
+  layers_remove(priv, layer);
+
+  return layers_apply(controller);
+}
+
+void layers_free(vibrant_controller *controller) {
+  vibrant_controller_internal *priv = controller->priv;
+
+  for (size_t i = 0; i < priv->layers_size; i++) {
+    free(priv->layers[i].name);
+  }
+  free(priv->layers);
+  priv->layers = NULL;
+  priv->layers_size = 0;
+}
@@ -0,0 +1,300 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/internal.h"
+#include "vibrant/vibrant.h"
+#include "vibrant/xerror.h"
+
+#include <math.h>
+#include <stdio.h>
+
+/*
+ * The lease of an output is the X selection _VIBRANT_LEASE_<id>, owned by an
+ * unmapped window of the holding instance. The server tells the previous
+ * owner through SelectionClear when someone else takes it over, and drops it
+ * when the holder disconnects. Other clients send their requests to the
+ * owner window as client messages:
+ *
+ *   message_type  _VIBRANT_LEASE_REQUEST
+ *   data.l[0]     selection of the output
+ *   data.l[1]     saturation * LEASE_SCALE
+ */
+#define LEASE_ATOM_FORMAT "_VIBRANT_LEASE_%016llx"
+#define LEASE_REQUEST_ATOM "_VIBRANT_LEASE_REQUEST"
+// format 32 client message data is 32 bits on the wire
+#define LEASE_SCALE 100000.0
+
+static int lease_window_create(vibrant_instance *instance) {
+  if (instance->lease_window != None) {
+    return 1;
+  }
+
+  Display *dpy = instance->dpy;
+
+  // selection and client messages reach the creator without an event mask
+  instance->lease_request_atom = XInternAtom(dpy, LEASE_REQUEST_ATOM, False);
+  instance->lease_window =
+      XCreateWindow(dpy, DefaultRootWindow(dpy), -1, -1, 1, 1, 0, 0, InputOnly,
+                    CopyFromParent, 0, NULL);
+
+  return instance->lease_window != None;
+}
+
+static Atom lease_atom(vibrant_controller *controller) {
+  vibrant_controller_internal *priv = controller->priv;
+
+  if (priv->lease_atom == None) {
+    char name[sizeof(LEASE_ATOM_FORMAT) + 16];
+    snprintf(name, sizeof(name), LEASE_ATOM_FORMAT,
+             (unsigned long long)priv->id);
+    priv->lease_atom = XInternAtom(controller->display, name, False);
+  }
+
+  return priv->lease_atom;
+}
+
+static vibrant_controller *lease_find_controller(vibrant_instance *instance,
+                                                 Atom atom) {
+  for (int i = 0; i < instance->controllers_size; i++) {
+    if (instance->controllers[i].priv->lease_atom == atom) {
+      return instance->controllers + i;
+    }
+  }
+
+  return NULL;
+}
+
+vibrant_errors vibrant_controller_acquire_lease(vibrant_controller *controller,
+                                                int force) {
+  vibrant_instance *instance = controller->priv->instance;
+  Display *dpy = instance->dpy;
+
+  if (dpy == NULL) {
+    controller->priv->leased = 1;
+    return vibrant_NoError;
+  }
+
+  if (!lease_window_create(instance)) {
+    return vibrant_BackendError;
+  }
+
+  Atom atom = lease_atom(controller);
+  Window owner = XGetSelectionOwner(dpy, atom);
+  if (owner == instance->lease_window) {
+    controller->priv->leased = 1;
+    return vibrant_NoError;
+  }
+  if (owner != None && !force) {
+    return vibrant_LeaseHeld;
+  }
+
+  XSetSelectionOwner(dpy, atom, instance->lease_window, CurrentTime);
+
+  // someone may have been faster, the server only keeps one owner
+  if (XGetSelectionOwner(dpy, atom) != instance->lease_window) {
+    return vibrant_LeaseHeld;
+  }
+
+  controller->priv->leased = 1;
+  return vibrant_NoError;
+}
+
+void vibrant_controller_release_lease(vibrant_controller *controller) {
+  vibrant_instance *instance = controller->priv->instance;
+  Display *dpy = instance->dpy;
+
+  if (!controller->priv->leased) {
+    return;
+  }
+  controller->priv->leased = 0;
+  controller->priv->lease_pending = 0;
+
+  if (dpy != NULL &&
+      XGetSelectionOwner(dpy, lease_atom(controller)) ==
+          instance->lease_window) {
+    XSetSelectionOwner(dpy, lease_atom(controller), None, CurrentTime);
+    XFlush(dpy);
+  }
+}
+
+int vibrant_controller_has_lease(vibrant_controller *controller) {
+  return controller->priv->leased;
+}
+
+/**
+ * Apply saturation to controller in a transaction of its own, which skips
+ * the write if the output already has it.
+ */
+static vibrant_errors lease_set_saturation(vibrant_controller *controller,
+                                           double saturation) {
+  vibrant_transaction *transaction;
+  vibrant_errors err =
+      vibrant_transaction_new(controller->priv->instance, &transaction);
+  if (err != vibrant_NoError) {
+    return err;
+  }
+
+  err = vibrant_transaction_set_saturation(transaction, controller,
+                                           saturation);
+  if (err == vibrant_NoError) {
+    err = vibrant_transaction_commit(transaction, NULL);
+  }
+  vibrant_transaction_free(&transaction);
+
+  return err;
+}
+
+vibrant_errors
+vibrant_controller_request_saturation(vibrant_controller *controller,
+                                      double saturation) {
+  vibrant_instance *instance = controller->priv->instance;
+  Display *dpy = instance->dpy;
+
+  if (dpy == NULL || controller->priv->leased) {
+    return lease_set_saturation(controller, saturation);
+  }
+
+  if (!lease_window_create(instance)) {
+    return vibrant_BackendError;
+  }
+
+  Atom atom = lease_atom(controller);
+  Window owner = XGetSelectionOwner(dpy, atom);
+  if (owner == None || owner == instance->lease_window) {
+    return lease_set_saturation(controller, saturation);
+  }
+
+  saturation = fmax(saturation, VIBRANT_SATURATION_MIN);
+  saturation = fmin(saturation, VIBRANT_SATURATION_MAX);
+
+  XEvent event = {0};
+  event.xclient.type = ClientMessage;
+  event.xclient.window = owner;
+  event.xclient.message_type = instance->lease_request_atom;
+  event.xclient.format = 32;
+  event.xclient.data.l[0] = (long)atom;
+  event.xclient.data.l[1] = lround(saturation * LEASE_SCALE);
+
+  // the owner may be gone by now, its window with it
+  xerror_trap_push(dpy);
+  unsigned long first_serial = NextRequest(dpy);
+  XSendEvent(dpy, owner, False, NoEventMask, &event);
+  unsigned long last_serial = NextRequest(dpy);
+  XSync(dpy, False);
+  int status = xerror_trap_find(first_serial, last_serial);
+  xerror_trap_pop();
+
+  if (status == BadWindow) {
+    return lease_set_saturation(controller, saturation);
+  }
+
+  return status == Success ? vibrant_NoError : vibrant_BackendError;
+}
+
+void vibrant_instance_set_lease_listener(vibrant_instance *instance,
+                                         vibrant_lease_fn fn,
+                                         void *user_data) {
+  instance->lease_fn = fn;
+  instance->lease_data = user_data;
+}
+
+int lease_handle_event(vibrant_instance *instance, const XEvent *event) {
+  if (instance->lease_window == None) {
+    return 0;
+  }
+
+  if (event->type == SelectionClear &&
+      event->xselectionclear.window == instance->lease_window) {
+    vibrant_controller *controller =
+        lease_find_controller(instance, event->xselectionclear.selection);
+
+    if (controller != NULL && controller->priv->leased) {
+      controller->priv->leased = 0;
+      controller->priv->lease_pending = 0;
+
+      if (instance->lease_fn != NULL) {
+        vibrant_lease_event lost = {vibrant_LeaseLost, controller, 0.0};
+        instance->lease_fn(&lost, instance->lease_data);
+      }
+    }
+    return 1;
+  }
+
+  if (event->type == ClientMessage &&
+      event->xclient.window == instance->lease_window &&
+      event->xclient.message_type == instance->lease_request_atom) {
+    vibrant_controller *controller =
+        lease_find_controller(instance, (Atom)event->xclient.data.l[0]);
+
+    // requests that crossed a lease change are dropped, like the lease
+    if (controller != NULL && controller->priv->leased) {
+      double saturation = event->xclient.data.l[1] / LEASE_SCALE;
+
+      if (instance->lease_fn != NULL) {
+        vibrant_lease_event request = {vibrant_LeaseRequest, controller,
+                                       saturation};
+        instance->lease_fn(&request, instance->lease_data);
+      } else {
+        // only the latest request per output counts
+        controller->priv->lease_pending = 1;
+        controller->priv->lease_saturation = saturation;
+      }
+    }
+    return 1;
+  }
+
+  return 0;
+}
+
+vibrant_errors lease_apply(vibrant_instance *instance,
+                           vibrant_transaction_result *result) {
+  *result = (vibrant_transaction_result){0, 0, 0, 0};
+
+  size_t pending = 0;
+  for (int i = 0; i < instance->controllers_size; i++) {
+    pending += instance->controllers[i].priv->lease_pending;
+  }
+  if (pending == 0) {
+    return vibrant_NoError;
+  }
+
+  vibrant_transaction *transaction;
+  vibrant_errors err = vibrant_transaction_new(instance, &transaction);
+  if (err != vibrant_NoError) {
+    return err;
+  }
+
+  for (int i = 0; i < instance->controllers_size && err == vibrant_NoError;
+       i++) {
+    vibrant_controller *controller = instance->controllers + i;
+
+    if (controller->priv->lease_pending) {
+      controller->priv->lease_pending = 0;
+      err = vibrant_transaction_set_saturation(
+          transaction, controller, controller->priv->lease_saturation);
+    }
+  }
+
+  if (err == vibrant_NoError) {
+    err = vibrant_transaction_commit(transaction, result);
+  }
+  vibrant_transaction_free(&transaction);
+
+  return err;
+}
@@ -0,0 +1,274 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/gamma.h"
+#include "vibrant/internal.h"
+#include "vibrant/nvidia.h"
+#include "vibrant/pixel.h"
+#include "vibrant/vibrant.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "util.c"
+
+#define LUT_MAX_THREADS 64u
+
+vibrant_errors vibrant_controller_get_matrix(vibrant_controller *controller,
+                                             double matrix[9]) {
+  vibrant_controller_state state;
+
+  if (controller->priv->get_state(controller, &state) != Success) {
+    return vibrant_BackendError;
+  }
+
+  if (controller->priv->backend == XNVCtrl) {
+    vibrant_saturation_to_coeffs(
+        nvidia_vibrance_to_saturation(state.nv_vibrance), matrix);
+  } else if (controller->priv->backend == Gamma ||
+             controller->priv->backend == Wayland) {
+    // the S-curve is not a matrix, report the saturation it stands for
+    vibrant_saturation_to_coeffs(gamma_level_to_saturation(state.gamma_level),
+                                 matrix);
+  } else if (controller->priv->backend == DRM) {
+    vibrant_translate_ctm_to_coeffs(&state.drm_ctm, matrix);
+  } else {
+    vibrant_translate_padded_ctm_to_coeffs(state.padded_ctm, matrix);
+  }
+
+  return vibrant_NoError;
+}
+
+/**
+ * Slices of the LUT handed to one thread of vibrant_lut_generate.
+ */
+typedef struct lut_job {
+  // matrix[row][column], as float to match the SIMD path
+  float matrix[3][3];
+  float gamma;
+  size_t size;
+  float *lut;
+  // blue slices [first_blue, last_blue)
+  size_t first_blue;
+  size_t last_blue;
+} lut_job;
+
+static float lut_clamp(float value) {
+  return value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+}
+
+/**
+ * Fill one row of the LUT, all values of red for one green and blue.
+ */
+static void lut_row(const lut_job *job, float g, float b, float *out) {
+  float scale = 1.0f / (float)(job->size - 1);
+  float base[3];
+  for (int c = 0; c < 3; c++) {
+    base[c] = job->matrix[c][1] * g + job->matrix[c][2] * b;
+  }
+
+  size_t r = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  // four reds at a time, SSE2 is part of every x86-64 CPU
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  for (; r + 4 <= job->size; r += 4) {
+    __m128 red =
+        _mm_mul_ps(_mm_set_ps(r + 3, r + 2, r + 1, r), _mm_set1_ps(scale));
+    float channels[3][4];
+
+    for (int c = 0; c < 3; c++) {
+      __m128 value = _mm_add_ps(_mm_mul_ps(red, _mm_set1_ps(job->matrix[c][0])),
+                                _mm_set1_ps(base[c]));
+      _mm_storeu_ps(channels[c], _mm_min_ps(_mm_max_ps(value, zero), one));
+    }
+    for (int i = 0; i < 4; i++) {
+      out[3 * (r + i)] = channels[0][i];
+      out[3 * (r + i) + 1] = channels[1][i];
+      out[3 * (r + i) + 2] = channels[2][i];
+    }
+  }
+#endif
+
+  for (; r < job->size; r++) {
+    float red = (float)r * scale;
+    for (int c = 0; c < 3; c++) {
+      out[3 * r + c] = lut_clamp(job->matrix[c][0] * red + base[c]);
+    }
+  }
+
+  if (job->gamma != 1.0f) {
+    float exponent = 1.0f / job->gamma;
+    for (size_t i = 0; i < 3 * job->size; i++) {
+      out[i] = powf(out[i], exponent);
+    }
+  }
+}
+
+static void *lut_generate_slices(void *arg) {
+  const lut_job *job = arg;
+  size_t size = job->size;
+  float scale = 1.0f / (float)(size - 1);
+
+  for (size_t b = job->first_blue; b < job->last_blue; b++) {
+    for (size_t g = 0; g < size; g++) {
+      lut_row(job, (float)g * scale, (float)b * scale,
+              job->lut + 3 * size * (g + size * b));
+    }
+  }
+
+  return NULL;
+}
+
+vibrant_errors vibrant_lut_generate(const double matrix[9], double gamma,
+                                    size_t size, float *lut, unsigned threads) {
+  if (size < VIBRANT_LUT_SIZE_MIN || size > VIBRANT_LUT_SIZE_MAX ||
+      !(gamma > 0.0)) {
+    return vibrant_InvalidArgument;
+  }
+
+  lut_job job;
+  double coeffs[9];
+  pixel_quantize_matrix(matrix, coeffs);
+  for (int i = 0; i < 9; i++) {
+    job.matrix[i / 3][i % 3] = (float)coeffs[i];
+  }
+  job.gamma = (float)gamma;
+  job.size = size;
+  job.lut = lut;
+
+  threads = threads < 1 ? 1 : threads;
+  threads = threads > LUT_MAX_THREADS ? LUT_MAX_THREADS : threads;
+  threads = threads > size ? (unsigned)size : threads;
+
+  lut_job jobs[LUT_MAX_THREADS];
+  pthread_t workers[LUT_MAX_THREADS];
+  int started[LUT_MAX_THREADS];
+  size_t first_blue = 0;
+
+  for (unsigned i = 0; i < threads; i++) {
+    size_t slices = size / threads + (i < size % threads);
+    jobs[i] = job;
+    jobs[i].first_blue = first_blue;
+    jobs[i].last_blue = first_blue + slices;
+    first_blue += slices;
+  }
+
+  // the calling thread takes the first slices itself
+  for (unsigned i = 1; i < threads; i++) {
+    started[i] =
+        pthread_create(workers + i, NULL, lut_generate_slices, jobs + i) == 0;
+  }
+  lut_generate_slices(jobs);
+
+  for (unsigned i = 1; i < threads; i++) {
+    if (started[i]) {
+      pthread_join(workers[i], NULL);
+    } else {
+      lut_generate_slices(jobs + i);
+    }
+  }
+
+  return vibrant_NoError;
+}
+
+static int lut_write(FILE *file, vibrant_lut_format format, const float *lut,
+                     size_t size) {
+  size_t entries = size * size * size;
+
+  if (format == vibrant_LutFloat32) {
+    return fwrite(lut, 3 * sizeof(float), entries, file) == entries;
+  }
+
+  if (fprintf(file,
+              "TITLE \"vibrant\"\n"
+              "LUT_3D_SIZE %zu\n"
+              "DOMAIN_MIN 0.0 0.0 0.0\n"
+              "DOMAIN_MAX 1.0 1.0 1.0\n",
+              size) < 0) {
+    return 0;
+  }
+  for (size_t i = 0; i < entries; i++) {
+    if (fprintf(file, "%.6f %.6f %.6f\n", lut[3 * i], lut[3 * i + 1],
+                lut[3 * i + 2]) < 0) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+vibrant_errors vibrant_lut_export(const double matrix[9], double gamma,
+                                  size_t size, vibrant_lut_format format,
+                                  const char *path, unsigned threads) {
+  if (size < VIBRANT_LUT_SIZE_MIN || size > VIBRANT_LUT_SIZE_MAX) {
+    return vibrant_InvalidArgument;
+  }
+
+  float *lut = malloc(size * size * size * 3 * sizeof(float));
+  if (lut == NULL) {
+    return vibrant_NoMem;
+  }
+
+  vibrant_errors err = vibrant_lut_generate(matrix, gamma, size, lut, threads);
+  if (err != vibrant_NoError) {
+    free(lut);
+    return err;
+  }
+
+  // write next to the target and rename, so readers never see partial files
+  size_t tmp_path_size = strlen(path) + sizeof(".tmp");
+  char *tmp_path = malloc(tmp_path_size);
+  if (tmp_path == NULL) {
+    free(lut);
+    return vibrant_NoMem;
+  }
+  snprintf(tmp_path, tmp_path_size, "%s.tmp", path);
+
+  FILE *file = fopen(tmp_path, "wb");
+  if (file == NULL) {
+    err = vibrant_IOError;
+  } else {
+    if (!lut_write(file, format, lut, size)) {
+      err = vibrant_IOError;
+    }
+    if (fclose(file) != 0) {
+      err = vibrant_IOError;
+    }
+    if (err == vibrant_NoError && rename(tmp_path, path) != 0) {
+      err = vibrant_IOError;
+    }
+    if (err != vibrant_NoError) {
+      unlink(tmp_path);
+    }
+  }
+
+  free(tmp_path);
+  free(lut);
+
+  return err;
+}
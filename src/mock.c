@@ -0,0 +1,368 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/mock.h"
+#include "vibrant/internal.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util.c"
+
+#define MOCK_NAME_FORMAT "MOCK-%zu"
+
+struct vibrant_mock {
+  vibrant_mock_options options;
+
+  // simulated CTM property of every output, as the X server would store it
+  long (*padded_ctms)[18];
+  bool *failing;
+
+  vibrant_mock_request *requests;
+  size_t requests_size;
+  size_t requests_capacity;
+  unsigned long long requests_total;
+
+  // guards the simulated outputs and the log, so controllers of a mock
+  // instance may be driven from multiple threads
+  pthread_mutex_t lock;
+};
+
+static unsigned long long mock_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void mock_sleep_us(unsigned int us) {
+  if (us == 0) {
+    return;
+  }
+
+  struct timespec ts = {us / 1000000, (long)(us % 1000000) * 1000};
+  while (nanosleep(&ts, &ts) != 0) {
+    // interrupted by a signal, sleep for the remaining time
+  }
+}
+
+/**
+ * Append a request to the log and decide whether it fails.
+ * Must be called with mock->lock held.
+ *
+ * @return Success or BadMatch if a failure was injected
+ */
+static int mock_log_request(struct vibrant_mock *mock,
+                            vibrant_mock_request_type type, size_t controller,
+                            double saturation, unsigned long long timestamp) {
+  mock->requests_total++;
+
+  int status = Success;
+  if (mock->failing[controller] ||
+      (mock->options.fail_every != 0 &&
+       mock->requests_total % mock->options.fail_every == 0)) {
+    status = BadMatch;
+  }
+
+  if (status != Success && type == vibrant_MockGetSaturation) {
+    // failed reads return -1.0, log what the caller gets to see
+    saturation = -1.0;
+  }
+
+  if (mock->requests_size == mock->requests_capacity) {
+    size_t capacity =
+        mock->requests_capacity == 0 ? 64 : mock->requests_capacity * 2;
+    vibrant_mock_request *tmp =
+        realloc(mock->requests, sizeof(vibrant_mock_request) * capacity);
+    if (tmp == NULL) {
+      // the log is best effort, the request itself still goes through
+      return status;
+    }
+    mock->requests = tmp;
+    mock->requests_capacity = capacity;
+  }
+
+  mock->requests[mock->requests_size++] =
+      (vibrant_mock_request){type, controller, saturation, status, timestamp};
+
+  return status;
+}
+
+static double mock_state_to_saturation(const vibrant_controller_state *state) {
+  double coeffs[9];
+  vibrant_translate_padded_ctm_to_coeffs(state->padded_ctm, coeffs);
+  return vibrant_coeffs_to_saturation(coeffs);
+}
+
+/**
+ * Simulate a request to the simulated output of controller. Sets read the
+ * new CTM from state, gets write the current CTM into state.
+ *
+ * @param saturation saturation logged for sets, gets log what they read
+ * @return Success or the injected X error code
+ */
+static int mock_request(vibrant_controller *controller,
+                        vibrant_mock_request_type type, double saturation,
+                        vibrant_controller_state *state) {
+  struct vibrant_mock *mock = controller->priv->instance->backend_data;
+  size_t index = controller->priv->index;
+  unsigned long long timestamp = mock_now_ns();
+
+  mock_sleep_us(mock->options.latency_us);
+
+  pthread_mutex_lock(&mock->lock);
+  if (type == vibrant_MockGetSaturation) {
+    memcpy(state->padded_ctm, mock->padded_ctms[index],
+           sizeof(state->padded_ctm));
+    saturation = mock_state_to_saturation(state);
+  }
+
+  int status = mock_log_request(mock, type, index, saturation, timestamp);
+  if (status == Success && type == vibrant_MockSetSaturation) {
+    memcpy(mock->padded_ctms[index], state->padded_ctm,
+           sizeof(state->padded_ctm));
+  }
+  pthread_mutex_unlock(&mock->lock);
+
+  return status;
+}
+
+static void mockctrl_saturation_to_state(double saturation,
+                                         vibrant_controller_state *state) {
+  // same clamping and encoding as ctm_set_saturation
+  saturation = fmax(saturation, VIBRANT_SATURATION_MIN);
+  saturation = fmin(saturation, VIBRANT_SATURATION_MAX);
+
+  double coeffs[9];
+  struct drm_color_ctm ctm;
+  vibrant_saturation_to_coeffs(saturation, coeffs);
+  vibrant_translate_coeffs_to_ctm(coeffs, &ctm);
+  vibrant_translate_ctm_to_padded_ctm(&ctm, state->padded_ctm);
+}
+
+static double mockctrl_get_saturation(vibrant_controller *controller) {
+  vibrant_controller_state state;
+  if (mock_request(controller, vibrant_MockGetSaturation, 0.0, &state) !=
+      Success) {
+    return -1.0;
+  }
+
+  return mock_state_to_saturation(&state);
+}
+
+static int mockctrl_set_saturation(vibrant_controller *controller,
+                                   double saturation) {
+  vibrant_controller_state state;
+  mockctrl_saturation_to_state(saturation, &state);
+
+  saturation = fmax(saturation, VIBRANT_SATURATION_MIN);
+  saturation = fmin(saturation, VIBRANT_SATURATION_MAX);
+  return mock_request(controller, vibrant_MockSetSaturation, saturation,
+                      &state);
+}
+
+static int mockctrl_get_state(vibrant_controller *controller,
+                              vibrant_controller_state *state) {
+  return mock_request(controller, vibrant_MockGetSaturation, 0.0, state);
+}
+
+static int mockctrl_set_state(vibrant_controller *controller,
+                              const vibrant_controller_state *state) {
+  vibrant_controller_state copy = *state;
+  return mock_request(controller, vibrant_MockSetSaturation,
+                      mock_state_to_saturation(state), &copy);
+}
+
+static void mock_free_controllers(vibrant_controller *controllers,
+                                  size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    free(controllers[i].info->name);
+    free(controllers[i].info);
+    layers_free(controllers + i);
+    free(controllers[i].priv);
+  }
+}
+
+vibrant_errors mock_instance_new(vibrant_instance *instance,
+                                 const vibrant_mock_options *options) {
+  size_t n = options->outputs;
+
+  struct vibrant_mock *mock = calloc(1, sizeof(struct vibrant_mock));
+  vibrant_controller *controllers = calloc(n, sizeof(vibrant_controller));
+  if (mock == NULL || (n > 0 && controllers == NULL)) {
+    free(controllers);
+    free(mock);
+    return vibrant_NoMem;
+  }
+
+  mock->options = *options;
+  mock->padded_ctms = calloc(n, sizeof(long[18]));
+  mock->failing = calloc(n, sizeof(bool));
+  if (n > 0 && (mock->padded_ctms == NULL || mock->failing == NULL)) {
+    free(mock->padded_ctms);
+    free(mock->failing);
+    free(controllers);
+    free(mock);
+    return vibrant_NoMem;
+  }
+  pthread_mutex_init(&mock->lock, NULL);
+
+  // every output starts out with the identity matrix, like a fresh CRTC
+  double coeffs[9];
+  struct drm_color_ctm ctm;
+  vibrant_saturation_to_coeffs(1.0, coeffs);
+  vibrant_translate_coeffs_to_ctm(coeffs, &ctm);
+
+  for (size_t i = 0; i < n; i++) {
+    vibrant_translate_ctm_to_padded_ctm(&ctm, mock->padded_ctms[i]);
+
+    int name_len = snprintf(NULL, 0, MOCK_NAME_FORMAT, i);
+    XRROutputInfo *info = calloc(1, sizeof(XRROutputInfo));
+    char *name = malloc(name_len + 1);
+    vibrant_controller_internal *priv =
+        malloc(sizeof(vibrant_controller_internal));
+    if (info == NULL || name == NULL || priv == NULL) {
+      free(info);
+      free(name);
+      free(priv);
+      mock_free_controllers(controllers, i);
+      pthread_mutex_destroy(&mock->lock);
+      free(mock->padded_ctms);
+      free(mock->failing);
+      free(controllers);
+      free(mock);
+      return vibrant_NoMem;
+    }
+
+    snprintf(name, name_len + 1, MOCK_NAME_FORMAT, i);
+    info->name = name;
+    info->nameLen = name_len;
+    info->connection = RR_Connected;
+
+    *priv = (vibrant_controller_internal){
+        .backend = Mock,
+        .nvId = -1,
+        .get_saturation = mockctrl_get_saturation,
+        .set_saturation = mockctrl_set_saturation,
+        .get_state = mockctrl_get_state,
+        .set_state = mockctrl_set_state,
+        .saturation_to_state = mockctrl_saturation_to_state,
+        .instance = instance,
+        .index = i,
+        .id = vibrant_hash(VIBRANT_HASH_SEED, name, name_len)};
+    // XIDs are never 0, mimic that for the fake outputs
+    controllers[i] = (vibrant_controller){i + 1, info, NULL, priv};
+  }
+
+  *instance = (vibrant_instance){.controllers = controllers,
+                                 .controllers_size = n,
+                                 .backend = vibrant_BackendMock,
+                                 .backend_data = mock};
+
+  return vibrant_NoError;
+}
+
+void mock_instance_free(vibrant_instance *instance) {
+  struct vibrant_mock *mock = instance->backend_data;
+
+  mock_free_controllers(instance->controllers, instance->controllers_size);
+  free(instance->controllers);
+
+  pthread_mutex_destroy(&mock->lock);
+  free(mock->padded_ctms);
+  free(mock->failing);
+  free(mock->requests);
+  free(mock);
+}
+
+vibrant_errors vibrant_mock_get_requests(vibrant_instance *instance,
+                                         vibrant_mock_request **requests,
+                                         size_t *length) {
+  *requests = NULL;
+  *length = 0;
+
+  if (instance->backend != vibrant_BackendMock) {
+    return vibrant_NoError;
+  }
+
+  struct vibrant_mock *mock = instance->backend_data;
+  vibrant_errors err = vibrant_NoError;
+
+  // requests of other threads grow the log, the caller gets a copy of it
+  pthread_mutex_lock(&mock->lock);
+  if (mock->requests_size > 0) {
+    *requests = malloc(sizeof(vibrant_mock_request) * mock->requests_size);
+    if (*requests == NULL) {
+      err = vibrant_NoMem;
+    } else {
+      memcpy(*requests, mock->requests,
+             sizeof(vibrant_mock_request) * mock->requests_size);
+      *length = mock->requests_size;
+    }
+  }
+  pthread_mutex_unlock(&mock->lock);
+
+  return err;
+}
+
+void vibrant_mock_clear_requests(vibrant_instance *instance) {
+  if (instance->backend != vibrant_BackendMock) {
+    return;
+  }
+
+  struct vibrant_mock *mock = instance->backend_data;
+  pthread_mutex_lock(&mock->lock);
+  mock->requests_size = 0;
+  pthread_mutex_unlock(&mock->lock);
+}
+
+void vibrant_mock_set_failing(vibrant_controller *controller, int fail) {
+  if (controller->priv->backend != Mock) {
+    return;
+  }
+
+  struct vibrant_mock *mock = controller->priv->instance->backend_data;
+  pthread_mutex_lock(&mock->lock);
+  mock->failing[controller->priv->index] = fail != 0;
+  pthread_mutex_unlock(&mock->lock);
+}
+
+void vibrant_mock_reset_output(vibrant_controller *controller) {
+  if (controller->priv->backend != Mock) {
+    return;
+  }
+
+  struct vibrant_mock *mock = controller->priv->instance->backend_data;
+  double coeffs[9];
+  struct drm_color_ctm ctm;
+  vibrant_saturation_to_coeffs(1.0, coeffs);
+  vibrant_translate_coeffs_to_ctm(coeffs, &ctm);
+
+  pthread_mutex_lock(&mock->lock);
+  vibrant_translate_ctm_to_padded_ctm(&ctm,
+                                      mock->padded_ctms[controller->priv->index]);
+  pthread_mutex_unlock(&mock->lock);
+
+  // stands in for the RRNotify events the X server would send
+  controller->priv->watch_pending = 1;
+}
@@ -23,34 +23,48 @@
 #include <float.h>
 #include <math.h>
 
-double nvidia_get_saturation(Display *dpy, int id) {
-  int nv_saturation;
-  double saturation;
-  XNVCTRLQueryTargetAttribute(dpy, NV_CTRL_TARGET_TYPE_DISPLAY, id, 0,
-                              NV_CTRL_DIGITAL_VIBRANCE, &nv_saturation);
-
+double nvidia_vibrance_to_saturation(int nv_saturation) {
   if (nv_saturation < 0) {
-    saturation = (double)(nv_saturation + 1024) / 1024;
-  } else {
-    saturation = (double)(nv_saturation * 3 + 1023) / 1023;
+    return (double)(nv_saturation + 1024) / 1024;
   }
 
-  return saturation;
+  return (double)(nv_saturation * 3 + 1023) / 1023;
 }
 
-void nvidia_set_saturation(Display *dpy, int id, double saturation) {
-  int nv_saturation;
-
+int nvidia_saturation_to_vibrance(double saturation) {
   saturation = fmax(saturation, VIBRANT_SATURATION_MIN);
   saturation = fmin(saturation, VIBRANT_SATURATION_MAX);
 
   // is saturation roughly in [0.0, 1.0]
   if (saturation >= 0.0 && saturation <= 1.0 + DBL_EPSILON) {
-    nv_saturation = saturation * 1024 - 1024;
-  } else {
-    nv_saturation = (saturation * 1023 - 1023) / 3;
+    return saturation * 1024 - 1024;
+  }
+
+  return (saturation * 1023 - 1023) / 3;
+}
+
+int nvidia_get_vibrance(Display *dpy, int id, int *nv_saturation) {
+  if (!XNVCTRLQueryTargetAttribute(dpy, NV_CTRL_TARGET_TYPE_DISPLAY, id, 0,
+                                   NV_CTRL_DIGITAL_VIBRANCE, nv_saturation)) {
+    return BadMatch;
   }
 
+  return Success;
+}
+
+void nvidia_queue_vibrance(Display *dpy, int id, int nv_saturation) {
   XNVCTRLSetTargetAttribute(dpy, NV_CTRL_TARGET_TYPE_DISPLAY, id, 0,
                             NV_CTRL_DIGITAL_VIBRANCE, nv_saturation);
 }
+
+double nvidia_get_saturation(Display *dpy, int id) {
+  int nv_saturation;
+  XNVCTRLQueryTargetAttribute(dpy, NV_CTRL_TARGET_TYPE_DISPLAY, id, 0,
+                              NV_CTRL_DIGITAL_VIBRANCE, &nv_saturation);
+
+  return nvidia_vibrance_to_saturation(nv_saturation);
+}
+
+void nvidia_set_saturation(Display *dpy, int id, double saturation) {
+  nvidia_queue_vibrance(dpy, id, nvidia_saturation_to_vibrance(saturation));
+}
@@ -0,0 +1,213 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/panel.h"
+#include "vibrant/internal.h"
+#include "vibrant/vibrant.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.c"
+
+// offset of the chromaticity coordinates inside the EDID base block
+#define EDID_CHROMATICITY 25
+
+/**
+ * Profile derived from one EDID. Panels without a usable gamut are cached
+ * too, so their EDID is only parsed once.
+ */
+typedef struct panel_profile {
+  uint64_t edid_hash;
+  int valid;
+  double weights[3];
+  struct panel_profile *next;
+} panel_profile;
+
+// all profiles derived so far, shared by every instance of the process
+static panel_profile *panel_profiles;
+static pthread_mutex_t panel_profiles_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void panel_edid_chromaticity(const unsigned char *edid, double *chromaticity) {
+  const unsigned char *c = edid + EDID_CHROMATICITY;
+
+  // 10-bit fractions: the low 2 bits of every coordinate are packed into the
+  // first two bytes, the high 8 bits follow in order
+  for (int i = 0; i < 8; i++) {
+    unsigned low = (c[i / 4] >> (6 - 2 * (i % 4))) & 0x3;
+    chromaticity[i] = ((c[2 + i] << 2) | low) / 1024.0;
+  }
+}
+
+static double panel_det3(const double *m) {
+  return m[0] * (m[4] * m[8] - m[5] * m[7]) -
+         m[1] * (m[3] * m[8] - m[5] * m[6]) +
+         m[2] * (m[3] * m[7] - m[4] * m[6]);
+}
+
+int panel_chromaticity_to_weights(const double *chromaticity, double *weights) {
+  for (int i = 1; i < 8; i += 2) {
+    if (chromaticity[i] <= 0.0) {
+      return 0;
+    }
+  }
+
+  // columns are the XYZ of the primaries at Y = 1
+  double primaries[9];
+  for (int i = 0; i < 3; i++) {
+    double x = chromaticity[2 * i];
+    double y = chromaticity[2 * i + 1];
+
+    primaries[i] = x / y;
+    primaries[3 + i] = 1.0;
+    primaries[6 + i] = (1.0 - x - y) / y;
+  }
+
+  double wx = chromaticity[6];
+  double wy = chromaticity[7];
+  double white[3] = {wx / wy, 1.0, (1.0 - wx - wy) / wy};
+
+  double det = panel_det3(primaries);
+  if (fabs(det) < 1e-9) {
+    return 0;
+  }
+
+  // scale the primaries so they add up to the white point, Cramer's rule.
+  // At Y = 1 the scales are the luminance of every primary.
+  for (int i = 0; i < 3; i++) {
+    double m[9];
+    for (int j = 0; j < 9; j++) {
+      m[j] = j % 3 == i ? white[j / 3] : primaries[j];
+    }
+    weights[i] = panel_det3(m) / det;
+
+    // primaries outside the white point's triangle, or a corrupt EDID
+    if (!(weights[i] > 0.0 && weights[i] < 1.0)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+int panel_profile_lookup(uint64_t edid_hash, const unsigned char *edid,
+                         double *weights) {
+  pthread_mutex_lock(&panel_profiles_lock);
+
+  panel_profile *profile = panel_profiles;
+  while (profile != NULL && profile->edid_hash != edid_hash) {
+    profile = profile->next;
+  }
+
+  if (profile == NULL) {
+    profile = calloc(1, sizeof(panel_profile));
+    if (profile == NULL) {
+      pthread_mutex_unlock(&panel_profiles_lock);
+      return 0;
+    }
+
+    double chromaticity[8];
+    panel_edid_chromaticity(edid, chromaticity);
+    profile->edid_hash = edid_hash;
+    profile->valid =
+        panel_chromaticity_to_weights(chromaticity, profile->weights);
+    profile->next = panel_profiles;
+    panel_profiles = profile;
+  }
+
+  int valid = profile->valid;
+  if (valid) {
+    memcpy(weights, profile->weights, sizeof(profile->weights));
+  }
+
+  pthread_mutex_unlock(&panel_profiles_lock);
+
+  return valid;
+}
+
+void panel_saturation_to_coeffs(const double *weights, double saturation,
+                                double *coeffs) {
+  for (int i = 0; i < 9; i++) {
+    coeffs[i] = (1.0 - saturation) * weights[i % 3] +
+                (i % 4 == 0 ? saturation : 0);
+  }
+}
+
+void controller_saturation_to_coeffs(vibrant_controller *controller,
+                                     double saturation, double *coeffs) {
+  vibrant_controller_internal *priv = controller->priv;
+
+  saturation = fmax(saturation, VIBRANT_SATURATION_MIN);
+  saturation = fmin(saturation, VIBRANT_SATURATION_MAX);
+
+  if (priv->saturation_model == vibrant_SaturationPanel) {
+    panel_saturation_to_coeffs(priv->panel_weights, saturation, coeffs);
+  } else {
+    vibrant_saturation_to_coeffs(saturation, coeffs);
+  }
+}
+
+void controller_saturation_to_state(vibrant_controller *controller,
+                                    double saturation,
+                                    vibrant_controller_state *state) {
+  vibrant_controller_internal *priv = controller->priv;
+
+  if (priv->saturation_model != vibrant_SaturationPanel) {
+    priv->saturation_to_state(saturation, state);
+    return;
+  }
+
+  double coeffs[9];
+  controller_saturation_to_coeffs(controller, saturation, coeffs);
+
+  if (priv->backend == DRM) {
+    vibrant_translate_coeffs_to_ctm(coeffs, &state->drm_ctm);
+  } else {
+    struct drm_color_ctm ctm;
+    vibrant_translate_coeffs_to_ctm(coeffs, &ctm);
+    vibrant_translate_ctm_to_padded_ctm(&ctm, state->padded_ctm);
+  }
+}
+
+vibrant_errors
+vibrant_controller_set_saturation_model(vibrant_controller *controller,
+                                        vibrant_saturation_model model) {
+  vibrant_controller_internal *priv = controller->priv;
+
+  if (model == vibrant_SaturationPanel) {
+    // digital vibrance and gamma ramps can't mix channels at all
+    if (!priv->panel_valid || priv->backend == XNVCtrl ||
+        priv->backend == Gamma || priv->backend == Wayland) {
+      return vibrant_BackendError;
+    }
+  } else if (model != vibrant_SaturationUniform) {
+    return vibrant_InvalidArgument;
+  }
+
+  priv->saturation_model = model;
+
+  return vibrant_NoError;
+}
+
+vibrant_saturation_model
+vibrant_controller_get_saturation_model(vibrant_controller *controller) {
+  return controller->priv->saturation_model;
+}
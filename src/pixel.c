@@ -0,0 +1,283 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/pixel.h"
+#include "vibrant/vibrant.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "util.c"
+
+// upper bound for vibrant_apply_matrix_rgba threads
+#define PIXEL_MAX_THREADS 64u
+
+void vibrant_saturation_to_matrix(double saturation, double matrix[9]) {
+  saturation = fmax(saturation, VIBRANT_SATURATION_MIN);
+  saturation = fmin(saturation, VIBRANT_SATURATION_MAX);
+
+  vibrant_saturation_to_coeffs(saturation, matrix);
+}
+
+void pixel_quantize_matrix(const double *matrix, double *coeffs) {
+  struct drm_color_ctm ctm;
+  vibrant_translate_coeffs_to_ctm(matrix, &ctm);
+  vibrant_translate_ctm_to_coeffs(&ctm, coeffs);
+}
+
+static unsigned pixel_channel_bits(vibrant_pixel_format format) {
+  return format == vibrant_PixelRGBA1010102 ? 10 : 8;
+}
+
+/*
+ * Every coefficient is a multiple of 2^-32 with at most 35 significant bits,
+ * every channel has at most 10 bits. Products and their sums therefore stay
+ * below 2^46 units of 2^-32 and are exact in a double, no matter in which
+ * order or whether they are fused. All kernels round the exact result half
+ * up after clamping, so they agree bit for bit.
+ */
+
+void pixel_apply_scalar(const double *coeffs, vibrant_pixel_format format,
+                        unsigned char *row, size_t width) {
+  unsigned bits = pixel_channel_bits(format);
+  uint32_t mask = (1u << bits) - 1;
+  double limit = mask;
+  uint32_t alpha_mask = ~((1u << 3 * bits) - 1);
+
+  for (size_t x = 0; x < width; x++) {
+    uint32_t pixel;
+    memcpy(&pixel, row + 4 * x, sizeof(pixel));
+
+    double r = pixel & mask;
+    double g = (pixel >> bits) & mask;
+    double b = (pixel >> 2 * bits) & mask;
+    uint32_t out = pixel & alpha_mask;
+
+    for (unsigned i = 0; i < 3; i++) {
+      double value =
+          coeffs[3 * i] * r + coeffs[3 * i + 1] * g + coeffs[3 * i + 2] * b;
+      value = value < 0.0 ? 0.0 : value;
+      value = value > limit ? limit : value;
+      out |= (uint32_t)(value + 0.5) << i * bits;
+    }
+
+    memcpy(row + 4 * x, &out, sizeof(out));
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * Apply the row of the matrix starting at coeffs to two pixels whose
+ * channels are in the low two lanes of r, g and b.
+ *
+ * @return the rounded and clamped channel in the low two lanes
+ */
+__attribute__((target("sse2"))) static __m128i
+pixel_row_sse2(const double *coeffs, __m128i r, __m128i g, __m128i b,
+               __m128d limit) {
+  __m128d value = _mm_add_pd(
+      _mm_add_pd(_mm_mul_pd(_mm_set1_pd(coeffs[0]), _mm_cvtepi32_pd(r)),
+                 _mm_mul_pd(_mm_set1_pd(coeffs[1]), _mm_cvtepi32_pd(g))),
+      _mm_mul_pd(_mm_set1_pd(coeffs[2]), _mm_cvtepi32_pd(b)));
+  value = _mm_min_pd(_mm_max_pd(value, _mm_setzero_pd()), limit);
+  // non-negative, so truncating rounds down
+  return _mm_cvttpd_epi32(_mm_add_pd(value, _mm_set1_pd(0.5)));
+}
+
+__attribute__((target("sse2"))) void
+pixel_apply_sse2(const double *coeffs, vibrant_pixel_format format,
+                 unsigned char *row, size_t width) {
+  unsigned bits = pixel_channel_bits(format);
+  const __m128i shift = _mm_cvtsi32_si128(bits);
+  const __m128i shift2 = _mm_cvtsi32_si128(2 * bits);
+  const __m128i mask = _mm_set1_epi32((1 << bits) - 1);
+  const __m128i alpha_mask = _mm_set1_epi32(~((1u << 3 * bits) - 1));
+  const __m128d limit = _mm_set1_pd((1 << bits) - 1);
+
+  size_t x = 0;
+  for (; x + 4 <= width; x += 4) {
+    __m128i pixels = _mm_loadu_si128((const __m128i *)(row + 4 * x));
+    __m128i r = _mm_and_si128(pixels, mask);
+    __m128i g = _mm_and_si128(_mm_srl_epi32(pixels, shift), mask);
+    __m128i b = _mm_and_si128(_mm_srl_epi32(pixels, shift2), mask);
+    // the upper two pixels, moved into the low lanes
+    __m128i r_high = _mm_shuffle_epi32(r, 0xee);
+    __m128i g_high = _mm_shuffle_epi32(g, 0xee);
+    __m128i b_high = _mm_shuffle_epi32(b, 0xee);
+
+    __m128i result = _mm_and_si128(pixels, alpha_mask);
+    for (int i = 0; i < 3; i++) {
+      __m128i value = _mm_unpacklo_epi64(
+          pixel_row_sse2(coeffs + 3 * i, r, g, b, limit),
+          pixel_row_sse2(coeffs + 3 * i, r_high, g_high, b_high, limit));
+      result = _mm_or_si128(
+          result, _mm_sll_epi32(value, _mm_cvtsi32_si128(i * bits)));
+    }
+    _mm_storeu_si128((__m128i *)(row + 4 * x), result);
+  }
+
+  if (x < width) {
+    pixel_apply_scalar(coeffs, format, row + 4 * x, width - x);
+  }
+}
+
+/**
+ * Apply the row of the matrix starting at coeffs to four pixels.
+ *
+ * @return the rounded and clamped channel of every pixel
+ */
+__attribute__((target("avx2"))) static __m128i
+pixel_row_avx2(const double *coeffs, __m128i r, __m128i g, __m128i b,
+               __m256d limit) {
+  __m256d value = _mm256_add_pd(
+      _mm256_add_pd(
+          _mm256_mul_pd(_mm256_set1_pd(coeffs[0]), _mm256_cvtepi32_pd(r)),
+          _mm256_mul_pd(_mm256_set1_pd(coeffs[1]), _mm256_cvtepi32_pd(g))),
+      _mm256_mul_pd(_mm256_set1_pd(coeffs[2]), _mm256_cvtepi32_pd(b)));
+  value = _mm256_min_pd(_mm256_max_pd(value, _mm256_setzero_pd()), limit);
+  // non-negative, so truncating rounds down
+  return _mm256_cvttpd_epi32(_mm256_add_pd(value, _mm256_set1_pd(0.5)));
+}
+
+__attribute__((target("avx2"))) void
+pixel_apply_avx2(const double *coeffs, vibrant_pixel_format format,
+                 unsigned char *row, size_t width) {
+  unsigned bits = pixel_channel_bits(format);
+  const __m128i shift = _mm_cvtsi32_si128(bits);
+  const __m128i shift2 = _mm_cvtsi32_si128(2 * bits);
+  const __m256i mask = _mm256_set1_epi32((1 << bits) - 1);
+  const __m256i alpha_mask = _mm256_set1_epi32(~((1u << 3 * bits) - 1));
+  const __m256d limit = _mm256_set1_pd((1 << bits) - 1);
+
+  size_t x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m256i pixels = _mm256_loadu_si256((const __m256i *)(row + 4 * x));
+    __m256i r = _mm256_and_si256(pixels, mask);
+    __m256i g = _mm256_and_si256(_mm256_srl_epi32(pixels, shift), mask);
+    __m256i b = _mm256_and_si256(_mm256_srl_epi32(pixels, shift2), mask);
+
+    __m256i result = _mm256_and_si256(pixels, alpha_mask);
+    for (int i = 0; i < 3; i++) {
+      __m128i low = pixel_row_avx2(coeffs + 3 * i, _mm256_castsi256_si128(r),
+                                   _mm256_castsi256_si128(g),
+                                   _mm256_castsi256_si128(b), limit);
+      __m128i high = pixel_row_avx2(
+          coeffs + 3 * i, _mm256_extracti128_si256(r, 1),
+          _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(b, 1),
+          limit);
+      __m256i value =
+          _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+      result = _mm256_or_si256(
+          result, _mm256_sll_epi32(value, _mm_cvtsi32_si128(i * bits)));
+    }
+    _mm256_storeu_si256((__m256i *)(row + 4 * x), result);
+  }
+
+  if (x < width) {
+    pixel_apply_scalar(coeffs, format, row + 4 * x, width - x);
+  }
+}
+#endif
+
+pixel_apply_fn pixel_apply_best(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return pixel_apply_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return pixel_apply_sse2;
+  }
+#endif
+
+  return pixel_apply_scalar;
+}
+
+/**
+ * Rows handed to one thread of vibrant_apply_matrix_rgba.
+ */
+typedef struct pixel_band {
+  pixel_apply_fn apply;
+  const double *coeffs;
+  vibrant_pixel_format format;
+  unsigned char *pixels;
+  size_t width;
+  size_t height;
+  size_t stride;
+} pixel_band;
+
+static void *pixel_apply_band(void *arg) {
+  const pixel_band *band = arg;
+
+  for (size_t y = 0; y < band->height; y++) {
+    band->apply(band->coeffs, band->format, band->pixels + y * band->stride,
+                band->width);
+  }
+
+  return NULL;
+}
+
+vibrant_errors vibrant_apply_matrix_rgba(const double matrix[9],
+                                         vibrant_pixel_format format,
+                                         unsigned char *pixels, size_t width,
+                                         size_t height, size_t stride,
+                                         unsigned threads) {
+  double coeffs[9];
+  pixel_quantize_matrix(matrix, coeffs);
+
+  threads = threads < 1 ? 1 : threads;
+  threads = threads > PIXEL_MAX_THREADS ? PIXEL_MAX_THREADS : threads;
+  threads = threads > height ? (unsigned)(height > 0 ? height : 1) : threads;
+
+  pixel_band bands[PIXEL_MAX_THREADS];
+  pthread_t workers[PIXEL_MAX_THREADS];
+  int started[PIXEL_MAX_THREADS];
+  pixel_apply_fn apply = pixel_apply_best();
+  size_t first_row = 0;
+
+  for (unsigned i = 0; i < threads; i++) {
+    // spread the remainder over the first bands
+    size_t rows = height / threads + (i < height % threads);
+    bands[i] = (pixel_band){apply, coeffs, format,
+                            pixels + first_row * stride, width, rows, stride};
+    first_row += rows;
+  }
+
+  // the calling thread takes the first band itself
+  for (unsigned i = 1; i < threads; i++) {
+    started[i] =
+        pthread_create(workers + i, NULL, pixel_apply_band, bands + i) == 0;
+  }
+  pixel_apply_band(bands);
+
+  for (unsigned i = 1; i < threads; i++) {
+    if (started[i]) {
+      pthread_join(workers[i], NULL);
+    } else {
+      pixel_apply_band(bands + i);
+    }
+  }
+
+  return vibrant_NoError;
+}
@@ -0,0 +1,347 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/internal.h"
+#include "vibrant/vibrant.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#define POOL_MAX_EVENTS 16
+
+typedef struct pool_display {
+  vibrant_instance *instance;
+  vibrant_pool_stats stats;
+
+  // state of the running batch: writes that did not complete yet, writes
+  // that failed and the monotonic time the first write was sent at, 0 if
+  // the batch has no write for this display
+  size_t pending;
+  size_t failed;
+  unsigned long long sent_ns;
+} pool_display;
+
+struct vibrant_pool {
+  // epoll set of the X connections, handed out to callers. The data of each
+  // entry is the index of its display
+  int epoll_fd;
+  pool_display *displays;
+  size_t displays_size;
+};
+
+static unsigned long long pool_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+vibrant_errors vibrant_pool_new(vibrant_pool **pool,
+                                const char *const *display_names,
+                                size_t display_names_size) {
+  return vibrant_pool_new_with_options(pool, display_names, display_names_size,
+                                       NULL);
+}
+
+vibrant_errors
+vibrant_pool_new_with_options(vibrant_pool **pool,
+                              const char *const *display_names,
+                              size_t display_names_size,
+                              const vibrant_instance_options *options) {
+  vibrant_pool *p = calloc(1, sizeof(vibrant_pool));
+  if (p == NULL) {
+    return vibrant_NoMem;
+  }
+
+  p->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  p->displays = calloc(display_names_size, sizeof(pool_display));
+  if (p->epoll_fd < 0 || (display_names_size > 0 && p->displays == NULL)) {
+    vibrant_errors err = p->epoll_fd < 0 ? vibrant_IOError : vibrant_NoMem;
+    vibrant_pool_free(&p);
+    return err;
+  }
+
+  for (size_t i = 0; i < display_names_size; i++) {
+    vibrant_errors err = vibrant_instance_new_with_options(
+        &p->displays[i].instance, display_names[i], options);
+    if (err != vibrant_NoError) {
+      vibrant_pool_free(&p);
+      return err;
+    }
+    p->displays_size++;
+
+    int fd = vibrant_instance_get_fd(p->displays[i].instance);
+    if (fd < 0) {
+      // mock and DRM instances have no connection, their requests complete
+      // at once
+      continue;
+    }
+
+    struct epoll_event event = {.events = EPOLLIN, .data.u64 = i};
+    if (epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      vibrant_pool_free(&p);
+      return vibrant_IOError;
+    }
+  }
+
+  *pool = p;
+  return vibrant_NoError;
+}
+
+void vibrant_pool_free(vibrant_pool **pool) {
+  vibrant_pool *p = *pool;
+
+  for (size_t i = 0; i < p->displays_size; i++) {
+    vibrant_instance_free(&p->displays[i].instance);
+  }
+  free(p->displays);
+  if (p->epoll_fd >= 0) {
+    close(p->epoll_fd);
+  }
+  free(p);
+
+  *pool = NULL;
+}
+
+size_t vibrant_pool_get_size(vibrant_pool *pool) {
+  return pool->displays_size;
+}
+
+vibrant_instance *vibrant_pool_get_instance(vibrant_pool *pool, size_t index) {
+  return index < pool->displays_size ? pool->displays[index].instance : NULL;
+}
+
+int vibrant_pool_get_fd(vibrant_pool *pool) { return pool->epoll_fd; }
+
+/**
+ * Dispatch the displays epoll reported as readable, waiting at most
+ * timeout_ms for the first one. Results are added to total.
+ */
+static vibrant_errors pool_dispatch_ready(vibrant_pool *pool, int timeout_ms,
+                                          vibrant_transaction_result *total) {
+  struct epoll_event events[POOL_MAX_EVENTS];
+
+  int n = epoll_wait(pool->epoll_fd, events, POOL_MAX_EVENTS, timeout_ms);
+  if (n < 0) {
+    return errno == EINTR ? vibrant_NoError : vibrant_IOError;
+  }
+
+  vibrant_errors err = vibrant_NoError;
+  for (int i = 0; i < n; i++) {
+    vibrant_transaction_result pass;
+    vibrant_errors pass_err = vibrant_instance_dispatch(
+        pool->displays[events[i].data.u64].instance, &pass);
+
+    if (err == vibrant_NoError) {
+      err = pass_err;
+    }
+    if (pass_err == vibrant_NoError) {
+      total->failed += pass.failed;
+      total->unchanged += pass.unchanged;
+      total->rolled_back |= pass.rolled_back;
+      total->apply_time_ns += pass.apply_time_ns;
+    }
+  }
+
+  return err;
+}
+
+vibrant_errors vibrant_pool_dispatch(vibrant_pool *pool,
+                                     vibrant_transaction_result *result) {
+  vibrant_transaction_result total = {0, 0, 0, 0};
+
+  // level triggered, displays beyond POOL_MAX_EVENTS are reported next time
+  vibrant_errors err = pool_dispatch_ready(pool, 0, &total);
+
+  if (result != NULL) {
+    *result = total;
+  }
+
+  return err;
+}
+
+static void pool_record_latency(vibrant_pool_stats *stats,
+                                unsigned long long latency_ns) {
+  if (stats->batches == 0 || latency_ns < stats->min_ns) {
+    stats->min_ns = latency_ns;
+  }
+  if (latency_ns > stats->max_ns) {
+    stats->max_ns = latency_ns;
+  }
+  stats->last_ns = latency_ns;
+  stats->total_ns += latency_ns;
+  stats->batches++;
+}
+
+static void pool_fence_done(vibrant_fence *fence, vibrant_fence_status status,
+                            void *user_data) {
+  pool_display *display = user_data;
+  (void)fence;
+
+  if (status != vibrant_FenceDone) {
+    display->failed++;
+  }
+
+  // pending counts every write of the batch up front, so this can't fire
+  // early for writes that complete while the batch is still being sent
+  if (--display->pending == 0) {
+    pool_record_latency(&display->stats, pool_now_ns() - display->sent_ns);
+  }
+}
+
+/**
+ * Returns the number of writes of the running batch that did not complete.
+ */
+static size_t pool_pending(vibrant_pool *pool) {
+  size_t pending = 0;
+
+  for (size_t i = 0; i < pool->displays_size; i++) {
+    pool_display *display = pool->displays + i;
+
+    if (display->pending > 0) {
+      // replies read while sending can carry the completions of earlier
+      // writes, which leaves nothing for epoll to report
+      fences_check(display->instance);
+      pending += display->pending;
+    }
+  }
+
+  return pending;
+}
+
+vibrant_errors vibrant_pool_apply(vibrant_pool *pool,
+                                  const vibrant_pool_command *commands,
+                                  size_t commands_size, int timeout_ms,
+                                  vibrant_transaction_result *result) {
+  unsigned long long start = pool_now_ns();
+
+  vibrant_controller **controllers =
+      malloc(commands_size * sizeof(vibrant_controller *));
+  vibrant_fence **fences = calloc(commands_size, sizeof(vibrant_fence *));
+  if (commands_size > 0 && (controllers == NULL || fences == NULL)) {
+    free(controllers);
+    free(fences);
+    return vibrant_NoMem;
+  }
+
+  for (size_t i = 0; i < pool->displays_size; i++) {
+    pool->displays[i].pending = 0;
+    pool->displays[i].failed = 0;
+    pool->displays[i].sent_ns = 0;
+  }
+
+  // resolve everything first, so a typo doesn't leave a batch half sent
+  vibrant_errors err = vibrant_NoError;
+  for (size_t i = 0; i < commands_size && err == vibrant_NoError; i++) {
+    const vibrant_pool_command *command = commands + i;
+
+    controllers[i] =
+        command->display < pool->displays_size
+            ? vibrant_instance_find_controller(
+                  pool->displays[command->display].instance, command->output)
+            : NULL;
+    if (controllers[i] == NULL) {
+      err = vibrant_InvalidArgument;
+    } else {
+      pool->displays[command->display].pending++;
+    }
+  }
+
+  if (err != vibrant_NoError) {
+    for (size_t i = 0; i < pool->displays_size; i++) {
+      pool->displays[i].pending = 0;
+    }
+    free(fences);
+    free(controllers);
+    return err;
+  }
+
+  for (size_t i = 0; i < commands_size && err == vibrant_NoError; i++) {
+    // writes that could not be sent stay pending and count as failed
+    pool_display *display = pool->displays + commands[i].display;
+
+    if (display->sent_ns == 0) {
+      display->sent_ns = pool_now_ns();
+    }
+
+    err = vibrant_controller_set_saturation_async(
+        controllers[i], commands[i].saturation, fences + i);
+    if (err == vibrant_NoError) {
+      vibrant_fence_set_callback(fences[i], pool_fence_done, display);
+    }
+  }
+
+  vibrant_transaction_result total = {0, 0, 0, 0};
+  unsigned long long deadline =
+      start + (unsigned long long)(timeout_ms > 0 ? timeout_ms : 0) * 1000000;
+
+  while (err == vibrant_NoError && pool_pending(pool) > 0) {
+    int wait_ms = -1;
+    if (timeout_ms >= 0) {
+      unsigned long long now = pool_now_ns();
+      if (now >= deadline) {
+        break;
+      }
+      // round up, waking early only to wait again is pointless
+      wait_ms = (int)((deadline - now + 999999) / 1000000);
+    }
+
+    // the events of the repairs and listeners of other displays don't belong
+    // to the batch, only their errors are of interest
+    vibrant_transaction_result events = {0, 0, 0, 0};
+    err = pool_dispatch_ready(pool, wait_ms, &events);
+  }
+
+  for (size_t i = 0; i < commands_size; i++) {
+    if (fences[i] != NULL) {
+      // fences still pending are released once the server gets to them
+      vibrant_fence_free(fences + i);
+    }
+  }
+  free(fences);
+  free(controllers);
+
+  for (size_t i = 0; i < pool->displays_size; i++) {
+    pool_display *display = pool->displays + i;
+
+    // whatever is still pending timed out
+    display->stats.failed += display->failed + display->pending;
+    total.failed += display->failed + display->pending;
+    display->pending = 0;
+  }
+
+  total.apply_time_ns = pool_now_ns() - start;
+  if (result != NULL) {
+    *result = total;
+  }
+
+  return err;
+}
+
+vibrant_errors vibrant_pool_get_stats(vibrant_pool *pool, size_t index,
+                                      vibrant_pool_stats *stats) {
+  if (index >= pool->displays_size) {
+    return vibrant_InvalidArgument;
+  }
+
+  *stats = pool->displays[index].stats;
+  return vibrant_NoError;
+}
@@ -0,0 +1,572 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/internal.h"
+#include "vibrant/schedule.h"
+#include "vibrant/vibrant.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/filter.h>
+#include <linux/netlink.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+struct vibrant_schedule {
+  vibrant_instance *instance;
+  schedule_rule *rules;
+  size_t rules_size;
+  unsigned transition_ms;
+
+  // epoll set of the timer and the uevent socket, handed out to callers
+  int epoll_fd;
+  int timer_fd;
+  // uevents, to notice power supply changes. -1 if unavailable
+  int uevent_fd;
+  // 1 if uevent_fd gets the filtered messages of udev, 0 if it gets every
+  // uevent of the kernel
+  int uevent_udev;
+  vibrant_power_state power;
+
+  // per controller: value last written, and the transition from -> to. NAN
+  // marks values that are unknown or outputs without a matching rule
+  double *written;
+  double *from;
+  double *to;
+  // monotonic time the running transition started at
+  uint64_t transition_start;
+  int transitioning;
+};
+
+int schedule_pick(const schedule_rule *rules, size_t rules_size,
+                  long controller, unsigned seconds, vibrant_power_state power,
+                  double *saturation) {
+  const schedule_rule *best = NULL;
+  unsigned best_key = 0;
+
+  for (size_t i = 0; i < rules_size; i++) {
+    const schedule_rule *rule = rules + i;
+
+    if ((rule->controller != -1 && rule->controller != controller) ||
+        (rule->power != vibrant_PowerAny && rule->power != power)) {
+      continue;
+    }
+
+    // rules that started today rank above those still running from yesterday
+    unsigned key = rule->start <= seconds ? rule->start + SCHEDULE_DAY
+                                          : rule->start;
+    // among rules starting at the same time, those naming the output beat
+    // those for every output, otherwise the one listed last wins
+    if (best == NULL || key > best_key ||
+        (key == best_key &&
+         (rule->controller != -1 || best->controller == -1))) {
+      best = rule;
+      best_key = key;
+    }
+  }
+
+  if (best == NULL) {
+    return 0;
+  }
+
+  *saturation = best->saturation;
+  return 1;
+}
+
+unsigned schedule_next_start(const schedule_rule *rules, size_t rules_size,
+                             unsigned seconds, vibrant_power_state power) {
+  unsigned next = 0;
+
+  for (size_t i = 0; i < rules_size; i++) {
+    const schedule_rule *rule = rules + i;
+
+    if (rule->power != vibrant_PowerAny && rule->power != power) {
+      continue;
+    }
+
+    unsigned start = rule->start > seconds ? rule->start
+                                           : rule->start + SCHEDULE_DAY;
+    if (next == 0 || start < next) {
+      next = start;
+    }
+  }
+
+  return next;
+}
+
+/**
+ * Read the first line of dir/name/attribute into buffer.
+ */
+static int schedule_read_attribute(const char *dir, const char *name,
+                                   const char *attribute, char *buffer,
+                                   size_t size) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s/%s", dir, name, attribute);
+
+  FILE *file = fopen(path, "re");
+  if (file == NULL) {
+    return 0;
+  }
+
+  int ok = fgets(buffer, (int)size, file) != NULL;
+  fclose(file);
+  if (ok) {
+    buffer[strcspn(buffer, "\n")] = '\0';
+  }
+
+  return ok;
+}
+
+vibrant_power_state schedule_read_power(const char *dir) {
+  DIR *supplies = opendir(dir);
+  if (supplies == NULL) {
+    return vibrant_PowerAC;
+  }
+
+  int online = 0;
+  int battery = 0;
+  struct dirent *supply;
+  char value[64];
+
+  while ((supply = readdir(supplies)) != NULL) {
+    if (supply->d_name[0] == '.' ||
+        !schedule_read_attribute(dir, supply->d_name, "type", value,
+                                 sizeof(value))) {
+      continue;
+    }
+
+    if (strcmp(value, "Battery") == 0) {
+      // batteries of mice, keyboards and the like have the scope Device
+      if (!schedule_read_attribute(dir, supply->d_name, "scope", value,
+                                   sizeof(value)) ||
+          strcmp(value, "Device") != 0) {
+        battery = 1;
+      }
+    } else if (schedule_read_attribute(dir, supply->d_name, "online", value,
+                                       sizeof(value)) &&
+               strcmp(value, "1") == 0) {
+      // Mains, USB power delivery and friends
+      online = 1;
+    }
+  }
+  closedir(supplies);
+
+  return battery && !online ? vibrant_PowerBattery : vibrant_PowerAC;
+}
+
+void schedule_set_power(vibrant_schedule *schedule,
+                        vibrant_power_state power) {
+  schedule->power = power;
+}
+
+uint32_t schedule_udev_hash(const char *subsystem) {
+  const uint32_t m = 0x5bd1e995u;
+  size_t length = strlen(subsystem);
+  const unsigned char *data = (const unsigned char *)subsystem;
+  uint32_t h = (uint32_t)length;
+
+  for (; length >= 4; data += 4, length -= 4) {
+    uint32_t k;
+    memcpy(&k, data, sizeof(k));
+    k *= m;
+    k ^= k >> 24u;
+    k *= m;
+    h = h * m ^ k;
+  }
+
+  switch (length) {
+  case 3:
+    h ^= (uint32_t)data[2] << 16u;
+    // fall through
+  case 2:
+    h ^= (uint32_t)data[1] << 8u;
+    // fall through
+  case 1:
+    h ^= data[0];
+    h *= m;
+  }
+
+  h ^= h >> 13u;
+  h *= m;
+  h ^= h >> 15u;
+  return h;
+}
+
+int schedule_attach_uevent_filter(int fd) {
+  // header of udev messages: "libudev\0", then big endian fields, see
+  // struct udev_monitor_netlink_header of systemd
+  enum { MAGIC_OFFSET = 8, SUBSYSTEM_HASH_OFFSET = 24 };
+  const uint32_t magic = 0xfeedcafeu;
+
+  struct sock_filter code[] = {
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, MAGIC_OFFSET),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, magic, 0, 3),
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SUBSYSTEM_HASH_OFFSET),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, schedule_udev_hash("power_supply"),
+               0, 1),
+      BPF_STMT(BPF_RET | BPF_K, 0xffffffffu),
+      BPF_STMT(BPF_RET | BPF_K, 0),
+  };
+  struct sock_fprog program = {sizeof(code) / sizeof(code[0]), code};
+
+  return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &program,
+                    sizeof(program));
+}
+
+/**
+ * Open the socket of power supply uevents. The messages of udev can be
+ * filtered in the kernel, the raw uevents of the kernel are only used if
+ * udev doesn't run, e.g. in containers.
+ *
+ * @return the socket, or -1 if there is none
+ */
+static int schedule_open_uevents(int *udev) {
+  int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                  NETLINK_KOBJECT_UEVENT);
+  if (fd < 0) {
+    return -1;
+  }
+
+  *udev = access(SCHEDULE_UDEV_CONTROL, F_OK) == 0;
+  struct sockaddr_nl address = {
+      .nl_family = AF_NETLINK,
+      .nl_groups = *udev ? SCHEDULE_UEVENT_UDEV : SCHEDULE_UEVENT_KERNEL};
+
+  if ((*udev && schedule_attach_uevent_filter(fd) != 0) ||
+      bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static uint64_t schedule_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+/**
+ * Arm the timer for the next transition step, or the next rule start after
+ * now. Wall clock changes cancel the timer, so a suspended or adjusted clock
+ * is noticed right away.
+ */
+static void schedule_arm(vibrant_schedule *schedule, const struct tm *local,
+                         time_t now) {
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+
+  if (schedule->transitioning) {
+    spec.it_value.tv_nsec = SCHEDULE_STEP_MS * 1000000l;
+    timerfd_settime(schedule->timer_fd, 0, &spec, NULL);
+    return;
+  }
+
+  unsigned seconds =
+      local->tm_hour * 3600u + local->tm_min * 60u + local->tm_sec;
+  unsigned next = schedule_next_start(schedule->rules, schedule->rules_size,
+                                      seconds, schedule->power);
+  if (next == 0) {
+    // disarms the timer, only power changes can matter now
+    timerfd_settime(schedule->timer_fd, 0, &spec, NULL);
+    return;
+  }
+
+  // let mktime sort out day boundaries and DST changes
+  struct tm start = *local;
+  start.tm_hour = 0;
+  start.tm_min = 0;
+  start.tm_sec = (int)next;
+  start.tm_isdst = -1;
+
+  time_t at = mktime(&start);
+  if (at <= now) {
+    at = now + 1;
+  }
+
+  spec.it_value.tv_sec = at;
+  timerfd_settime(schedule->timer_fd,
+                  TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL);
+}
+
+vibrant_errors schedule_update(vibrant_schedule *schedule, time_t now,
+                               uint64_t now_ms,
+                               vibrant_transaction_result *result) {
+  vibrant_instance *instance = schedule->instance;
+  struct tm local;
+  localtime_r(&now, &local);
+  unsigned seconds = local.tm_hour * 3600u + local.tm_min * 60u + local.tm_sec;
+
+  int changed = 0;
+  for (int i = 0; i < instance->controllers_size; i++) {
+    double target = NAN;
+    schedule_pick(schedule->rules, schedule->rules_size, i, seconds,
+                  schedule->power, &target);
+
+    if (target != schedule->to[i] &&
+        !(isnan(target) && isnan(schedule->to[i]))) {
+      changed = 1;
+    }
+  }
+
+  if (changed) {
+    for (int i = 0; i < instance->controllers_size; i++) {
+      double target = NAN;
+      schedule_pick(schedule->rules, schedule->rules_size, i, seconds,
+                    schedule->power, &target);
+
+      // a running transition continues from where it is now
+      schedule->from[i] =
+          isnan(schedule->written[i])
+              ? vibrant_controller_get_saturation(instance->controllers + i)
+              : schedule->written[i];
+      schedule->to[i] = target;
+    }
+    schedule->transitioning = schedule->transition_ms > 0;
+    schedule->transition_start = now_ms;
+  }
+
+  double progress = 1.0;
+  if (schedule->transitioning) {
+    progress = (double)(now_ms - schedule->transition_start) /
+               schedule->transition_ms;
+    if (progress >= 1.0) {
+      progress = 1.0;
+      schedule->transitioning = 0;
+    }
+  }
+
+  vibrant_transaction *transaction = NULL;
+  vibrant_errors err = vibrant_NoError;
+  for (int i = 0; i < instance->controllers_size && err == vibrant_NoError;
+       i++) {
+    if (isnan(schedule->to[i])) {
+      continue;
+    }
+
+    double value = schedule->from[i] +
+                   (schedule->to[i] - schedule->from[i]) * progress;
+    if (value == schedule->written[i]) {
+      continue;
+    }
+
+    if (transaction == NULL) {
+      err = vibrant_transaction_new(instance, &transaction);
+      if (err != vibrant_NoError) {
+        break;
+      }
+    }
+
+    vibrant_controller *controller = instance->controllers + i;
+    vibrant_controller_state state;
+    controller_saturation_to_state(controller, value, &state);
+    err = transaction_set_state(transaction, controller, &state);
+    schedule->written[i] = value;
+  }
+
+  if (transaction != NULL) {
+    if (err == vibrant_NoError) {
+      err = vibrant_transaction_commit(transaction, result);
+    }
+    vibrant_transaction_free(&transaction);
+
+    if (err != vibrant_NoError) {
+      // read the outputs back next time instead of trusting written
+      for (int i = 0; i < instance->controllers_size; i++) {
+        schedule->written[i] = NAN;
+      }
+    }
+  } else if (result != NULL) {
+    memset(result, 0, sizeof(vibrant_transaction_result));
+  }
+
+  schedule_arm(schedule, &local, now);
+
+  return err;
+}
+
+vibrant_errors vibrant_schedule_new(vibrant_instance *instance,
+                                    const vibrant_schedule_rule *rules,
+                                    size_t rules_size, unsigned transition_ms,
+                                    vibrant_schedule **schedule) {
+  for (size_t i = 0; i < rules_size; i++) {
+    if (rules[i].start >= SCHEDULE_DAY ||
+        rules[i].power > vibrant_PowerBattery ||
+        !(rules[i].saturation >= VIBRANT_SATURATION_MIN &&
+          rules[i].saturation <= VIBRANT_SATURATION_MAX) ||
+        (rules[i].output != NULL &&
+         vibrant_instance_find_controller(instance, rules[i].output) ==
+             NULL)) {
+      return vibrant_InvalidArgument;
+    }
+  }
+
+  vibrant_schedule *s = calloc(1, sizeof(vibrant_schedule));
+  if (s == NULL) {
+    return vibrant_NoMem;
+  }
+
+  size_t n = instance->controllers_size;
+  s->instance = instance;
+  s->transition_ms = transition_ms;
+  s->epoll_fd = -1;
+  s->timer_fd = -1;
+  s->uevent_fd = -1;
+  s->rules = malloc((rules_size > 0 ? rules_size : 1) * sizeof(schedule_rule));
+  s->written = malloc((n > 0 ? n : 1) * sizeof(double));
+  s->from = malloc((n > 0 ? n : 1) * sizeof(double));
+  s->to = malloc((n > 0 ? n : 1) * sizeof(double));
+  if (s->rules == NULL || s->written == NULL || s->from == NULL ||
+      s->to == NULL) {
+    vibrant_schedule_free(&s);
+    return vibrant_NoMem;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    s->written[i] = NAN;
+    s->from[i] = NAN;
+    s->to[i] = NAN;
+  }
+
+  for (size_t i = 0; i < rules_size; i++) {
+    long controller = -1;
+    if (rules[i].output != NULL) {
+      // outputs were checked above
+      vibrant_controller *found =
+          vibrant_instance_find_controller(instance, rules[i].output);
+      controller = (long)found->priv->index;
+    }
+
+    s->rules[s->rules_size++] = (schedule_rule){
+        controller, rules[i].start, rules[i].power, rules[i].saturation};
+  }
+
+  s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  s->timer_fd =
+      timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (s->epoll_fd < 0 || s->timer_fd < 0) {
+    vibrant_schedule_free(&s);
+    return vibrant_IOError;
+  }
+
+  struct epoll_event event = {.events = EPOLLIN, .data.fd = s->timer_fd};
+  epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->timer_fd, &event);
+
+  // power changes are optional, e.g. containers may not get uevents
+  s->uevent_fd = schedule_open_uevents(&s->uevent_udev);
+  if (s->uevent_fd >= 0) {
+    event.data.fd = s->uevent_fd;
+    if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->uevent_fd, &event) != 0) {
+      close(s->uevent_fd);
+      s->uevent_fd = -1;
+    }
+  }
+
+  s->power = schedule_read_power(SCHEDULE_POWER_DIR);
+
+  // fire right away, the first dispatch applies the current profile
+  struct itimerspec spec = {.it_value = {.tv_nsec = 1}};
+  timerfd_settime(s->timer_fd, 0, &spec, NULL);
+
+  *schedule = s;
+  return vibrant_NoError;
+}
+
+void vibrant_schedule_free(vibrant_schedule **schedule) {
+  vibrant_schedule *s = *schedule;
+
+  if (s->uevent_fd >= 0) {
+    close(s->uevent_fd);
+  }
+  if (s->timer_fd >= 0) {
+    close(s->timer_fd);
+  }
+  if (s->epoll_fd >= 0) {
+    close(s->epoll_fd);
+  }
+
+  free(s->rules);
+  free(s->written);
+  free(s->from);
+  free(s->to);
+  free(s);
+  *schedule = NULL;
+}
+
+int vibrant_schedule_get_fd(vibrant_schedule *schedule) {
+  return schedule->epoll_fd;
+}
+
+/**
+ * Drain the uevent socket.
+ *
+ * @return 1 if a power supply changed
+ */
+static int schedule_drain_uevents(vibrant_schedule *schedule) {
+  static const char subsystem[] = "SUBSYSTEM=power_supply";
+  char buffer[4096];
+  int power_changed = 0;
+  ssize_t length;
+
+  while ((length = recv(schedule->uevent_fd, buffer, sizeof(buffer) - 1, 0)) >
+         0) {
+    buffer[length] = '\0';
+
+    // the filter only lets those of power supplies through
+    if (schedule->uevent_udev) {
+      power_changed = 1;
+      continue;
+    }
+
+    // "action@devpath" followed by NUL separated KEY=VALUE pairs
+    for (ssize_t i = 0; i < length; i += strlen(buffer + i) + 1) {
+      if (strcmp(buffer + i, subsystem) == 0) {
+        power_changed = 1;
+        break;
+      }
+    }
+  }
+
+  return power_changed;
+}
+
+vibrant_errors vibrant_schedule_dispatch(vibrant_schedule *schedule,
+                                         vibrant_transaction_result *result) {
+  uint64_t expirations;
+
+  // ECANCELED after clock changes and EAGAIN are fine, re-evaluating is cheap
+  if (read(schedule->timer_fd, &expirations, sizeof(expirations)) < 0 &&
+      errno != EAGAIN && errno != ECANCELED) {
+    return vibrant_BackendError;
+  }
+
+  if (schedule->uevent_fd >= 0 && schedule_drain_uevents(schedule)) {
+    schedule->power = schedule_read_power(SCHEDULE_POWER_DIR);
+  }
+
+  return schedule_update(schedule, time(NULL), schedule_now_ms(), result);
+}
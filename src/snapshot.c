@@ -0,0 +1,279 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/internal.h"
+#include "vibrant/vibrant.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_MAGIC "VIBSNAP"
+#define SNAPSHOT_VERSION 1u
+#define SNAPSHOT_NAME_SIZE 32
+
+/*
+ * Snapshot file layout, in host byte order. Snapshots are meant to be
+ * restored on the machine they were taken on.
+ *
+ *   snapshot_header
+ *   snapshot_entry[header.entries]
+ */
+typedef struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t entries;
+} snapshot_header;
+
+typedef struct snapshot_entry {
+  // see vibrant_controller_internal.id
+  uint64_t id;
+  // output name, for humans inspecting the file. May be truncated.
+  char name[SNAPSHOT_NAME_SIZE];
+  // SNAPSHOT_BACKEND_* of the backend the state belongs to
+  uint32_t backend;
+  // nv_vibrance for XNVCtrl, gamma_level for Gamma and Wayland
+  int32_t value;
+  // padded_ctm truncated to 32 bits, or the drm_ctm words for DRM
+  uint32_t ctm[18];
+} snapshot_entry;
+
+/*
+ * Backend tags as stored in snapshot entries. They are part of the file
+ * format: new backends get new tags, existing ones never change, whatever
+ * happens to vibrant_controller_backend.
+ */
+#define SNAPSHOT_BACKEND_CTM 0u
+#define SNAPSHOT_BACKEND_XNVCTRL 1u
+#define SNAPSHOT_BACKEND_MOCK 2u
+#define SNAPSHOT_BACKEND_GAMMA 3u
+#define SNAPSHOT_BACKEND_DRM 4u
+#define SNAPSHOT_BACKEND_WAYLAND 5u
+#define SNAPSHOT_BACKEND_EXPORT 6u
+
+// indexed by vibrant_controller_backend
+static const uint32_t snapshot_backend_tags[] = {
+    [CTM] = SNAPSHOT_BACKEND_CTM,
+    [XNVCtrl] = SNAPSHOT_BACKEND_XNVCTRL,
+    [Mock] = SNAPSHOT_BACKEND_MOCK,
+    [Gamma] = SNAPSHOT_BACKEND_GAMMA,
+    [DRM] = SNAPSHOT_BACKEND_DRM,
+    [Wayland] = SNAPSHOT_BACKEND_WAYLAND,
+    [Export] = SNAPSHOT_BACKEND_EXPORT};
+
+_Static_assert(sizeof(snapshot_backend_tags) / sizeof(uint32_t) == Unknown,
+               "every backend has a snapshot tag");
+
+_Static_assert(sizeof(snapshot_header) == 16, "snapshot header is packed");
+_Static_assert(sizeof(snapshot_entry) == 120, "snapshot entry is packed");
+_Static_assert(sizeof(((snapshot_entry *)0)->ctm) ==
+                   sizeof(struct drm_color_ctm),
+               "DRM CTMs fit into snapshot entries");
+
+static void snapshot_entry_from_state(snapshot_entry *entry,
+                                      vibrant_controller *controller,
+                                      const vibrant_controller_state *state) {
+  memset(entry, 0, sizeof(snapshot_entry));
+
+  entry->id = controller->priv->id;
+  strncpy(entry->name, controller->info->name, SNAPSHOT_NAME_SIZE - 1);
+  entry->backend = snapshot_backend_tags[controller->priv->backend];
+
+  if (controller->priv->backend == XNVCtrl) {
+    entry->value = state->nv_vibrance;
+  } else if (controller->priv->backend == Gamma ||
+             controller->priv->backend == Wayland) {
+    entry->value = state->gamma_level;
+  } else if (controller->priv->backend == DRM) {
+    memcpy(entry->ctm, state->drm_ctm.matrix, sizeof(entry->ctm));
+  } else {
+    for (int i = 0; i < 18; i++) {
+      entry->ctm[i] = (uint32_t)state->padded_ctm[i];
+    }
+  }
+}
+
+/**
+ * Find the backend stored as tag.
+ *
+ * @return the backend, or Unknown if no backend has tag
+ */
+static vibrant_controller_backend snapshot_tag_to_backend(uint32_t tag) {
+  for (int i = 0; i < Unknown; i++) {
+    if (snapshot_backend_tags[i] == tag) {
+      return i;
+    }
+  }
+
+  return Unknown;
+}
+
+static void snapshot_entry_to_state(const snapshot_entry *entry,
+                                    vibrant_controller_state *state) {
+  vibrant_controller_backend backend = snapshot_tag_to_backend(entry->backend);
+
+  if (backend == XNVCtrl) {
+    state->nv_vibrance = entry->value;
+  } else if (backend == Gamma || backend == Wayland) {
+    state->gamma_level = entry->value;
+  } else if (backend == DRM) {
+    memcpy(state->drm_ctm.matrix, entry->ctm, sizeof(entry->ctm));
+  } else {
+    for (int i = 0; i < 18; i++) {
+      state->padded_ctm[i] = entry->ctm[i];
+    }
+  }
+}
+
+vibrant_errors vibrant_instance_save_snapshot(vibrant_instance *instance,
+                                              const char *path) {
+  size_t n = instance->controllers_size;
+  snapshot_header header = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, n};
+
+  snapshot_entry *entries = calloc(n, sizeof(snapshot_entry));
+  if (n > 0 && entries == NULL) {
+    return vibrant_NoMem;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    vibrant_controller *controller = instance->controllers + i;
+    vibrant_controller_state state;
+
+    if (controller->priv->get_state(controller, &state) != Success) {
+      free(entries);
+      return vibrant_BackendError;
+    }
+    snapshot_entry_from_state(entries + i, controller, &state);
+  }
+
+  // write next to the target and rename, so readers never see partial files
+  size_t tmp_path_size = strlen(path) + sizeof(".tmp");
+  char *tmp_path = malloc(tmp_path_size);
+  if (tmp_path == NULL) {
+    free(entries);
+    return vibrant_NoMem;
+  }
+  snprintf(tmp_path, tmp_path_size, "%s.tmp", path);
+
+  vibrant_errors err = vibrant_NoError;
+  FILE *file = fopen(tmp_path, "wb");
+  if (file == NULL) {
+    err = vibrant_IOError;
+  } else {
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        (n > 0 && fwrite(entries, sizeof(snapshot_entry), n, file) != n)) {
+      err = vibrant_IOError;
+    }
+    if (fclose(file) != 0) {
+      err = vibrant_IOError;
+    }
+    if (err == vibrant_NoError && rename(tmp_path, path) != 0) {
+      err = vibrant_IOError;
+    }
+    if (err != vibrant_NoError) {
+      unlink(tmp_path);
+    }
+  }
+
+  free(tmp_path);
+  free(entries);
+
+  return err;
+}
+
+vibrant_errors
+vibrant_instance_restore_snapshot(vibrant_instance *instance, const char *path,
+                                  vibrant_transaction_result *result) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return vibrant_IOError;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return vibrant_IOError;
+  }
+
+  if ((size_t)st.st_size < sizeof(snapshot_header)) {
+    close(fd);
+    return vibrant_BadFile;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return vibrant_IOError;
+  }
+
+  const snapshot_header *header = map;
+  const snapshot_entry *entries =
+      (const snapshot_entry *)((const char *)map + sizeof(snapshot_header));
+
+  if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != SNAPSHOT_VERSION ||
+      (size_t)st.st_size != sizeof(snapshot_header) +
+                                header->entries * sizeof(snapshot_entry)) {
+    munmap(map, st.st_size);
+    return vibrant_BadFile;
+  }
+
+  // a backend this library doesn't know means the file is not one of ours
+  for (uint32_t i = 0; i < header->entries; i++) {
+    if (snapshot_tag_to_backend(entries[i].backend) == Unknown) {
+      munmap(map, st.st_size);
+      return vibrant_BadFile;
+    }
+  }
+
+  vibrant_transaction *transaction;
+  vibrant_errors err = vibrant_transaction_new(instance, &transaction);
+  if (err != vibrant_NoError) {
+    munmap(map, st.st_size);
+    return err;
+  }
+
+  for (uint32_t i = 0; i < header->entries && err == vibrant_NoError; i++) {
+    vibrant_controller *controller = index_find_id(instance, entries[i].id);
+    if (controller == NULL || snapshot_tag_to_backend(entries[i].backend) !=
+                                  controller->priv->backend) {
+      // the output is gone or now driven differently, nothing to restore
+      continue;
+    }
+
+    vibrant_controller_state state;
+    snapshot_entry_to_state(entries + i, &state);
+    err = transaction_set_state(transaction, controller, &state);
+  }
+
+  munmap(map, st.st_size);
+
+  if (err == vibrant_NoError) {
+    // outputs that still match the snapshot are skipped by the commit
+    err = vibrant_transaction_commit(transaction, result);
+  }
+  vibrant_transaction_free(&transaction);
+
+  return err;
+}
@@ -0,0 +1,349 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/gamma.h"
+#include "vibrant/internal.h"
+#include "vibrant/nvidia.h"
+#include "vibrant/seqlock.h"
+#include "vibrant/vibrant.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util.c"
+
+#define STATUS_MAGIC "VIBSTAT"
+#define STATUS_VERSION 2u
+
+/*
+ * Status page layout, in host byte order:
+ *
+ *   status_page_header
+ *   status_page_entry[header.entries]
+ *
+ * Everything after the magic is protected by the seqlock in sequence, see
+ * seqlock.h.
+ */
+typedef struct status_page_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t entries;
+  // pid of the publisher, 0 while the page is being created
+  int32_t owner;
+  uint32_t reserved;
+  _Atomic uint64_t sequence;
+  uint64_t generation;
+} status_page_header;
+
+typedef struct status_page_entry {
+  uint64_t id;
+  char name[VIBRANT_STATUS_NAME_SIZE];
+  char backend[VIBRANT_STATUS_BACKEND_SIZE];
+  double saturation;
+  uint64_t generation;
+} status_page_entry;
+
+_Static_assert(sizeof(status_page_header) == 40, "status header is packed");
+_Static_assert(sizeof(status_page_entry) == 72, "status entry is packed");
+
+struct vibrant_status_publisher {
+  char *name;
+  status_page_header *page;
+  size_t size;
+  // serializes writers, readers never take it
+  pthread_mutex_t lock;
+};
+
+struct vibrant_status {
+  // mapped read-only
+  status_page_header *page;
+  size_t size;
+};
+
+static status_page_entry *status_entries(status_page_header *page) {
+  return (status_page_entry *)(page + 1);
+}
+
+static double status_state_to_saturation(vibrant_controller *controller,
+                                         const vibrant_controller_state *state) {
+  if (controller->priv->backend == XNVCtrl) {
+    return nvidia_vibrance_to_saturation(state->nv_vibrance);
+  }
+  if (controller->priv->backend == Gamma ||
+      controller->priv->backend == Wayland) {
+    return gamma_level_to_saturation(state->gamma_level);
+  }
+
+  double coeffs[9];
+  if (controller->priv->backend == DRM) {
+    vibrant_translate_ctm_to_coeffs(&state->drm_ctm, coeffs);
+  } else {
+    vibrant_translate_padded_ctm_to_coeffs(state->padded_ctm, coeffs);
+  }
+
+  return vibrant_coeffs_to_saturation(coeffs);
+}
+
+/**
+ * Remove the page called name if its publisher died without removing it.
+ * Concurrent takeovers are serialized by a lock on the old page, and the
+ * name is only unlinked while it still refers to the locked page.
+ *
+ * @return 1 if the page was removed, 0 if it is in use or being created
+ */
+static int status_take_over(const char *name) {
+  int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0) {
+    // removed in the meantime
+    return errno == ENOENT;
+  }
+
+  int stale = 0;
+  struct stat st;
+  if (flock(fd, LOCK_EX | LOCK_NB) == 0 && fstat(fd, &st) == 0 &&
+      (size_t)st.st_size >= sizeof(status_page_header)) {
+    status_page_header header;
+    if (pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        header.owner > 0 && kill(header.owner, 0) != 0 && errno == ESRCH) {
+      stale = 1;
+    }
+  }
+
+  if (stale) {
+    // another takeover may have replaced the page already
+    int current = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    struct stat current_st;
+    stale = current >= 0 && fstat(current, &current_st) == 0 &&
+            current_st.st_dev == st.st_dev && current_st.st_ino == st.st_ino;
+    if (current >= 0) {
+      close(current);
+    }
+  }
+
+  if (stale) {
+    shm_unlink(name);
+  }
+  close(fd);
+
+  return stale;
+}
+
+vibrant_errors vibrant_instance_publish_status(vibrant_instance *instance,
+                                               const char *name) {
+  size_t n = instance->controllers_size;
+  size_t size = sizeof(status_page_header) + n * sizeof(status_page_entry);
+
+  status_unpublish(instance);
+
+  struct vibrant_status_publisher *publisher =
+      calloc(1, sizeof(struct vibrant_status_publisher));
+  char *publisher_name = strdup(name);
+  if (publisher == NULL || publisher_name == NULL) {
+    free(publisher);
+    free(publisher_name);
+    return vibrant_NoMem;
+  }
+
+  // never truncate a page another publisher still has mapped, its readers
+  // and writer would fault on the next access. Pages of dead publishers are
+  // unlinked instead, their readers keep the old page until they close it
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0 && errno == EEXIST && status_take_over(name)) {
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  }
+  if (fd < 0) {
+    free(publisher);
+    free(publisher_name);
+    return vibrant_IOError;
+  }
+
+  void *map = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    shm_unlink(name);
+    free(publisher);
+    free(publisher_name);
+    return vibrant_IOError;
+  }
+
+  status_page_header *page = map;
+  status_page_entry *entries = status_entries(page);
+  page->owner = getpid();
+  page->version = STATUS_VERSION;
+  page->entries = n;
+
+  for (size_t i = 0; i < n; i++) {
+    vibrant_controller *controller = instance->controllers + i;
+    vibrant_controller_state state;
+
+    if (controller->priv->get_state(controller, &state) != Success) {
+      munmap(map, size);
+      shm_unlink(name);
+      free(publisher);
+      free(publisher_name);
+      return vibrant_BackendError;
+    }
+
+    entries[i].id = controller->priv->id;
+    strncpy(entries[i].name, controller->info->name,
+            VIBRANT_STATUS_NAME_SIZE - 1);
+    strncpy(entries[i].backend,
+            vibrant_controller_get_backend_name(controller),
+            VIBRANT_STATUS_BACKEND_SIZE - 1);
+    entries[i].saturation = status_state_to_saturation(controller, &state);
+  }
+
+  // readers reject the page until the magic shows up
+  atomic_thread_fence(memory_order_release);
+  memcpy(page->magic, STATUS_MAGIC, sizeof(page->magic));
+
+  publisher->name = publisher_name;
+  publisher->page = page;
+  publisher->size = size;
+  pthread_mutex_init(&publisher->lock, NULL);
+  instance->status = publisher;
+
+  return vibrant_NoError;
+}
+
+void status_update(vibrant_controller *controller,
+                   const vibrant_controller_state *state) {
+  struct vibrant_status_publisher *publisher =
+      controller->priv->instance->status;
+  if (publisher == NULL) {
+    return;
+  }
+
+  double saturation = status_state_to_saturation(controller, state);
+  status_page_entry *entry =
+      status_entries(publisher->page) + controller->priv->index;
+
+  pthread_mutex_lock(&publisher->lock);
+  seqlock_write_begin(&publisher->page->sequence);
+  entry->saturation = saturation;
+  entry->generation++;
+  publisher->page->generation++;
+  seqlock_write_end(&publisher->page->sequence);
+  pthread_mutex_unlock(&publisher->lock);
+}
+
+void status_unpublish(vibrant_instance *instance) {
+  struct vibrant_status_publisher *publisher = instance->status;
+  if (publisher == NULL) {
+    return;
+  }
+
+  munmap(publisher->page, publisher->size);
+  shm_unlink(publisher->name);
+  pthread_mutex_destroy(&publisher->lock);
+  free(publisher->name);
+  free(publisher);
+  instance->status = NULL;
+}
+
+vibrant_errors vibrant_status_open(const char *name, vibrant_status **status) {
+  int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    return vibrant_IOError;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return vibrant_IOError;
+  }
+  if ((size_t)st.st_size < sizeof(status_page_header)) {
+    close(fd);
+    return vibrant_BadFile;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return vibrant_IOError;
+  }
+
+  // the page never grows, its size is fixed by the publisher up front
+  status_page_header *page = map;
+  if (memcmp(page->magic, STATUS_MAGIC, sizeof(page->magic)) != 0 ||
+      page->version != STATUS_VERSION ||
+      (size_t)st.st_size != sizeof(status_page_header) +
+                                page->entries * sizeof(status_page_entry)) {
+    munmap(map, st.st_size);
+    return vibrant_BadFile;
+  }
+
+  *status = malloc(sizeof(vibrant_status));
+  if (*status == NULL) {
+    munmap(map, st.st_size);
+    return vibrant_NoMem;
+  }
+  (*status)->page = page;
+  (*status)->size = st.st_size;
+
+  return vibrant_NoError;
+}
+
+void vibrant_status_close(vibrant_status **status) {
+  munmap((*status)->page, (*status)->size);
+  free(*status);
+  *status = NULL;
+}
+
+void vibrant_status_read(vibrant_status *status, vibrant_status_entry *entries,
+                         size_t capacity, size_t *length,
+                         unsigned long long *generation) {
+  status_page_header *page = status->page;
+  const status_page_entry *page_entries = status_entries(page);
+  size_t n = page->entries;
+  size_t copy = n < capacity ? n : capacity;
+  uint64_t begin, page_generation;
+
+  do {
+    begin = seqlock_read_begin(&page->sequence);
+
+    page_generation = page->generation;
+    for (size_t i = 0; i < copy; i++) {
+      entries[i].id = page_entries[i].id;
+      memcpy(entries[i].name, page_entries[i].name, VIBRANT_STATUS_NAME_SIZE);
+      memcpy(entries[i].backend, page_entries[i].backend,
+             VIBRANT_STATUS_BACKEND_SIZE);
+      entries[i].saturation = page_entries[i].saturation;
+      entries[i].generation = page_entries[i].generation;
+    }
+  } while (seqlock_read_retry(&page->sequence, begin));
+
+  *length = n;
+  if (generation != NULL) {
+    *generation = page_generation;
+  }
+}
@@ -0,0 +1,775 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/trace.h"
+#include "vibrant/gamma.h"
+#include "vibrant/internal.h"
+#include "vibrant/nvidia.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util.c"
+
+#define TRACE_MAGIC "vibrant-trace"
+#define TRACE_VERSION 2
+#define TRACE_NAME_SIZE 256
+
+/*
+ * Traces are line based text, so they can be inspected, trimmed and written
+ * by hand. Latencies are in nanoseconds, statuses are X error codes.
+ *
+ *   vibrant-trace 2
+ *   init <latency>
+ *   probe <step> <latency>
+ *   output <backend> <gamma size> <id> <18 hex state words> <name>
+ *   get <output> <latency> <status>
+ *   set <output> <latency> <status>
+ *   commit <latency> <status>
+ *
+ * Blank lines and lines starting with # are ignored.
+ * Outputs are numbered in the order of their lines and come first. State
+ * words are encoded like in snapshots, see snapshot.c. Opening the instance
+ * took the latencies of its probing steps, in the order of their lines, plus
+ * the init latency. Version 1 traces have no probing steps.
+ */
+
+// indexed by vibrant_controller_backend
+static const char *const trace_backend_names[] = {
+    "CTM", "XNVCtrl", "Mock", "Gamma", "DRM", "Wayland", "Export"};
+
+// indexed by trace_probe_step
+static const char *const trace_probe_names[] = {
+    "connect", "resources", "output", "nvidia", "ctm", "gamma", "edid"};
+
+typedef struct trace_backend {
+  vibrant_get_saturation_fn get_saturation;
+  vibrant_set_saturation_fn set_saturation;
+  vibrant_get_state_fn get_state;
+  vibrant_set_state_fn set_state;
+} trace_backend;
+
+struct vibrant_trace {
+  FILE *file;
+  // original backend functions of every controller
+  trace_backend *backends;
+  int (*commit)(vibrant_instance *instance);
+
+  // controllers may be driven from multiple threads
+  pthread_mutex_t lock;
+};
+
+typedef struct trace_event {
+  unsigned long long latency_ns;
+  int status;
+} trace_event;
+
+/**
+ * Recorded events of one kind, replayed in a loop.
+ */
+typedef struct trace_events {
+  trace_event *events;
+  size_t size;
+  size_t capacity;
+  size_t next;
+} trace_events;
+
+typedef struct replay_output {
+  vibrant_controller_state state;
+  trace_events gets;
+  trace_events sets;
+} replay_output;
+
+struct vibrant_replay {
+  double latency_scale;
+
+  replay_output *outputs;
+  trace_events commits;
+
+  pthread_mutex_t lock;
+};
+
+unsigned long long trace_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void trace_state_to_words(vibrant_controller_backend backend,
+                                 const vibrant_controller_state *state,
+                                 uint32_t *words) {
+  memset(words, 0, 18 * sizeof(uint32_t));
+
+  if (backend == XNVCtrl) {
+    words[0] = (uint32_t)state->nv_vibrance;
+  } else if (backend == Gamma || backend == Wayland) {
+    words[0] = (uint32_t)state->gamma_level;
+  } else if (backend == DRM) {
+    memcpy(words, state->drm_ctm.matrix, sizeof(state->drm_ctm.matrix));
+  } else {
+    for (int i = 0; i < 18; i++) {
+      words[i] = (uint32_t)state->padded_ctm[i];
+    }
+  }
+}
+
+static void trace_words_to_state(vibrant_controller_backend backend,
+                                 const uint32_t *words,
+                                 vibrant_controller_state *state) {
+  if (backend == XNVCtrl) {
+    state->nv_vibrance = (int32_t)words[0];
+  } else if (backend == Gamma || backend == Wayland) {
+    state->gamma_level = (int32_t)words[0];
+  } else if (backend == DRM) {
+    memcpy(state->drm_ctm.matrix, words, sizeof(state->drm_ctm.matrix));
+  } else {
+    for (int i = 0; i < 18; i++) {
+      state->padded_ctm[i] = words[i];
+    }
+  }
+}
+
+static void trace_log(struct vibrant_trace *trace, const char *kind,
+                      size_t index, unsigned long long latency_ns,
+                      int status) {
+  pthread_mutex_lock(&trace->lock);
+  fprintf(trace->file, "%s %zu %llu %d\n", kind, index, latency_ns, status);
+  pthread_mutex_unlock(&trace->lock);
+}
+
+static double trace_get_saturation(vibrant_controller *controller) {
+  struct vibrant_trace *trace = controller->priv->instance->trace;
+  size_t index = controller->priv->index;
+
+  unsigned long long start = trace_now_ns();
+  double saturation = trace->backends[index].get_saturation(controller);
+  // failed reads are only visible as negative saturations
+  trace_log(trace, "get", index, trace_now_ns() - start,
+            saturation < 0.0 ? BadMatch : Success);
+
+  return saturation;
+}
+
+static int trace_set_saturation(vibrant_controller *controller,
+                                double saturation) {
+  struct vibrant_trace *trace = controller->priv->instance->trace;
+  size_t index = controller->priv->index;
+
+  unsigned long long start = trace_now_ns();
+  int status = trace->backends[index].set_saturation(controller, saturation);
+  trace_log(trace, "set", index, trace_now_ns() - start, status);
+
+  return status;
+}
+
+static int trace_get_state(vibrant_controller *controller,
+                           vibrant_controller_state *state) {
+  struct vibrant_trace *trace = controller->priv->instance->trace;
+  size_t index = controller->priv->index;
+
+  unsigned long long start = trace_now_ns();
+  int status = trace->backends[index].get_state(controller, state);
+  trace_log(trace, "get", index, trace_now_ns() - start, status);
+
+  return status;
+}
+
+static int trace_set_state(vibrant_controller *controller,
+                           const vibrant_controller_state *state) {
+  struct vibrant_trace *trace = controller->priv->instance->trace;
+  size_t index = controller->priv->index;
+
+  unsigned long long start = trace_now_ns();
+  int status = trace->backends[index].set_state(controller, state);
+  trace_log(trace, "set", index, trace_now_ns() - start, status);
+
+  return status;
+}
+
+/**
+ * Commit hook of recorded instances. X instances have no commit of their
+ * own, the round trip confirming their queued requests is recorded instead.
+ */
+static int trace_commit(vibrant_instance *instance) {
+  struct vibrant_trace *trace = instance->trace;
+
+  unsigned long long start = trace_now_ns();
+  int status = Success;
+  if (trace->commit != NULL) {
+    status = trace->commit(instance);
+  } else if (instance->dpy != NULL) {
+    XSync(instance->dpy, False);
+  }
+  unsigned long long latency_ns = trace_now_ns() - start;
+
+  pthread_mutex_lock(&trace->lock);
+  fprintf(trace->file, "commit %llu %d\n", latency_ns, status);
+  pthread_mutex_unlock(&trace->lock);
+
+  return status;
+}
+
+void trace_probe_begin(trace_probes *probes) {
+  if (probes != NULL) {
+    probes->start_ns = trace_now_ns();
+  }
+}
+
+void trace_probe_end(trace_probes *probes, trace_probe_step step) {
+  if (probes == NULL) {
+    return;
+  }
+
+  unsigned long long latency_ns = trace_now_ns() - probes->start_ns;
+
+  if (probes->size == probes->capacity) {
+    size_t capacity = probes->capacity == 0 ? 16 : probes->capacity * 2;
+    trace_probe *tmp = realloc(probes->probes, sizeof(trace_probe) * capacity);
+    if (tmp == NULL) {
+      probes->failed = 1;
+      return;
+    }
+    probes->probes = tmp;
+    probes->capacity = capacity;
+  }
+
+  probes->probes[probes->size++] = (trace_probe){step, latency_ns};
+}
+
+void trace_probes_free(trace_probes *probes) {
+  free(probes->probes);
+  *probes = (trace_probes){0};
+}
+
+vibrant_errors trace_record_start(vibrant_instance *instance, const char *path,
+                                  unsigned long long start_ns,
+                                  const trace_probes *probes) {
+  size_t n = instance->controllers_size;
+
+  if (probes->failed) {
+    return vibrant_NoMem;
+  }
+
+  struct vibrant_trace *trace = calloc(1, sizeof(struct vibrant_trace));
+  trace_backend *backends = calloc(n, sizeof(trace_backend));
+  if (trace == NULL || (n > 0 && backends == NULL)) {
+    free(backends);
+    free(trace);
+    return vibrant_NoMem;
+  }
+
+  FILE *file = fopen(path, "we");
+  if (file == NULL) {
+    free(backends);
+    free(trace);
+    return vibrant_IOError;
+  }
+
+  // init is what opening took beyond the probing steps
+  unsigned long long init_ns = trace_now_ns() - start_ns;
+  for (size_t i = 0; i < probes->size; i++) {
+    init_ns -= probes->probes[i].latency_ns;
+  }
+
+  fprintf(file, "%s %d\ninit %llu\n", TRACE_MAGIC, TRACE_VERSION, init_ns);
+  for (size_t i = 0; i < probes->size; i++) {
+    fprintf(file, "probe %s %llu\n", trace_probe_names[probes->probes[i].step],
+            probes->probes[i].latency_ns);
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    vibrant_controller *controller = instance->controllers + i;
+    vibrant_controller_internal *priv = controller->priv;
+
+    // replays start out where the outputs were when recording began
+    vibrant_controller_state state;
+    if (priv->get_state(controller, &state) != Success) {
+      priv->saturation_to_state(1.0, &state);
+    }
+
+    uint32_t words[18];
+    trace_state_to_words(priv->backend, &state, words);
+
+    fprintf(file, "output %s %d %016llx", trace_backend_names[priv->backend],
+            priv->gamma_size, (unsigned long long)priv->id);
+    for (int j = 0; j < 18; j++) {
+      fprintf(file, " %08x", words[j]);
+    }
+    fprintf(file, " %s\n", controller->info->name);
+  }
+
+  if (ferror(file)) {
+    fclose(file);
+    free(backends);
+    free(trace);
+    return vibrant_IOError;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    vibrant_controller_internal *priv = instance->controllers[i].priv;
+
+    backends[i] = (trace_backend){priv->get_saturation, priv->set_saturation,
+                                  priv->get_state, priv->set_state};
+    priv->get_saturation = trace_get_saturation;
+    priv->set_saturation = trace_set_saturation;
+    priv->get_state = trace_get_state;
+    priv->set_state = trace_set_state;
+  }
+
+  trace->file = file;
+  trace->backends = backends;
+  trace->commit = instance->commit;
+  pthread_mutex_init(&trace->lock, NULL);
+
+  instance->trace = trace;
+  instance->commit = trace_commit;
+
+  return vibrant_NoError;
+}
+
+void trace_record_stop(vibrant_instance *instance) {
+  struct vibrant_trace *trace = instance->trace;
+  if (trace == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < instance->controllers_size; i++) {
+    vibrant_controller_internal *priv = instance->controllers[i].priv;
+
+    priv->get_saturation = trace->backends[i].get_saturation;
+    priv->set_saturation = trace->backends[i].set_saturation;
+    priv->get_state = trace->backends[i].get_state;
+    priv->set_state = trace->backends[i].set_state;
+  }
+  instance->commit = trace->commit;
+  instance->trace = NULL;
+
+  fclose(trace->file);
+  pthread_mutex_destroy(&trace->lock);
+  free(trace->backends);
+  free(trace);
+}
+
+static void replay_sleep_ns(double ns) {
+  if (ns < 1.0) {
+    return;
+  }
+
+  struct timespec ts = {(time_t)(ns / 1e9), (long)fmod(ns, 1e9)};
+  while (nanosleep(&ts, &ts) != 0) {
+    // interrupted by a signal, sleep for the remaining time
+  }
+}
+
+static int trace_events_append(trace_events *events,
+                               unsigned long long latency_ns, int status) {
+  if (events->size == events->capacity) {
+    size_t capacity = events->capacity == 0 ? 64 : events->capacity * 2;
+    trace_event *tmp = realloc(events->events, sizeof(trace_event) * capacity);
+    if (tmp == NULL) {
+      return 0;
+    }
+    events->events = tmp;
+    events->capacity = capacity;
+  }
+
+  events->events[events->size++] = (trace_event){latency_ns, status};
+  return 1;
+}
+
+/**
+ * Delay like the next recorded event of events and tell how it ended.
+ * Requests beyond the recording start over with its first event.
+ *
+ * @return Success or the recorded X error code
+ */
+static int replay_event(struct vibrant_replay *replay, trace_events *events) {
+  pthread_mutex_lock(&replay->lock);
+  if (events->size == 0) {
+    pthread_mutex_unlock(&replay->lock);
+    return Success;
+  }
+  trace_event event = events->events[events->next];
+  events->next = (events->next + 1) % events->size;
+  pthread_mutex_unlock(&replay->lock);
+
+  replay_sleep_ns(event.latency_ns * replay->latency_scale);
+
+  return event.status;
+}
+
+static double replay_state_to_saturation(vibrant_controller *controller,
+                                         const vibrant_controller_state *state) {
+  if (controller->priv->backend == XNVCtrl) {
+    return nvidia_vibrance_to_saturation(state->nv_vibrance);
+  }
+  if (controller->priv->backend == Gamma ||
+      controller->priv->backend == Wayland) {
+    return gamma_level_to_saturation(state->gamma_level);
+  }
+
+  double coeffs[9];
+  if (controller->priv->backend == DRM) {
+    vibrant_translate_ctm_to_coeffs(&state->drm_ctm, coeffs);
+  } else {
+    vibrant_translate_padded_ctm_to_coeffs(state->padded_ctm, coeffs);
+  }
+
+  return vibrant_coeffs_to_saturation(coeffs);
+}
+
+static void replay_ctm_saturation_to_state(double saturation,
+                                           vibrant_controller_state *state) {
+  ctm_saturation_to_padded_ctm(saturation, state->padded_ctm);
+}
+
+static void replay_nvidia_saturation_to_state(double saturation,
+                                              vibrant_controller_state *state) {
+  state->nv_vibrance = nvidia_saturation_to_vibrance(saturation);
+}
+
+static void replay_gamma_saturation_to_state(double saturation,
+                                             vibrant_controller_state *state) {
+  state->gamma_level = gamma_saturation_to_level(saturation);
+}
+
+static void replay_drm_saturation_to_state(double saturation,
+                                           vibrant_controller_state *state) {
+  saturation = fmax(saturation, VIBRANT_SATURATION_MIN);
+  saturation = fmin(saturation, VIBRANT_SATURATION_MAX);
+
+  double coeffs[9];
+  vibrant_saturation_to_coeffs(saturation, coeffs);
+  vibrant_translate_coeffs_to_ctm(coeffs, &state->drm_ctm);
+}
+
+static int replayctrl_get_state(vibrant_controller *controller,
+                                vibrant_controller_state *state) {
+  struct vibrant_replay *replay = controller->priv->instance->backend_data;
+  replay_output *output = replay->outputs + controller->priv->index;
+
+  int status = replay_event(replay, &output->gets);
+  if (status == Success) {
+    pthread_mutex_lock(&replay->lock);
+    *state = output->state;
+    pthread_mutex_unlock(&replay->lock);
+  }
+
+  return status;
+}
+
+static int replayctrl_set_state(vibrant_controller *controller,
+                                const vibrant_controller_state *state) {
+  struct vibrant_replay *replay = controller->priv->instance->backend_data;
+  replay_output *output = replay->outputs + controller->priv->index;
+
+  int status = replay_event(replay, &output->sets);
+  if (status == Success) {
+    pthread_mutex_lock(&replay->lock);
+    output->state = *state;
+    pthread_mutex_unlock(&replay->lock);
+  }
+
+  return status;
+}
+
+static double replayctrl_get_saturation(vibrant_controller *controller) {
+  vibrant_controller_state state;
+  if (replayctrl_get_state(controller, &state) != Success) {
+    return -1.0;
+  }
+
+  return replay_state_to_saturation(controller, &state);
+}
+
+static int replayctrl_set_saturation(vibrant_controller *controller,
+                                     double saturation) {
+  vibrant_controller_state state;
+  controller->priv->saturation_to_state(saturation, &state);
+
+  return replayctrl_set_state(controller, &state);
+}
+
+static int replay_commit(vibrant_instance *instance) {
+  struct vibrant_replay *replay = instance->backend_data;
+
+  return replay_event(replay, &replay->commits);
+}
+
+static void replay_free(struct vibrant_replay *replay,
+                        vibrant_controller *controllers, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    free(controllers[i].info->name);
+    free(controllers[i].info);
+    layers_free(controllers + i);
+    free(controllers[i].priv);
+    free(replay->outputs[i].gets.events);
+    free(replay->outputs[i].sets.events);
+  }
+  free(controllers);
+  free(replay->outputs);
+  free(replay->commits.events);
+  free(replay);
+}
+
+/**
+ * Add the output described by the rest of an output line.
+ *
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BadFile
+ */
+static vibrant_errors replay_add_output(vibrant_instance *instance,
+                                        struct vibrant_replay *replay,
+                                        vibrant_controller **controllers,
+                                        size_t *n, const char *line) {
+  char backend_name[16];
+  int gamma_size;
+  unsigned long long id;
+  uint32_t w[18];
+  int name_offset = -1;
+
+  sscanf(line,
+         "%15s %d %llx %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x "
+         "%n",
+         backend_name, &gamma_size, &id, w, w + 1, w + 2, w + 3, w + 4, w + 5,
+         w + 6, w + 7, w + 8, w + 9, w + 10, w + 11, w + 12, w + 13, w + 14,
+         w + 15, w + 16, w + 17, &name_offset);
+  if (name_offset < 0) {
+    return vibrant_BadFile;
+  }
+
+  const char *name = line + name_offset;
+  size_t name_len = strcspn(name, "\n");
+  if (name_len == 0) {
+    return vibrant_BadFile;
+  }
+
+  vibrant_controller_backend backend = Unknown;
+  for (int i = 0; i < Unknown; i++) {
+    if (strcmp(backend_name, trace_backend_names[i]) == 0) {
+      backend = i;
+    }
+  }
+  if (backend == Unknown) {
+    return vibrant_BadFile;
+  }
+
+  vibrant_controller *c =
+      realloc(*controllers, sizeof(vibrant_controller) * (*n + 1));
+  if (c == NULL) {
+    return vibrant_NoMem;
+  }
+  *controllers = c;
+  replay_output *outputs =
+      realloc(replay->outputs, sizeof(replay_output) * (*n + 1));
+  if (outputs == NULL) {
+    return vibrant_NoMem;
+  }
+  replay->outputs = outputs;
+
+  XRROutputInfo *info = calloc(1, sizeof(XRROutputInfo));
+  char *info_name = strndup(name, name_len);
+  vibrant_controller_internal *priv =
+      malloc(sizeof(vibrant_controller_internal));
+  if (info == NULL || info_name == NULL || priv == NULL) {
+    free(info);
+    free(info_name);
+    free(priv);
+    return vibrant_NoMem;
+  }
+
+  info->name = info_name;
+  info->nameLen = (int)name_len;
+  info->connection = RR_Connected;
+  // every output gets a CRTC of its own, like the index of the controller
+  info->crtc = *n + 1;
+
+  vibrant_saturation_to_state_fn saturation_to_state =
+      backend == XNVCtrl                        ? replay_nvidia_saturation_to_state
+      : backend == Gamma || backend == Wayland ? replay_gamma_saturation_to_state
+      : backend == DRM                          ? replay_drm_saturation_to_state
+                                                : replay_ctm_saturation_to_state;
+
+  *priv = (vibrant_controller_internal){
+      .backend = backend,
+      .nvId = backend == XNVCtrl ? (int)*n : -1,
+      .gamma_size = gamma_size,
+      .get_saturation = replayctrl_get_saturation,
+      .set_saturation = replayctrl_set_saturation,
+      .get_state = replayctrl_get_state,
+      .set_state = replayctrl_set_state,
+      .saturation_to_state = saturation_to_state,
+      .instance = instance,
+      .index = *n,
+      .id = id};
+  // XIDs are never 0, mimic that for the replayed outputs
+  c[*n] = (vibrant_controller){*n + 1, info, NULL, priv};
+
+  outputs[*n] = (replay_output){0};
+  trace_words_to_state(backend, w, &outputs[*n].state);
+  (*n)++;
+
+  return vibrant_NoError;
+}
+
+/**
+ * Add the event described by line to replay.
+ *
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BadFile
+ */
+static vibrant_errors replay_add_event(struct vibrant_replay *replay,
+                                       size_t n, const char *line) {
+  char kind[8];
+  size_t index;
+  unsigned long long latency_ns;
+  int status;
+  trace_events *events;
+
+  if (sscanf(line, "commit %llu %d", &latency_ns, &status) == 2) {
+    events = &replay->commits;
+  } else if (sscanf(line, "%7s %zu %llu %d", kind, &index, &latency_ns,
+                    &status) == 4 &&
+             index < n) {
+    if (strcmp(kind, "get") == 0) {
+      events = &replay->outputs[index].gets;
+    } else if (strcmp(kind, "set") == 0) {
+      events = &replay->outputs[index].sets;
+    } else {
+      return vibrant_BadFile;
+    }
+  } else {
+    return vibrant_BadFile;
+  }
+
+  return trace_events_append(events, latency_ns, status) ? vibrant_NoError
+                                                         : vibrant_NoMem;
+}
+
+/**
+ * Add the probing step described by line to probes.
+ *
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BadFile
+ */
+static vibrant_errors replay_add_probe(trace_events *probes,
+                                       const char *line) {
+  char step[16];
+  unsigned long long latency_ns;
+
+  if (sscanf(line, "%15s %llu", step, &latency_ns) != 2) {
+    return vibrant_BadFile;
+  }
+
+  for (int i = 0; i <= ProbeEDID; i++) {
+    if (strcmp(step, trace_probe_names[i]) == 0) {
+      return trace_events_append(probes, latency_ns, Success)
+                 ? vibrant_NoError
+                 : vibrant_NoMem;
+    }
+  }
+
+  return vibrant_BadFile;
+}
+
+vibrant_errors replay_instance_new(vibrant_instance *instance,
+                                   const vibrant_replay_options *options) {
+  FILE *file = fopen(options->path, "re");
+  if (file == NULL) {
+    return vibrant_IOError;
+  }
+
+  struct vibrant_replay *replay = calloc(1, sizeof(struct vibrant_replay));
+  if (replay == NULL) {
+    fclose(file);
+    return vibrant_NoMem;
+  }
+  replay->latency_scale = fmax(options->latency_scale, 0.0);
+
+  vibrant_controller *controllers = NULL;
+  size_t n = 0;
+  unsigned long long init_ns = 0;
+  trace_events probes = {0};
+  int version = 0;
+  char magic[16];
+
+  char *line = NULL;
+  size_t line_size = 0;
+  vibrant_errors err = vibrant_NoError;
+
+  if (getline(&line, &line_size, file) < 0 ||
+      sscanf(line, "%15s %d", magic, &version) != 2 ||
+      strcmp(magic, TRACE_MAGIC) != 0 || version < 1 ||
+      version > TRACE_VERSION) {
+    err = ferror(file) ? vibrant_IOError : vibrant_BadFile;
+  }
+
+  while (err == vibrant_NoError && getline(&line, &line_size, file) >= 0) {
+    if (line[0] == '\n' || line[0] == '#') {
+      // blank lines and comments, for traces edited by hand
+      continue;
+    }
+    if (strncmp(line, "output ", 7) == 0) {
+      err = replay_add_output(instance, replay, &controllers, &n, line + 7);
+    } else if (version >= 2 && strncmp(line, "probe ", 6) == 0) {
+      err = replay_add_probe(&probes, line + 6);
+    } else if (sscanf(line, "init %llu", &init_ns) != 1) {
+      err = replay_add_event(replay, n, line);
+    }
+  }
+  if (err == vibrant_NoError && ferror(file)) {
+    err = vibrant_IOError;
+  }
+
+  free(line);
+  fclose(file);
+
+  if (err != vibrant_NoError) {
+    free(probes.events);
+    replay_free(replay, controllers, n);
+    return err;
+  }
+
+  pthread_mutex_init(&replay->lock, NULL);
+
+  *instance = (vibrant_instance){.controllers = controllers,
+                                 .controllers_size = n,
+                                 .backend = vibrant_BackendReplay,
+                                 .backend_data = replay};
+  if (replay->commits.size > 0) {
+    instance->commit = replay_commit;
+  }
+
+  // opening the instance took this long when it was recorded, step by step
+  for (size_t i = 0; i < probes.size; i++) {
+    replay_sleep_ns(probes.events[i].latency_ns * replay->latency_scale);
+  }
+  free(probes.events);
+  replay_sleep_ns(init_ns * replay->latency_scale);
+
+  return vibrant_NoError;
+}
+
+void replay_instance_free(vibrant_instance *instance) {
+  struct vibrant_replay *replay = instance->backend_data;
+
+  pthread_mutex_destroy(&replay->lock);
+  replay_free(replay, instance->controllers, instance->controllers_size);
+}
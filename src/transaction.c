@@ -0,0 +1,293 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/internal.h"
+#include "vibrant/vibrant.h"
+#include "vibrant/xerror.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct vibrant_transaction_entry {
+  vibrant_controller *controller;
+
+  vibrant_controller_state target;
+  // state before the commit, used for the rollback
+  vibrant_controller_state saved;
+
+  // serial range of the requests that applied target, see xerror_trap_find()
+  unsigned long first_serial;
+  unsigned long last_serial;
+  // Success or the X error code the last apply resulted in
+  int status;
+  // 0 if the output already had the target state and was left alone
+  int written;
+} vibrant_transaction_entry;
+
+struct vibrant_transaction {
+  vibrant_instance *instance;
+
+  vibrant_transaction_entry *entries;
+  size_t entries_size;
+  size_t entries_capacity;
+};
+
+static unsigned long long transaction_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+vibrant_errors vibrant_transaction_new(vibrant_instance *instance,
+                                       vibrant_transaction **transaction) {
+  *transaction = calloc(1, sizeof(vibrant_transaction));
+  if (*transaction == NULL) {
+    return vibrant_NoMem;
+  }
+
+  (*transaction)->instance = instance;
+
+  return vibrant_NoError;
+}
+
+void vibrant_transaction_free(vibrant_transaction **transaction) {
+  free((*transaction)->entries);
+  free(*transaction);
+  *transaction = NULL;
+}
+
+/**
+ * Find the entry of controller in transaction or append a new one.
+ *
+ * @return the entry or NULL if memory allocation failed
+ */
+static vibrant_transaction_entry *
+transaction_get_entry(vibrant_transaction *transaction,
+                      vibrant_controller *controller) {
+  for (size_t i = 0; i < transaction->entries_size; i++) {
+    if (transaction->entries[i].controller == controller) {
+      return transaction->entries + i;
+    }
+  }
+
+  if (transaction->entries_size == transaction->entries_capacity) {
+    size_t capacity = transaction->entries_capacity == 0
+                          ? 4
+                          : transaction->entries_capacity * 2;
+    vibrant_transaction_entry *tmp = realloc(
+        transaction->entries, sizeof(vibrant_transaction_entry) * capacity);
+    if (tmp == NULL) {
+      return NULL;
+    }
+    transaction->entries = tmp;
+    transaction->entries_capacity = capacity;
+  }
+
+  vibrant_transaction_entry *entry =
+      transaction->entries + transaction->entries_size++;
+  entry->controller = controller;
+
+  return entry;
+}
+
+vibrant_errors vibrant_transaction_set_saturation(
+    vibrant_transaction *transaction, vibrant_controller *controller,
+    double saturation) {
+  vibrant_transaction_entry *entry =
+      transaction_get_entry(transaction, controller);
+  if (entry == NULL) {
+    return vibrant_NoMem;
+  }
+
+  controller_saturation_to_state(controller, saturation, &entry->target);
+
+  return vibrant_NoError;
+}
+
+vibrant_errors transaction_set_state(vibrant_transaction *transaction,
+                                     vibrant_controller *controller,
+                                     const vibrant_controller_state *state) {
+  vibrant_transaction_entry *entry =
+      transaction_get_entry(transaction, controller);
+  if (entry == NULL) {
+    return vibrant_NoMem;
+  }
+
+  entry->target = *state;
+
+  return vibrant_NoError;
+}
+
+/**
+ * Check if an entry before index already sent the same gamma ramps to the
+ * CRTC of entry index. Cloned outputs share their CRTC and with it the
+ * ramps, so each CRTC is updated once per batch.
+ */
+static int transaction_crtc_sent(vibrant_transaction *transaction,
+                                 size_t index, int restore) {
+  vibrant_transaction_entry *entry = transaction->entries + index;
+  vibrant_controller *controller = entry->controller;
+
+  if (controller->priv->backend != Gamma) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < index; i++) {
+    vibrant_transaction_entry *other = transaction->entries + i;
+
+    if (other->written && other->controller->priv->backend == Gamma &&
+        other->controller->info->crtc == controller->info->crtc &&
+        vibrant_controller_state_equal(
+            controller, restore ? &other->saved : &other->target,
+            restore ? &entry->saved : &entry->target)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Send the target (or saved, if restore is set) state of every entry and wait
+ * for the server to process them.
+ *
+ * @return number of entries that failed to apply
+ */
+static size_t transaction_apply(vibrant_transaction *transaction,
+                                int restore) {
+  Display *dpy = transaction->instance->dpy;
+  size_t failed = 0;
+
+  for (size_t i = 0; i < transaction->entries_size; i++) {
+    vibrant_transaction_entry *entry = transaction->entries + i;
+    vibrant_controller *controller = entry->controller;
+
+    if (!entry->written) {
+      entry->status = Success;
+      continue;
+    }
+
+    if (transaction_crtc_sent(transaction, i, restore)) {
+      // errors are reported on the entry that sent the ramps
+      entry->first_serial = entry->last_serial = 0;
+      entry->status = Success;
+      continue;
+    }
+
+    entry->first_serial = dpy != NULL ? NextRequest(dpy) : 0;
+    entry->status = controller->priv->set_state(
+        controller, restore ? &entry->saved : &entry->target);
+    entry->last_serial = dpy != NULL ? NextRequest(dpy) : 0;
+  }
+
+  // one round trip confirms every request sent above, batching backends
+  // like DRM apply them all in one commit which succeeds or fails as a whole
+  int commit_status = Success;
+  if (transaction->instance->commit != NULL) {
+    // X instances only have a commit hook while they are recorded, which
+    // syncs them in turn
+    commit_status = transaction->instance->commit(transaction->instance);
+  } else if (dpy != NULL) {
+    XSync(dpy, False);
+  }
+
+  for (size_t i = 0; i < transaction->entries_size; i++) {
+    vibrant_transaction_entry *entry = transaction->entries + i;
+
+    if (entry->written && entry->status == Success) {
+      entry->status =
+          dpy != NULL
+              ? xerror_trap_find(entry->first_serial, entry->last_serial)
+              : commit_status;
+    }
+    if (entry->status != Success) {
+      failed++;
+    }
+  }
+
+  return failed;
+}
+
+vibrant_errors vibrant_transaction_commit(vibrant_transaction *transaction,
+                                          vibrant_transaction_result *result) {
+  Display *dpy = transaction->instance->dpy;
+  size_t failed = 0;
+  size_t unchanged = 0;
+  int rolled_back = 0;
+
+  unsigned long long start = transaction_now_ns();
+
+  if (dpy != NULL) {
+    xerror_trap_push(dpy);
+    // nobody else may change or even see the outputs until we are done
+    XGrabServer(dpy);
+  }
+
+  for (size_t i = 0; i < transaction->entries_size; i++) {
+    vibrant_transaction_entry *entry = transaction->entries + i;
+    vibrant_controller *controller = entry->controller;
+
+    entry->written = 0;
+    if (controller->priv->get_state(controller, &entry->saved) != Success) {
+      failed++;
+      continue;
+    }
+
+    // writing what is already there would only cost a request and a flicker
+    entry->written = !vibrant_controller_state_equal(controller, &entry->saved,
+                                                     &entry->target);
+    if (!entry->written) {
+      unchanged++;
+    }
+  }
+
+  // without a complete snapshot nothing could be rolled back, so don't start
+  if (failed == 0) {
+    failed = transaction_apply(transaction, 0);
+
+    if (failed > 0) {
+      transaction_apply(transaction, 1);
+      rolled_back = 1;
+    }
+  }
+
+  if (dpy != NULL) {
+    XUngrabServer(dpy);
+    XFlush(dpy);
+    xerror_trap_pop();
+  }
+
+  if (failed == 0) {
+    for (size_t i = 0; i < transaction->entries_size; i++) {
+      vibrant_transaction_entry *entry = transaction->entries + i;
+      controller_state_changed(entry->controller, &entry->target);
+    }
+  }
+
+  unsigned long long end = transaction_now_ns();
+
+  if (result != NULL) {
+    *result = (vibrant_transaction_result){failed, unchanged, rolled_back,
+                                           end - start};
+  }
+
+  transaction->entries_size = 0;
+
+  return failed == 0 ? vibrant_NoError : vibrant_BackendError;
+}
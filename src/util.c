@@ -49,6 +49,7 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "vibrant/ctm.h"
 
@@ -83,10 +84,12 @@ static double vibrant_coeffs_to_saturation(const double *coeffs) {
   /*
    * When calculating the coefficients we add the saturation value to the
    * coefficients with indices 0, 4, 8. This means we can just subtract
-   * a coefficient other than 0, 4, 8 from a coefficient at indices 0, 4, 8.
+   * a coefficient of the same column from a coefficient at indices 0, 4, 8.
+   * Rows only differ by the saturation on the diagonal, the columns carry
+   * the channel weights, which are not equal for panel profiles.
    */
 
-  return coeffs[0] - coeffs[1];
+  return coeffs[0] - coeffs[3];
 }
 
 /**
@@ -110,6 +113,45 @@ static void vibrant_translate_coeffs_to_ctm(const double *coeffs,
   }
 }
 
+/**
+ * Translate a color CTM in the format DRM accepts back to coefficients.
+ *
+ * @param ctm DRM CTM struct
+ * @param coeffs Translated coefficients will be placed here.
+ */
+static void vibrant_translate_ctm_to_coeffs(const struct drm_color_ctm *ctm,
+                                            double *coeffs) {
+  for (int i = 0; i < 9; i++) {
+    // clear sign bit and convert fixed-point to floating point
+    coeffs[i] = (ctm->matrix[i] & ~(1ULL << 63u)) / pow(2.0, 32);
+    if (ctm->matrix[i] & (1ULL << 63u))
+      coeffs[i] *= -1;
+  }
+}
+
+/**
+ * Pad a color CTM to the long-sized 32-bit format RandR expects.
+ *
+ * Every S31.32 value is split into its two 32-bit halves, each stored in its
+ * own long. See ctm_set_ctm() for why this is needed.
+ *
+ * @param ctm DRM CTM struct
+ * @param padded_ctm Long array with a length of 18. The padded values will be
+ * placed here.
+ */
+static void vibrant_translate_ctm_to_padded_ctm(const struct drm_color_ctm *ctm,
+                                                long *padded_ctm) {
+  uint32_t words[18];
+
+  // copy instead of casting ctm->matrix, which would break strict aliasing
+  memcpy(words, ctm->matrix, sizeof(words));
+
+  for (int i = 0; i < 18; i++)
+    // Think of this as a padded 'memcpy()'.
+    // long* padded_ctm <- (uint32_t *) ctm.matrix
+    padded_ctm[i] = words[i];
+}
+
 /**
  * Translate padded color CTM format back to coefficients.
  *
@@ -49,56 +49,264 @@
 
 #include "vibrant/vibrant.h"
 #include "vibrant/ctm.h"
+#include "vibrant/drm.h"
+#include "vibrant/export.h"
+#include "vibrant/gamma.h"
+#include "vibrant/internal.h"
+#include "vibrant/mock.h"
 #include "vibrant/nvidia.h"
+#include "vibrant/panel.h"
+#include "vibrant/trace.h"
+#include "vibrant/wayland.h"
+#include "vibrant/xerror.h"
 
 #include <NVCtrl/NVCtrlLib.h>
+#include <X11/extensions/randr.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
-typedef double (*vibrant_get_saturation_fn)(vibrant_controller *);
-
-typedef void (*vibrant_set_saturation_fn)(vibrant_controller *, double);
-
 double ctmctrl_get_saturation(vibrant_controller *controller);
 
-void ctmctrl_set_saturation(vibrant_controller *controller, double saturation);
+int ctmctrl_set_saturation(vibrant_controller *controller, double saturation);
 
 double nvctrl_get_saturation(vibrant_controller *controller);
 
-void nvctrl_set_saturation(vibrant_controller *controller, double saturation);
+int nvctrl_set_saturation(vibrant_controller *controller, double saturation);
+
+static vibrant_errors x11_instance_new(vibrant_instance **instance,
+                                       const char *display_name, bool exported,
+                                       trace_probes *probes);
+
+int ctmctrl_get_state(vibrant_controller *controller,
+                      vibrant_controller_state *state);
+
+int ctmctrl_set_state(vibrant_controller *controller,
+                      const vibrant_controller_state *state);
+
+void ctmctrl_saturation_to_state(double saturation,
+                                 vibrant_controller_state *state);
 
-typedef enum vibrant_controller_backend {
-  CTM,
-  XNVCtrl,
-  Unknown
-} vibrant_controller_backend;
+int nvctrl_get_state(vibrant_controller *controller,
+                     vibrant_controller_state *state);
 
-typedef struct vibrant_controller_internal {
-  vibrant_controller_backend backend;
+int nvctrl_set_state(vibrant_controller *controller,
+                     const vibrant_controller_state *state);
 
-  // only applied if this display is an nvidia display,
-  // otherwise this is set to -1
-  int nvId;
+void nvctrl_saturation_to_state(double saturation,
+                                vibrant_controller_state *state);
 
-  vibrant_get_saturation_fn get_saturation;
-  vibrant_set_saturation_fn set_saturation;
-} vibrant_controller_internal;
+double gammactrl_get_saturation(vibrant_controller *controller);
 
-struct vibrant_instance {
-  Display *dpy;
+int gammactrl_set_saturation(vibrant_controller *controller,
+                             double saturation);
 
-  vibrant_controller *controllers;
-  int controllers_size;
-};
+int gammactrl_get_state(vibrant_controller *controller,
+                        vibrant_controller_state *state);
+
+int gammactrl_set_state(vibrant_controller *controller,
+                        const vibrant_controller_state *state);
+
+void gammactrl_saturation_to_state(double saturation,
+                                   vibrant_controller_state *state);
 
 vibrant_errors vibrant_instance_new(vibrant_instance **instance,
                                     const char *display_name) {
+  return vibrant_instance_new_with_options(instance, display_name, NULL);
+}
+
+vibrant_errors
+vibrant_instance_new_with_options(vibrant_instance **instance,
+                                  const char *display_name,
+                                  const vibrant_instance_options *options) {
+  vibrant_errors err;
+  unsigned long long start_ns = trace_now_ns();
+  const char *record_path = getenv("VIBRANT_RECORD");
+  bool recording = record_path != NULL && record_path[0] != '\0';
+  // only opening an X server takes steps worth recording on their own
+  trace_probes probes = {0};
+
+  if (options != NULL && options->backend == vibrant_BackendMock) {
+    *instance = malloc(sizeof(vibrant_instance));
+    if (*instance == NULL) {
+      return vibrant_NoMem;
+    }
+
+    err = mock_instance_new(*instance, &options->mock);
+    if (err != vibrant_NoError) {
+      free(*instance);
+      return err;
+    }
+  } else if (options != NULL && options->backend == vibrant_BackendDRM) {
+    *instance = malloc(sizeof(vibrant_instance));
+    if (*instance == NULL) {
+      return vibrant_NoMem;
+    }
+
+    err = drm_instance_new(*instance, &options->drm);
+    if (err != vibrant_NoError) {
+      free(*instance);
+      return err;
+    }
+  } else if (options != NULL && options->backend == vibrant_BackendWayland) {
+#ifdef VIBRANT_ENABLE_WAYLAND
+    *instance = malloc(sizeof(vibrant_instance));
+    if (*instance == NULL) {
+      return vibrant_NoMem;
+    }
+
+    err = wayland_instance_new(*instance, display_name);
+    if (err != vibrant_NoError) {
+      free(*instance);
+      return err;
+    }
+#else
+    return vibrant_BackendError;
+#endif
+  } else if (options != NULL && options->backend == vibrant_BackendReplay) {
+    *instance = malloc(sizeof(vibrant_instance));
+    if (*instance == NULL) {
+      return vibrant_NoMem;
+    }
+
+    err = replay_instance_new(*instance, &options->replay);
+    if (err != vibrant_NoError) {
+      free(*instance);
+      return err;
+    }
+  } else if (options != NULL && options->backend == vibrant_BackendExport &&
+             options->exported.outputs != NULL) {
+    *instance = malloc(sizeof(vibrant_instance));
+    if (*instance == NULL) {
+      return vibrant_NoMem;
+    }
+
+    err = export_instance_new(*instance, &options->exported);
+    if (err != vibrant_NoError) {
+      free(*instance);
+      return err;
+    }
+  } else {
+    err = x11_instance_new(
+        instance, display_name,
+        options != NULL && options->backend == vibrant_BackendExport,
+        recording ? &probes : NULL);
+    if (err != vibrant_NoError) {
+      trace_probes_free(&probes);
+      return err;
+    }
+  }
+
+  if (options != NULL && options->backend == vibrant_BackendExport) {
+    err = export_publish(*instance);
+    if (err != vibrant_NoError) {
+      trace_probes_free(&probes);
+      vibrant_instance_free(instance);
+      return err;
+    }
+  }
+
+  err = index_build(*instance);
+  if (err != vibrant_NoError) {
+    trace_probes_free(&probes);
+    vibrant_instance_free(instance);
+    return err;
+  }
+
+  if (recording) {
+    err = trace_record_start(*instance, record_path, start_ns, &probes);
+    if (err != vibrant_NoError) {
+      vibrant_instance_free(instance);
+    }
+  }
+  trace_probes_free(&probes);
+
+  return err;
+}
+
+/**
+ * Derive the stable id and the panel profile of every output from its EDID.
+ * All EDIDs are fetched in a single pass while the controllers are set up.
+ * Outputs without an EDID fall back to the hash of their name. If several
+ * outputs share an EDID, e.g. identical panels without serial numbers, their
+ * connector names are mixed in to tell them apart.
+ */
+static void assign_output_ids(Display *dpy, vibrant_controller *controllers,
+                              int controllers_size, trace_probes *probes) {
+  Atom edid_atom = XInternAtom(dpy, RR_PROPERTY_RANDR_EDID, True);
+  uint64_t *edid_ids = calloc(controllers_size, sizeof(uint64_t));
+
+  for (int i = 0; i < controllers_size; i++) {
+    vibrant_controller *controller = controllers + i;
+    controller->priv->id =
+        vibrant_hash(VIBRANT_HASH_SEED, controller->info->name,
+                     controller->info->nameLen);
+
+    if (edid_atom == None || edid_ids == NULL) {
+      continue;
+    }
+
+    int actual_format;
+    unsigned long n_items, bytes_after;
+    unsigned char *edid = NULL;
+    Atom actual_type;
+
+    // the base block identifies the panel, extension blocks don't matter
+    trace_probe_begin(probes);
+    XRRGetOutputProperty(dpy, controller->output, edid_atom, 0,
+                         EDID_BLOCK_SIZE / 4, False, False, AnyPropertyType,
+                         &actual_type, &actual_format, &n_items, &bytes_after,
+                         &edid);
+    trace_probe_end(probes, ProbeEDID);
+    if (edid != NULL && actual_format == 8 && n_items >= EDID_BLOCK_SIZE) {
+      // 0 marks outputs without EDID, FNV-1a practically never yields it
+      edid_ids[i] = vibrant_hash(VIBRANT_HASH_SEED, edid, EDID_BLOCK_SIZE);
+      controller->priv->panel_valid = panel_profile_lookup(
+          edid_ids[i], edid, controller->priv->panel_weights);
+    }
+    if (edid != NULL) {
+      XFree(edid);
+    }
+  }
+
+  if (edid_ids == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < controllers_size; i++) {
+    if (edid_ids[i] == 0) {
+      continue;
+    }
+
+    controllers[i].priv->id = edid_ids[i];
+    for (int j = 0; j < controllers_size; j++) {
+      if (i != j && edid_ids[i] == edid_ids[j]) {
+        controllers[i].priv->id =
+            vibrant_hash(edid_ids[i], controllers[i].info->name,
+                         controllers[i].info->nameLen);
+        break;
+      }
+    }
+  }
+
+  free(edid_ids);
+}
+
+/**
+ * Set up the connected outputs of the X server on display_name. If exported
+ * is set, outputs without NV-CONTROL or a CTM become Export controllers
+ * instead of being driven through their gamma ramps. Every step that waits
+ * for the server is timed into probes, unless it is NULL.
+ */
+static vibrant_errors x11_instance_new(vibrant_instance **instance,
+                                       const char *display_name, bool exported,
+                                       trace_probes *probes) {
   *instance = malloc(sizeof(vibrant_instance));
   if (*instance == NULL) {
     return vibrant_NoMem;
   }
 
+  trace_probe_begin(probes);
   Display *dpy = XOpenDisplay(display_name);
   if (dpy == NULL) {
     free(*instance);
@@ -107,9 +315,12 @@ vibrant_errors vibrant_instance_new(vibrant_instance **instance,
   }
 
   bool dpy_has_nvidia = XNVCTRLQueryExtension(dpy, NULL, NULL);
+  trace_probe_end(probes, ProbeConnect);
 
   Window root = DefaultRootWindow(dpy);
+  trace_probe_begin(probes);
   XRRScreenResources *resources = XRRGetScreenResources(dpy, root);
+  trace_probe_end(probes, ProbeResources);
 
   vibrant_controller *controllers =
       malloc(sizeof(vibrant_controller) * resources->noutput);
@@ -125,8 +336,10 @@ vibrant_errors vibrant_instance_new(vibrant_instance **instance,
   // filter out disconnected outputs
   int n_connected = 0;
   for (int i = 0; i < controllers_size; i++) {
+    trace_probe_begin(probes);
     XRROutputInfo *info =
         XRRGetOutputInfo(dpy, resources, resources->outputs[i]);
+    trace_probe_end(probes, ProbeOutput);
 
     if (info->connection == RR_Connected) {
       vibrant_controller_internal *priv =
@@ -147,7 +360,8 @@ vibrant_errors vibrant_instance_new(vibrant_instance **instance,
         return vibrant_NoMem;
       }
 
-      *priv = (vibrant_controller_internal){Unknown, -1};
+      *priv = (vibrant_controller_internal){
+          .backend = Unknown, .nvId = -1, .instance = *instance};
       controllers[n_connected] =
           (vibrant_controller){resources->outputs[i], info, dpy, priv};
       n_connected++;
@@ -192,6 +406,7 @@ vibrant_errors vibrant_instance_new(vibrant_instance **instance,
    */
   if (dpy_has_nvidia) {
     for (int i = 0; i < ScreenCount(dpy); i++) {
+      trace_probe_begin(probes);
       if (XNVCTRLIsNvScreen(dpy, i)) {
         int *nvDpyIds;
         int nvDpyIdsLen;
@@ -217,10 +432,15 @@ vibrant_errors vibrant_instance_new(vibrant_instance **instance,
               controllers[k].priv->nvId = nvDpyIds[j];
               controllers[k].priv->get_saturation = nvctrl_get_saturation;
               controllers[k].priv->set_saturation = nvctrl_set_saturation;
+              controllers[k].priv->get_state = nvctrl_get_state;
+              controllers[k].priv->set_state = nvctrl_set_state;
+              controllers[k].priv->saturation_to_state =
+                  nvctrl_saturation_to_state;
             }
           }
         }
       }
+      trace_probe_end(probes, ProbeNvidia);
     }
   }
 
@@ -230,10 +450,50 @@ vibrant_errors vibrant_instance_new(vibrant_instance **instance,
    */
   for (size_t i = 0; i < controllers_size; i++) {
     if (controllers[i].priv->backend == Unknown) {
-      if (ctm_output_has_ctm(dpy, controllers[i].output)) {
+      trace_probe_begin(probes);
+      bool has_ctm = ctm_output_has_ctm(dpy, controllers[i].output);
+      trace_probe_end(probes, ProbeCTM);
+
+      if (has_ctm) {
         controllers[i].priv->backend = CTM;
         controllers[i].priv->get_saturation = ctmctrl_get_saturation;
         controllers[i].priv->set_saturation = ctmctrl_set_saturation;
+        controllers[i].priv->get_state = ctmctrl_get_state;
+        controllers[i].priv->set_state = ctmctrl_set_state;
+        controllers[i].priv->saturation_to_state = ctmctrl_saturation_to_state;
+      }
+    }
+  }
+
+  /**
+   * Hand the remaining outputs to the compositor if it asked for them, it
+   * applies their matrix exactly in its shaders.
+   */
+  for (size_t i = 0; i < controllers_size; i++) {
+    if (exported && controllers[i].priv->backend == Unknown) {
+      export_controller_init(controllers[i].priv);
+    }
+  }
+
+  /**
+   * Fall back to the gamma ramps of the CRTC driving the remaining outputs.
+   * They only approximate saturation, but work on practically every driver.
+   */
+  for (size_t i = 0; i < controllers_size; i++) {
+    if (controllers[i].priv->backend == Unknown) {
+      trace_probe_begin(probes);
+      int gamma_size = gamma_crtc_size(dpy, controllers[i].info->crtc);
+      trace_probe_end(probes, ProbeGamma);
+
+      if (gamma_size > 0) {
+        controllers[i].priv->backend = Gamma;
+        controllers[i].priv->gamma_size = gamma_size;
+        controllers[i].priv->get_saturation = gammactrl_get_saturation;
+        controllers[i].priv->set_saturation = gammactrl_set_saturation;
+        controllers[i].priv->get_state = gammactrl_get_state;
+        controllers[i].priv->set_state = gammactrl_set_state;
+        controllers[i].priv->saturation_to_state =
+            gammactrl_saturation_to_state;
       }
     }
   }
@@ -279,19 +539,77 @@ vibrant_errors vibrant_instance_new(vibrant_instance **instance,
     return vibrant_NoMem;
   }
 
-  **instance = (vibrant_instance){dpy, controllers, controllers_size};
+  assign_output_ids(dpy, controllers, controllers_size, probes);
+  for (int i = 0; i < controllers_size; i++) {
+    controllers[i].priv->index = i;
+  }
+
+  **instance = (vibrant_instance){.dpy = dpy,
+                                  .controllers = controllers,
+                                  .controllers_size = controllers_size,
+                                  .backend = vibrant_BackendX11};
   XRRFreeScreenResources(resources);
 
   return vibrant_NoError;
 }
 
 void vibrant_instance_free(vibrant_instance **instance) {
+  trace_record_stop(*instance);
+  index_free(*instance);
+  status_unpublish(*instance);
+  export_unpublish(*instance);
+  fences_abandon(*instance);
+
+  if ((*instance)->backend == vibrant_BackendMock) {
+    mock_instance_free(*instance);
+
+    free(*instance);
+    instance = NULL;
+    return;
+  }
+
+  if ((*instance)->backend == vibrant_BackendDRM) {
+    drm_instance_free(*instance);
+
+    free(*instance);
+    instance = NULL;
+    return;
+  }
+
+  if ((*instance)->backend == vibrant_BackendReplay) {
+    replay_instance_free(*instance);
+
+    free(*instance);
+    instance = NULL;
+    return;
+  }
+
+  if ((*instance)->backend == vibrant_BackendExport) {
+    export_instance_free(*instance);
+
+    free(*instance);
+    instance = NULL;
+    return;
+  }
+
+#ifdef VIBRANT_ENABLE_WAYLAND
+  if ((*instance)->backend == vibrant_BackendWayland) {
+    wayland_instance_free(*instance);
+
+    free(*instance);
+    instance = NULL;
+    return;
+  }
+#endif
+
   for (int i = 0; i < (*instance)->controllers_size; i++) {
     XRRFreeOutputInfo((*instance)->controllers[i].info);
+    layers_free((*instance)->controllers + i);
     free((*instance)->controllers[i].priv);
   }
 
   free((*instance)->controllers);
+  gamma_cache_free(&(*instance)->gamma_cache);
   XCloseDisplay((*instance)->dpy);
 
   free(*instance);
@@ -309,24 +627,241 @@ double vibrant_controller_get_saturation(vibrant_controller *controller) {
   return controller->priv->get_saturation(controller);
 }
 
+/**
+ * Apply state to controller and wait until the backend took it, like the
+ * setters of the backends do for the uniform matrix.
+ *
+ * @return Success or the X error code of the request
+ */
+static int controller_apply_state(vibrant_controller *controller,
+                                  const vibrant_controller_state *state) {
+  vibrant_instance *instance = controller->priv->instance;
+  Display *dpy = instance->dpy;
+
+  if (dpy != NULL) {
+    xerror_acquire(dpy);
+  }
+
+  unsigned long first_serial = dpy != NULL ? NextRequest(dpy) : 0;
+  int status = controller->priv->set_state(controller, state);
+  unsigned long last_serial = dpy != NULL ? NextRequest(dpy) : 0;
+
+  // set_state only queues the request
+  if (status == Success && instance->commit != NULL) {
+    status = instance->commit(instance);
+  } else if (status == Success && dpy != NULL) {
+    XSync(dpy, False);
+  }
+
+  if (dpy != NULL) {
+    if (status == Success) {
+      status = xerror_find(dpy, first_serial, last_serial);
+    }
+    xerror_release(dpy);
+  }
+
+  return status;
+}
+
 void vibrant_controller_set_saturation(vibrant_controller *controller,
                                        double saturation) {
-  controller->priv->set_saturation(controller, saturation);
+  vibrant_controller_internal *priv = controller->priv;
+  vibrant_controller_state state;
+
+  if (priv->saturation_model != vibrant_SaturationUniform) {
+    // the setters of the backends only know the uniform matrix, the state
+    // of the model is written directly, a single output needs no grab
+    controller_saturation_to_state(controller, saturation, &state);
+    if (controller_apply_state(controller, &state) == Success) {
+      controller_state_changed(controller, &state);
+    }
+    return;
+  }
+
+  if (priv->set_saturation(controller, saturation) == Success) {
+    priv->saturation_to_state(saturation, &state);
+    controller_state_changed(controller, &state);
+  }
+}
+
+void controller_state_changed(vibrant_controller *controller,
+                              const vibrant_controller_state *state) {
+  vibrant_controller_internal *priv = controller->priv;
+
+  // something else wrote over the layers, they have to be written again
+  if (priv->composed_written &&
+      !vibrant_controller_state_equal(controller, &priv->composed, state)) {
+    priv->composed_written = 0;
+  }
+
+  watch_set_intended(controller, state);
+  status_update(controller, state);
+}
+
+unsigned long long vibrant_controller_get_id(vibrant_controller *controller) {
+  return controller->priv->id;
+}
+
+const char *vibrant_controller_get_backend_name(vibrant_controller *controller) {
+  switch (controller->priv->backend) {
+  case CTM:
+    return "CTM";
+  case XNVCtrl:
+    return "NV-CONTROL";
+  case Mock:
+    return "mock";
+  case Gamma:
+    return "gamma";
+  case DRM:
+    return "DRM";
+  case Wayland:
+    return "wlr-gamma-control";
+  case Export:
+    return "export";
+  default:
+    return "unknown";
+  }
+}
+
+uint64_t vibrant_hash(uint64_t seed, const void *data, size_t length) {
+  const unsigned char *bytes = data;
+  uint64_t hash = seed;
+
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+int vibrant_controller_state_equal(vibrant_controller *controller,
+                                   const vibrant_controller_state *a,
+                                   const vibrant_controller_state *b) {
+  switch (controller->priv->backend) {
+  case XNVCtrl:
+    return a->nv_vibrance == b->nv_vibrance;
+  case Gamma:
+  case Wayland:
+    return a->gamma_level == b->gamma_level;
+  case DRM:
+    return memcmp(a->drm_ctm.matrix, b->drm_ctm.matrix,
+                  sizeof(a->drm_ctm.matrix)) == 0;
+  case CTM:
+  case Mock:
+  case Export:
+    // only the lower 32 bits of each element are meaningful
+    for (int i = 0; i < 18; i++) {
+      if ((uint32_t)a->padded_ctm[i] != (uint32_t)b->padded_ctm[i]) {
+        return 0;
+      }
+    }
+    return 1;
+  default:
+    return 0;
+  }
 }
 
 double ctmctrl_get_saturation(vibrant_controller *controller) {
   return ctm_get_saturation(controller->display, controller->output, NULL);
 }
 
-void ctmctrl_set_saturation(vibrant_controller *controller, double saturation) {
-  ctm_set_saturation(controller->display, controller->output, saturation, NULL);
+int ctmctrl_set_saturation(vibrant_controller *controller, double saturation) {
+  int x_status;
+  ctm_set_saturation(controller->display, controller->output, saturation,
+                     &x_status);
+  return x_status;
 }
 
 double nvctrl_get_saturation(vibrant_controller *controller) {
   return nvidia_get_saturation(controller->display, controller->priv->nvId);
 }
 
-void nvctrl_set_saturation(vibrant_controller *controller, double saturation) {
+int nvctrl_set_saturation(vibrant_controller *controller, double saturation) {
   nvidia_set_saturation(controller->display, controller->priv->nvId,
                         saturation);
+  return Success;
+}
+
+int ctmctrl_get_state(vibrant_controller *controller,
+                      vibrant_controller_state *state) {
+  return ctm_get_padded_ctm(controller->display, controller->output,
+                            state->padded_ctm);
+}
+
+int ctmctrl_set_state(vibrant_controller *controller,
+                      const vibrant_controller_state *state) {
+  ctm_queue_padded_ctm(controller->display, controller->output,
+                       state->padded_ctm);
+  return Success;
+}
+
+void ctmctrl_saturation_to_state(double saturation,
+                                 vibrant_controller_state *state) {
+  ctm_saturation_to_padded_ctm(saturation, state->padded_ctm);
+}
+
+int nvctrl_get_state(vibrant_controller *controller,
+                     vibrant_controller_state *state) {
+  return nvidia_get_vibrance(controller->display, controller->priv->nvId,
+                             &state->nv_vibrance);
+}
+
+int nvctrl_set_state(vibrant_controller *controller,
+                     const vibrant_controller_state *state) {
+  nvidia_queue_vibrance(controller->display, controller->priv->nvId,
+                        state->nv_vibrance);
+  return Success;
+}
+
+void nvctrl_saturation_to_state(double saturation,
+                                vibrant_controller_state *state) {
+  state->nv_vibrance = nvidia_saturation_to_vibrance(saturation);
+}
+
+double gammactrl_get_saturation(vibrant_controller *controller) {
+  vibrant_controller_state state;
+  if (gammactrl_get_state(controller, &state) != Success) {
+    return -1.0;
+  }
+
+  return gamma_level_to_saturation(state.gamma_level);
+}
+
+int gammactrl_set_saturation(vibrant_controller *controller,
+                             double saturation) {
+  vibrant_controller_state state;
+  gammactrl_saturation_to_state(saturation, &state);
+
+  Display *dpy = controller->display;
+  xerror_acquire(dpy);
+  unsigned long first_serial = NextRequest(dpy);
+  int x_status = gammactrl_set_state(controller, &state);
+  unsigned long last_serial = NextRequest(dpy);
+  XSync(dpy, False);
+
+  if (x_status == Success) {
+    x_status = xerror_find(dpy, first_serial, last_serial);
+  }
+  xerror_release(dpy);
+
+  return x_status;
+}
+
+int gammactrl_get_state(vibrant_controller *controller,
+                        vibrant_controller_state *state) {
+  return gamma_get_level(controller->display, controller->info->crtc,
+                         &state->gamma_level);
+}
+
+int gammactrl_set_state(vibrant_controller *controller,
+                        const vibrant_controller_state *state) {
+  return gamma_queue_level(&controller->priv->instance->gamma_cache,
+                           controller->display, controller->info->crtc,
+                           controller->priv->gamma_size, state->gamma_level);
+}
+
+void gammactrl_saturation_to_state(double saturation,
+                                   vibrant_controller_state *state) {
+  state->gamma_level = gamma_saturation_to_level(saturation);
 }
@@ -0,0 +1,389 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/ctm.h"
+#include "vibrant/internal.h"
+#include "vibrant/vibrant.h"
+
+#include <NVCtrl/NVCtrl.h>
+#include <NVCtrl/NVCtrlLib.h>
+#include <X11/extensions/randr.h>
+
+#define WATCH_EVENT_MASK                                                       \
+  (RRCrtcChangeNotifyMask | RROutputChangeNotifyMask |                         \
+   RROutputPropertyNotifyMask)
+
+void watch_set_intended(vibrant_controller *controller,
+                        const vibrant_controller_state *state) {
+  if (controller->priv->instance->watching) {
+    controller->priv->intended = *state;
+  }
+}
+
+int vibrant_instance_get_fd(vibrant_instance *instance) {
+  return instance->dpy != NULL ? ConnectionNumber(instance->dpy) : -1;
+}
+
+/**
+ * Select the events the watchdog and the change listener need, or none if
+ * both are off.
+ *
+ * @return vibrant_NoError or vibrant_BackendError if RandR is missing
+ */
+static vibrant_errors watch_select(vibrant_instance *instance, int enabled) {
+  Display *dpy = instance->dpy;
+  if (dpy == NULL) {
+    return vibrant_NoError;
+  }
+
+  int error_base;
+  if (enabled &&
+      !XRRQueryExtension(dpy, &instance->randr_event_base, &error_base)) {
+    return vibrant_BackendError;
+  }
+  XRRSelectInput(dpy, DefaultRootWindow(dpy), enabled ? WATCH_EVENT_MASK : 0);
+
+  instance->nv_event_base = -1;
+  for (int i = 0; i < instance->controllers_size; i++) {
+    vibrant_controller *controller = instance->controllers + i;
+    if (controller->priv->backend != XNVCtrl) {
+      continue;
+    }
+
+    if (instance->nv_event_base == -1 &&
+        !XNVCTRLQueryExtension(dpy, &instance->nv_event_base, &error_base)) {
+      break;
+    }
+    XNVCtrlSelectTargetNotify(dpy, NV_CTRL_TARGET_TYPE_DISPLAY,
+                              controller->priv->nvId,
+                              TARGET_ATTRIBUTE_CHANGED_EVENT, enabled);
+  }
+
+  XFlush(dpy);
+  return vibrant_NoError;
+}
+
+vibrant_errors vibrant_instance_set_watchdog(vibrant_instance *instance,
+                                             int enabled) {
+  if (!enabled) {
+    if (instance->watching && instance->change_fn == NULL) {
+      watch_select(instance, 0);
+    }
+    instance->watching = 0;
+
+    return vibrant_NoError;
+  }
+
+  for (int i = 0; i < instance->controllers_size; i++) {
+    vibrant_controller *controller = instance->controllers + i;
+
+    if (controller->priv->get_state(controller, &controller->priv->intended) !=
+        Success) {
+      return vibrant_BackendError;
+    }
+    controller->priv->watch_pending = 0;
+  }
+
+  if (watch_select(instance, 1) != vibrant_NoError) {
+    return vibrant_BackendError;
+  }
+  instance->watching = 1;
+
+  return vibrant_NoError;
+}
+
+vibrant_errors vibrant_instance_set_change_listener(vibrant_instance *instance,
+                                                    vibrant_change_fn fn,
+                                                    void *user_data) {
+  if (fn == NULL) {
+    if (instance->change_fn != NULL && !instance->watching) {
+      watch_select(instance, 0);
+    }
+    instance->change_fn = NULL;
+    instance->change_data = NULL;
+
+    return vibrant_NoError;
+  }
+
+  // changes are reported relative to what the outputs show now
+  for (int i = 0; i < instance->controllers_size; i++) {
+    vibrant_controller *controller = instance->controllers + i;
+
+    if (controller->priv->get_state(controller, &controller->priv->reported) !=
+        Success) {
+      return vibrant_BackendError;
+    }
+  }
+
+  if (watch_select(instance, 1) != vibrant_NoError) {
+    return vibrant_BackendError;
+  }
+  instance->change_fn = fn;
+  instance->change_data = user_data;
+  instance->outputs_changed = 0;
+
+  return vibrant_NoError;
+}
+
+/**
+ * Mark the controllers driven by NV-CONTROL display nv_id whose digital
+ * vibrance changed.
+ */
+static void watch_handle_nv_event(vibrant_instance *instance,
+                                  const XEvent *event) {
+  const XNVCtrlAttributeChangedEventTarget *nv_event =
+      (const XNVCtrlAttributeChangedEventTarget *)event;
+
+  if (nv_event->target_type != NV_CTRL_TARGET_TYPE_DISPLAY ||
+      nv_event->attribute != NV_CTRL_DIGITAL_VIBRANCE) {
+    return;
+  }
+
+  for (int i = 0; i < instance->controllers_size; i++) {
+    vibrant_controller_internal *priv = instance->controllers[i].priv;
+    if (priv->backend == XNVCtrl && priv->nvId == nv_event->target_id) {
+      priv->watch_pending = 1;
+    }
+  }
+}
+
+/**
+ * Mark the controllers an RandR event may have reset.
+ */
+static void watch_handle_event(vibrant_instance *instance,
+                               const XEvent *event, Atom ctm_atom) {
+  if (instance->nv_event_base != -1 &&
+      event->type ==
+          instance->nv_event_base + TARGET_ATTRIBUTE_CHANGED_EVENT) {
+    watch_handle_nv_event(instance, event);
+    return;
+  }
+
+  if (event->type != instance->randr_event_base + RRNotify) {
+    return;
+  }
+
+  const XRRNotifyEvent *notify = (const XRRNotifyEvent *)event;
+  int matched = 0;
+
+  for (int i = 0; i < instance->controllers_size; i++) {
+    vibrant_controller *controller = instance->controllers + i;
+
+    switch (notify->subtype) {
+    case RRNotify_CrtcChange: {
+      const XRRCrtcChangeNotifyEvent *crtc_event =
+          (const XRRCrtcChangeNotifyEvent *)event;
+      if (controller->info->crtc == crtc_event->crtc) {
+        controller->priv->watch_pending = 1;
+        matched = 1;
+      }
+      break;
+    }
+    case RRNotify_OutputChange: {
+      const XRROutputChangeNotifyEvent *output_event =
+          (const XRROutputChangeNotifyEvent *)event;
+      if (controller->output == output_event->output) {
+        // follow the output to its new CRTC for later CRTC events
+        controller->info->crtc = output_event->crtc;
+        if (output_event->connection != controller->info->connection) {
+          controller->info->connection = output_event->connection;
+          instance->outputs_changed = 1;
+        }
+        controller->priv->watch_pending = 1;
+        matched = 1;
+      }
+      break;
+    }
+    case RRNotify_OutputProperty: {
+      const XRROutputPropertyNotifyEvent *property_event =
+          (const XRROutputPropertyNotifyEvent *)event;
+      if (controller->output == property_event->output &&
+          property_event->property == ctm_atom && ctm_atom != None) {
+        controller->priv->watch_pending = 1;
+        matched = 1;
+      }
+      break;
+    }
+    default:
+      return;
+    }
+  }
+
+  // an output we don't control got connected
+  if (!matched && notify->subtype == RRNotify_OutputChange &&
+      ((const XRROutputChangeNotifyEvent *)event)->connection ==
+          RR_Connected) {
+    instance->outputs_changed = 1;
+  }
+
+  // a CRTC none of our outputs was known to use, e.g. after a hotplug
+  if (!matched && notify->subtype == RRNotify_CrtcChange) {
+    for (int i = 0; i < instance->controllers_size; i++) {
+      instance->controllers[i].priv->watch_pending = 1;
+    }
+  }
+}
+
+/**
+ * Call the change listener for outputs that were connected or disconnected
+ * and for every marked controller whose state differs from the one reported
+ * last. Outputs the watchdog is about to repair are reported as well, the
+ * events of the repair report the restored state afterwards.
+ */
+static void watch_report_changes(vibrant_instance *instance) {
+  if (instance->outputs_changed) {
+    instance->outputs_changed = 0;
+
+    vibrant_change change = {NULL, 0.0};
+    instance->change_fn(&change, instance->change_data);
+  }
+
+  for (int i = 0; i < instance->controllers_size; i++) {
+    vibrant_controller *controller = instance->controllers + i;
+    vibrant_controller_internal *priv = controller->priv;
+    vibrant_controller_state state;
+
+    if (!priv->watch_pending ||
+        priv->get_state(controller, &state) != Success ||
+        vibrant_controller_state_equal(controller, &priv->reported, &state)) {
+      continue;
+    }
+
+    priv->reported = state;
+    vibrant_change change = {controller, priv->get_saturation(controller)};
+    instance->change_fn(&change, instance->change_data);
+  }
+}
+
+/**
+ * Handle the events received so far, see vibrant_instance_dispatch.
+ */
+static vibrant_errors watch_dispatch_pass(vibrant_instance *instance,
+                                          vibrant_transaction_result *result) {
+  Display *dpy = instance->dpy;
+
+  if (dpy != NULL) {
+    Atom ctm_atom = ctm_get_atom(dpy);
+
+    while (XPending(dpy) > 0) {
+      XEvent event;
+      XNextEvent(dpy, &event);
+
+      if (lease_handle_event(instance, &event)) {
+        continue;
+      }
+      if (instance->watching || instance->change_fn != NULL) {
+        watch_handle_event(instance, &event, ctm_atom);
+      }
+    }
+  }
+
+  fences_check(instance);
+
+  // requests other clients handed to us, before the watchdog looks at state
+  vibrant_errors err = lease_apply(instance, result);
+  if (err != vibrant_NoError) {
+    return err;
+  }
+
+  if (instance->change_fn != NULL) {
+    watch_report_changes(instance);
+  }
+
+  if (!instance->watching) {
+    for (int i = 0; i < instance->controllers_size; i++) {
+      instance->controllers[i].priv->watch_pending = 0;
+    }
+
+    return vibrant_NoError;
+  }
+
+  vibrant_transaction *transaction;
+  err = vibrant_transaction_new(instance, &transaction);
+  if (err != vibrant_NoError) {
+    return err;
+  }
+
+  size_t pending = 0;
+  for (int i = 0; i < instance->controllers_size && err == vibrant_NoError;
+       i++) {
+    vibrant_controller *controller = instance->controllers + i;
+
+    if (controller->priv->watch_pending) {
+      err = transaction_set_state(transaction, controller,
+                                  &controller->priv->intended);
+      pending++;
+    }
+  }
+
+  /*
+   * Outputs that still have their state are skipped by the commit. This is
+   * also what stops the loop caused by the property events of our own
+   * writes, they only cost one read.
+   */
+  if (err == vibrant_NoError && pending > 0) {
+    vibrant_transaction_result watch_result;
+    err = vibrant_transaction_commit(transaction, &watch_result);
+
+    result->failed += watch_result.failed;
+    result->unchanged += watch_result.unchanged;
+    result->rolled_back |= watch_result.rolled_back;
+    result->apply_time_ns += watch_result.apply_time_ns;
+  }
+  vibrant_transaction_free(&transaction);
+
+  if (err == vibrant_NoError) {
+    for (int i = 0; i < instance->controllers_size; i++) {
+      instance->controllers[i].priv->watch_pending = 0;
+    }
+  }
+
+  return err;
+}
+
+vibrant_errors vibrant_instance_dispatch(vibrant_instance *instance,
+                                         vibrant_transaction_result *result) {
+  vibrant_transaction_result total = {0, 0, 0, 0};
+  vibrant_errors err;
+
+  /*
+   * The reads and writes of a pass sync with the server, which moves events
+   * that arrived meanwhile into the Xlib queue where polling the fd can't see
+   * them. Handle those too until the queue is empty, otherwise the caller
+   * would sleep on them. The events of our own writes end the loop after one
+   * more pass: the outputs have their intended state then, so that pass only
+   * reads.
+   */
+  do {
+    vibrant_transaction_result pass;
+    err = watch_dispatch_pass(instance, &pass);
+
+    total.failed += pass.failed;
+    total.unchanged += pass.unchanged;
+    total.rolled_back |= pass.rolled_back;
+    total.apply_time_ns += pass.apply_time_ns;
+  } while (err == vibrant_NoError && instance->dpy != NULL &&
+           XQLength(instance->dpy) > 0);
+
+  if (result != NULL) {
+    *result = total;
+  }
+
+  return err;
+}
@@ -0,0 +1,494 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/gamma.h"
+#include "vibrant/internal.h"
+#include "vibrant/wayland.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+#include "wlr-gamma-control-unstable-v1-client-protocol.h"
+
+// name of outputs whose compositor predates wl_output version 4
+#define WAYLAND_NAME_FORMAT "WL-%u"
+// wl_output.name appeared in version 4
+#define WAYLAND_OUTPUT_VERSION 4
+
+typedef struct wayland_output {
+  struct wl_output *output;
+  // registry name of output
+  uint32_t global;
+  char *name;
+
+  struct zwlr_gamma_control_v1 *control;
+  // entries per channel, 0 until the compositor told us
+  uint32_t gamma_size;
+  // set once the compositor revoked control, e.g. to another client
+  bool failed;
+
+  // level set_state queued for the next wayland_commit()
+  bool queued;
+  int queued_level;
+  // level last applied, the identity until the first commit
+  int level;
+} wayland_output;
+
+struct vibrant_wayland {
+  struct wl_display *display;
+  struct wl_registry *registry;
+  struct zwlr_gamma_control_manager_v1 *manager;
+
+  // one per controller, in the same order. While probing, every output the
+  // compositor announced
+  wayland_output *outputs;
+  size_t outputs_size;
+  // set if outputs could not grow while probing
+  bool outputs_nomem;
+
+  // sealed tables handed to the compositor, see gamma.h
+  gamma_table_cache *tables;
+};
+
+static void wayland_output_geometry(void *data, struct wl_output *output,
+                                    int32_t x, int32_t y, int32_t width_mm,
+                                    int32_t height_mm, int32_t subpixel,
+                                    const char *make, const char *model,
+                                    int32_t transform) {
+  // outputs are only told apart by name
+  (void)data;
+  (void)output;
+  (void)x;
+  (void)y;
+  (void)width_mm;
+  (void)height_mm;
+  (void)subpixel;
+  (void)make;
+  (void)model;
+  (void)transform;
+}
+
+static void wayland_output_mode(void *data, struct wl_output *output,
+                                uint32_t flags, int32_t width, int32_t height,
+                                int32_t refresh) {
+  (void)data;
+  (void)output;
+  (void)flags;
+  (void)width;
+  (void)height;
+  (void)refresh;
+}
+
+static void wayland_output_done(void *data, struct wl_output *output) {
+  (void)data;
+  (void)output;
+}
+
+static void wayland_output_scale(void *data, struct wl_output *output,
+                                 int32_t factor) {
+  (void)data;
+  (void)output;
+  (void)factor;
+}
+
+static void wayland_output_name(void *data, struct wl_output *output,
+                                const char *name) {
+  struct vibrant_wayland *wl = data;
+
+  for (size_t i = 0; i < wl->outputs_size; i++) {
+    if (wl->outputs[i].output == output && wl->outputs[i].name == NULL) {
+      wl->outputs[i].name = strdup(name);
+      return;
+    }
+  }
+}
+
+static void wayland_output_description(void *data, struct wl_output *output,
+                                       const char *description) {
+  (void)data;
+  (void)output;
+  (void)description;
+}
+
+static const struct wl_output_listener wayland_output_listener = {
+    .geometry = wayland_output_geometry,
+    .mode = wayland_output_mode,
+    .done = wayland_output_done,
+    .scale = wayland_output_scale,
+    .name = wayland_output_name,
+    .description = wayland_output_description};
+
+static void wayland_registry_global(void *data, struct wl_registry *registry,
+                                    uint32_t global, const char *interface,
+                                    uint32_t version) {
+  struct vibrant_wayland *wl = data;
+
+  if (strcmp(interface, zwlr_gamma_control_manager_v1_interface.name) == 0) {
+    wl->manager = wl_registry_bind(
+        registry, global, &zwlr_gamma_control_manager_v1_interface, 1);
+  } else if (strcmp(interface, wl_output_interface.name) == 0) {
+    wayland_output *outputs = realloc(
+        wl->outputs, (wl->outputs_size + 1) * sizeof(wayland_output));
+    if (outputs == NULL) {
+      wl->outputs_nomem = true;
+      return;
+    }
+    wl->outputs = outputs;
+
+    uint32_t bind_version =
+        version < WAYLAND_OUTPUT_VERSION ? version : WAYLAND_OUTPUT_VERSION;
+    struct wl_output *output =
+        wl_registry_bind(registry, global, &wl_output_interface, bind_version);
+    wl_output_add_listener(output, &wayland_output_listener, wl);
+
+    wl->outputs[wl->outputs_size++] =
+        (wayland_output){.output = output, .global = global};
+  }
+}
+
+static void wayland_registry_global_remove(void *data,
+                                           struct wl_registry *registry,
+                                           uint32_t global) {
+  // gamma controls of removed outputs receive failed, see
+  // wayland_gamma_failed()
+  (void)data;
+  (void)registry;
+  (void)global;
+}
+
+static const struct wl_registry_listener wayland_registry_listener = {
+    .global = wayland_registry_global,
+    .global_remove = wayland_registry_global_remove};
+
+static void wayland_gamma_size(void *data,
+                               struct zwlr_gamma_control_v1 *control,
+                               uint32_t size) {
+  wayland_output *output = data;
+  (void)control;
+  output->gamma_size = size;
+}
+
+static void wayland_gamma_failed(void *data,
+                                 struct zwlr_gamma_control_v1 *control) {
+  wayland_output *output = data;
+  (void)control;
+  output->failed = true;
+}
+
+static const struct zwlr_gamma_control_v1_listener wayland_gamma_listener = {
+    .gamma_size = wayland_gamma_size, .failed = wayland_gamma_failed};
+
+static void wayland_output_free(wayland_output *output) {
+  if (output->control != NULL) {
+    zwlr_gamma_control_v1_destroy(output->control);
+  }
+  if (wl_output_get_version(output->output) >=
+      WL_OUTPUT_RELEASE_SINCE_VERSION) {
+    wl_output_release(output->output);
+  } else {
+    wl_output_destroy(output->output);
+  }
+  free(output->name);
+}
+
+static void wayland_free(struct vibrant_wayland *wl) {
+  for (size_t i = 0; i < wl->outputs_size; i++) {
+    wayland_output_free(wl->outputs + i);
+  }
+  free(wl->outputs);
+
+  if (wl->manager != NULL) {
+    zwlr_gamma_control_manager_v1_destroy(wl->manager);
+  }
+  if (wl->registry != NULL) {
+    wl_registry_destroy(wl->registry);
+  }
+  gamma_table_cache_free(&wl->tables);
+  wl_display_disconnect(wl->display);
+  free(wl);
+}
+
+/**
+ * Send the queued table of every output and wait until the compositor
+ * processed all of them, so a whole batch costs one round trip.
+ *
+ * @return Success, BadAlloc if a table could not be created, or BadAccess if
+ * the compositor revoked control over an output or the connection broke
+ */
+static int wayland_commit(vibrant_instance *instance) {
+  struct vibrant_wayland *wl = instance->backend_data;
+  int status = Success;
+
+  for (size_t i = 0; i < wl->outputs_size; i++) {
+    wayland_output *output = wl->outputs + i;
+
+    if (!output->queued || output->failed) {
+      continue;
+    }
+
+    int fd = gamma_table_lookup(&wl->tables, (int)output->gamma_size,
+                                output->queued_level);
+    if (fd < 0) {
+      output->queued = false;
+      status = BadAlloc;
+      continue;
+    }
+
+    // libwayland sends a duplicate of fd, the compositor reads the table
+    // from its offset, so it is never shared with an earlier send
+    zwlr_gamma_control_v1_set_gamma(output->control, fd);
+    close(fd);
+  }
+
+  bool connected = wl_display_roundtrip(wl->display) >= 0;
+
+  for (size_t i = 0; i < wl->outputs_size; i++) {
+    wayland_output *output = wl->outputs + i;
+
+    if (!output->queued) {
+      continue;
+    }
+    output->queued = false;
+
+    if (!connected || output->failed) {
+      status = BadAccess;
+    } else {
+      output->level = output->queued_level;
+    }
+  }
+
+  return status;
+}
+
+static void waylandctrl_saturation_to_state(double saturation,
+                                            vibrant_controller_state *state) {
+  state->gamma_level = gamma_saturation_to_level(saturation);
+}
+
+static int waylandctrl_get_state(vibrant_controller *controller,
+                                 vibrant_controller_state *state) {
+  struct vibrant_wayland *wl = controller->priv->instance->backend_data;
+  wayland_output *output = wl->outputs + controller->priv->index;
+
+  // the protocol has no way to read tables back, report what we applied
+  state->gamma_level = output->level;
+
+  return output->failed ? BadAccess : Success;
+}
+
+static int waylandctrl_set_state(vibrant_controller *controller,
+                                 const vibrant_controller_state *state) {
+  struct vibrant_wayland *wl = controller->priv->instance->backend_data;
+  wayland_output *output = wl->outputs + controller->priv->index;
+
+  if (output->failed) {
+    return BadAccess;
+  }
+
+  output->queued_level = state->gamma_level;
+  output->queued = true;
+
+  return Success;
+}
+
+static double waylandctrl_get_saturation(vibrant_controller *controller) {
+  vibrant_controller_state state;
+  if (waylandctrl_get_state(controller, &state) != Success) {
+    return -1.0;
+  }
+
+  return gamma_level_to_saturation(state.gamma_level);
+}
+
+static int waylandctrl_set_saturation(vibrant_controller *controller,
+                                      double saturation) {
+  vibrant_controller_state state;
+  waylandctrl_saturation_to_state(saturation, &state);
+
+  int status = waylandctrl_set_state(controller, &state);
+  if (status != Success) {
+    return status;
+  }
+
+  return wayland_commit(controller->priv->instance);
+}
+
+static void wayland_free_controllers(vibrant_controller *controllers,
+                                     size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    free(controllers[i].info->name);
+    free(controllers[i].info);
+    layers_free(controllers + i);
+    free(controllers[i].priv);
+  }
+}
+
+/**
+ * Take control over the gamma of every output and create a controller for
+ * each output the compositor granted it for. Outputs without a controller
+ * are released.
+ *
+ * @return vibrant_NoError, vibrant_NoMem or vibrant_BackendError
+ */
+static vibrant_errors wayland_probe(vibrant_instance *instance,
+                                    struct vibrant_wayland *wl,
+                                    vibrant_controller **controllers,
+                                    size_t *controllers_size) {
+  // announces the globals, a second round trip their initial state
+  if (wl_display_roundtrip(wl->display) < 0 ||
+      wl_display_roundtrip(wl->display) < 0) {
+    return vibrant_BackendError;
+  }
+  if (wl->outputs_nomem) {
+    return vibrant_NoMem;
+  }
+  if (wl->manager == NULL) {
+    return vibrant_BackendError;
+  }
+
+  for (size_t i = 0; i < wl->outputs_size; i++) {
+    wayland_output *output = wl->outputs + i;
+
+    output->control = zwlr_gamma_control_manager_v1_get_gamma_control(
+        wl->manager, output->output);
+    zwlr_gamma_control_v1_add_listener(output->control,
+                                       &wayland_gamma_listener, output);
+  }
+
+  // gamma_size or failed for every control
+  if (wl_display_roundtrip(wl->display) < 0) {
+    return vibrant_BackendError;
+  }
+
+  vibrant_controller *c = calloc(wl->outputs_size + 1,
+                                 sizeof(vibrant_controller));
+  if (c == NULL) {
+    return vibrant_NoMem;
+  }
+
+  size_t n = 0;
+  for (size_t i = 0; i < wl->outputs_size; i++) {
+    wayland_output output = wl->outputs[i];
+
+    if (output.failed || output.gamma_size == 0) {
+      wayland_output_free(&output);
+      continue;
+    }
+
+    char fallback[sizeof(WAYLAND_NAME_FORMAT) + 8];
+    snprintf(fallback, sizeof(fallback), WAYLAND_NAME_FORMAT, output.global);
+    const char *output_name = output.name != NULL ? output.name : fallback;
+
+    XRROutputInfo *info = calloc(1, sizeof(XRROutputInfo));
+    char *name = strdup(output_name);
+    vibrant_controller_internal *priv =
+        malloc(sizeof(vibrant_controller_internal));
+    if (info == NULL || name == NULL || priv == NULL) {
+      free(info);
+      free(name);
+      free(priv);
+      // outputs from i on are still in place for wayland_free()
+      memmove(wl->outputs + n, wl->outputs + i,
+              (wl->outputs_size - i) * sizeof(wayland_output));
+      wl->outputs_size = n + wl->outputs_size - i;
+      wayland_free_controllers(c, n);
+      free(c);
+      return vibrant_NoMem;
+    }
+
+    info->name = name;
+    info->nameLen = strlen(name);
+    info->connection = RR_Connected;
+    // outputs never share tables, but transactions tell CRTCs apart
+    info->crtc = n + 1;
+
+    output.level = GAMMA_LEVEL_SCALE;
+
+    *priv = (vibrant_controller_internal){
+        .backend = Wayland,
+        .nvId = -1,
+        .get_saturation = waylandctrl_get_saturation,
+        .set_saturation = waylandctrl_set_saturation,
+        .get_state = waylandctrl_get_state,
+        .set_state = waylandctrl_set_state,
+        .saturation_to_state = waylandctrl_saturation_to_state,
+        .instance = instance,
+        .index = n,
+        .id = vibrant_hash(VIBRANT_HASH_SEED, name, info->nameLen)};
+    c[n] = (vibrant_controller){output.global, info, NULL, priv};
+
+    // the control's listener data must follow the output as it moves
+    wl->outputs[n] = output;
+    zwlr_gamma_control_v1_set_user_data(output.control, wl->outputs + n);
+    n++;
+  }
+  wl->outputs_size = n;
+
+  *controllers = c;
+  *controllers_size = n;
+
+  return vibrant_NoError;
+}
+
+vibrant_errors wayland_instance_new(vibrant_instance *instance,
+                                    const char *display_name) {
+  struct vibrant_wayland *wl = calloc(1, sizeof(struct vibrant_wayland));
+  if (wl == NULL) {
+    return vibrant_NoMem;
+  }
+
+  wl->display = wl_display_connect(display_name);
+  if (wl->display == NULL) {
+    free(wl);
+    return vibrant_ConnectToX;
+  }
+
+  wl->registry = wl_display_get_registry(wl->display);
+  wl_registry_add_listener(wl->registry, &wayland_registry_listener, wl);
+
+  vibrant_controller *controllers = NULL;
+  size_t n = 0;
+  vibrant_errors err = wayland_probe(instance, wl, &controllers, &n);
+  if (err != vibrant_NoError) {
+    wayland_free(wl);
+    return err;
+  }
+
+  *instance = (vibrant_instance){.controllers = controllers,
+                                 .controllers_size = n,
+                                 .backend = vibrant_BackendWayland,
+                                 .backend_data = wl};
+  instance->commit = wayland_commit;
+
+  return vibrant_NoError;
+}
+
+void wayland_instance_free(vibrant_instance *instance) {
+  struct vibrant_wayland *wl = instance->backend_data;
+
+  wayland_free_controllers(instance->controllers, instance->controllers_size);
+  free(instance->controllers);
+
+  wayland_free(wl);
+}
@@ -0,0 +1,144 @@
+/*
+ * vibrant - Adjust color vibrancy of X11 output
+ * Copyright (C) 2020  Sefa Eyeoglu <contact@scrumplex.net>
+ * (https://scrumplex.net) Copyright (C) 2020  zee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vibrant/xerror.h"
+
+#include <stddef.h>
+
+// errors beyond this overwrite the oldest ones
+#define XERROR_CAPACITY 64
+// displays that can be recorded at the same time
+#define XERROR_DISPLAYS 16
+
+typedef struct xerror_record {
+  Display *dpy;
+  unsigned long serial;
+  int error_code;
+} xerror_record;
+
+typedef struct xerror_display {
+  Display *dpy;
+  unsigned int users;
+} xerror_display;
+
+static struct {
+  XErrorHandler previous;
+  // number of displays with users, the handler is installed while > 0
+  size_t displays_size;
+  xerror_display displays[XERROR_DISPLAYS];
+
+  // ring buffer of the most recent errors
+  xerror_record errors[XERROR_CAPACITY];
+  size_t errors_next;
+
+  // display of the current trap
+  Display *trap_dpy;
+} xerror;
+
+static xerror_display *xerror_find_display(Display *dpy) {
+  for (size_t i = 0; i < xerror.displays_size; i++) {
+    if (xerror.displays[i].dpy == dpy) {
+      return xerror.displays + i;
+    }
+  }
+
+  return NULL;
+}
+
+static int xerror_handler(Display *dpy, XErrorEvent *event) {
+  if (xerror_find_display(dpy) == NULL) {
+    return xerror.previous != NULL ? xerror.previous(dpy, event) : 0;
+  }
+
+  xerror.errors[xerror.errors_next] =
+      (xerror_record){dpy, event->serial, event->error_code};
+  xerror.errors_next = (xerror.errors_next + 1) % XERROR_CAPACITY;
+
+  return 0;
+}
+
+void xerror_acquire(Display *dpy) {
+  xerror_display *display = xerror_find_display(dpy);
+
+  if (display == NULL) {
+    if (xerror.displays_size == XERROR_DISPLAYS) {
+      // errors of this display keep going to the previous handler
+      return;
+    }
+    if (xerror.displays_size == 0) {
+      xerror.previous = XSetErrorHandler(xerror_handler);
+    }
+
+    display = xerror.displays + xerror.displays_size++;
+    *display = (xerror_display){dpy, 0};
+  }
+
+  display->users++;
+}
+
+void xerror_release(Display *dpy) {
+  xerror_display *display = xerror_find_display(dpy);
+  if (display == NULL || --display->users > 0) {
+    return;
+  }
+
+  // errors of a display that is gone must not match a new one at the same
+  // address
+  for (size_t i = 0; i < XERROR_CAPACITY; i++) {
+    if (xerror.errors[i].dpy == dpy) {
+      xerror.errors[i].dpy = NULL;
+    }
+  }
+
+  *display = xerror.displays[--xerror.displays_size];
+  if (xerror.displays_size == 0) {
+    XSetErrorHandler(xerror.previous);
+    xerror.previous = NULL;
+  }
+}
+
+int xerror_find(Display *dpy, unsigned long first_serial,
+                unsigned long last_serial) {
+  // oldest first, so the first error of the range wins
+  for (size_t i = 0; i < XERROR_CAPACITY; i++) {
+    const xerror_record *record =
+        xerror.errors + (xerror.errors_next + i) % XERROR_CAPACITY;
+
+    if (record->dpy == dpy && record->serial >= first_serial &&
+        record->serial < last_serial) {
+      return record->error_code;
+    }
+  }
+
+  return Success;
+}
+
+void xerror_trap_push(Display *dpy) {
+  xerror.trap_dpy = dpy;
+  xerror_acquire(dpy);
+}
+
+void xerror_trap_pop(void) {
+  xerror_release(xerror.trap_dpy);
+  xerror.trap_dpy = NULL;
+}
+
+int xerror_trap_find(unsigned long first_serial, unsigned long last_serial) {
+  return xerror_find(xerror.trap_dpy, first_serial, last_serial);
+}
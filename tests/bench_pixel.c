@@ -0,0 +1,91 @@
+/*
+ * Throughput of vibrant_apply_matrix_rgba and its kernels, in gigapixels per
+ * second. Not run as part of the tests, timings depend on the machine.
+ *
+ * Usage: bench_pixel [THREADS]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vibrant/pixel.h>
+#include <vibrant/vibrant.h>
+
+#define BENCH_WIDTH 3840
+#define BENCH_HEIGHT 2160
+#define BENCH_ROUNDS 20
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, vibrant_pixel_format format,
+                   double seconds) {
+  double pixels = (double)BENCH_WIDTH * BENCH_HEIGHT * BENCH_ROUNDS;
+  printf("%-10s %-12s %8.3f GPix/s\n", name,
+         format == vibrant_PixelRGBA8888 ? "RGBA8888" : "RGBA1010102",
+         pixels / seconds / 1e9);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned threads = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : 4;
+  size_t stride = BENCH_WIDTH * 4;
+  unsigned char *frame = malloc(stride * BENCH_HEIGHT);
+  if (frame == NULL) {
+    return EXIT_FAILURE;
+  }
+  memset(frame, 0x5a, stride * BENCH_HEIGHT);
+
+  double matrix[9];
+  double coeffs[9];
+  vibrant_saturation_to_matrix(1.5, matrix);
+  pixel_quantize_matrix(matrix, coeffs);
+
+  struct {
+    const char *name;
+    pixel_apply_fn apply;
+  } kernels[] = {
+      {"scalar", pixel_apply_scalar},
+#if defined(__x86_64__) || defined(__i386__)
+      {"sse2", pixel_apply_sse2},
+      {"avx2", __builtin_cpu_supports("avx2") ? pixel_apply_avx2 : NULL},
+#endif
+  };
+
+  vibrant_pixel_format formats[] = {vibrant_PixelRGBA8888,
+                                    vibrant_PixelRGBA1010102};
+  for (size_t f = 0; f < 2; f++) {
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+      if (kernels[k].apply == NULL) {
+        continue;
+      }
+
+      double start = now_s();
+      for (int round = 0; round < BENCH_ROUNDS; round++) {
+        for (size_t y = 0; y < BENCH_HEIGHT; y++) {
+          kernels[k].apply(coeffs, formats[f], frame + y * stride,
+                           BENCH_WIDTH);
+        }
+      }
+      report(kernels[k].name, formats[f], now_s() - start);
+    }
+
+    double start = now_s();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+      vibrant_apply_matrix_rgba(matrix, formats[f], frame, BENCH_WIDTH,
+                                BENCH_HEIGHT, stride, threads);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%u threads", threads);
+    report(name, formats[f], now_s() - start);
+  }
+
+  free(frame);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+/*
+ * Time spent opening an instance, reading every output and committing
+ * transactions against a trace recorded with VIBRANT_RECORD, once with the
+ * recorded latencies and once without them, which leaves the overhead of the
+ * library itself. Not run as part of the tests, timings depend on the
+ * machine.
+ *
+ * Usage: bench_replay TRACE [ROUNDS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <vibrant/vibrant.h>
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench(const char *path, double latency_scale, int rounds) {
+  vibrant_instance_options options = {.backend = vibrant_BackendReplay,
+                                      .replay = {path, latency_scale}};
+  vibrant_instance *instance;
+
+  double start = now_s();
+  vibrant_errors err =
+      vibrant_instance_new_with_options(&instance, NULL, &options);
+  if (err != vibrant_NoError) {
+    fprintf(stderr, "can't replay %s: error %d\n", path, err);
+    return 0;
+  }
+  double open_s = now_s() - start;
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  start = now_s();
+  for (int round = 0; round < rounds; round++) {
+    for (size_t i = 0; i < length; i++) {
+      vibrant_controller_get_saturation(controllers + i);
+    }
+  }
+  double get_s = now_s() - start;
+
+  vibrant_transaction *transaction;
+  if (vibrant_transaction_new(instance, &transaction) != vibrant_NoError) {
+    vibrant_instance_free(&instance);
+    return 0;
+  }
+
+  start = now_s();
+  for (int round = 0; round < rounds; round++) {
+    for (size_t i = 0; i < length; i++) {
+      vibrant_transaction_set_saturation(transaction, controllers + i,
+                                         round % 2 ? 1.0 : 1.5);
+    }
+    vibrant_transaction_commit(transaction, NULL);
+  }
+  double commit_s = now_s() - start;
+
+  vibrant_transaction_free(&transaction);
+  vibrant_instance_free(&instance);
+
+  printf("latency x%-4g open %10.3f ms   get %10.3f us   transaction "
+         "%10.3f us\n",
+         latency_scale, open_s * 1e3,
+         length > 0 ? get_s / rounds / length * 1e6 : 0.0,
+         commit_s / rounds * 1e6);
+
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s TRACE [ROUNDS]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  int rounds = argc > 2 ? atoi(argv[2]) : 100;
+  if (rounds < 1) {
+    rounds = 1;
+  }
+
+  if (!bench(argv[1], 1.0, rounds) || !bench(argv[1], 0.0, rounds)) {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
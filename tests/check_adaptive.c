@@ -0,0 +1,186 @@
+#include <check.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vibrant/frame.h>
+#include <vibrant/vibrant.h>
+
+/**
+ * this tolerance is used for comparing rational numbers
+ */
+#define TOLERANCE 0.00001
+
+#define FRAME_WIDTH 1001
+#define FRAME_HEIGHT 37
+
+/**
+ * Fill a frame with 32-bit XRGB pixels of color rgb, or random ones if rgb is
+ * negative.
+ */
+static unsigned char *new_frame(long rgb) {
+  unsigned char *frame = malloc(FRAME_WIDTH * FRAME_HEIGHT * 4);
+  uint32_t state = 12345;
+
+  for (size_t i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++) {
+    uint32_t pixel = (uint32_t)rgb;
+    if (rgb < 0) {
+      state = state * 1664525u + 1013904223u;
+      pixel = state >> 8u;
+    }
+    memcpy(frame + 4 * i, &pixel, 4);
+  }
+
+  return frame;
+}
+
+START_TEST(test_kernels_match) {
+  unsigned char *frame = new_frame(-1);
+  frame_accumulate_fn best = frame_accumulate_best();
+
+  for (unsigned step = 1; step <= 3; step++) {
+    frame_sums expected, actual;
+    memset(&expected, 0, sizeof(expected));
+    memset(&actual, 0, sizeof(actual));
+
+    for (size_t y = 0; y < FRAME_HEIGHT; y++) {
+      frame_accumulate_scalar(frame + y * FRAME_WIDTH * 4, FRAME_WIDTH, step,
+                              &expected);
+      best(frame + y * FRAME_WIDTH * 4, FRAME_WIDTH, step, &actual);
+    }
+
+    ck_assert_int_eq(memcmp(&expected, &actual, sizeof(frame_sums)), 0);
+  }
+
+  free(frame);
+}
+
+END_TEST
+
+START_TEST(test_analyze_gray) {
+  unsigned char *frame = new_frame(0x808080);
+  vibrant_frame_metrics metrics;
+
+  vibrant_frame_analyze(frame, FRAME_WIDTH, FRAME_HEIGHT, FRAME_WIDTH * 4, 1,
+                        &metrics);
+  ck_assert_uint_eq(metrics.samples, FRAME_WIDTH * FRAME_HEIGHT);
+  ck_assert_double_eq_tol(metrics.colorfulness, 0.0, TOLERANCE);
+  ck_assert_double_eq_tol(metrics.chroma_histogram[0], 1.0, TOLERANCE);
+
+  free(frame);
+}
+
+END_TEST
+
+START_TEST(test_analyze_red) {
+  unsigned char *frame = new_frame(0xff0000);
+  vibrant_frame_metrics metrics;
+
+  vibrant_frame_analyze(frame, FRAME_WIDTH, FRAME_HEIGHT, FRAME_WIDTH * 4, 2,
+                        &metrics);
+  // rg = 255, yb = 127.5 and no variance
+  ck_assert_double_eq_tol(metrics.colorfulness,
+                          0.3 * sqrt(255.0 * 255.0 + 127.5 * 127.5),
+                          TOLERANCE);
+  ck_assert_double_eq_tol(metrics.chroma_histogram[7], 1.0, TOLERANCE);
+
+  free(frame);
+}
+
+END_TEST
+
+START_TEST(test_adaptive_feed) {
+  vibrant_instance *instance;
+  vibrant_mock_options mock_options = {1, 0, 0};
+  vibrant_instance_options options = {vibrant_BackendMock, mock_options};
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_NoError);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_adaptive *adaptive;
+  ck_assert_int_eq(vibrant_adaptive_new(controllers, NULL, &adaptive),
+                   vibrant_NoError);
+
+  // mock outputs can't be captured
+  ck_assert_int_eq(vibrant_adaptive_step(adaptive, NULL),
+                   vibrant_BackendError);
+
+  // dull content is boosted smoothly
+  unsigned char *gray = new_frame(0x808080);
+  double previous = 1.0, saturation;
+  for (int i = 0; i < 30; i++) {
+    vibrant_adaptive_feed(adaptive, gray, FRAME_WIDTH, FRAME_HEIGHT,
+                          FRAME_WIDTH * 4, &saturation);
+    ck_assert(saturation >= previous);
+    previous = saturation;
+  }
+  ck_assert_double_eq_tol(saturation, 2.0, 0.01);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers),
+                          saturation, 0.01);
+
+  // strongly saturated content backs off to the minimum
+  unsigned char *red = new_frame(0xff0000);
+  for (int i = 0; i < 30; i++) {
+    vibrant_adaptive_feed(adaptive, red, FRAME_WIDTH, FRAME_HEIGHT,
+                          FRAME_WIDTH * 4, &saturation);
+  }
+  ck_assert_double_eq_tol(saturation, 1.0, 0.01);
+
+  // failed writes are reported and retried by the next step
+  vibrant_mock_set_failing(controllers, 1);
+  ck_assert_int_eq(vibrant_adaptive_feed(adaptive, gray, FRAME_WIDTH,
+                                         FRAME_HEIGHT, FRAME_WIDTH * 4,
+                                         &saturation),
+                   vibrant_BackendError);
+  vibrant_mock_set_failing(controllers, 0);
+  double failed = saturation;
+  ck_assert_int_eq(vibrant_adaptive_feed(adaptive, gray, FRAME_WIDTH,
+                                         FRAME_HEIGHT, FRAME_WIDTH * 4,
+                                         &saturation),
+                   vibrant_NoError);
+  ck_assert(saturation > failed);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers),
+                          saturation, TOLERANCE);
+
+  free(gray);
+  free(red);
+  vibrant_adaptive_free(&adaptive);
+  ck_assert_ptr_null(adaptive);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+Suite *adaptive_suite(void) {
+  Suite *suite = suite_create("adaptive");
+
+  TCase *tcase = tcase_create("frame");
+  tcase_add_test(tcase, test_kernels_match);
+  tcase_add_test(tcase, test_analyze_gray);
+  tcase_add_test(tcase, test_analyze_red);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("controller");
+  tcase_add_test(tcase, test_adaptive_feed);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = adaptive_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,111 @@
+#define _GNU_SOURCE
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cli/src/watch.c"
+
+/**
+ * Run print_json_string on text and return what it printed, to be freed.
+ */
+static char *json_string(const char *text) {
+  char *output;
+  size_t output_size;
+  FILE *file = open_memstream(&output, &output_size);
+
+  print_json_string(file, text);
+  fclose(file);
+  return output;
+}
+
+START_TEST(test_json_string) {
+  const struct {
+    const char *text;
+    const char *expected;
+  } cases[] = {
+      {"DP-1", "\"DP-1\""},
+      {"a\"b\\c", "\"a\\\"b\\\\c\""},
+      {"line\nreturn\rtab\t", "\"line\\nreturn\\rtab\\t\""},
+      {"\x01\x1f end", "\"\\u0001\\u001f end\""},
+      // UTF-8 is valid in JSON strings as is
+      {"HDMI-\xc3\xa4", "\"HDMI-\xc3\xa4\""},
+  };
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    char *output = json_string(cases[i].text);
+    ck_assert_str_eq(output, cases[i].expected);
+    free(output);
+  }
+}
+
+END_TEST
+
+START_TEST(test_watch_line) {
+  char *output;
+  size_t output_size;
+  FILE *file = open_memstream(&output, &output_size);
+
+  print_watch_line(file, 1, "DP\n1", 0x2a, 1.5);
+  print_watch_line(file, 0, "DP-1", 0x2a, 1.5);
+  fclose(file);
+
+  ck_assert_str_eq(output, "{\"event\": \"saturation\", \"name\": \"DP\\n1\", "
+                           "\"id\": \"000000000000002a\", \"saturation\": "
+                           "1.500000}\n"
+                           "DP-1 1.500000\n");
+  free(output);
+}
+
+END_TEST
+
+START_TEST(test_watch_arguments) {
+  char *const watch_json[] = {"vibrant-cli", "--watch", "--json"};
+  char *const json_watch[] = {"vibrant-cli", "--json", "--watch"};
+  char *const watch[] = {"vibrant-cli", "--watch"};
+  char *const json[] = {"vibrant-cli", "--json"};
+  char *const twice[] = {"vibrant-cli", "--watch", "--watch"};
+  char *const other[] = {"vibrant-cli", "--watch", "DP-1"};
+  int is_json;
+
+  ck_assert_int_eq(parse_watch_arguments(3, watch_json, &is_json), 1);
+  ck_assert_int_eq(is_json, 1);
+  ck_assert_int_eq(parse_watch_arguments(3, json_watch, &is_json), 1);
+  ck_assert_int_eq(is_json, 1);
+  ck_assert_int_eq(parse_watch_arguments(2, watch, &is_json), 1);
+  ck_assert_int_eq(is_json, 0);
+
+  ck_assert_int_eq(parse_watch_arguments(2, json, &is_json), 0);
+  ck_assert_int_eq(parse_watch_arguments(3, twice, &is_json), 0);
+  ck_assert_int_eq(parse_watch_arguments(3, other, &is_json), 0);
+}
+
+END_TEST
+
+Suite *cli_suite(void) {
+  Suite *suite = suite_create("cli");
+
+  TCase *tcase = tcase_create("json");
+  tcase_add_test(tcase, test_json_string);
+  tcase_add_test(tcase, test_watch_line);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("arguments");
+  tcase_add_test(tcase, test_watch_arguments);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = cli_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
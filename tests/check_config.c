@@ -0,0 +1,222 @@
+#include <check.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vibrant/vibrant.h>
+
+/**
+ * this tolerance is used for comparing rational numbers
+ */
+#define TOLERANCE 0.00001
+
+static char directory[] = "/tmp/vibrant-config-XXXXXX";
+static char path[64];
+
+static vibrant_instance *new_mock(size_t outputs) {
+  vibrant_instance_options options = {vibrant_BackendMock, {outputs, 0, 0}};
+  vibrant_instance *instance;
+
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_NoError);
+  return instance;
+}
+
+/**
+ * Replace the config file atomically, the way most editors save.
+ */
+static void write_config(const char *text) {
+  char tmp_path[80];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+  FILE *file = fopen(tmp_path, "w");
+  ck_assert_ptr_nonnull(file);
+  fputs(text, file);
+  fclose(file);
+  ck_assert_int_eq(rename(tmp_path, path), 0);
+}
+
+/**
+ * Find the only set request in the log of instance.
+ */
+static vibrant_mock_request single_set(vibrant_instance *instance) {
+  vibrant_mock_request *requests;
+  vibrant_mock_request set;
+  size_t sets = 0;
+  size_t length;
+
+  ck_assert_int_eq(vibrant_mock_get_requests(instance, &requests, &length),
+                   vibrant_NoError);
+  for (size_t i = 0; i < length; i++) {
+    if (requests[i].type == vibrant_MockSetSaturation) {
+      set = requests[i];
+      sets++;
+    }
+  }
+  free(requests);
+
+  ck_assert_uint_eq(sets, 1);
+  return set;
+}
+
+static void wait_readable(vibrant_config *config) {
+  struct pollfd pfd = {vibrant_config_get_fd(config), POLLIN, 0};
+  ck_assert_int_eq(poll(&pfd, 1, 1000), 1);
+}
+
+static void setup(void) {
+  ck_assert_ptr_nonnull(mkdtemp(directory));
+  snprintf(path, sizeof(path), "%s/vibrant.conf", directory);
+}
+
+static void teardown(void) {
+  unlink(path);
+  rmdir(directory);
+  snprintf(directory, sizeof(directory), "/tmp/vibrant-config-XXXXXX");
+}
+
+START_TEST(test_config_rules) {
+  vibrant_instance *instance = new_mock(3);
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  write_config("# defaults\n"
+               "* = 1.2\n"
+               "MOCK-1=1.5   # named outputs win over *\n"
+               "MOCK-9 = 3.0\n"
+               "\n"
+               "[Firefox]\n"
+               "MOCK-0 = 1.0\n"
+               "[mpv]\n"
+               "* = 2.0\n");
+
+  vibrant_config *config;
+  ck_assert_int_eq(vibrant_config_new(instance, path, &config, NULL),
+                   vibrant_NoError);
+
+  ck_assert_int_eq(vibrant_config_set_application(config, NULL, NULL),
+                   vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 0),
+                          1.2, TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          1.5, TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 2),
+                          1.2, TOLERANCE);
+
+  // application rules fall back to the defaults
+  vibrant_mock_clear_requests(instance);
+  ck_assert_int_eq(vibrant_config_set_application(config, "firefox", NULL),
+                   vibrant_NoError);
+  vibrant_mock_request set = single_set(instance);
+  ck_assert_uint_eq(set.controller, 0);
+  ck_assert_double_eq_tol(set.saturation, 1.0, TOLERANCE);
+
+  ck_assert_int_eq(vibrant_config_set_application(config, "mpv", NULL),
+                   vibrant_NoError);
+  for (size_t i = 0; i < 3; i++) {
+    ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + i),
+                            2.0, TOLERANCE);
+  }
+
+  vibrant_config_free(&config);
+  ck_assert_ptr_null(config);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_config_reload) {
+  vibrant_instance *instance = new_mock(3);
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  write_config("* = 1.2\n");
+
+  vibrant_config *config;
+  ck_assert_int_eq(vibrant_config_new(instance, path, &config, NULL),
+                   vibrant_NoError);
+  ck_assert_int_eq(vibrant_config_set_application(config, NULL, NULL),
+                   vibrant_NoError);
+
+  write_config("* = 1.2\nMOCK-2 = 0.5\n");
+  wait_readable(config);
+
+  // only the output whose value changed is written
+  vibrant_mock_clear_requests(instance);
+  ck_assert_int_eq(vibrant_config_dispatch(config, NULL), vibrant_NoError);
+  ck_assert_uint_eq(single_set(instance).controller, 2);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 2),
+                          0.5, TOLERANCE);
+
+  // invalid files keep the previous rules in effect
+  write_config("* = 1.2\nMOCK-2 = 7\n");
+  wait_readable(config);
+  ck_assert_int_eq(vibrant_config_dispatch(config, NULL), vibrant_BadFile);
+  ck_assert_uint_eq(vibrant_config_get_error_line(config), 2);
+
+  ck_assert_int_eq(vibrant_config_set_application(config, "other", NULL),
+                   vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 2),
+                          0.5, TOLERANCE);
+
+  // nothing pending
+  ck_assert_int_eq(vibrant_config_dispatch(config, NULL), vibrant_NoError);
+
+  vibrant_config_free(&config);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_config_invalid) {
+  vibrant_instance *instance = new_mock(1);
+  vibrant_config *config;
+  size_t error_line;
+
+  ck_assert_int_eq(vibrant_config_new(instance, path, &config, &error_line),
+                   vibrant_IOError);
+
+  const char *invalid[] = {"MOCK-0\n", "MOCK-0 = 1.0x\n", "\n[mpv\n",
+                           "[]\n", "= 1.0\n"};
+  const size_t lines[] = {1, 1, 2, 1, 1};
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+    write_config(invalid[i]);
+    ck_assert_int_eq(vibrant_config_new(instance, path, &config, &error_line),
+                     vibrant_BadFile);
+    ck_assert_uint_eq(error_line, lines[i]);
+  }
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+Suite *config_suite(void) {
+  Suite *suite = suite_create("config");
+
+  TCase *tcase = tcase_create("config");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_config_rules);
+  tcase_add_test(tcase, test_config_reload);
+  tcase_add_test(tcase, test_config_invalid);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = config_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,144 @@
+#include <check.h>
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
+
+#include <vibrant/vibrant.hpp>
+
+/**
+ * this tolerance is used for comparing rational numbers
+ */
+#define TOLERANCE 0.00001
+
+// presets are baked at compile time
+constexpr auto identity = vibrant::saturation_to_ctm(1.0);
+constexpr auto vivid = vibrant::saturation_to_ctm(2.0);
+constexpr auto vivid_padded = vibrant::saturation_to_padded_ctm(2.0);
+
+static_assert(identity[0] == 1ull << 32u && identity[1] == 0);
+// -1/3 in S31.32 sign-magnitude
+static_assert(vivid[1] == (1ull << 63u | 1431655765ull));
+static_assert(vivid_padded[2] == 1431655765l && vivid_padded[3] == 1l << 31u);
+static_assert(vibrant::padded_ctm_to_ctm(vivid_padded) == vivid);
+static_assert(vibrant::saturation_to_ctm(10.0) ==
+              vibrant::saturation_to_ctm(VIBRANT_SATURATION_MAX));
+static_assert(vibrant::coeffs_to_saturation(vibrant::saturation_to_coeffs(
+                  0.25)) == 0.25);
+
+static_assert(!std::is_copy_constructible_v<vibrant::instance>);
+static_assert(std::is_nothrow_move_constructible_v<vibrant::instance>);
+static_assert(!std::is_copy_constructible_v<vibrant::transaction>);
+static_assert(std::is_nothrow_move_constructible_v<vibrant::transaction>);
+
+static vibrant::instance new_mock(std::size_t outputs) {
+  vibrant_instance_options options = {};
+  options.backend = vibrant_BackendMock;
+  options.mock = {outputs, 0, 0};
+  return vibrant::instance(nullptr, options);
+}
+
+START_TEST(test_cpp_instance) {
+  vibrant::instance instance = new_mock(3);
+
+  auto controllers = instance.controllers();
+  ck_assert_uint_eq(controllers.size(), 3);
+
+  // views alias the array of the instance, nothing is copied
+  ck_assert_ptr_eq(controllers[1].native(),
+                   instance.native_controllers().data() + 1);
+
+  std::size_t n = 0;
+  for (vibrant::controller controller : controllers) {
+    ck_assert(controller.name().starts_with("MOCK-"));
+    ck_assert_str_eq(controller.backend_name().data(), "mock");
+    n++;
+  }
+  ck_assert_uint_eq(n, 3);
+
+  auto found = instance.find("MOCK-2");
+  ck_assert(found.has_value());
+  ck_assert(*found == controllers[2]);
+  ck_assert(!instance.find("HDMI-A-0").has_value());
+
+  vibrant::instance moved = std::move(instance);
+  ck_assert_ptr_null(instance.native());
+  ck_assert_uint_eq(moved.controllers().size(), 3);
+}
+END_TEST
+
+START_TEST(test_cpp_saturation) {
+  vibrant::instance instance = new_mock(2);
+  auto controllers = instance.controllers();
+
+  controllers[0].set_saturation(2.0);
+  ck_assert_double_eq_tol(controllers[0].saturation(), 2.0, TOLERANCE);
+
+  // the compile-time encoding matches what the library wrote
+  vibrant::matrix written = controllers[0].get_matrix();
+  vibrant::matrix expected = vibrant::ctm_to_coeffs(vivid);
+  for (std::size_t i = 0; i < 9; i++) {
+    ck_assert_double_eq(written[i], expected[i]);
+  }
+
+  vibrant::transaction transaction(instance);
+  transaction.set_saturation(controllers[0], 0.5)
+      .set_saturation(controllers[1], 1.5);
+  vibrant_transaction_result result = transaction.commit();
+  ck_assert_uint_eq(result.failed, 0);
+  ck_assert_double_eq_tol(controllers[0].saturation(), 0.5, TOLERANCE);
+  ck_assert_double_eq_tol(controllers[1].saturation(), 1.5, TOLERANCE);
+
+  controllers[1].set_layer_saturation("night", 10, 0.5);
+  ck_assert_double_eq_tol(controllers[1].saturation(), 0.5, TOLERANCE);
+  controllers[1].remove_layer("night");
+}
+END_TEST
+
+START_TEST(test_cpp_errors) {
+  vibrant_instance_options options = {};
+  options.backend = vibrant_BackendReplay;
+  options.replay = {"/nonexistent/trace", 0.0};
+
+  try {
+    vibrant::instance instance(nullptr, options);
+    ck_abort_msg("opening a missing trace succeeded");
+  } catch (const vibrant::error &e) {
+    ck_assert_int_eq(e.code(), vibrant_IOError);
+  }
+
+  vibrant::instance instance = new_mock(1);
+  try {
+    // mock outputs have no EDID
+    instance.controllers()[0].set_saturation_model(vibrant_SaturationPanel);
+    ck_abort_msg("panel model without EDID succeeded");
+  } catch (const vibrant::error &e) {
+    ck_assert_int_eq(e.code(), vibrant_BackendError);
+  }
+}
+END_TEST
+
+Suite *cpp_suite(void) {
+  Suite *suite = suite_create("cpp");
+
+  TCase *tcase = tcase_create("wrapper");
+  tcase_add_test(tcase, test_cpp_instance);
+  tcase_add_test(tcase, test_cpp_saturation);
+  tcase_add_test(tcase, test_cpp_errors);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = cpp_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,225 @@
+#include <check.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <systemd/sd-bus.h>
+
+/**
+ * this tolerance is used for comparing rational numbers
+ */
+#define TOLERANCE 0.00001
+
+#define BUS_NAME "io.github.libvibrant.Vibrant1"
+#define PATH "/io/github/libvibrant/Vibrant1"
+#define OUTPUT_PATH PATH "/outputs/MOCK_2d0"
+#define OUTPUT_INTERFACE BUS_NAME ".Output"
+
+// private bus and the daemon under test, VIBRANTD and DBUS_DAEMON are set
+// by CMake
+static pid_t bus_pid;
+static pid_t daemon_pid;
+static sd_bus *bus;
+static int signals;
+
+static int count_signal(sd_bus_message *message, void *user_data,
+                        sd_bus_error *error) {
+  signals++;
+  return 0;
+}
+
+/**
+ * Handle every message that arrived so far, e.g. signals emitted before the
+ * reply of a call.
+ */
+static void process_pending(void) {
+  while (sd_bus_process(bus, NULL) > 0) {
+  }
+}
+
+static void wait_for_name(void) {
+  for (int i = 0; i < 500; i++) {
+    sd_bus_message *reply = NULL;
+    int owned = 0;
+
+    ck_assert_int_ge(sd_bus_call_method(bus, "org.freedesktop.DBus",
+                                        "/org/freedesktop/DBus",
+                                        "org.freedesktop.DBus", "NameHasOwner",
+                                        NULL, &reply, "s", BUS_NAME),
+                     0);
+    ck_assert_int_ge(sd_bus_message_read(reply, "b", &owned), 0);
+    sd_bus_message_unref(reply);
+    if (owned) {
+      return;
+    }
+
+    usleep(10000);
+  }
+
+  ck_abort_msg("vibrantd did not show up on the bus");
+}
+
+static void setup(void) {
+  int address_pipe[2];
+  ck_assert_int_eq(pipe(address_pipe), 0);
+
+  bus_pid = fork();
+  ck_assert_int_ge(bus_pid, 0);
+  if (bus_pid == 0) {
+    char print_address[32];
+    snprintf(print_address, sizeof(print_address), "--print-address=%d",
+             address_pipe[1]);
+    close(address_pipe[0]);
+    execl(DBUS_DAEMON, DBUS_DAEMON, "--session", "--nofork", print_address,
+          (char *)NULL);
+    _exit(EXIT_FAILURE);
+  }
+  close(address_pipe[1]);
+
+  char address[256];
+  ssize_t length = read(address_pipe[0], address, sizeof(address) - 1);
+  close(address_pipe[0]);
+  ck_assert_int_gt(length, 0);
+  address[length] = '\0';
+  address[strcspn(address, "\n")] = '\0';
+
+  daemon_pid = fork();
+  ck_assert_int_ge(daemon_pid, 0);
+  if (daemon_pid == 0) {
+    setenv("DBUS_SESSION_BUS_ADDRESS", address, 1);
+    execl(VIBRANTD, VIBRANTD, "--mock", "2", (char *)NULL);
+    _exit(EXIT_FAILURE);
+  }
+
+  ck_assert_int_ge(sd_bus_new(&bus), 0);
+  ck_assert_int_ge(sd_bus_set_address(bus, address), 0);
+  ck_assert_int_ge(sd_bus_set_bus_client(bus, 1), 0);
+  ck_assert_int_ge(sd_bus_start(bus), 0);
+
+  wait_for_name();
+
+  signals = 0;
+  ck_assert_int_ge(sd_bus_match_signal(bus, NULL, BUS_NAME, NULL,
+                                       "org.freedesktop.DBus.Properties",
+                                       "PropertiesChanged", count_signal, NULL),
+                   0);
+}
+
+static void teardown(void) {
+  sd_bus_flush_close_unref(bus);
+
+  kill(daemon_pid, SIGTERM);
+  waitpid(daemon_pid, NULL, 0);
+  kill(bus_pid, SIGTERM);
+  waitpid(bus_pid, NULL, 0);
+}
+
+static double get_saturation(void) {
+  double saturation = -1.0;
+  ck_assert_int_ge(sd_bus_get_property_trivial(bus, BUS_NAME, OUTPUT_PATH,
+                                               OUTPUT_INTERFACE, "Saturation",
+                                               NULL, 'd', &saturation),
+                   0);
+  return saturation;
+}
+
+/**
+ * Call SetMany with the same saturation for MOCK-0 and MOCK-1.
+ */
+static void set_many(double saturation, uint32_t *failed,
+                     uint32_t *unchanged) {
+  sd_bus_message *reply = NULL;
+  ck_assert_int_ge(sd_bus_call_method(bus, BUS_NAME, PATH, BUS_NAME,
+                                      "SetMany", NULL, &reply, "a{sd}", 2,
+                                      "MOCK-0", saturation, "MOCK-1",
+                                      saturation),
+                   0);
+  ck_assert_int_ge(sd_bus_message_read(reply, "uu", failed, unchanged), 0);
+  sd_bus_message_unref(reply);
+}
+
+START_TEST(test_dbus_set_many) {
+  uint32_t failed, unchanged;
+
+  ck_assert_double_eq_tol(get_saturation(), 1.0, TOLERANCE);
+
+  set_many(1.5, &failed, &unchanged);
+  ck_assert_uint_eq(failed, 0);
+  ck_assert_uint_eq(unchanged, 0);
+  ck_assert_double_eq_tol(get_saturation(), 1.5, TOLERANCE);
+
+  process_pending();
+  ck_assert_int_eq(signals, 2);
+
+  // nothing changes, so nothing is written or announced
+  set_many(1.5, &failed, &unchanged);
+  ck_assert_uint_eq(failed, 0);
+  ck_assert_uint_eq(unchanged, 2);
+
+  process_pending();
+  ck_assert_int_eq(signals, 2);
+}
+
+END_TEST
+
+START_TEST(test_dbus_set_property) {
+  ck_assert_int_ge(sd_bus_set_property(bus, BUS_NAME, OUTPUT_PATH,
+                                       OUTPUT_INTERFACE, "Saturation", NULL,
+                                       "d", 2.0),
+                   0);
+  ck_assert_double_eq_tol(get_saturation(), 2.0, TOLERANCE);
+
+  process_pending();
+  ck_assert_int_eq(signals, 1);
+}
+
+END_TEST
+
+START_TEST(test_dbus_unknown_output) {
+  sd_bus_error error = SD_BUS_ERROR_NULL;
+
+  ck_assert_int_lt(sd_bus_call_method(bus, BUS_NAME, PATH, BUS_NAME,
+                                      "SetMany", &error, NULL, "a{sd}", 2,
+                                      "MOCK-0", 1.5, "HDMI-9", 1.5),
+                   0);
+  ck_assert(sd_bus_error_has_name(&error, SD_BUS_ERROR_INVALID_ARGS));
+  sd_bus_error_free(&error);
+
+  // the valid part of the call was not applied either
+  ck_assert_double_eq_tol(get_saturation(), 1.0, TOLERANCE);
+
+  process_pending();
+  ck_assert_int_eq(signals, 0);
+}
+
+END_TEST
+
+Suite *dbus_suite(void) {
+  Suite *suite = suite_create("dbus");
+
+  TCase *tcase = tcase_create("dbus");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_dbus_set_many);
+  tcase_add_test(tcase, test_dbus_set_property);
+  tcase_add_test(tcase, test_dbus_unknown_output);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = dbus_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
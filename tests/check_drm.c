@@ -0,0 +1,499 @@
+#include <check.h>
+#include <drm/drm.h>
+#include <drm/drm_mode.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vibrant/vibrant.h>
+
+/**
+ * this tolerance is used for comparing rational numbers
+ */
+#define TOLERANCE 0.00001
+
+#define PROP_ACTIVE 70
+#define PROP_CTM 71
+#define PROP_EDID 72
+
+#define MAX_BLOBS 64
+#define MAX_PROPS 4
+
+/*
+ * A fake DRM device with three connectors: DP-1 and HDMI-A-1 are connected
+ * to CRTCs with a CTM, eDP-1 is connected to a CRTC without one, and a
+ * disconnected DP-2.
+ */
+typedef struct fake_object {
+  uint32_t id;
+  uint32_t props[MAX_PROPS];
+  uint64_t values[MAX_PROPS];
+  size_t props_size;
+} fake_object;
+
+typedef struct fake_connector {
+  uint32_t id;
+  uint32_t type;
+  uint32_t type_id;
+  uint32_t connection;
+  // encoder and CRTC share the id, 0 if inactive
+  uint32_t crtc;
+} fake_connector;
+
+typedef struct fake_blob {
+  uint32_t length;
+  unsigned char data[256];
+  // handle of the client still open
+  int open;
+} fake_blob;
+
+typedef struct fake_device {
+  fake_connector connectors[4];
+  fake_object crtcs[3];
+  fake_object connector_props[4];
+  // blob ids are the index + 1
+  fake_blob blobs[MAX_BLOBS];
+  size_t blobs_size;
+
+  int refuse_atomic;
+  int fail_commit;
+  size_t commits;
+  size_t last_commit_objs;
+  size_t property_reads;
+} fake_device;
+
+static fake_device fake;
+
+static fake_object *fake_find_object(uint32_t id) {
+  for (size_t i = 0; i < 3; i++) {
+    if (fake.crtcs[i].id == id) {
+      return fake.crtcs + i;
+    }
+  }
+  for (size_t i = 0; i < 4; i++) {
+    if (fake.connector_props[i].id == id) {
+      return fake.connector_props + i;
+    }
+  }
+  return NULL;
+}
+
+static fake_blob *fake_find_blob(uint64_t id) {
+  return id >= 1 && id <= fake.blobs_size ? fake.blobs + id - 1 : NULL;
+}
+
+static uint32_t fake_new_blob(const void *data, uint32_t length) {
+  ck_assert_uint_lt(fake.blobs_size, MAX_BLOBS);
+  fake_blob *blob = fake.blobs + fake.blobs_size++;
+  blob->length = length;
+  memcpy(blob->data, data, length);
+  blob->open = 1;
+  return fake.blobs_size;
+}
+
+static void fake_reset(void) {
+  memset(&fake, 0, sizeof(fake));
+
+  fake.connectors[0] = (fake_connector){31, DRM_MODE_CONNECTOR_DisplayPort, 1,
+                                        1, 51};
+  fake.connectors[1] = (fake_connector){32, DRM_MODE_CONNECTOR_HDMIA, 1, 1, 52};
+  fake.connectors[2] = (fake_connector){33, DRM_MODE_CONNECTOR_eDP, 1, 1, 53};
+  fake.connectors[3] = (fake_connector){34, DRM_MODE_CONNECTOR_DisplayPort, 2,
+                                        2, 0};
+
+  fake.crtcs[0] = (fake_object){51, {PROP_ACTIVE, PROP_CTM}, {1, 0}, 2};
+  fake.crtcs[1] = (fake_object){52, {PROP_ACTIVE, PROP_CTM}, {1, 0}, 2};
+  fake.crtcs[2] = (fake_object){53, {PROP_ACTIVE}, {1}, 1};
+
+  unsigned char edid[128] = {0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
+  // sRGB primaries with a D65 white point
+  const unsigned char chromaticity[10] = {0xee, 0x91, 0xa3, 0x54, 0x4c,
+                                          0x99, 0x26, 0x0f, 0x50, 0x54};
+  memcpy(edid + 25, chromaticity, sizeof(chromaticity));
+  uint32_t edid_blob = fake_new_blob(edid, sizeof(edid));
+  fake.blobs[edid_blob - 1].open = 0;
+  fake.connector_props[0] = (fake_object){31, {PROP_EDID}, {edid_blob}, 1};
+  fake.connector_props[1] = (fake_object){32, {PROP_EDID}, {0}, 1};
+  fake.connector_props[2] = (fake_object){33, {0}, {0}, 0};
+  fake.connector_props[3] = (fake_object){34, {0}, {0}, 0};
+}
+
+static int fake_atomic(struct drm_mode_atomic *atomic) {
+  uint32_t *objs = (uint32_t *)(uintptr_t)atomic->objs_ptr;
+  uint32_t *count_props = (uint32_t *)(uintptr_t)atomic->count_props_ptr;
+  uint32_t *props = (uint32_t *)(uintptr_t)atomic->props_ptr;
+  uint64_t *values = (uint64_t *)(uintptr_t)atomic->prop_values_ptr;
+
+  if (fake.fail_commit) {
+    errno = fake.fail_commit;
+    return -1;
+  }
+
+  // validate everything before touching anything, commits are atomic
+  size_t k = 0;
+  for (uint32_t i = 0; i < atomic->count_objs; i++) {
+    fake_object *object = fake_find_object(objs[i]);
+    for (uint32_t j = 0; j < count_props[i]; j++, k++) {
+      fake_blob *blob = fake_find_blob(values[k]);
+      if (object == NULL || props[k] != PROP_CTM ||
+          object->props_size < 2 ||
+          (values[k] != 0 && (blob == NULL || !blob->open ||
+                              blob->length != sizeof(struct drm_color_ctm)))) {
+        errno = EINVAL;
+        return -1;
+      }
+    }
+  }
+
+  k = 0;
+  for (uint32_t i = 0; i < atomic->count_objs; i++) {
+    fake_object *object = fake_find_object(objs[i]);
+    for (uint32_t j = 0; j < count_props[i]; j++, k++) {
+      object->values[1] = values[k];
+    }
+  }
+
+  fake.commits++;
+  fake.last_commit_objs = atomic->count_objs;
+  return 0;
+}
+
+static int fake_ioctl(int fd, unsigned long request, void *arg,
+                      void *user_data) {
+  ck_assert_int_eq(fd, -1);
+  ck_assert_ptr_eq(user_data, &fake);
+
+  if (request == DRM_IOCTL_SET_CLIENT_CAP) {
+    struct drm_set_client_cap *cap = arg;
+    if (fake.refuse_atomic && cap->capability == DRM_CLIENT_CAP_ATOMIC) {
+      errno = EOPNOTSUPP;
+      return -1;
+    }
+    return 0;
+  }
+
+  if (request == DRM_IOCTL_MODE_GETRESOURCES) {
+    struct drm_mode_card_res *res = arg;
+    uint32_t *ids = (uint32_t *)(uintptr_t)res->connector_id_ptr;
+    for (uint32_t i = 0; i < 4 && i < res->count_connectors; i++) {
+      ids[i] = fake.connectors[i].id;
+    }
+    res->count_connectors = 4;
+    res->count_crtcs = 3;
+    res->count_encoders = 3;
+    return 0;
+  }
+
+  if (request == DRM_IOCTL_MODE_GETCONNECTOR) {
+    struct drm_mode_get_connector *conn = arg;
+    // forcing a probe is slow on real hardware
+    ck_assert_uint_ne(conn->count_modes, 0);
+    for (size_t i = 0; i < 4; i++) {
+      if (fake.connectors[i].id == conn->connector_id) {
+        conn->connector_type = fake.connectors[i].type;
+        conn->connector_type_id = fake.connectors[i].type_id;
+        conn->connection = fake.connectors[i].connection;
+        conn->encoder_id = fake.connectors[i].crtc;
+        conn->count_modes = 0;
+        return 0;
+      }
+    }
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (request == DRM_IOCTL_MODE_GETENCODER) {
+    struct drm_mode_get_encoder *encoder = arg;
+    encoder->crtc_id = encoder->encoder_id;
+    return 0;
+  }
+
+  if (request == DRM_IOCTL_MODE_OBJ_GETPROPERTIES) {
+    struct drm_mode_obj_get_properties *props = arg;
+    fake.property_reads++;
+    fake_object *object = fake_find_object(props->obj_id);
+    if (object == NULL) {
+      errno = ENOENT;
+      return -1;
+    }
+    uint32_t *ids = (uint32_t *)(uintptr_t)props->props_ptr;
+    uint64_t *values = (uint64_t *)(uintptr_t)props->prop_values_ptr;
+    for (size_t i = 0; i < object->props_size && i < props->count_props; i++) {
+      ids[i] = object->props[i];
+      values[i] = object->values[i];
+    }
+    props->count_props = object->props_size;
+    return 0;
+  }
+
+  if (request == DRM_IOCTL_MODE_GETPROPERTY) {
+    struct drm_mode_get_property *prop = arg;
+    const char *name = prop->prop_id == PROP_ACTIVE ? "ACTIVE"
+                       : prop->prop_id == PROP_CTM  ? "CTM"
+                                                    : "EDID";
+    strncpy(prop->name, name, DRM_PROP_NAME_LEN);
+    return 0;
+  }
+
+  if (request == DRM_IOCTL_MODE_GETPROPBLOB) {
+    struct drm_mode_get_blob *get = arg;
+    fake_blob *blob = fake_find_blob(get->blob_id);
+    if (blob == NULL) {
+      errno = ENOENT;
+      return -1;
+    }
+    // like the kernel, only copy if the length matches
+    if (get->length == blob->length) {
+      memcpy((void *)(uintptr_t)get->data, blob->data, blob->length);
+    }
+    get->length = blob->length;
+    return 0;
+  }
+
+  if (request == DRM_IOCTL_MODE_CREATEPROPBLOB) {
+    struct drm_mode_create_blob *create = arg;
+    create->blob_id =
+        fake_new_blob((const void *)(uintptr_t)create->data, create->length);
+    return 0;
+  }
+
+  if (request == DRM_IOCTL_MODE_DESTROYPROPBLOB) {
+    struct drm_mode_destroy_blob *destroy = arg;
+    fake_blob *blob = fake_find_blob(destroy->blob_id);
+    ck_assert_ptr_nonnull(blob);
+    ck_assert(blob->open);
+    // the CRTC keeps its own reference, the data stays
+    blob->open = 0;
+    return 0;
+  }
+
+  if (request == DRM_IOCTL_MODE_ATOMIC) {
+    return fake_atomic(arg);
+  }
+
+  errno = ENOTTY;
+  return -1;
+}
+
+static vibrant_instance *new_fake(void) {
+  vibrant_instance_options options = {.backend = vibrant_BackendDRM,
+                                      .drm = {NULL, fake_ioctl, &fake}};
+  vibrant_instance *instance;
+
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_NoError);
+  return instance;
+}
+
+static size_t open_blobs(void) {
+  size_t open = 0;
+  for (size_t i = 0; i < fake.blobs_size; i++) {
+    open += fake.blobs[i].open;
+  }
+  return open;
+}
+
+START_TEST(test_drm_probe) {
+  vibrant_instance *instance = new_fake();
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  // eDP-1 has no CTM, DP-2 is disconnected
+  ck_assert_uint_eq(length, 2);
+  ck_assert_str_eq(controllers[0].info->name, "DP-1");
+  ck_assert_str_eq(controllers[1].info->name, "HDMI-A-1");
+  ck_assert_uint_eq(controllers[0].output, 31);
+  ck_assert_ptr_null(controllers[0].display);
+  ck_assert_str_eq(vibrant_controller_get_backend_name(controllers), "DRM");
+  ck_assert_uint_ne(vibrant_controller_get_id(controllers),
+                    vibrant_controller_get_id(controllers + 1));
+  ck_assert_ptr_eq(vibrant_instance_find_controller(instance, "HDMI-A-1"),
+                   controllers + 1);
+  ck_assert_int_eq(vibrant_instance_get_fd(instance), -1);
+
+  // no CTM blob means identity
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.0,
+                          TOLERANCE);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_drm_no_atomic) {
+  fake.refuse_atomic = 1;
+
+  vibrant_instance_options options = {.backend = vibrant_BackendDRM,
+                                      .drm = {NULL, fake_ioctl, &fake}};
+  vibrant_instance *instance;
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_BackendError);
+}
+
+END_TEST
+
+START_TEST(test_drm_set_saturation) {
+  vibrant_instance *instance = new_fake();
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_controller_set_saturation(controllers, 2.0);
+  ck_assert_uint_eq(fake.commits, 1);
+  ck_assert_uint_eq(fake.last_commit_objs, 1);
+  ck_assert_uint_eq(open_blobs(), 0);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 2.0,
+                          TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          1.0, TOLERANCE);
+
+  // the blob is the plain struct, S31.32 sign-magnitude without padding
+  fake_blob *blob = fake_find_blob(fake.crtcs[0].values[1]);
+  ck_assert_ptr_nonnull(blob);
+  ck_assert_uint_eq(blob->length, sizeof(struct drm_color_ctm));
+  struct drm_color_ctm ctm;
+  memcpy(&ctm, blob->data, sizeof(ctm));
+  ck_assert_uint_eq(ctm.matrix[1] >> 63u, 1);
+  ck_assert_double_eq_tol((ctm.matrix[1] & ~(1ULL << 63u)) / 4294967296.0,
+                          1.0 / 3.0, TOLERANCE);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_drm_transaction) {
+  vibrant_instance *instance = new_fake();
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_transaction *transaction;
+  vibrant_transaction_result result;
+  ck_assert_int_eq(vibrant_transaction_new(instance, &transaction),
+                   vibrant_NoError);
+
+  // both CRTCs change in a single commit
+  vibrant_transaction_set_saturation(transaction, controllers, 1.5);
+  vibrant_transaction_set_saturation(transaction, controllers + 1, 0.5);
+  ck_assert_int_eq(vibrant_transaction_commit(transaction, &result),
+                   vibrant_NoError);
+  ck_assert_uint_eq(fake.commits, 1);
+  ck_assert_uint_eq(fake.last_commit_objs, 2);
+  ck_assert_uint_eq(result.failed, 0);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.5,
+                          TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          0.5, TOLERANCE);
+
+  // nothing to do, nothing committed
+  vibrant_transaction_set_saturation(transaction, controllers, 1.5);
+  vibrant_transaction_set_saturation(transaction, controllers + 1, 0.5);
+  ck_assert_int_eq(vibrant_transaction_commit(transaction, &result),
+                   vibrant_NoError);
+  ck_assert_uint_eq(fake.commits, 1);
+  ck_assert_uint_eq(result.unchanged, 2);
+
+  // a rejected commit changes nothing
+  fake.fail_commit = EACCES;
+  vibrant_transaction_set_saturation(transaction, controllers, 3.0);
+  vibrant_transaction_set_saturation(transaction, controllers + 1, 3.0);
+  ck_assert_int_eq(vibrant_transaction_commit(transaction, &result),
+                   vibrant_BackendError);
+  ck_assert_uint_eq(result.failed, 2);
+  ck_assert_int_eq(result.rolled_back, 1);
+  ck_assert_uint_eq(open_blobs(), 0);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.5,
+                          TOLERANCE);
+
+  vibrant_transaction_free(&transaction);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_drm_panel_model) {
+  vibrant_instance *instance = new_fake();
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  // HDMI-A-1 has no EDID to derive a profile from
+  ck_assert_int_eq(vibrant_controller_set_saturation_model(
+                       controllers + 1, vibrant_SaturationPanel),
+                   vibrant_BackendError);
+  ck_assert_int_eq(vibrant_controller_get_saturation_model(controllers + 1),
+                   vibrant_SaturationUniform);
+
+  ck_assert_int_eq(vibrant_controller_set_saturation_model(
+                       controllers, vibrant_SaturationPanel),
+                   vibrant_NoError);
+
+  // fully desaturated, every channel becomes the Rec. 709 luminance. Like
+  // the uniform matrix this is a single commit without reading anything
+  size_t property_reads = fake.property_reads;
+  vibrant_controller_set_saturation(controllers, 0.0);
+  ck_assert_uint_eq(fake.commits, 1);
+  ck_assert_uint_eq(fake.property_reads, property_reads);
+  double matrix[9];
+  ck_assert_int_eq(vibrant_controller_get_matrix(controllers, matrix),
+                   vibrant_NoError);
+  const double luminance[3] = {0.2126, 0.7152, 0.0722};
+  for (int i = 0; i < 9; i++) {
+    ck_assert_double_eq_tol(matrix[i], luminance[i % 3], 0.005);
+  }
+
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 0.0,
+                          TOLERANCE);
+  vibrant_controller_set_saturation(controllers, 2.5);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 2.5,
+                          TOLERANCE);
+
+  // back to the equal weights
+  ck_assert_int_eq(vibrant_controller_set_saturation_model(
+                       controllers, vibrant_SaturationUniform),
+                   vibrant_NoError);
+  vibrant_controller_set_saturation(controllers, 0.0);
+  ck_assert_int_eq(vibrant_controller_get_matrix(controllers, matrix),
+                   vibrant_NoError);
+  ck_assert_double_eq_tol(matrix[1], 1.0 / 3.0, TOLERANCE);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+Suite *drm_suite(void) {
+  Suite *suite = suite_create("drm");
+
+  TCase *tcase = tcase_create("fake_device");
+  tcase_add_checked_fixture(tcase, fake_reset, NULL);
+  tcase_add_test(tcase, test_drm_probe);
+  tcase_add_test(tcase, test_drm_no_atomic);
+  tcase_add_test(tcase, test_drm_set_saturation);
+  tcase_add_test(tcase, test_drm_transaction);
+  tcase_add_test(tcase, test_drm_panel_model);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = drm_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,189 @@
+#include <check.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <vibrant/vibrant.h>
+
+/**
+ * matrices go through the S31.32 encoding of the page
+ */
+#define TOLERANCE 0.001
+
+static const char *const outputs[] = {"eDP-1", "DP-2"};
+
+static vibrant_instance *new_export(void) {
+  vibrant_instance_options options = {.backend = vibrant_BackendExport,
+                                      .exported = {outputs, 2}};
+  vibrant_instance *instance;
+
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_NoError);
+
+  return instance;
+}
+
+/**
+ * @return the number of changes signalled since the last call
+ */
+static uint64_t drain(int event_fd) {
+  eventfd_t count;
+  return eventfd_read(event_fd, &count) == 0 ? count : 0;
+}
+
+static void ck_assert_matrix(const double *matrix, double saturation) {
+  double expected[9];
+  vibrant_saturation_to_matrix(saturation, expected);
+  for (int i = 0; i < 9; i++) {
+    ck_assert_double_eq_tol(matrix[i], expected[i], TOLERANCE);
+  }
+}
+
+START_TEST(test_export_page) {
+  vibrant_instance *instance = new_export();
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+  ck_assert_uint_eq(length, 2);
+  ck_assert_str_eq(controllers[0].info->name, "eDP-1");
+  ck_assert_str_eq(vibrant_controller_get_backend_name(controllers),
+                   "export");
+
+  int fd = vibrant_instance_get_export_fd(instance);
+  int event_fd = vibrant_instance_get_export_event_fd(instance);
+  ck_assert_int_ge(fd, 0);
+  ck_assert_int_ge(event_fd, 0);
+  // the compositor must be able to rely on the size of its mapping
+  ck_assert_int_ne(ftruncate(fd, 0), 0);
+
+  vibrant_export *exported;
+  ck_assert_int_eq(vibrant_export_open(fd, &exported), vibrant_NoError);
+
+  vibrant_export_entry entries[4];
+  unsigned long long generation;
+  vibrant_export_read(exported, entries, 4, &length, &generation);
+  ck_assert_uint_eq(length, 2);
+  ck_assert_uint_eq(generation, 0);
+  ck_assert_str_eq(entries[1].name, "DP-2");
+  ck_assert_uint_eq(entries[1].id, vibrant_controller_get_id(controllers + 1));
+  ck_assert_matrix(entries[0].matrix, 1.0);
+  ck_assert_matrix(entries[1].matrix, 1.0);
+  ck_assert_uint_eq(drain(event_fd), 0);
+
+  // changes show up without the reader touching the instance
+  vibrant_controller_set_saturation(controllers + 1, 2.5);
+  ck_assert_uint_eq(drain(event_fd), 1);
+  vibrant_export_read(exported, entries, 4, &length, &generation);
+  ck_assert_uint_eq(generation, 1);
+  ck_assert_uint_eq(entries[0].generation, 0);
+  ck_assert_uint_eq(entries[1].generation, 1);
+  ck_assert_matrix(entries[0].matrix, 1.0);
+  ck_assert_matrix(entries[1].matrix, 2.5);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          2.5, TOLERANCE);
+
+  vibrant_export_close(&exported);
+  ck_assert_ptr_null(exported);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_export_transaction) {
+  vibrant_instance *instance = new_export();
+  int event_fd = vibrant_instance_get_export_event_fd(instance);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_transaction *transaction;
+  ck_assert_int_eq(vibrant_transaction_new(instance, &transaction),
+                   vibrant_NoError);
+  ck_assert_int_eq(
+      vibrant_transaction_set_saturation(transaction, controllers, 0.5),
+      vibrant_NoError);
+  ck_assert_int_eq(
+      vibrant_transaction_set_saturation(transaction, controllers + 1, 1.0),
+      vibrant_NoError);
+
+  vibrant_transaction_result result;
+  ck_assert_int_eq(vibrant_transaction_commit(transaction, &result),
+                   vibrant_NoError);
+  ck_assert_uint_eq(result.failed, 0);
+  ck_assert_uint_eq(result.unchanged, 1);
+  vibrant_transaction_free(&transaction);
+
+  ck_assert_uint_eq(drain(event_fd), 1);
+
+  vibrant_export *exported;
+  ck_assert_int_eq(vibrant_export_open(vibrant_instance_get_export_fd(instance),
+                                       &exported),
+                   vibrant_NoError);
+
+  // capacity only limits the copy, not the reported length
+  vibrant_export_entry entry;
+  vibrant_export_read(exported, &entry, 1, &length, NULL);
+  ck_assert_uint_eq(length, 2);
+  ck_assert_matrix(entry.matrix, 0.5);
+
+  vibrant_export_close(&exported);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_export_invalid) {
+  const char *const duplicates[] = {"DP-1", "DP-1"};
+  vibrant_instance_options options = {.backend = vibrant_BackendExport,
+                                      .exported = {duplicates, 2}};
+  vibrant_instance *instance;
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_InvalidArgument);
+
+  // only export instances have a page
+  vibrant_instance_options mock = {.backend = vibrant_BackendMock,
+                                   .mock = {1, 0, 0}};
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &mock),
+                   vibrant_NoError);
+  ck_assert_int_eq(vibrant_instance_get_export_fd(instance), -1);
+  ck_assert_int_eq(vibrant_instance_get_export_event_fd(instance), -1);
+  vibrant_instance_free(&instance);
+
+  vibrant_export *exported;
+  int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  ck_assert_int_ge(fd, 0);
+  ck_assert_int_eq(vibrant_export_open(fd, &exported), vibrant_BadFile);
+  close(fd);
+}
+
+END_TEST
+
+Suite *export_suite(void) {
+  Suite *suite = suite_create("export");
+
+  TCase *tcase = tcase_create("export");
+  tcase_add_test(tcase, test_export_page);
+  tcase_add_test(tcase, test_export_transaction);
+  tcase_add_test(tcase, test_export_invalid);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = export_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,258 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vibrant/vibrant.h>
+#include <vibrant/xerror.h>
+
+/**
+ * this tolerance is used for comparing rational numbers
+ */
+#define TOLERANCE 0.00001
+
+/**
+ * the recorder only compares Display pointers, so these never have to be
+ * connected
+ */
+static char fake_displays[2];
+#define DPY_A ((Display *)(fake_displays + 0))
+#define DPY_B ((Display *)(fake_displays + 1))
+
+static int forwarded;
+
+static int forward_handler(Display *dpy, XErrorEvent *event) {
+  forwarded++;
+  return 0;
+}
+
+/**
+ * Delivers an error to the handler Xlib would call.
+ */
+static void raise_error(Display *dpy, unsigned long serial, int error_code) {
+  XErrorHandler handler = XSetErrorHandler(NULL);
+  XSetErrorHandler(handler);
+
+  XErrorEvent event = {.type = 0,
+                       .display = dpy,
+                       .serial = serial,
+                       .error_code = (unsigned char)error_code};
+  handler(dpy, &event);
+}
+
+START_TEST(test_xerror_find) {
+  XErrorHandler previous = XSetErrorHandler(forward_handler);
+
+  xerror_acquire(DPY_A);
+  raise_error(DPY_A, 10, BadValue);
+  raise_error(DPY_A, 12, BadMatch);
+
+  // [first, last) of the serials, the first error of the range wins
+  ck_assert_int_eq(xerror_find(DPY_A, 1, 10), Success);
+  ck_assert_int_eq(xerror_find(DPY_A, 10, 11), BadValue);
+  ck_assert_int_eq(xerror_find(DPY_A, 5, 20), BadValue);
+  ck_assert_int_eq(xerror_find(DPY_A, 11, 20), BadMatch);
+  ck_assert_int_eq(xerror_find(DPY_A, 13, 20), Success);
+  ck_assert_int_eq(forwarded, 0);
+
+  // displays that aren't recorded go to the previous handler
+  raise_error(DPY_B, 10, BadWindow);
+  ck_assert_int_eq(forwarded, 1);
+  ck_assert_int_eq(xerror_find(DPY_B, 1, 20), Success);
+
+  xerror_acquire(DPY_B);
+  raise_error(DPY_B, 11, BadWindow);
+  ck_assert_int_eq(xerror_find(DPY_B, 1, 20), BadWindow);
+  ck_assert_int_eq(xerror_find(DPY_A, 11, 12), Success);
+  xerror_release(DPY_B);
+
+  // released displays forget their errors
+  ck_assert_int_eq(xerror_find(DPY_B, 1, 20), Success);
+  ck_assert_int_eq(xerror_find(DPY_A, 5, 20), BadValue);
+
+  xerror_release(DPY_A);
+  ck_assert_int_eq(xerror_find(DPY_A, 5, 20), Success);
+
+  // the previous handler is back once nothing is recorded
+  ck_assert_ptr_eq(XSetErrorHandler(previous), forward_handler);
+  forwarded = 0;
+}
+
+END_TEST
+
+START_TEST(test_xerror_nesting) {
+  XErrorHandler previous = XSetErrorHandler(forward_handler);
+
+  xerror_acquire(DPY_A);
+  xerror_acquire(DPY_A);
+  raise_error(DPY_A, 30, BadAccess);
+
+  // still recorded while a user is left
+  xerror_release(DPY_A);
+  ck_assert_int_eq(xerror_find(DPY_A, 30, 31), BadAccess);
+
+  xerror_trap_push(DPY_A);
+  raise_error(DPY_A, 31, BadAlloc);
+  ck_assert_int_eq(xerror_trap_find(30, 32), BadAccess);
+  ck_assert_int_eq(xerror_trap_find(31, 32), BadAlloc);
+  xerror_trap_pop();
+
+  xerror_release(DPY_A);
+  ck_assert_int_eq(xerror_find(DPY_A, 30, 32), Success);
+  ck_assert_int_eq(forwarded, 0);
+
+  XSetErrorHandler(previous);
+}
+
+END_TEST
+
+/**
+ * Connects to the display of the environment. There is no server in most
+ * build environments, so the tests that need one return early without it,
+ * run them under xvfb-run to cover the server side.
+ */
+static vibrant_instance *new_x11(void) {
+  if (getenv("DISPLAY") == NULL) {
+    return NULL;
+  }
+
+  vibrant_instance *instance;
+  if (vibrant_instance_new(&instance, NULL) != vibrant_NoError) {
+    return NULL;
+  }
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+  if (length == 0) {
+    vibrant_instance_free(&instance);
+    return NULL;
+  }
+
+  return instance;
+}
+
+static vibrant_fence_status fence_status;
+static int fence_calls;
+
+static void record_fence(vibrant_fence *fence, vibrant_fence_status status,
+                         void *user_data) {
+  fence_status = status;
+  fence_calls++;
+}
+
+START_TEST(test_fence_server) {
+  vibrant_instance *instance = new_x11();
+  if (instance == NULL) {
+    return;
+  }
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+  double saturation = vibrant_controller_get_saturation(controllers);
+
+  vibrant_fence *fence;
+  ck_assert_int_eq(
+      vibrant_controller_set_saturation_async(controllers, 1.5, &fence),
+      vibrant_NoError);
+  fence_calls = 0;
+  vibrant_fence_set_callback(fence, record_fence, NULL);
+
+  // completed by the PropertyNotify of the marker request
+  ck_assert_int_eq(vibrant_fence_wait(fence, 5000), vibrant_FenceDone);
+  ck_assert_int_eq(fence_calls, 1);
+  ck_assert_int_eq(fence_status, vibrant_FenceDone);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.5,
+                          TOLERANCE);
+  vibrant_fence_free(&fence);
+
+  vibrant_controller_set_saturation(controllers, saturation);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_fence_server_freed) {
+  vibrant_instance *instance = new_x11();
+  if (instance == NULL) {
+    return;
+  }
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+  double saturation = vibrant_controller_get_saturation(controllers);
+
+  char name[64];
+  snprintf(name, sizeof(name), "/vibrant-check-fence-%d", (int)getpid());
+  ck_assert_int_eq(vibrant_instance_publish_status(instance, name),
+                   vibrant_NoError);
+  vibrant_status *status;
+  ck_assert_int_eq(vibrant_status_open(name, &status), vibrant_NoError);
+
+  vibrant_status_entry entry;
+  unsigned long long generation;
+  vibrant_status_read(status, &entry, 1, &length, &generation);
+  unsigned long long before = entry.generation;
+
+  // nobody waits for the first fence anymore, it must still count
+  vibrant_fence *freed;
+  vibrant_fence *fence;
+  ck_assert_int_eq(
+      vibrant_controller_set_saturation_async(controllers, 1.5, &freed),
+      vibrant_NoError);
+  vibrant_fence_free(&freed);
+  ck_assert_int_eq(
+      vibrant_controller_set_saturation_async(controllers, 2.0, &fence),
+      vibrant_NoError);
+
+  // requests are processed in order, so both are done after the second
+  ck_assert_int_eq(vibrant_fence_wait(fence, 5000), vibrant_FenceDone);
+  vibrant_fence_free(&fence);
+
+  vibrant_status_read(status, &entry, 1, &length, &generation);
+  ck_assert_uint_eq(entry.generation, before + 2);
+  ck_assert_double_eq_tol(entry.saturation, 2.0, TOLERANCE);
+
+  // a pending fence that is freed with its instance is released as well
+  ck_assert_int_eq(
+      vibrant_controller_set_saturation_async(controllers, saturation, &freed),
+      vibrant_NoError);
+  vibrant_fence_free(&freed);
+
+  vibrant_status_close(&status);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+Suite *fence_suite(void) {
+  Suite *suite = suite_create("fence");
+
+  TCase *tcase = tcase_create("xerror");
+  tcase_add_test(tcase, test_xerror_find);
+  tcase_add_test(tcase, test_xerror_nesting);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("server");
+  tcase_add_test(tcase, test_fence_server);
+  tcase_add_test(tcase, test_fence_server_freed);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = fence_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,198 @@
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vibrant/gamma.h>
+#include <vibrant/vibrant.h>
+
+/**
+ * ramp sizes seen in the wild: Xvfb and most drivers, amdgpu, intel
+ */
+static const int sizes[] = {256, 1024, 4096};
+
+START_TEST(test_identity_ramp) {
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    unsigned short *ramp = malloc(sizes[s] * sizeof(unsigned short));
+
+    gamma_fill_ramp(GAMMA_LEVEL_SCALE, sizes[s], ramp);
+    for (int i = 0; i < sizes[s]; i++) {
+      ck_assert_int_eq(ramp[i], (i * 65535 + (sizes[s] - 1) / 2) /
+                                    (sizes[s] - 1));
+    }
+
+    free(ramp);
+  }
+}
+
+END_TEST
+
+START_TEST(test_ramp_monotonic) {
+  unsigned short ramp[1024];
+
+  for (int level = 0; level <= VIBRANT_SATURATION_MAX * GAMMA_LEVEL_SCALE;
+       level += 125) {
+    gamma_fill_ramp(level, 1024, ramp);
+
+    ck_assert_int_eq(ramp[0], 0);
+    ck_assert_int_eq(ramp[1023], 65535);
+    for (int i = 1; i < 1024; i++) {
+      ck_assert_int_ge(ramp[i], ramp[i - 1]);
+    }
+  }
+}
+
+END_TEST
+
+START_TEST(test_ramp_contrast) {
+  unsigned short muted[256], boosted[256];
+
+  gamma_fill_ramp(500, 256, muted);
+  gamma_fill_ramp(2000, 256, boosted);
+
+  // boosting pushes shadows down and highlights up, muting does the opposite
+  ck_assert_int_gt(muted[64], boosted[64]);
+  ck_assert_int_lt(muted[192], boosted[192]);
+}
+
+END_TEST
+
+START_TEST(test_level_round_trip) {
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    unsigned short *ramp = malloc(sizes[s] * sizeof(unsigned short));
+
+    for (int level = 0; level <= VIBRANT_SATURATION_MAX * GAMMA_LEVEL_SCALE;
+         level++) {
+      gamma_fill_ramp(level, sizes[s], ramp);
+      ck_assert_int_eq(gamma_ramp_to_level(ramp, sizes[s]), level);
+    }
+
+    free(ramp);
+  }
+}
+
+END_TEST
+
+START_TEST(test_saturation_to_level) {
+  ck_assert_int_eq(gamma_saturation_to_level(1.0), GAMMA_LEVEL_SCALE);
+  ck_assert_int_eq(gamma_saturation_to_level(1.2345), 1235);
+  ck_assert_int_eq(gamma_saturation_to_level(-1.0), 0);
+  ck_assert_int_eq(gamma_saturation_to_level(VIBRANT_SATURATION_MAX + 1),
+                   VIBRANT_SATURATION_MAX * GAMMA_LEVEL_SCALE);
+  ck_assert_double_eq(gamma_level_to_saturation(1500), 1.5);
+}
+
+END_TEST
+
+START_TEST(test_table_fd) {
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    int size = sizes[s];
+    unsigned short *ramp = malloc(size * sizeof(unsigned short));
+    unsigned short *table = malloc(3 * size * sizeof(unsigned short));
+    ck_assert_ptr_nonnull(ramp);
+    ck_assert_ptr_nonnull(table);
+
+    gamma_fill_ramp(1500, size, ramp);
+
+    int fd = gamma_table_fd(1500, size);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(pread(fd, table, 3 * size * sizeof(unsigned short), 0),
+                     3 * size * sizeof(unsigned short));
+    for (int channel = 0; channel < 3; channel++) {
+      ck_assert_mem_eq(table + channel * size, ramp,
+                       size * sizeof(unsigned short));
+    }
+
+    // the compositor reads the table, it must stay as it is
+    int seals = fcntl(fd, F_GET_SEALS);
+    ck_assert_int_eq(seals & (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE),
+                     F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE);
+    ck_assert_int_eq(pwrite(fd, ramp, sizeof(unsigned short), 0), -1);
+
+    close(fd);
+    free(table);
+    free(ramp);
+  }
+
+  ck_assert_int_eq(gamma_table_fd(1000, 0), -1);
+}
+
+END_TEST
+
+START_TEST(test_table_cache) {
+  gamma_table_cache *cache = NULL;
+
+  size_t bytes = 3 * 256 * sizeof(unsigned short);
+  unsigned short *first = malloc(bytes);
+  unsigned short *second = malloc(bytes);
+  ck_assert_ptr_nonnull(first);
+  ck_assert_ptr_nonnull(second);
+
+  int fd = gamma_table_lookup(&cache, 256, 1500);
+  ck_assert_int_ge(fd, 0);
+  ck_assert_ptr_nonnull(cache);
+  ck_assert_int_eq(read(fd, first, bytes), bytes);
+
+  // compositors read() every table they get, a cached one must start over
+  int again = gamma_table_lookup(&cache, 256, 1500);
+  ck_assert_int_ge(again, 0);
+  ck_assert_int_ne(again, fd);
+  ck_assert_int_eq(read(again, second, bytes), bytes);
+  ck_assert_mem_eq(first, second, bytes);
+  ck_assert_int_eq(read(fd, second, bytes), 0);
+  close(again);
+
+  int other = gamma_table_lookup(&cache, 1024, 1500);
+  ck_assert_int_ge(other, 0);
+  ck_assert_int_eq(lseek(other, 0, SEEK_END),
+                   3 * 1024 * sizeof(unsigned short));
+  close(other);
+
+  gamma_table_cache_free(&cache);
+  ck_assert_ptr_null(cache);
+
+  // the caller owns what it got, the table outlives the cache
+  ck_assert_int_eq(pread(fd, second, bytes, 0), bytes);
+  ck_assert_mem_eq(first, second, bytes);
+  close(fd);
+
+  free(second);
+  free(first);
+}
+
+END_TEST
+
+Suite *gamma_suite(void) {
+  Suite *suite = suite_create("gamma");
+
+  TCase *tcase = tcase_create("ramp");
+  tcase_add_test(tcase, test_identity_ramp);
+  tcase_add_test(tcase, test_ramp_monotonic);
+  tcase_add_test(tcase, test_ramp_contrast);
+  tcase_add_test(tcase, test_level_round_trip);
+  tcase_add_test(tcase, test_saturation_to_level);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("table");
+  tcase_add_test(tcase, test_table_fd);
+  tcase_add_test(tcase, test_table_cache);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = gamma_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
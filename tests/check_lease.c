@@ -0,0 +1,319 @@
+// RTLD_NEXT
+#define _GNU_SOURCE
+
+#include <X11/Xlib.h>
+#include <check.h>
+#include <dlfcn.h>
+#include <math.h>
+#include <poll.h>
+#include <stdlib.h>
+
+#include <vibrant/vibrant.h>
+
+/**
+ * this tolerance is used for comparing rational numbers
+ */
+#define TOLERANCE 0.00001
+
+/**
+ * saturations read back from a gamma ramp are off by up to a level
+ */
+#define SERVER_TOLERANCE 0.002
+
+/**
+ * Owner reported for every selection while set. The server forgets owners
+ * together with their window, so this is the only way to make the window of
+ * a holder disappear between the lookup and the request, as it does when
+ * the holder exits at that moment.
+ */
+static Window stale_owner = None;
+
+Window XGetSelectionOwner(Display *dpy, Atom selection) {
+  static Window (*next)(Display *, Atom);
+
+  if (stale_owner != None) {
+    return stale_owner;
+  }
+  if (next == NULL) {
+    *(void **)&next = dlsym(RTLD_NEXT, "XGetSelectionOwner");
+  }
+  return next(dpy, selection);
+}
+
+static vibrant_instance *new_mock(size_t outputs) {
+  vibrant_instance_options options = {vibrant_BackendMock, {outputs, 0, 0}};
+  vibrant_instance *instance;
+
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_NoError);
+  return instance;
+}
+
+static size_t count_sets(vibrant_instance *instance) {
+  vibrant_mock_request *requests;
+  size_t requests_size;
+  size_t sets = 0;
+
+  vibrant_mock_get_requests(instance, &requests, &requests_size);
+  for (size_t i = 0; i < requests_size; i++) {
+    sets += requests[i].type == vibrant_MockSetSaturation;
+  }
+  free(requests);
+
+  return sets;
+}
+
+START_TEST(test_lease_acquire_release) {
+  vibrant_instance *instance = new_mock(2);
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  ck_assert_int_eq(vibrant_controller_has_lease(controllers), 0);
+
+  // nobody else can hold leases on outputs without an X server
+  ck_assert_int_eq(vibrant_controller_acquire_lease(controllers, 0),
+                   vibrant_NoError);
+  ck_assert_int_eq(vibrant_controller_has_lease(controllers), 1);
+  ck_assert_int_eq(vibrant_controller_has_lease(controllers + 1), 0);
+
+  // acquiring again is a no-op
+  ck_assert_int_eq(vibrant_controller_acquire_lease(controllers, 0),
+                   vibrant_NoError);
+  ck_assert_int_eq(vibrant_controller_has_lease(controllers), 1);
+
+  vibrant_controller_release_lease(controllers);
+  ck_assert_int_eq(vibrant_controller_has_lease(controllers), 0);
+  vibrant_controller_release_lease(controllers);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_lease_request) {
+  vibrant_instance *instance = new_mock(1);
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  ck_assert_int_eq(vibrant_controller_acquire_lease(controllers, 0),
+                   vibrant_NoError);
+
+  ck_assert_int_eq(vibrant_controller_request_saturation(controllers, 1.5),
+                   vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.5,
+                          TOLERANCE);
+  ck_assert_uint_eq(count_sets(instance), 1);
+
+  // requesting what the output already shows writes nothing
+  ck_assert_int_eq(vibrant_controller_request_saturation(controllers, 1.5),
+                   vibrant_NoError);
+  ck_assert_uint_eq(count_sets(instance), 1);
+
+  // without the lease, requests still apply when nobody else holds it
+  vibrant_controller_release_lease(controllers);
+  ck_assert_int_eq(vibrant_controller_request_saturation(controllers, 0.5),
+                   vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 0.5,
+                          TOLERANCE);
+  ck_assert_uint_eq(count_sets(instance), 2);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+/**
+ * Connects to the display of the environment. There is no server in most
+ * build environments, so the tests that need one return early without it,
+ * run them under xvfb-run to cover the server side.
+ */
+static vibrant_instance *new_x11(void) {
+  if (getenv("DISPLAY") == NULL) {
+    return NULL;
+  }
+
+  vibrant_instance *instance;
+  if (vibrant_instance_new(&instance, NULL) != vibrant_NoError) {
+    return NULL;
+  }
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+  if (length == 0) {
+    vibrant_instance_free(&instance);
+    return NULL;
+  }
+
+  return instance;
+}
+
+static vibrant_lease_event last_event;
+static int lease_events;
+
+static void record_lease(const vibrant_lease_event *event, void *user_data) {
+  last_event = *event;
+  lease_events++;
+}
+
+/**
+ * Dispatches instance until it reported another lease event, for at most a
+ * second.
+ */
+static void dispatch_lease_event(vibrant_instance *instance) {
+  int events = lease_events;
+
+  for (int i = 0; i < 100 && lease_events == events; i++) {
+    vibrant_transaction_result result;
+    ck_assert_int_eq(vibrant_instance_dispatch(instance, &result),
+                     vibrant_NoError);
+
+    struct pollfd pfd = {vibrant_instance_get_fd(instance), POLLIN, 0};
+    poll(&pfd, 1, 10);
+  }
+}
+
+/**
+ * Dispatches instance until controller shows saturation, for at most a
+ * second.
+ */
+static void dispatch_saturation(vibrant_instance *instance,
+                                vibrant_controller *controller,
+                                double saturation) {
+  for (int i = 0; i < 100; i++) {
+    vibrant_transaction_result result;
+    ck_assert_int_eq(vibrant_instance_dispatch(instance, &result),
+                     vibrant_NoError);
+    if (fabs(vibrant_controller_get_saturation(controller) - saturation) <
+        SERVER_TOLERANCE) {
+      return;
+    }
+
+    struct pollfd pfd = {vibrant_instance_get_fd(instance), POLLIN, 0};
+    poll(&pfd, 1, 10);
+  }
+}
+
+START_TEST(test_lease_server) {
+  vibrant_instance *holder = new_x11();
+  if (holder == NULL) {
+    return;
+  }
+  vibrant_instance *other = new_x11();
+  ck_assert_ptr_nonnull(other);
+
+  vibrant_controller *held;
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(holder, &held, &length);
+  vibrant_instance_get_controllers(other, &controllers, &length);
+  ck_assert_uint_eq(vibrant_controller_get_id(controllers),
+                    vibrant_controller_get_id(held));
+  double saturation = vibrant_controller_get_saturation(held);
+
+  // the selection has one owner at a time
+  ck_assert_int_eq(vibrant_controller_acquire_lease(held, 0), vibrant_NoError);
+  ck_assert_int_eq(vibrant_controller_acquire_lease(controllers, 0),
+                   vibrant_LeaseHeld);
+  ck_assert_int_eq(vibrant_controller_has_lease(held), 1);
+  ck_assert_int_eq(vibrant_controller_has_lease(controllers), 0);
+
+  // requests travel to the holder as client messages
+  lease_events = 0;
+  vibrant_instance_set_lease_listener(holder, record_lease, NULL);
+  ck_assert_int_eq(vibrant_controller_request_saturation(controllers, 1.25),
+                   vibrant_NoError);
+  dispatch_lease_event(holder);
+  ck_assert_int_eq(lease_events, 1);
+  ck_assert_int_eq(last_event.type, vibrant_LeaseRequest);
+  ck_assert_ptr_eq(last_event.controller, held);
+  ck_assert_double_eq_tol(last_event.saturation, 1.25, TOLERANCE);
+
+  // without a listener the holder applies them itself
+  vibrant_instance_set_lease_listener(holder, NULL, NULL);
+  ck_assert_int_eq(vibrant_controller_request_saturation(controllers, 0.75),
+                   vibrant_NoError);
+  dispatch_saturation(holder, held, 0.75);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(held), 0.75,
+                          SERVER_TOLERANCE);
+
+  // taking the lease over clears the selection of the holder
+  vibrant_instance_set_lease_listener(holder, record_lease, NULL);
+  ck_assert_int_eq(vibrant_controller_acquire_lease(controllers, 1),
+                   vibrant_NoError);
+  ck_assert_int_eq(vibrant_controller_has_lease(controllers), 1);
+  dispatch_lease_event(holder);
+  ck_assert_int_eq(lease_events, 2);
+  ck_assert_int_eq(last_event.type, vibrant_LeaseLost);
+  ck_assert_ptr_eq(last_event.controller, held);
+  ck_assert_int_eq(vibrant_controller_has_lease(held), 0);
+
+  vibrant_controller_set_saturation(held, saturation);
+  vibrant_instance_free(&other);
+  vibrant_instance_free(&holder);
+}
+
+END_TEST
+
+START_TEST(test_lease_server_gone) {
+  vibrant_instance *instance = new_x11();
+  if (instance == NULL) {
+    return;
+  }
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+  double saturation = vibrant_controller_get_saturation(controllers);
+
+  Display *dpy = controllers->display;
+  Window gone = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0, 1, 1,
+                                    0, 0, 0);
+  XDestroyWindow(dpy, gone);
+  XSync(dpy, False);
+
+  // the holder exited after the lookup, the request applies right here
+  stale_owner = gone;
+  vibrant_errors err = vibrant_controller_request_saturation(controllers, 1.5);
+  stale_owner = None;
+  ck_assert_int_eq(err, vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.5,
+                          SERVER_TOLERANCE);
+
+  vibrant_controller_set_saturation(controllers, saturation);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+Suite *lease_suite(void) {
+  Suite *suite = suite_create("lease");
+
+  TCase *tcase = tcase_create("lease");
+  tcase_add_test(tcase, test_lease_acquire_release);
+  tcase_add_test(tcase, test_lease_request);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("server");
+  tcase_add_test(tcase, test_lease_server);
+  tcase_add_test(tcase, test_lease_server_gone);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = lease_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
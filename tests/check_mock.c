@@ -0,0 +1,840 @@
+#include <check.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <vibrant/vibrant.h>
+
+/**
+ * this tolerance is used for comparing rational numbers
+ */
+#define TOLERANCE 0.00001
+
+static vibrant_instance *new_mock(size_t outputs, unsigned int latency_us,
+                                  unsigned int fail_every) {
+  vibrant_instance_options options = {
+      vibrant_BackendMock, {outputs, latency_us, fail_every}};
+  vibrant_instance *instance;
+
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_NoError);
+  return instance;
+}
+
+START_TEST(test_mock_controllers) {
+  vibrant_instance *instance = new_mock(3, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  ck_assert_uint_eq(length, 3);
+  ck_assert_str_eq(controllers[0].info->name, "MOCK-0");
+  ck_assert_str_eq(controllers[2].info->name, "MOCK-2");
+  for (size_t i = 0; i < length; i++) {
+    ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + i),
+                            1.0, TOLERANCE);
+  }
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_find_controller) {
+  vibrant_instance *instance = new_mock(40, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  for (size_t i = 0; i < length; i++) {
+    char id[17];
+    snprintf(id, sizeof(id), "%016llx",
+             vibrant_controller_get_id(controllers + i));
+
+    ck_assert_ptr_eq(
+        vibrant_instance_find_controller(instance, controllers[i].info->name),
+        controllers + i);
+    ck_assert_ptr_eq(vibrant_instance_find_controller(instance, id),
+                     controllers + i);
+  }
+
+  ck_assert_ptr_null(vibrant_instance_find_controller(instance, "MOCK-40"));
+  ck_assert_ptr_null(
+      vibrant_instance_find_controller(instance, "0123456789abcdef"));
+  ck_assert_ptr_null(
+      vibrant_instance_find_controller(instance, "not-an-id-at-all"));
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_mock_roundtrip) {
+  vibrant_instance *instance = new_mock(2, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_controller_set_saturation(controllers + 1, 2.5);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          2.5, TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.0,
+                          TOLERANCE);
+
+  // values are clamped like on real hardware
+  vibrant_controller_set_saturation(controllers, 10.0);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers),
+                          VIBRANT_SATURATION_MAX, TOLERANCE);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_mock_request_log) {
+  vibrant_instance *instance = new_mock(2, 100, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_controller_set_saturation(controllers + 1, 1.5);
+  vibrant_controller_get_saturation(controllers + 1);
+
+  vibrant_mock_request *requests;
+  size_t requests_size;
+  vibrant_mock_get_requests(instance, &requests, &requests_size);
+
+  ck_assert_uint_eq(requests_size, 2);
+  ck_assert_int_eq(requests[0].type, vibrant_MockSetSaturation);
+  ck_assert_uint_eq(requests[0].controller, 1);
+  ck_assert_double_eq(requests[0].saturation, 1.5);
+  ck_assert_int_eq(requests[0].status, Success);
+  ck_assert_int_eq(requests[1].type, vibrant_MockGetSaturation);
+  ck_assert_double_eq_tol(requests[1].saturation, 1.5, TOLERANCE);
+  // the second request can only arrive after the first one's latency
+  ck_assert_uint_ge(requests[1].timestamp_ns - requests[0].timestamp_ns,
+                    100 * 1000);
+
+  // the copy stays as it was while the log goes on
+  vibrant_controller_set_saturation(controllers, 0.5);
+  ck_assert_uint_eq(requests_size, 2);
+  ck_assert_double_eq(requests[0].saturation, 1.5);
+  free(requests);
+
+  vibrant_mock_clear_requests(instance);
+  vibrant_mock_get_requests(instance, &requests, &requests_size);
+  ck_assert_uint_eq(requests_size, 0);
+  ck_assert_ptr_null(requests);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_mock_fail_every) {
+  vibrant_instance *instance = new_mock(1, 0, 2);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_controller_set_saturation(controllers, 2.0);
+  // second request fails and leaves the state untouched
+  vibrant_controller_set_saturation(controllers, 3.0);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 2.0,
+                          TOLERANCE);
+
+  vibrant_mock_request *requests;
+  size_t requests_size;
+  vibrant_mock_get_requests(instance, &requests, &requests_size);
+  ck_assert_uint_eq(requests_size, 3);
+  ck_assert_int_eq(requests[0].status, Success);
+  ck_assert_int_eq(requests[1].status, BadMatch);
+  ck_assert_int_eq(requests[2].status, Success);
+  free(requests);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_mock_set_failing) {
+  vibrant_instance *instance = new_mock(2, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_mock_set_failing(controllers, 1);
+  vibrant_controller_set_saturation(controllers, 2.0);
+  vibrant_controller_set_saturation(controllers + 1, 2.0);
+  ck_assert_double_eq(vibrant_controller_get_saturation(controllers), -1.0);
+
+  vibrant_mock_set_failing(controllers, 0);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.0,
+                          TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          2.0, TOLERANCE);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_transaction_commit) {
+  vibrant_instance *instance = new_mock(3, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_transaction *transaction;
+  ck_assert_int_eq(vibrant_transaction_new(instance, &transaction),
+                   vibrant_NoError);
+  vibrant_transaction_set_saturation(transaction, controllers, 3.0);
+  vibrant_transaction_set_saturation(transaction, controllers + 2, 2.0);
+  // replaces the previous value
+  vibrant_transaction_set_saturation(transaction, controllers, 0.5);
+
+  vibrant_transaction_result result;
+  ck_assert_int_eq(vibrant_transaction_commit(transaction, &result),
+                   vibrant_NoError);
+  ck_assert_uint_eq(result.failed, 0);
+  ck_assert_int_eq(result.rolled_back, 0);
+
+  // one snapshot read and one write per changed output
+  vibrant_mock_request *requests;
+  size_t requests_size;
+  vibrant_mock_get_requests(instance, &requests, &requests_size);
+  ck_assert_uint_eq(requests_size, 4);
+  ck_assert_int_eq(requests[0].type, vibrant_MockGetSaturation);
+  ck_assert_int_eq(requests[1].type, vibrant_MockGetSaturation);
+  ck_assert_int_eq(requests[2].type, vibrant_MockSetSaturation);
+  ck_assert_int_eq(requests[3].type, vibrant_MockSetSaturation);
+  free(requests);
+
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 0.5,
+                          TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          1.0, TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 2),
+                          2.0, TOLERANCE);
+
+  vibrant_transaction_free(&transaction);
+  ck_assert_ptr_null(transaction);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_transaction_rollback) {
+  // two snapshot reads, then the second write fails
+  vibrant_instance *instance = new_mock(2, 0, 4);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_transaction *transaction;
+  vibrant_transaction_new(instance, &transaction);
+  vibrant_transaction_set_saturation(transaction, controllers, 2.0);
+  vibrant_transaction_set_saturation(transaction, controllers + 1, 2.0);
+
+  vibrant_transaction_result result;
+  ck_assert_int_eq(vibrant_transaction_commit(transaction, &result),
+                   vibrant_BackendError);
+  ck_assert_uint_eq(result.failed, 1);
+  ck_assert_int_eq(result.rolled_back, 1);
+
+  // both outputs were restored to their snapshot
+  vibrant_mock_request *requests;
+  size_t requests_size;
+  vibrant_mock_get_requests(instance, &requests, &requests_size);
+  ck_assert_uint_eq(requests_size, 6);
+  for (size_t i = 4; i < 6; i++) {
+    ck_assert_int_eq(requests[i].type, vibrant_MockSetSaturation);
+    ck_assert_int_eq(requests[i].status, Success);
+    ck_assert_double_eq_tol(requests[i].saturation, 1.0, TOLERANCE);
+  }
+  free(requests);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.0,
+                          TOLERANCE);
+
+  vibrant_transaction_free(&transaction);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_snapshot_roundtrip) {
+  char path[] = "/tmp/check_mock_snapshotXXXXXX";
+  int fd = mkstemp(path);
+  ck_assert_int_ge(fd, 0);
+  close(fd);
+
+  vibrant_instance *instance = new_mock(3, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_controller_set_saturation(controllers, 2.0);
+  vibrant_controller_set_saturation(controllers + 2, 0.25);
+  ck_assert_int_eq(vibrant_instance_save_snapshot(instance, path),
+                   vibrant_NoError);
+
+  vibrant_controller_set_saturation(controllers, 1.0);
+  vibrant_controller_set_saturation(controllers + 1, 3.0);
+  vibrant_mock_clear_requests(instance);
+
+  vibrant_transaction_result result;
+  ck_assert_int_eq(vibrant_instance_restore_snapshot(instance, path, &result),
+                   vibrant_NoError);
+  ck_assert_uint_eq(result.failed, 0);
+  // the third output never changed after the snapshot was taken
+  ck_assert_uint_eq(result.unchanged, 1);
+
+  vibrant_mock_request *requests;
+  size_t requests_size;
+  vibrant_mock_get_requests(instance, &requests, &requests_size);
+  // three snapshot reads, two writes
+  ck_assert_uint_eq(requests_size, 5);
+  free(requests);
+
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 2.0,
+                          TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          1.0, TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 2),
+                          0.25, TOLERANCE);
+
+  vibrant_instance_free(&instance);
+  unlink(path);
+}
+
+END_TEST
+
+START_TEST(test_snapshot_bad_file) {
+  char path[] = "/tmp/check_mock_snapshotXXXXXX";
+  int fd = mkstemp(path);
+  ck_assert_int_ge(fd, 0);
+  ck_assert_int_eq(write(fd, "not a snapshot, but long enough", 31), 31);
+  close(fd);
+
+  vibrant_instance *instance = new_mock(1, 0, 0);
+
+  ck_assert_int_eq(vibrant_instance_restore_snapshot(instance, path, NULL),
+                   vibrant_BadFile);
+
+  // backend tags are fixed, the mock backend is stored as 2 after the
+  // 16 byte header, the id and the 32 byte name
+  ck_assert_int_eq(vibrant_instance_save_snapshot(instance, path),
+                   vibrant_NoError);
+  fd = open(path, O_RDWR);
+  ck_assert_int_ge(fd, 0);
+  uint32_t tag;
+  ck_assert_int_eq(pread(fd, &tag, sizeof(tag), 56), sizeof(tag));
+  ck_assert_uint_eq(tag, 2);
+
+  // tags of unknown backends are rejected, nothing is written
+  tag = 99;
+  ck_assert_int_eq(pwrite(fd, &tag, sizeof(tag), 56), sizeof(tag));
+  close(fd);
+  vibrant_mock_clear_requests(instance);
+  ck_assert_int_eq(vibrant_instance_restore_snapshot(instance, path, NULL),
+                   vibrant_BadFile);
+  vibrant_mock_request *requests;
+  size_t requests_size;
+  vibrant_mock_get_requests(instance, &requests, &requests_size);
+  ck_assert_uint_eq(requests_size, 0);
+
+  unlink(path);
+  ck_assert_int_eq(vibrant_instance_restore_snapshot(instance, path, NULL),
+                   vibrant_IOError);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+static size_t count_sets(vibrant_instance *instance) {
+  vibrant_mock_request *requests;
+  size_t requests_size;
+  size_t sets = 0;
+
+  vibrant_mock_get_requests(instance, &requests, &requests_size);
+  for (size_t i = 0; i < requests_size; i++) {
+    if (requests[i].type == vibrant_MockSetSaturation) {
+      sets++;
+    }
+  }
+  free(requests);
+
+  return sets;
+}
+
+START_TEST(test_layers_compose) {
+  vibrant_instance *instance = new_mock(1, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  ck_assert_int_eq(
+      vibrant_controller_set_layer_saturation(controllers, "profile", 0, 2.0),
+      vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 2.0,
+                          TOLERANCE);
+
+  // saturation layers multiply
+  ck_assert_int_eq(
+      vibrant_controller_set_layer_saturation(controllers, "dim", 10, 0.75),
+      vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.5,
+                          TOLERANCE);
+
+  ck_assert_int_eq(vibrant_controller_remove_layer(controllers, "profile"),
+                   vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 0.75,
+                          TOLERANCE);
+
+  ck_assert_int_eq(vibrant_controller_remove_layer(controllers, "dim"),
+                   vibrant_NoError);
+  ck_assert_int_eq(vibrant_controller_remove_layer(controllers, "dim"),
+                   vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.0,
+                          TOLERANCE);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_layers_skip_unchanged) {
+  vibrant_instance *instance = new_mock(1, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_controller_set_layer_saturation(controllers, "night", 0, 0.5);
+  vibrant_controller_set_layer_saturation(controllers, "vibrance", 1, 2.0);
+  ck_assert_uint_eq(count_sets(instance), 2);
+
+  // both clients re-applying their settings must not cause writes
+  for (int i = 0; i < 10; i++) {
+    vibrant_controller_set_layer_saturation(controllers, "night", 0, 0.5);
+    vibrant_controller_set_layer_saturation(controllers, "vibrance", 1, 2.0);
+  }
+  ck_assert_uint_eq(count_sets(instance), 2);
+
+  // an identity layer doesn't change the composed result
+  const double identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  vibrant_controller_set_layer(controllers, "identity", 5, identity);
+  ck_assert_uint_eq(count_sets(instance), 2);
+
+  vibrant_controller_set_layer_saturation(controllers, "night", 0, 1.0);
+  ck_assert_uint_eq(count_sets(instance), 3);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 2.0,
+                          TOLERANCE);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_layers_other_writes) {
+  vibrant_instance *instance = new_mock(1, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_controller_set_layer_saturation(controllers, "vibrance", 0, 2.0);
+  ck_assert_uint_eq(count_sets(instance), 1);
+
+  // a direct write replaces the composed state, so the same layer again is
+  // a change
+  vibrant_controller_set_saturation(controllers, 0.5);
+  ck_assert_uint_eq(count_sets(instance), 2);
+  vibrant_controller_set_layer_saturation(controllers, "vibrance", 0, 2.0);
+  ck_assert_uint_eq(count_sets(instance), 3);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 2.0,
+                          TOLERANCE);
+
+  // so is one through a transaction
+  vibrant_transaction *transaction;
+  ck_assert_int_eq(vibrant_transaction_new(instance, &transaction),
+                   vibrant_NoError);
+  vibrant_transaction_set_saturation(transaction, controllers, 1.0);
+  ck_assert_int_eq(vibrant_transaction_commit(transaction, NULL),
+                   vibrant_NoError);
+  vibrant_transaction_free(&transaction);
+  vibrant_controller_set_layer_saturation(controllers, "vibrance", 0, 2.0);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 2.0,
+                          TOLERANCE);
+
+  // layers that couldn't be written are dropped or left as they were
+  vibrant_mock_set_failing(controllers, 1);
+  ck_assert_int_ne(
+      vibrant_controller_set_layer_saturation(controllers, "night", 1, 0.5),
+      vibrant_NoError);
+  ck_assert_int_ne(
+      vibrant_controller_set_layer_saturation(controllers, "vibrance", 0, 3.0),
+      vibrant_NoError);
+  vibrant_mock_set_failing(controllers, 0);
+
+  size_t sets = count_sets(instance);
+  vibrant_controller_set_layer_saturation(controllers, "vibrance", 0, 2.0);
+  ck_assert_uint_eq(count_sets(instance), sets);
+  ck_assert_int_eq(vibrant_controller_remove_layer(controllers, "vibrance"),
+                   vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.0,
+                          TOLERANCE);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_watchdog_reapply) {
+  vibrant_instance *instance = new_mock(3, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  ck_assert_int_eq(vibrant_instance_get_fd(instance), -1);
+  ck_assert_int_eq(vibrant_instance_set_watchdog(instance, 1),
+                   vibrant_NoError);
+
+  vibrant_controller_set_saturation(controllers, 2.0);
+  vibrant_controller_set_saturation(controllers + 2, 0.5);
+
+  // controllers + 1 was at the default already, resetting changes nothing
+  vibrant_mock_reset_output(controllers);
+  vibrant_mock_reset_output(controllers + 1);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.0,
+                          TOLERANCE);
+  vibrant_mock_clear_requests(instance);
+
+  vibrant_transaction_result result;
+  ck_assert_int_eq(vibrant_instance_dispatch(instance, &result),
+                   vibrant_NoError);
+  ck_assert_uint_eq(result.failed, 0);
+  ck_assert_uint_eq(result.unchanged, 1);
+
+  // two checks, one write
+  vibrant_mock_request *requests;
+  size_t requests_size;
+  vibrant_mock_get_requests(instance, &requests, &requests_size);
+  ck_assert_uint_eq(requests_size, 3);
+  ck_assert_int_eq(requests[2].type, vibrant_MockSetSaturation);
+  ck_assert_uint_eq(requests[2].controller, 0);
+  free(requests);
+
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 2.0,
+                          TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 2),
+                          0.5, TOLERANCE);
+
+  // nothing pending, nothing to do
+  vibrant_mock_clear_requests(instance);
+  ck_assert_int_eq(vibrant_instance_dispatch(instance, NULL), vibrant_NoError);
+  vibrant_mock_get_requests(instance, &requests, &requests_size);
+  ck_assert_uint_eq(requests_size, 0);
+  ck_assert_ptr_null(requests);
+
+  // transactions update the intended state as well
+  vibrant_transaction *transaction;
+  vibrant_transaction_new(instance, &transaction);
+  vibrant_transaction_set_saturation(transaction, controllers + 1, 3.0);
+  vibrant_transaction_commit(transaction, NULL);
+  vibrant_transaction_free(&transaction);
+
+  vibrant_mock_reset_output(controllers + 1);
+  vibrant_instance_dispatch(instance, NULL);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          3.0, TOLERANCE);
+
+  // without the watchdog, resets stick
+  vibrant_instance_set_watchdog(instance, 0);
+  vibrant_mock_reset_output(controllers);
+  vibrant_instance_dispatch(instance, NULL);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.0,
+                          TOLERANCE);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+static vibrant_change changes[8];
+static size_t changes_size;
+
+static void record_change(const vibrant_change *change, void *user_data) {
+  ck_assert_ptr_eq(user_data, changes);
+  ck_assert_uint_lt(changes_size, 8);
+  changes[changes_size++] = *change;
+}
+
+START_TEST(test_change_listener) {
+  vibrant_instance *instance = new_mock(3, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_controller_set_saturation(controllers, 2.0);
+  vibrant_controller_set_saturation(controllers + 2, 0.5);
+  changes_size = 0;
+  ck_assert_int_eq(
+      vibrant_instance_set_change_listener(instance, record_change, changes),
+      vibrant_NoError);
+
+  // the reset of controllers + 1 doesn't change what it shows
+  vibrant_mock_reset_output(controllers);
+  vibrant_mock_reset_output(controllers + 1);
+  ck_assert_int_eq(vibrant_instance_dispatch(instance, NULL), vibrant_NoError);
+  ck_assert_uint_eq(changes_size, 1);
+  ck_assert_ptr_eq(changes[0].controller, controllers);
+  ck_assert_double_eq_tol(changes[0].saturation, 1.0, TOLERANCE);
+
+  // nothing pending, nothing reported
+  ck_assert_int_eq(vibrant_instance_dispatch(instance, NULL), vibrant_NoError);
+  ck_assert_uint_eq(changes_size, 1);
+
+  // with the watchdog the drift is reported, the repair on the next events
+  vibrant_instance_set_watchdog(instance, 1);
+  vibrant_mock_reset_output(controllers + 2);
+  vibrant_instance_dispatch(instance, NULL);
+  ck_assert_uint_eq(changes_size, 2);
+  ck_assert_ptr_eq(changes[1].controller, controllers + 2);
+  ck_assert_double_eq_tol(changes[1].saturation, 1.0, TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 2),
+                          0.5, TOLERANCE);
+
+  ck_assert_int_eq(vibrant_instance_set_change_listener(instance, NULL, NULL),
+                   vibrant_NoError);
+  vibrant_mock_reset_output(controllers + 2);
+  vibrant_instance_dispatch(instance, NULL);
+  ck_assert_uint_eq(changes_size, 2);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+static vibrant_fence_status fence_status;
+static int fence_calls;
+
+static void record_fence(vibrant_fence *fence, vibrant_fence_status status,
+                         void *user_data) {
+  fence_status = status;
+  fence_calls++;
+}
+
+START_TEST(test_fence_async) {
+  vibrant_instance *instance = new_mock(2, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  vibrant_fence *fence;
+  ck_assert_int_eq(
+      vibrant_controller_set_saturation_async(controllers, 2.0, &fence),
+      vibrant_NoError);
+  ck_assert_int_eq(vibrant_fence_poll(fence), vibrant_FenceDone);
+  ck_assert_int_eq(vibrant_fence_wait(fence, 0), vibrant_FenceDone);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 2.0,
+                          TOLERANCE);
+
+  // a completed fence reports right away
+  fence_calls = 0;
+  vibrant_fence_set_callback(fence, record_fence, NULL);
+  ck_assert_int_eq(fence_calls, 1);
+  ck_assert_int_eq(fence_status, vibrant_FenceDone);
+  vibrant_fence_free(&fence);
+  ck_assert_ptr_null(fence);
+
+  vibrant_mock_set_failing(controllers + 1, 1);
+  ck_assert_int_eq(
+      vibrant_controller_set_saturation_async(controllers + 1, 2.0, &fence),
+      vibrant_NoError);
+  ck_assert_int_eq(vibrant_fence_poll(fence), vibrant_FenceFailed);
+  vibrant_fence_free(&fence);
+
+  vibrant_mock_set_failing(controllers + 1, 0);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          1.0, TOLERANCE);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_status_page) {
+  vibrant_instance *instance = new_mock(2, 0, 0);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  char name[64];
+  snprintf(name, sizeof(name), "/vibrant-check-%d", (int)getpid());
+
+  vibrant_status *status;
+  ck_assert_int_eq(vibrant_status_open(name, &status), vibrant_IOError);
+
+  vibrant_controller_set_saturation(controllers + 1, 3.0);
+  ck_assert_int_eq(vibrant_instance_publish_status(instance, name),
+                   vibrant_NoError);
+  ck_assert_int_eq(vibrant_status_open(name, &status), vibrant_NoError);
+
+  // the name is taken, the live page must stay intact
+  vibrant_instance *other = new_mock(1, 0, 0);
+  ck_assert_int_eq(vibrant_instance_publish_status(other, name),
+                   vibrant_IOError);
+  vibrant_instance_free(&other);
+
+  vibrant_status_entry entries[4];
+  unsigned long long generation;
+  vibrant_status_read(status, entries, 4, &length, &generation);
+  ck_assert_uint_eq(length, 2);
+  ck_assert_uint_eq(generation, 0);
+  ck_assert_str_eq(entries[0].name, "MOCK-0");
+  ck_assert_str_eq(entries[0].backend, "mock");
+  ck_assert_uint_eq(entries[0].id, vibrant_controller_get_id(controllers));
+  ck_assert_double_eq_tol(entries[0].saturation, 1.0, TOLERANCE);
+  ck_assert_double_eq_tol(entries[1].saturation, 3.0, TOLERANCE);
+
+  // updates show up without the reader touching the instance
+  vibrant_controller_set_saturation(controllers, 0.5);
+  vibrant_status_read(status, entries, 1, &length, &generation);
+  ck_assert_uint_eq(length, 2);
+  ck_assert_uint_eq(generation, 1);
+  ck_assert_uint_eq(entries[0].generation, 1);
+  ck_assert_double_eq_tol(entries[0].saturation, 0.5, TOLERANCE);
+
+  vibrant_status_close(&status);
+  ck_assert_ptr_null(status);
+
+  // the page goes away with its instance
+  vibrant_instance_free(&instance);
+  ck_assert_int_eq(vibrant_status_open(name, &status), vibrant_IOError);
+}
+
+END_TEST
+
+START_TEST(test_status_page_stale) {
+  char name[64];
+  snprintf(name, sizeof(name), "/vibrant-check-stale-%d", (int)getpid());
+
+  // a publisher that dies without removing its page
+  pid_t pid = fork();
+  ck_assert_int_ge(pid, 0);
+  if (pid == 0) {
+    vibrant_instance *instance;
+    vibrant_instance_options options = {vibrant_BackendMock, {3, 0, 0}};
+    _exit(vibrant_instance_new_with_options(&instance, NULL, &options) ==
+                  vibrant_NoError &&
+                  vibrant_instance_publish_status(instance, name) ==
+                      vibrant_NoError
+              ? EXIT_SUCCESS
+              : EXIT_FAILURE);
+  }
+  int wstatus;
+  ck_assert_int_eq(waitpid(pid, &wstatus, 0), pid);
+  ck_assert(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == EXIT_SUCCESS);
+
+  // readers of the old page keep it until they close it
+  vibrant_status *stale;
+  ck_assert_int_eq(vibrant_status_open(name, &stale), vibrant_NoError);
+
+  vibrant_instance *instance = new_mock(1, 0, 0);
+  ck_assert_int_eq(vibrant_instance_publish_status(instance, name),
+                   vibrant_NoError);
+
+  vibrant_status *status;
+  vibrant_status_entry entries[4];
+  size_t length;
+  ck_assert_int_eq(vibrant_status_open(name, &status), vibrant_NoError);
+  vibrant_status_read(status, entries, 4, &length, NULL);
+  ck_assert_uint_eq(length, 1);
+  vibrant_status_read(stale, entries, 4, &length, NULL);
+  ck_assert_uint_eq(length, 3);
+
+  vibrant_status_close(&stale);
+  vibrant_status_close(&status);
+  vibrant_instance_free(&instance);
+  ck_assert_int_eq(vibrant_status_open(name, &status), vibrant_IOError);
+}
+
+END_TEST
+
+Suite *mock_suite(void) {
+  Suite *suite = suite_create("mock");
+
+  TCase *tcase = tcase_create("mock_backend");
+  tcase_add_test(tcase, test_mock_controllers);
+  tcase_add_test(tcase, test_find_controller);
+  tcase_add_test(tcase, test_mock_roundtrip);
+  tcase_add_test(tcase, test_mock_request_log);
+  tcase_add_test(tcase, test_mock_fail_every);
+  tcase_add_test(tcase, test_mock_set_failing);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("transaction");
+  tcase_add_test(tcase, test_transaction_commit);
+  tcase_add_test(tcase, test_transaction_rollback);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("layers");
+  tcase_add_test(tcase, test_layers_compose);
+  tcase_add_test(tcase, test_layers_skip_unchanged);
+  tcase_add_test(tcase, test_layers_other_writes);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("watchdog");
+  tcase_add_test(tcase, test_watchdog_reapply);
+  tcase_add_test(tcase, test_change_listener);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("fence");
+  tcase_add_test(tcase, test_fence_async);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("status");
+  tcase_add_test(tcase, test_status_page);
+  tcase_add_test(tcase, test_status_page_stale);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("snapshot");
+  tcase_add_test(tcase, test_snapshot_roundtrip);
+  tcase_add_test(tcase, test_snapshot_bad_file);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = mock_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,170 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vibrant/panel.h>
+#include <vibrant/vibrant.h>
+
+/**
+ * this tolerance is used for comparing rational numbers
+ */
+#define TOLERANCE 0.00001
+
+static const double srgb[8] = {0.640, 0.330, 0.300, 0.600,
+                               0.150, 0.060, 0.3127, 0.3290};
+
+/**
+ * Encode chromaticity into the 10-bit fractions of an EDID base block.
+ */
+static void edid_set_chromaticity(unsigned char *edid,
+                                  const double *chromaticity) {
+  memset(edid + 25, 0, 10);
+  for (int i = 0; i < 8; i++) {
+    unsigned value = (unsigned)(chromaticity[i] * 1024 + 0.5);
+    edid[25 + i / 4] |= (value & 0x3) << (6 - 2 * (i % 4));
+    edid[27 + i] = value >> 2;
+  }
+}
+
+START_TEST(test_panel_edid_chromaticity) {
+  unsigned char edid[128] = {0};
+  edid_set_chromaticity(edid, srgb);
+
+  double chromaticity[8];
+  panel_edid_chromaticity(edid, chromaticity);
+  for (int i = 0; i < 8; i++) {
+    ck_assert_double_eq_tol(chromaticity[i], srgb[i], 0.5 / 1024);
+  }
+}
+
+END_TEST
+
+START_TEST(test_panel_weights_srgb) {
+  double weights[3];
+  ck_assert_int_eq(panel_chromaticity_to_weights(srgb, weights), 1);
+
+  // Rec. 709 luma coefficients
+  ck_assert_double_eq_tol(weights[0], 0.2126, 0.0001);
+  ck_assert_double_eq_tol(weights[1], 0.7152, 0.0001);
+  ck_assert_double_eq_tol(weights[2], 0.0722, 0.0001);
+}
+
+END_TEST
+
+START_TEST(test_panel_weights_wide_gamut) {
+  const double p3[8] = {0.680, 0.320, 0.265, 0.690,
+                        0.150, 0.060, 0.3127, 0.3290};
+  double weights[3];
+  ck_assert_int_eq(panel_chromaticity_to_weights(p3, weights), 1);
+
+  // Display P3: a deeper red weighs more, green less than on sRGB
+  ck_assert_double_eq_tol(weights[0], 0.2290, 0.0001);
+  ck_assert_double_eq_tol(weights[1], 0.6917, 0.0001);
+  ck_assert_double_eq_tol(weights[2], 0.0793, 0.0001);
+  ck_assert_double_eq_tol(weights[0] + weights[1] + weights[2], 1.0,
+                          TOLERANCE);
+}
+
+END_TEST
+
+START_TEST(test_panel_weights_invalid) {
+  const double zero[8] = {0};
+  double weights[3];
+  ck_assert_int_eq(panel_chromaticity_to_weights(zero, weights), 0);
+
+  // white point outside of the gamut
+  double outside[8];
+  memcpy(outside, srgb, sizeof(outside));
+  outside[6] = 0.05;
+  outside[7] = 0.9;
+  ck_assert_int_eq(panel_chromaticity_to_weights(outside, weights), 0);
+}
+
+END_TEST
+
+START_TEST(test_panel_coeffs) {
+  double weights[3];
+  ck_assert_int_eq(panel_chromaticity_to_weights(srgb, weights), 1);
+
+  const double color[3] = {0.9, 0.2, 0.4};
+  double luminance = weights[0] * color[0] + weights[1] * color[1] +
+                     weights[2] * color[2];
+
+  const double saturations[] = {0.0, 0.5, 1.0, 2.0, 4.0};
+  for (size_t s = 0; s < sizeof(saturations) / sizeof(saturations[0]); s++) {
+    double coeffs[9];
+    panel_saturation_to_coeffs(weights, saturations[s], coeffs);
+
+    double mixed[3];
+    for (int row = 0; row < 3; row++) {
+      // grays stay gray
+      ck_assert_double_eq_tol(coeffs[row * 3] + coeffs[row * 3 + 1] +
+                                  coeffs[row * 3 + 2],
+                              1.0, TOLERANCE);
+      mixed[row] = coeffs[row * 3] * color[0] +
+                   coeffs[row * 3 + 1] * color[1] +
+                   coeffs[row * 3 + 2] * color[2];
+    }
+
+    // and colors keep their luminance
+    ck_assert_double_eq_tol(weights[0] * mixed[0] + weights[1] * mixed[1] +
+                                weights[2] * mixed[2],
+                            luminance, TOLERANCE);
+
+    // saturation is read back as the difference within a column
+    ck_assert_double_eq_tol(coeffs[0] - coeffs[3], saturations[s], TOLERANCE);
+  }
+}
+
+END_TEST
+
+START_TEST(test_panel_profile_cache) {
+  unsigned char edid[128] = {0};
+  edid_set_chromaticity(edid, srgb);
+
+  double weights[3];
+  ck_assert_int_eq(panel_profile_lookup(0x1234, edid, weights), 1);
+  ck_assert_double_eq_tol(weights[1], 0.7152, 0.005);
+
+  // known panels are not parsed again
+  memset(edid, 0, sizeof(edid));
+  double cached[3];
+  ck_assert_int_eq(panel_profile_lookup(0x1234, edid, cached), 1);
+  ck_assert_mem_eq(weights, cached, sizeof(weights));
+
+  // neither are panels without a usable profile
+  ck_assert_int_eq(panel_profile_lookup(0x5678, edid, weights), 0);
+  edid_set_chromaticity(edid, srgb);
+  ck_assert_int_eq(panel_profile_lookup(0x5678, edid, weights), 0);
+}
+
+END_TEST
+
+Suite *panel_suite(void) {
+  Suite *suite = suite_create("panel");
+
+  TCase *tcase = tcase_create("profile");
+  tcase_add_test(tcase, test_panel_edid_chromaticity);
+  tcase_add_test(tcase, test_panel_weights_srgb);
+  tcase_add_test(tcase, test_panel_weights_wide_gamut);
+  tcase_add_test(tcase, test_panel_weights_invalid);
+  tcase_add_test(tcase, test_panel_coeffs);
+  tcase_add_test(tcase, test_panel_profile_cache);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = panel_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,356 @@
+#include <check.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vibrant/pixel.h>
+#include <vibrant/vibrant.h>
+
+#define FRAME_WIDTH 1003
+#define FRAME_HEIGHT 29
+#define FRAME_SIZE (FRAME_WIDTH * FRAME_HEIGHT * 4)
+
+static unsigned char *new_frame(void) {
+  unsigned char *frame = malloc(FRAME_SIZE);
+  uint32_t state = 4242;
+
+  for (size_t i = 0; i < FRAME_SIZE; i++) {
+    state = state * 1664525u + 1013904223u;
+    frame[i] = state >> 24u;
+  }
+
+  return frame;
+}
+
+static const vibrant_pixel_format formats[] = {vibrant_PixelRGBA8888,
+                                               vibrant_PixelRGBA1010102};
+
+START_TEST(test_quantize) {
+  double matrix[9];
+  double coeffs[9];
+
+  vibrant_saturation_to_matrix(1.0, matrix);
+  pixel_quantize_matrix(matrix, coeffs);
+  for (int i = 0; i < 9; i++) {
+    ck_assert_double_eq(coeffs[i], i % 4 == 0 ? 1.0 : 0.0);
+  }
+
+  // (1 - 4) / 3 = -1 off the diagonal, 4 - 1 = 3 on it
+  vibrant_saturation_to_matrix(4.0, matrix);
+  pixel_quantize_matrix(matrix, coeffs);
+  ck_assert_double_eq(coeffs[0], 3.0);
+  ck_assert_double_eq(coeffs[1], -1.0);
+
+  // 1/3 keeps all 32 fractional bits of the CTM
+  vibrant_saturation_to_matrix(0.0, matrix);
+  pixel_quantize_matrix(matrix, coeffs);
+  ck_assert_double_eq(coeffs[0], floor(4294967296.0 / 3.0) / 4294967296.0);
+}
+
+END_TEST
+
+/**
+ * Apply matrix to one channel in S31.32 fixed point with 64-bit integers,
+ * truncating the coefficients like the CTM encoding and rounding the result
+ * half up.
+ */
+static uint32_t reference_channel(const double *matrix, int row,
+                                  const int64_t *rgb, uint32_t limit) {
+  int64_t sum = 0;
+  for (int i = 0; i < 3; i++) {
+    double coeff = matrix[3 * row + i];
+    int64_t magnitude = (int64_t)(fabs(coeff) * 4294967296.0);
+    sum += (coeff < 0 ? -magnitude : magnitude) * rgb[i];
+  }
+
+  int64_t value = (sum + (1LL << 31)) >> 32;
+  value = value < 0 ? 0 : value;
+  return value > limit ? limit : (uint32_t)value;
+}
+
+START_TEST(test_exact_ctm) {
+  unsigned char *frame = new_frame();
+  unsigned char *original = malloc(FRAME_SIZE);
+  memcpy(original, frame, FRAME_SIZE);
+
+  double matrix[9];
+  vibrant_saturation_to_matrix(0.3, matrix);
+  vibrant_apply_matrix_rgba(matrix, vibrant_PixelRGBA1010102, frame,
+                            FRAME_WIDTH, FRAME_HEIGHT, FRAME_WIDTH * 4, 1);
+
+  for (size_t i = 0; i < FRAME_SIZE; i += 4) {
+    uint32_t in, out;
+    memcpy(&in, original + i, sizeof(in));
+    memcpy(&out, frame + i, sizeof(out));
+
+    int64_t rgb[3] = {in & 1023u, (in >> 10) & 1023u, (in >> 20) & 1023u};
+    for (int c = 0; c < 3; c++) {
+      ck_assert_uint_eq((out >> 10 * c) & 1023u,
+                        reference_channel(matrix, c, rgb, 1023u));
+    }
+    ck_assert_uint_eq(out >> 30, in >> 30);
+  }
+
+  free(original);
+  free(frame);
+}
+
+END_TEST
+
+START_TEST(test_kernels_match) {
+  unsigned char *expected = new_frame();
+  unsigned char *actual = malloc(FRAME_SIZE);
+  pixel_apply_fn kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+      pixel_apply_sse2,
+      pixel_apply_avx2,
+#endif
+      pixel_apply_best(),
+  };
+  double matrix[9];
+  double coeffs[9];
+
+  vibrant_saturation_to_matrix(2.7, matrix);
+  pixel_quantize_matrix(matrix, coeffs);
+
+  for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+    unsigned char *original = new_frame();
+    memcpy(expected, original, FRAME_SIZE);
+    pixel_apply_scalar(coeffs, formats[f], expected, FRAME_WIDTH * FRAME_HEIGHT);
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+#if defined(__x86_64__) || defined(__i386__)
+      if (kernels[k] == pixel_apply_avx2 && !__builtin_cpu_supports("avx2")) {
+        continue;
+      }
+#endif
+      memcpy(actual, original, FRAME_SIZE);
+      kernels[k](coeffs, formats[f], actual, FRAME_WIDTH * FRAME_HEIGHT);
+      ck_assert_int_eq(memcmp(expected, actual, FRAME_SIZE), 0);
+    }
+    free(original);
+  }
+
+  free(expected);
+  free(actual);
+}
+
+END_TEST
+
+START_TEST(test_identity) {
+  unsigned char *original = new_frame();
+  unsigned char *frame = malloc(FRAME_SIZE);
+  double matrix[9];
+
+  vibrant_saturation_to_matrix(1.0, matrix);
+  for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+    memcpy(frame, original, FRAME_SIZE);
+    vibrant_apply_matrix_rgba(matrix, formats[f], frame, FRAME_WIDTH,
+                              FRAME_HEIGHT, FRAME_WIDTH * 4, 1);
+    ck_assert_int_eq(memcmp(frame, original, FRAME_SIZE), 0);
+  }
+
+  free(original);
+  free(frame);
+}
+
+END_TEST
+
+START_TEST(test_monochrome) {
+  unsigned char *frame = new_frame();
+  double matrix[9];
+
+  vibrant_saturation_to_matrix(0.0, matrix);
+  vibrant_apply_matrix_rgba(matrix, vibrant_PixelRGBA8888, frame, FRAME_WIDTH,
+                            FRAME_HEIGHT, FRAME_WIDTH * 4, 1);
+
+  for (size_t i = 0; i < FRAME_SIZE; i += 4) {
+    ck_assert_uint_eq(frame[i], frame[i + 1]);
+    ck_assert_uint_eq(frame[i], frame[i + 2]);
+  }
+
+  free(frame);
+}
+
+END_TEST
+
+START_TEST(test_threads) {
+  unsigned char *expected = new_frame();
+  unsigned char *actual = new_frame();
+  double matrix[9];
+
+  vibrant_saturation_to_matrix(1.8, matrix);
+  // a stride wider than the rows must leave the padding alone
+  vibrant_apply_matrix_rgba(matrix, vibrant_PixelRGBA1010102, expected,
+                            FRAME_WIDTH - 3, FRAME_HEIGHT, FRAME_WIDTH * 4, 1);
+  vibrant_apply_matrix_rgba(matrix, vibrant_PixelRGBA1010102, actual,
+                            FRAME_WIDTH - 3, FRAME_HEIGHT, FRAME_WIDTH * 4, 7);
+  ck_assert_int_eq(memcmp(expected, actual, FRAME_SIZE), 0);
+
+  unsigned char *original = new_frame();
+  ck_assert_int_eq(memcmp(expected + (FRAME_WIDTH - 3) * 4,
+                          original + (FRAME_WIDTH - 3) * 4, 12),
+                   0);
+
+  free(original);
+  free(expected);
+  free(actual);
+}
+
+END_TEST
+
+START_TEST(test_lut_identity) {
+  size_t size = 17;
+  float *lut = malloc(size * size * size * 3 * sizeof(float));
+  double matrix[9];
+
+  vibrant_saturation_to_matrix(1.0, matrix);
+  ck_assert_int_eq(vibrant_lut_generate(matrix, 1.0, size, lut, 3),
+                   vibrant_NoError);
+
+  for (size_t b = 0; b < size; b++) {
+    for (size_t g = 0; g < size; g++) {
+      for (size_t r = 0; r < size; r++) {
+        const float *entry = lut + 3 * (r + size * (g + size * b));
+        ck_assert_float_eq_tol(entry[0], r / 16.0f, 1e-6f);
+        ck_assert_float_eq_tol(entry[1], g / 16.0f, 1e-6f);
+        ck_assert_float_eq_tol(entry[2], b / 16.0f, 1e-6f);
+      }
+    }
+  }
+
+  ck_assert_int_eq(vibrant_lut_generate(matrix, 1.0, 1, lut, 1),
+                   vibrant_InvalidArgument);
+  ck_assert_int_eq(vibrant_lut_generate(matrix, 0.0, size, lut, 1),
+                   vibrant_InvalidArgument);
+
+  free(lut);
+}
+
+END_TEST
+
+START_TEST(test_lut_threads) {
+  size_t size = 33;
+  size_t floats = size * size * size * 3;
+  float *expected = malloc(floats * sizeof(float));
+  float *actual = malloc(floats * sizeof(float));
+  double matrix[9];
+
+  vibrant_saturation_to_matrix(0.0, matrix);
+  vibrant_lut_generate(matrix, 2.2, size, expected, 1);
+  vibrant_lut_generate(matrix, 2.2, size, actual, 5);
+  ck_assert_int_eq(memcmp(expected, actual, floats * sizeof(float)), 0);
+
+  // monochrome, every entry is gray
+  for (size_t i = 0; i < floats; i += 3) {
+    ck_assert_float_eq(expected[i], expected[i + 1]);
+    ck_assert_float_eq(expected[i], expected[i + 2]);
+  }
+
+  free(expected);
+  free(actual);
+}
+
+END_TEST
+
+START_TEST(test_lut_export) {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/vibrant-check-%d.cube", (int)getpid());
+  double matrix[9];
+  vibrant_saturation_to_matrix(2.0, matrix);
+
+  ck_assert_int_eq(
+      vibrant_lut_export(matrix, 1.0, 5, vibrant_LutCube, path, 2),
+      vibrant_NoError);
+  FILE *file = fopen(path, "r");
+  ck_assert_ptr_nonnull(file);
+  char line[128];
+  size_t lines = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (lines == 1) {
+      ck_assert_str_eq(line, "LUT_3D_SIZE 5\n");
+    }
+    lines++;
+  }
+  fclose(file);
+  ck_assert_uint_eq(lines, 4 + 5 * 5 * 5);
+
+  ck_assert_int_eq(
+      vibrant_lut_export(matrix, 1.0, 5, vibrant_LutFloat32, path, 2),
+      vibrant_NoError);
+  struct stat st;
+  ck_assert_int_eq(stat(path, &st), 0);
+  ck_assert_int_eq(st.st_size, 5 * 5 * 5 * 3 * sizeof(float));
+  unlink(path);
+
+  ck_assert_int_eq(vibrant_lut_export(matrix, 1.0, 5, vibrant_LutCube,
+                                      "/nonexistent/vibrant.cube", 1),
+                   vibrant_IOError);
+}
+
+END_TEST
+
+START_TEST(test_controller_matrix) {
+  vibrant_instance *instance;
+  vibrant_mock_options mock_options = {1, 0, 0};
+  vibrant_instance_options options = {vibrant_BackendMock, mock_options};
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_NoError);
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  double expected[9], actual[9];
+  vibrant_controller_set_saturation(controllers, 2.5);
+  vibrant_saturation_to_matrix(2.5, expected);
+  ck_assert_int_eq(vibrant_controller_get_matrix(controllers, actual),
+                   vibrant_NoError);
+  for (int i = 0; i < 9; i++) {
+    ck_assert_double_eq_tol(actual[i], expected[i], 1e-9);
+  }
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+Suite *pixel_suite(void) {
+  Suite *suite = suite_create("pixel");
+
+  TCase *tcase = tcase_create("apply_matrix");
+  tcase_add_test(tcase, test_quantize);
+  tcase_add_test(tcase, test_exact_ctm);
+  tcase_add_test(tcase, test_kernels_match);
+  tcase_add_test(tcase, test_identity);
+  tcase_add_test(tcase, test_monochrome);
+  tcase_add_test(tcase, test_threads);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("lut");
+  tcase_add_test(tcase, test_lut_identity);
+  tcase_add_test(tcase, test_lut_threads);
+  tcase_add_test(tcase, test_lut_export);
+  tcase_add_test(tcase, test_controller_matrix);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = pixel_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
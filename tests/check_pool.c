@@ -0,0 +1,188 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vibrant/vibrant.h>
+
+/**
+ * this tolerance is used for comparing rational numbers
+ */
+#define TOLERANCE 0.00001
+
+#define DISPLAYS 3
+
+static vibrant_pool *new_pool(size_t outputs) {
+  const char *const names[DISPLAYS] = {":0", ":1", ":2"};
+  vibrant_instance_options options = {vibrant_BackendMock, {outputs, 0, 0}};
+  vibrant_pool *pool;
+
+  ck_assert_int_eq(
+      vibrant_pool_new_with_options(&pool, names, DISPLAYS, &options),
+      vibrant_NoError);
+  return pool;
+}
+
+static double pool_saturation(vibrant_pool *pool, size_t display,
+                              const char *output) {
+  vibrant_instance *instance = vibrant_pool_get_instance(pool, display);
+  vibrant_controller *controller =
+      vibrant_instance_find_controller(instance, output);
+  ck_assert_ptr_nonnull(controller);
+
+  return vibrant_controller_get_saturation(controller);
+}
+
+START_TEST(test_pool_new) {
+  vibrant_pool *pool = new_pool(2);
+
+  ck_assert_uint_eq(vibrant_pool_get_size(pool), DISPLAYS);
+  ck_assert_ptr_nonnull(vibrant_pool_get_instance(pool, DISPLAYS - 1));
+  ck_assert_ptr_null(vibrant_pool_get_instance(pool, DISPLAYS));
+  ck_assert_int_ge(vibrant_pool_get_fd(pool), 0);
+
+  vibrant_transaction_result result;
+  ck_assert_int_eq(vibrant_pool_dispatch(pool, &result), vibrant_NoError);
+  ck_assert_uint_eq(result.failed, 0);
+
+  vibrant_pool_stats stats;
+  ck_assert_int_eq(vibrant_pool_get_stats(pool, 0, &stats), vibrant_NoError);
+  ck_assert_uint_eq(stats.batches, 0);
+  ck_assert_int_eq(vibrant_pool_get_stats(pool, DISPLAYS, &stats),
+                   vibrant_InvalidArgument);
+
+  vibrant_pool_free(&pool);
+  ck_assert_ptr_null(pool);
+}
+
+END_TEST
+
+START_TEST(test_pool_apply) {
+  vibrant_pool *pool = new_pool(2);
+
+  const vibrant_pool_command commands[] = {
+      {0, "MOCK-0", 1.5},
+      {2, "MOCK-0", 0.5},
+      {2, "MOCK-1", 2.0},
+  };
+  vibrant_transaction_result result;
+  ck_assert_int_eq(vibrant_pool_apply(pool, commands, 3, 1000, &result),
+                   vibrant_NoError);
+  ck_assert_uint_eq(result.failed, 0);
+
+  ck_assert_double_eq_tol(pool_saturation(pool, 0, "MOCK-0"), 1.5, TOLERANCE);
+  ck_assert_double_eq_tol(pool_saturation(pool, 0, "MOCK-1"), 1.0, TOLERANCE);
+  ck_assert_double_eq_tol(pool_saturation(pool, 1, "MOCK-0"), 1.0, TOLERANCE);
+  ck_assert_double_eq_tol(pool_saturation(pool, 2, "MOCK-0"), 0.5, TOLERANCE);
+  ck_assert_double_eq_tol(pool_saturation(pool, 2, "MOCK-1"), 2.0, TOLERANCE);
+
+  // displays without a write in the batch keep their stats
+  vibrant_pool_stats stats;
+  vibrant_pool_get_stats(pool, 0, &stats);
+  ck_assert_uint_eq(stats.batches, 1);
+  ck_assert_uint_eq(stats.failed, 0);
+  ck_assert_uint_eq(stats.total_ns, stats.last_ns);
+  ck_assert_uint_ge(stats.max_ns, stats.min_ns);
+  vibrant_pool_get_stats(pool, 1, &stats);
+  ck_assert_uint_eq(stats.batches, 0);
+
+  ck_assert_int_eq(vibrant_pool_apply(pool, commands + 1, 1, -1, NULL),
+                   vibrant_NoError);
+  vibrant_pool_get_stats(pool, 2, &stats);
+  ck_assert_uint_eq(stats.batches, 2);
+
+  vibrant_pool_free(&pool);
+}
+
+END_TEST
+
+START_TEST(test_pool_apply_invalid) {
+  vibrant_pool *pool = new_pool(2);
+
+  const vibrant_pool_command bad_output[] = {
+      {0, "MOCK-0", 1.5},
+      {1, "MOCK-2", 1.5},
+  };
+  const vibrant_pool_command bad_display[] = {
+      {0, "MOCK-0", 1.5},
+      {DISPLAYS, "MOCK-0", 1.5},
+  };
+
+  ck_assert_int_eq(vibrant_pool_apply(pool, bad_output, 2, 1000, NULL),
+                   vibrant_InvalidArgument);
+  ck_assert_int_eq(vibrant_pool_apply(pool, bad_display, 2, 1000, NULL),
+                   vibrant_InvalidArgument);
+
+  // nothing was sent
+  for (size_t i = 0; i < DISPLAYS; i++) {
+    vibrant_mock_request *requests;
+    size_t length;
+    vibrant_mock_get_requests(vibrant_pool_get_instance(pool, i), &requests,
+                              &length);
+    ck_assert_uint_eq(length, 0);
+    ck_assert_ptr_null(requests);
+  }
+
+  vibrant_pool_free(&pool);
+}
+
+END_TEST
+
+START_TEST(test_pool_apply_failing) {
+  vibrant_pool *pool = new_pool(2);
+
+  vibrant_controller *failing = vibrant_instance_find_controller(
+      vibrant_pool_get_instance(pool, 1), "MOCK-1");
+  vibrant_mock_set_failing(failing, 1);
+
+  const vibrant_pool_command commands[] = {
+      {0, "MOCK-1", 1.5},
+      {1, "MOCK-0", 1.5},
+      {1, "MOCK-1", 1.5},
+  };
+  vibrant_transaction_result result;
+  ck_assert_int_eq(vibrant_pool_apply(pool, commands, 3, 1000, &result),
+                   vibrant_NoError);
+  ck_assert_uint_eq(result.failed, 1);
+
+  // writes are independent, the other writes stay applied
+  ck_assert_double_eq_tol(pool_saturation(pool, 0, "MOCK-1"), 1.5, TOLERANCE);
+  ck_assert_double_eq_tol(pool_saturation(pool, 1, "MOCK-0"), 1.5, TOLERANCE);
+
+  vibrant_pool_stats stats;
+  vibrant_pool_get_stats(pool, 1, &stats);
+  ck_assert_uint_eq(stats.batches, 1);
+  ck_assert_uint_eq(stats.failed, 1);
+  vibrant_pool_get_stats(pool, 0, &stats);
+  ck_assert_uint_eq(stats.failed, 0);
+
+  vibrant_pool_free(&pool);
+}
+
+END_TEST
+
+Suite *pool_suite(void) {
+  Suite *suite = suite_create("pool");
+
+  TCase *tcase = tcase_create("pool");
+  tcase_add_test(tcase, test_pool_new);
+  tcase_add_test(tcase, test_pool_apply);
+  tcase_add_test(tcase, test_pool_apply_invalid);
+  tcase_add_test(tcase, test_pool_apply_failing);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = pool_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
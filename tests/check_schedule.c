@@ -0,0 +1,360 @@
+#include <arpa/inet.h>
+#include <check.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vibrant/schedule.h>
+#include <vibrant/vibrant.h>
+
+/**
+ * this tolerance is used for comparing rational numbers
+ */
+#define TOLERANCE 0.00001
+
+#define HOUR 3600u
+
+// 2020-06-01 00:00:00 UTC
+#define MIDNIGHT 1590969600
+
+static vibrant_instance *new_mock(size_t outputs) {
+  vibrant_instance_options options = {vibrant_BackendMock, {outputs, 0, 0}};
+  vibrant_instance *instance;
+
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_NoError);
+  return instance;
+}
+
+static void setup_utc(void) {
+  setenv("TZ", "UTC", 1);
+  tzset();
+}
+
+START_TEST(test_pick) {
+  const schedule_rule rules[] = {
+      {-1, 7 * HOUR, vibrant_PowerAny, 1.5},
+      {-1, 20 * HOUR, vibrant_PowerAny, 1.0},
+      {1, 20 * HOUR, vibrant_PowerAny, 1.2},
+      {-1, 12 * HOUR, vibrant_PowerBattery, 0.8},
+  };
+  double saturation;
+
+  // before the first start of the day the evening rule still applies
+  ck_assert_int_eq(
+      schedule_pick(rules, 4, 0, 3 * HOUR, vibrant_PowerAC, &saturation), 1);
+  ck_assert_double_eq(saturation, 1.0);
+
+  ck_assert_int_eq(
+      schedule_pick(rules, 4, 0, 7 * HOUR, vibrant_PowerAC, &saturation), 1);
+  ck_assert_double_eq(saturation, 1.5);
+
+  ck_assert_int_eq(
+      schedule_pick(rules, 4, 0, 13 * HOUR, vibrant_PowerBattery, &saturation),
+      1);
+  ck_assert_double_eq(saturation, 0.8);
+  ck_assert_int_eq(
+      schedule_pick(rules, 4, 0, 13 * HOUR, vibrant_PowerAC, &saturation), 1);
+  ck_assert_double_eq(saturation, 1.5);
+
+  // a rule for the output beats one for every output with the same start
+  ck_assert_int_eq(
+      schedule_pick(rules, 4, 1, 21 * HOUR, vibrant_PowerAC, &saturation), 1);
+  ck_assert_double_eq(saturation, 1.2);
+  ck_assert_int_eq(
+      schedule_pick(rules, 4, 0, 21 * HOUR, vibrant_PowerAC, &saturation), 1);
+  ck_assert_double_eq(saturation, 1.0);
+
+  // no matter in which order they are listed
+  const schedule_rule reversed[] = {rules[2], rules[1]};
+  ck_assert_int_eq(
+      schedule_pick(reversed, 2, 1, 21 * HOUR, vibrant_PowerAC, &saturation),
+      1);
+  ck_assert_double_eq(saturation, 1.2);
+
+  // otherwise the later of two rules with the same start wins
+  const schedule_rule same[] = {rules[1],
+                                {-1, 20 * HOUR, vibrant_PowerAny, 0.9}};
+  ck_assert_int_eq(
+      schedule_pick(same, 2, 0, 21 * HOUR, vibrant_PowerAC, &saturation), 1);
+  ck_assert_double_eq(saturation, 0.9);
+
+  ck_assert_int_eq(
+      schedule_pick(rules + 2, 1, 0, 21 * HOUR, vibrant_PowerAC, &saturation),
+      0);
+}
+
+END_TEST
+
+START_TEST(test_next_start) {
+  const schedule_rule rules[] = {
+      {-1, 7 * HOUR, vibrant_PowerAny, 1.5},
+      {-1, 20 * HOUR, vibrant_PowerAC, 1.0},
+  };
+
+  ck_assert_uint_eq(schedule_next_start(rules, 2, 0, vibrant_PowerAC),
+                    7 * HOUR);
+  ck_assert_uint_eq(schedule_next_start(rules, 2, 7 * HOUR, vibrant_PowerAC),
+                    20 * HOUR);
+  ck_assert_uint_eq(
+      schedule_next_start(rules, 2, 7 * HOUR, vibrant_PowerBattery),
+      7 * HOUR + SCHEDULE_DAY);
+  ck_assert_uint_eq(schedule_next_start(rules, 2, 21 * HOUR, vibrant_PowerAC),
+                    7 * HOUR + SCHEDULE_DAY);
+  ck_assert_uint_eq(schedule_next_start(rules, 0, 0, vibrant_PowerAC), 0);
+}
+
+END_TEST
+
+static void write_supply(const char *dir, const char *name, const char *type,
+                         const char *attribute, const char *value) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  mkdir(path, 0700);
+
+  snprintf(path, sizeof(path), "%s/%s/type", dir, name);
+  FILE *file = fopen(path, "w");
+  fprintf(file, "%s\n", type);
+  fclose(file);
+
+  snprintf(path, sizeof(path), "%s/%s/%s", dir, name, attribute);
+  file = fopen(path, "w");
+  fprintf(file, "%s\n", value);
+  fclose(file);
+}
+
+START_TEST(test_read_power) {
+  char dir[] = "/tmp/vibrant-power-XXXXXX";
+  ck_assert_ptr_nonnull(mkdtemp(dir));
+
+  // desktops without any supply
+  ck_assert_int_eq(schedule_read_power(dir), vibrant_PowerAC);
+
+  // peripheral batteries don't count
+  write_supply(dir, "hid-mouse", "Battery", "scope", "Device");
+  ck_assert_int_eq(schedule_read_power(dir), vibrant_PowerAC);
+
+  write_supply(dir, "BAT0", "Battery", "status", "Discharging");
+  ck_assert_int_eq(schedule_read_power(dir), vibrant_PowerBattery);
+
+  write_supply(dir, "AC", "Mains", "online", "0");
+  ck_assert_int_eq(schedule_read_power(dir), vibrant_PowerBattery);
+
+  write_supply(dir, "AC", "Mains", "online", "1");
+  ck_assert_int_eq(schedule_read_power(dir), vibrant_PowerAC);
+
+  char command[64];
+  snprintf(command, sizeof(command), "rm -r %s", dir);
+  ck_assert_int_eq(system(command), 0);
+}
+
+END_TEST
+
+/**
+ * Send a message with the header of udev for subsystem to fd.
+ */
+static void send_udev_message(int fd, const char *subsystem) {
+  unsigned char message[40 + sizeof("SUBSYSTEM=power_supply")];
+  memset(message, 0, sizeof(message));
+  memcpy(message, "libudev", 8);
+
+  uint32_t magic = htonl(0xfeedcafeu);
+  uint32_t hash = htonl(schedule_udev_hash(subsystem));
+  memcpy(message + 8, &magic, sizeof(magic));
+  memcpy(message + 24, &hash, sizeof(hash));
+
+  ck_assert_int_eq(send(fd, message, sizeof(message), 0), sizeof(message));
+}
+
+START_TEST(test_uevent_filter) {
+  int fds[2];
+  ck_assert_int_eq(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, fds),
+                   0);
+  ck_assert_int_eq(schedule_attach_uevent_filter(fds[1]), 0);
+
+  // the hash udev uses for subsystem names
+  ck_assert_uint_eq(schedule_udev_hash(""), 0);
+  ck_assert_uint_ne(schedule_udev_hash("power_supply"),
+                    schedule_udev_hash("drm"));
+
+  send_udev_message(fds[0], "drm");
+  send_udev_message(fds[0], "power_supply");
+  // raw kernel uevents have no header
+  const char uevent[] = "change@/devices/power_supply/AC\0"
+                        "SUBSYSTEM=power_supply";
+  ck_assert_int_eq(send(fds[0], uevent, sizeof(uevent), 0), sizeof(uevent));
+
+  unsigned char buffer[256];
+  ck_assert_int_gt(recv(fds[1], buffer, sizeof(buffer), 0), 0);
+  ck_assert_int_eq(memcmp(buffer, "libudev", 8), 0);
+  ck_assert_int_lt(recv(fds[1], buffer, sizeof(buffer), 0), 0);
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+END_TEST
+
+START_TEST(test_schedule_apply) {
+  vibrant_instance *instance = new_mock(2);
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  const vibrant_schedule_rule rules[] = {
+      {NULL, 0, vibrant_PowerAny, 1.0},
+      {"MOCK-1", 8 * HOUR, vibrant_PowerAny, 2.0},
+      {NULL, 0, vibrant_PowerBattery, 0.5},
+  };
+  vibrant_schedule *schedule;
+  ck_assert_int_eq(vibrant_schedule_new(instance, rules, 3, 0, &schedule),
+                   vibrant_NoError);
+
+  // readable right away, so the first dispatch applies the current profile
+  struct pollfd pfd = {vibrant_schedule_get_fd(schedule), POLLIN, 0};
+  ck_assert_int_eq(poll(&pfd, 1, 1000), 1);
+
+  schedule_set_power(schedule, vibrant_PowerAC);
+  vibrant_transaction_result result;
+  ck_assert_int_eq(
+      schedule_update(schedule, MIDNIGHT + 9 * HOUR, 0, &result),
+      vibrant_NoError);
+  ck_assert_uint_eq(result.failed, 0);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 0),
+                          1.0, TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          2.0, TOLERANCE);
+
+  // nothing changed, nothing is written
+  vibrant_mock_clear_requests(instance);
+  ck_assert_int_eq(
+      schedule_update(schedule, MIDNIGHT + 10 * HOUR, 0, &result),
+      vibrant_NoError);
+  vibrant_mock_request *requests;
+  vibrant_mock_get_requests(instance, &requests, &length);
+  ck_assert_uint_eq(length, 0);
+  ck_assert_ptr_null(requests);
+
+  schedule_set_power(schedule, vibrant_PowerBattery);
+  ck_assert_int_eq(
+      schedule_update(schedule, MIDNIGHT + 10 * HOUR, 0, &result),
+      vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 0),
+                          0.5, TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          2.0, TOLERANCE);
+
+  // the day wraps around, MOCK-1 follows the battery rule before 8:00
+  ck_assert_int_eq(
+      schedule_update(schedule, MIDNIGHT + SCHEDULE_DAY + HOUR, 0, &result),
+      vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          0.5, TOLERANCE);
+
+  vibrant_schedule_free(&schedule);
+  ck_assert_ptr_null(schedule);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_schedule_transition) {
+  vibrant_instance *instance = new_mock(1);
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  const vibrant_schedule_rule rules[] = {
+      {NULL, 0, vibrant_PowerAny, 1.0},
+      {NULL, 18 * HOUR, vibrant_PowerAny, 2.0},
+  };
+  vibrant_schedule *schedule;
+  ck_assert_int_eq(vibrant_schedule_new(instance, rules, 2, 1000, &schedule),
+                   vibrant_NoError);
+  schedule_set_power(schedule, vibrant_PowerAC);
+
+  ck_assert_int_eq(schedule_update(schedule, MIDNIGHT + 18 * HOUR, 5000, NULL),
+                   vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.0,
+                          TOLERANCE);
+
+  ck_assert_int_eq(schedule_update(schedule, MIDNIGHT + 18 * HOUR, 5500, NULL),
+                   vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.5,
+                          0.01);
+
+  ck_assert_int_eq(
+      schedule_update(schedule, MIDNIGHT + 18 * HOUR + 1, 6000, NULL),
+      vibrant_NoError);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 2.0,
+                          TOLERANCE);
+
+  vibrant_schedule_free(&schedule);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_schedule_invalid) {
+  vibrant_instance *instance = new_mock(1);
+  vibrant_schedule *schedule;
+
+  const vibrant_schedule_rule late = {NULL, SCHEDULE_DAY, vibrant_PowerAny,
+                                      1.0};
+  ck_assert_int_eq(vibrant_schedule_new(instance, &late, 1, 0, &schedule),
+                   vibrant_InvalidArgument);
+
+  const vibrant_schedule_rule vivid = {NULL, 0, vibrant_PowerAny,
+                                       VIBRANT_SATURATION_MAX + 1};
+  ck_assert_int_eq(vibrant_schedule_new(instance, &vivid, 1, 0, &schedule),
+                   vibrant_InvalidArgument);
+
+  // a typo in an output name must not go unnoticed
+  const vibrant_schedule_rule missing = {"MOCK-7", 0, vibrant_PowerAny, 1.0};
+  ck_assert_int_eq(vibrant_schedule_new(instance, &missing, 1, 0, &schedule),
+                   vibrant_InvalidArgument);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+Suite *schedule_suite(void) {
+  Suite *suite = suite_create("schedule");
+
+  TCase *tcase = tcase_create("rules");
+  tcase_add_test(tcase, test_pick);
+  tcase_add_test(tcase, test_next_start);
+  tcase_add_test(tcase, test_read_power);
+  tcase_add_test(tcase, test_uevent_filter);
+  suite_add_tcase(suite, tcase);
+
+  tcase = tcase_create("schedule");
+  tcase_add_checked_fixture(tcase, setup_utc, NULL);
+  tcase_add_test(tcase, test_schedule_apply);
+  tcase_add_test(tcase, test_schedule_transition);
+  tcase_add_test(tcase, test_schedule_invalid);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = schedule_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,282 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vibrant/vibrant.h>
+
+/**
+ * this tolerance is used for comparing rational numbers
+ */
+#define TOLERANCE 0.00001
+
+// latency of the recorded mock requests, in microseconds
+#define LATENCY_US 2000
+
+static char path[] = "/tmp/check_trace_XXXXXX";
+
+static void setup(void) {
+  snprintf(path, sizeof(path), "/tmp/check_trace_XXXXXX");
+  int fd = mkstemp(path);
+  ck_assert_int_ge(fd, 0);
+  close(fd);
+}
+
+static void teardown(void) { unlink(path); }
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_trace(const char *contents) {
+  FILE *file = fopen(path, "w");
+  ck_assert_ptr_nonnull(file);
+  fputs(contents, file);
+  fclose(file);
+}
+
+static vibrant_instance *new_replay(double latency_scale) {
+  vibrant_instance_options options = {.backend = vibrant_BackendReplay,
+                                      .replay = {path, latency_scale}};
+  vibrant_instance *instance;
+
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_NoError);
+
+  return instance;
+}
+
+/**
+ * Record a mock instance with two outputs, the first set to 2.0 once
+ * directly and to 1.5 by a transaction.
+ */
+static void record_mock(unsigned long long ids[2]) {
+  vibrant_instance_options options = {vibrant_BackendMock,
+                                      {2, LATENCY_US, 0}};
+  vibrant_instance *instance;
+
+  ck_assert_int_eq(setenv("VIBRANT_RECORD", path, 1), 0);
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_NoError);
+  unsetenv("VIBRANT_RECORD");
+
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+  ck_assert_uint_eq(length, 2);
+  ids[0] = vibrant_controller_get_id(controllers);
+  ids[1] = vibrant_controller_get_id(controllers + 1);
+
+  vibrant_controller_set_saturation(controllers, 2.0);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 2.0,
+                          TOLERANCE);
+
+  vibrant_transaction *transaction;
+  ck_assert_int_eq(vibrant_transaction_new(instance, &transaction),
+                   vibrant_NoError);
+  ck_assert_int_eq(
+      vibrant_transaction_set_saturation(transaction, controllers, 1.5),
+      vibrant_NoError);
+  ck_assert_int_eq(vibrant_transaction_commit(transaction, NULL),
+                   vibrant_NoError);
+  vibrant_transaction_free(&transaction);
+
+  vibrant_instance_free(&instance);
+}
+
+START_TEST(test_trace_replay_outputs) {
+  unsigned long long ids[2];
+  record_mock(ids);
+
+  vibrant_instance *instance = new_replay(0.0);
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+  ck_assert_uint_eq(length, 2);
+
+  ck_assert_str_eq(controllers[0].info->name, "MOCK-0");
+  ck_assert_str_eq(controllers[1].info->name, "MOCK-1");
+  ck_assert_uint_eq(vibrant_controller_get_id(controllers), ids[0]);
+  ck_assert_uint_eq(vibrant_controller_get_id(controllers + 1), ids[1]);
+  ck_assert_str_eq(vibrant_controller_get_backend_name(controllers), "mock");
+
+  // outputs start out where they were when the recording began
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.0,
+                          TOLERANCE);
+
+  vibrant_controller_set_saturation(controllers, 3.0);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 3.0,
+                          TOLERANCE);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers + 1),
+                          1.0, TOLERANCE);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_trace_replay_latency) {
+  unsigned long long ids[2];
+  record_mock(ids);
+
+  vibrant_instance *instance = new_replay(1.0);
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+
+  // every recorded request of the mock took at least LATENCY_US
+  double start = now_s();
+  vibrant_controller_get_saturation(controllers);
+  vibrant_controller_set_saturation(controllers, 0.5);
+  ck_assert_double_ge(now_s() - start, 2 * LATENCY_US / 1e6);
+
+  // outputs without recorded requests answer right away
+  start = now_s();
+  vibrant_controller_set_saturation(controllers + 1, 0.5);
+  ck_assert_double_lt(now_s() - start, LATENCY_US / 1e6);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_trace_replay_failures) {
+  // BadMatch is 8
+  write_trace("vibrant-trace 1\n"
+              "init 0\n"
+              "output CTM 0 00000000000000aa"
+              " 00000000 00000001 00000000 00000000 00000000 00000000"
+              " 00000000 00000000 00000000 00000001 00000000 00000000"
+              " 00000000 00000000 00000000 00000000 00000000 00000001"
+              " HDMI-A-0\n"
+              "\n"
+              "# the first read fails, the others succeed\n"
+              "get 0 0 8\n"
+              "get 0 0 0\n"
+              "get 0 0 0\n"
+              "set 0 0 0\n"
+              "commit 0 8\n");
+
+  vibrant_instance *instance = new_replay(1.0);
+  vibrant_controller *controllers;
+  size_t length;
+  vibrant_instance_get_controllers(instance, &controllers, &length);
+  ck_assert_uint_eq(length, 1);
+  ck_assert_str_eq(controllers[0].info->name, "HDMI-A-0");
+  ck_assert_uint_eq(vibrant_controller_get_id(controllers), 0xaa);
+  ck_assert_str_eq(vibrant_controller_get_backend_name(controllers), "CTM");
+
+  ck_assert_double_lt(vibrant_controller_get_saturation(controllers), 0.0);
+  ck_assert_double_eq_tol(vibrant_controller_get_saturation(controllers), 1.0,
+                          TOLERANCE);
+
+  // the recorded commit failed, so does every replayed one
+  vibrant_transaction *transaction;
+  vibrant_transaction_result result;
+  ck_assert_int_eq(vibrant_transaction_new(instance, &transaction),
+                   vibrant_NoError);
+  ck_assert_int_eq(
+      vibrant_transaction_set_saturation(transaction, controllers, 2.0),
+      vibrant_NoError);
+  ck_assert_int_eq(vibrant_transaction_commit(transaction, &result),
+                   vibrant_BackendError);
+  ck_assert_uint_eq(result.failed, 1);
+  vibrant_transaction_free(&transaction);
+
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_trace_replay_probes) {
+  write_trace("vibrant-trace 2\n"
+              "init 1000000\n"
+              "probe connect 4000000\n"
+              "probe resources 5000000\n"
+              "probe output 5000000\n"
+              "probe edid 5000000\n"
+              "output Gamma 256 00000000000000aa"
+              " 000003e8 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 HDMI-A-0\n");
+
+  // opening waits for every recorded step of the server
+  double start = now_s();
+  vibrant_instance *instance = new_replay(1.0);
+  ck_assert_double_ge(now_s() - start, 0.02);
+  vibrant_instance_free(&instance);
+
+  start = now_s();
+  instance = new_replay(0.0);
+  ck_assert_double_lt(now_s() - start, 0.02);
+  vibrant_instance_free(&instance);
+}
+
+END_TEST
+
+START_TEST(test_trace_bad_file) {
+  vibrant_instance_options options = {.backend = vibrant_BackendReplay,
+                                      .replay = {path, 0.0}};
+  vibrant_instance *instance;
+
+  write_trace("vibrant-snapshot 1\n");
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_BadFile);
+
+  // events must refer to outputs listed before them
+  write_trace("vibrant-trace 1\ninit 0\nget 0 100 0\n");
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_BadFile);
+
+  write_trace("vibrant-trace 1\n"
+              "output Teletype 0 00000000000000aa"
+              " 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 TTY-0\n");
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_BadFile);
+
+  write_trace("vibrant-trace 2\ninit 0\nprobe dial 100\n");
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_BadFile);
+
+  // probing steps came with version 2
+  write_trace("vibrant-trace 1\ninit 0\nprobe edid 100\n");
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_BadFile);
+
+  unlink(path);
+  ck_assert_int_eq(vibrant_instance_new_with_options(&instance, NULL, &options),
+                   vibrant_IOError);
+}
+
+END_TEST
+
+Suite *trace_suite(void) {
+  Suite *suite = suite_create("trace");
+
+  TCase *tcase = tcase_create("trace");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_trace_replay_outputs);
+  tcase_add_test(tcase, test_trace_replay_latency);
+  tcase_add_test(tcase, test_trace_replay_failures);
+  tcase_add_test(tcase, test_trace_replay_probes);
+  tcase_add_test(tcase, test_trace_bad_file);
+  suite_add_tcase(suite, tcase);
+
+  return suite;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *suite;
+  SRunner *runner;
+
+  suite = trace_suite();
+  runner = srunner_create(suite);
+
+  srunner_run_all(runner, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}